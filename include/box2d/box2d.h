@@ -1248,9 +1248,131 @@ B2_API float b2WheelJoint_GetMaxMotorTorque( b2JointId jointId );
 /// Get the wheel joint current motor torque, usually in newton-meters
 B2_API float b2WheelJoint_GetMotorTorque( b2JointId jointId );
 
+/**@}*/
+
+/**@}*/
+
+/**
+ * @defgroup particle_system Particle System
+ * @brief Particle systems simulate liquids and soft bodies as particles.
+ *
+ * The particle system class is C++, see b2ParticleSystem.h. Its definition and colors are plain structs in
+ * types.h. These functions access a particle system through an id so that it can be driven from C or through a
+ * foreign function interface. Per-particle data is read and written in bulk through caller arrays so that a frame
+ * of interaction takes a few calls instead of one per particle.
+ * Particle indices are those of the C++ class and change when particles are destroyed or reordered during a step.
+ * Particle ranges are clamped to the particles of the system and indices outside of them are skipped.
+ * @{
+ */
+
+/// Create a particle system. Initialize the definition with b2DefaultParticleSystemDef in C.
 B2_API b2ParticleSystem* b2CreateParticleSystem( b2WorldId worldId, const b2ParticleSystemDef* def);
+
+/// Destroy a particle system and all of its particles.
 B2_API void b2DestroyParticleSystem( b2ParticleSystem* system );
 
-/**@}*/
+/// Create a particle system and return its id. Pass NULL for the definition to use the default definition.
+B2_API b2ParticleSystemId b2World_CreateParticleSystem( b2WorldId worldId, const b2ParticleSystemDef* def );
+
+/// Destroy a particle system and all of its particles.
+B2_API void b2ParticleSystem_Destroy( b2ParticleSystemId systemId );
+
+/// Particle system identifier validation. Provides validation for up to 64K allocations.
+B2_API bool b2ParticleSystem_IsValid( b2ParticleSystemId id );
+
+/// Get the id of a particle system.
+B2_API b2ParticleSystemId b2ParticleSystem_GetId( const b2ParticleSystem* system );
+
+/// Get the particle system of an id, to access the full C++ interface.
+B2_API b2ParticleSystem* b2ParticleSystem_Get( b2ParticleSystemId systemId );
+
+/// Get the world that owns this particle system.
+B2_API b2WorldId b2ParticleSystem_GetWorld( b2ParticleSystemId systemId );
+
+/// Get the number of particles.
+B2_API int b2ParticleSystem_GetParticleCount( b2ParticleSystemId systemId );
+
+/// Create particles with the given flags, see b2ParticleFlag.
+/// @param positions the world positions of the particles
+/// @param velocities the initial velocities or NULL to create the particles at rest
+/// @param count the number of particles to create
+/// @param indices receives the index of each created particle or -1 if it couldn't be created. May be NULL.
+/// @return the number of particles created
+B2_API int b2ParticleSystem_CreateParticles( b2ParticleSystemId systemId, const b2Vec2* positions, const b2Vec2* velocities,
+											 uint32_t flags, int count, int* indices );
+
+/// Destroy particles given their indices. The particles are removed during the next step, so
+/// the indices remain valid until then.
+B2_API void b2ParticleSystem_DestroyParticles( b2ParticleSystemId systemId, const int* indices, int count );
+
+/// Destroy the particles in the range [startIndex, startIndex + count) during the next step.
+B2_API void b2ParticleSystem_DestroyParticleRange( b2ParticleSystemId systemId, int startIndex, int count );
+
+/// Copy the positions of the particles in the range [startIndex, startIndex + count) into an array.
+/// @return the number of positions copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_GetPositions( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2* positions );
+
+/// Set the positions of the particles in the range [startIndex, startIndex + count).
+/// @return the number of positions copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_SetPositions( b2ParticleSystemId systemId, int startIndex, int count, const b2Vec2* positions );
+
+/// Copy the velocities of the particles in the range [startIndex, startIndex + count) into an array.
+/// @return the number of velocities copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_GetVelocities( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2* velocities );
+
+/// Set the velocities of the particles in the range [startIndex, startIndex + count).
+/// @return the number of velocities copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_SetVelocities( b2ParticleSystemId systemId, int startIndex, int count, const b2Vec2* velocities );
+
+/// Copy the colors of the particles in the range [startIndex, startIndex + count) into an array.
+/// Each color is four bytes: red, green, blue and alpha.
+/// @return the number of colors copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_GetColors( b2ParticleSystemId systemId, int startIndex, int count, b2ParticleColor* colors );
+
+/// Set the colors of the particles in the range [startIndex, startIndex + count).
+/// @return the number of colors copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_SetColors( b2ParticleSystemId systemId, int startIndex, int count, const b2ParticleColor* colors );
+
+/// Copy the flags of the particles in the range [startIndex, startIndex + count) into an array.
+/// @return the number of flags copied, which is clamped to the particle count
+B2_API int b2ParticleSystem_GetFlags( b2ParticleSystemId systemId, int startIndex, int count, uint32_t* flags );
+
+/// Get the position buffer of the particle system. The buffer holds one entry per particle and is valid
+/// until particles are created or destroyed or the world is stepped. Call b2ParticleSystem_InvalidateAABB
+/// after writing positions through it.
+B2_API b2Vec2* b2ParticleSystem_MapPositions( b2ParticleSystemId systemId );
+
+/// Notify the particle system that positions were written through b2ParticleSystem_MapPositions, so that
+/// particle queries and ray casts use the new bounds of the particles.
+B2_API void b2ParticleSystem_InvalidateAABB( b2ParticleSystemId systemId );
+
+/// Get the velocity buffer of the particle system. See b2ParticleSystem_MapPositions.
+B2_API b2Vec2* b2ParticleSystem_MapVelocities( b2ParticleSystemId systemId );
+
+/// Get the color buffer of the particle system, allocating it if needed. See b2ParticleSystem_MapPositions.
+B2_API b2ParticleColor* b2ParticleSystem_MapColors( b2ParticleSystemId systemId );
+
+/// Apply the same force to each particle in the range [startIndex, startIndex + count). Unlike
+/// b2ParticleSystem::ApplyForce, the force is not divided among the particles. Wall particles are skipped.
+/// @param force the world force vector, usually in newtons (N)
+B2_API void b2ParticleSystem_ApplyForceToRange( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2 force );
+
+/// Apply one force per particle to the particles of an index list. Wall particles are skipped.
+/// @param indices the particles or NULL for the range [0, count)
+/// @param forces the world force vectors, one per particle
+B2_API void b2ParticleSystem_ApplyForces( b2ParticleSystemId systemId, const int* indices, const b2Vec2* forces, int count );
+
+/// Apply the same linear impulse to each particle in the range [startIndex, startIndex + count).
+/// This immediately modifies the velocities.
+/// @param impulse the world impulse vector, usually in N*s or kg*m/s
+B2_API void b2ParticleSystem_ApplyLinearImpulseToRange( b2ParticleSystemId systemId, int startIndex, int count,
+														b2Vec2 impulse );
+
+/// Apply one linear impulse per particle to the particles of an index list. This immediately modifies the
+/// velocities.
+/// @param indices the particles or NULL for the range [0, count)
+/// @param impulses the world impulse vectors, one per particle
+B2_API void b2ParticleSystem_ApplyLinearImpulses( b2ParticleSystemId systemId, const int* indices, const b2Vec2* impulses,
+												  int count );
 
 /**@}*/
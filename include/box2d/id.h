@@ -72,6 +72,14 @@ typedef struct b2JointId
 	uint16_t generation;
 } b2JointId;
 
+/// Particle system id references a particle system instance. This should be treated as an opaque handle.
+typedef struct b2ParticleSystemId
+{
+	int32_t index1;
+	uint16_t world0;
+	uint16_t generation;
+} b2ParticleSystemId;
+
 /// Use these to make your identifiers null.
 /// You may also use zero initialization to get null.
 static const b2WorldId b2_nullWorldId = B2_ZERO_INIT;
@@ -79,6 +87,7 @@ static const b2BodyId b2_nullBodyId = B2_ZERO_INIT;
 static const b2ShapeId b2_nullShapeId = B2_ZERO_INIT;
 static const b2ChainId b2_nullChainId = B2_ZERO_INIT;
 static const b2JointId b2_nullJointId = B2_ZERO_INIT;
+static const b2ParticleSystemId b2_nullParticleSystemId = B2_ZERO_INIT;
 
 /// Macro to determine if any id is null.
 #define B2_IS_NULL( id ) ( id.index1 == 0 )
@@ -64,18 +64,26 @@ enum b2ParticleFlag
 	b2_reactiveParticle = 1 << 12,
 	/// With high repulsive force.
 	b2_repulsiveParticle = 1 << 13,
-	/// Call b2ContactListener when this particle is about to interact with
-	/// a rigid body or stops interacting with a rigid body.
+	/// Report begin / end touch events when this particle starts or stops
+	/// interacting with a shape.
+	/// See b2ParticleSystem::GetBodyContactEvents().
 	/// This results in an expensive operation compared to using
 	/// b2_fixtureContactFilterParticle to detect collisions between
 	/// particles.
 	b2_fixtureContactListenerParticle = 1 << 14,
-	/// Call b2ContactListener when this particle is about to interact with
-	/// another particle or stops interacting with another particle.
+	/// Report begin / end touch events when this particle starts or stops
+	/// interacting with another particle.
+	/// See b2ParticleSystem::GetParticleContactEvents().
 	/// This results in an expensive operation compared to using
 	/// b2_particleContactFilterParticle to detect collisions between
 	/// particles.
 	b2_particleContactListenerParticle = 1 << 15,
+	/// Pass the contacts of this particle with shapes to the batched filter
+	/// set with b2ParticleSystem::SetBodyContactFilter().
+	b2_fixtureContactFilterParticle = 1 << 16,
+	/// Pass the contacts of this particle with other particles to the batched
+	/// filter set with b2ParticleSystem::SetParticleContactFilter().
+	b2_particleContactFilterParticle = 1 << 17,
 };
 
 /// Small color object for each particle
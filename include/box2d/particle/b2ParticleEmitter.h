@@ -0,0 +1,296 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef B2_PARTICLE_EMITTER
+#define B2_PARTICLE_EMITTER
+
+#include "particle/b2Particle.h"
+
+class b2ParticleSystem;
+class b2ParticleGroup;
+
+/// @file
+/// The particle emitter.
+
+/// A particle emitter definition holds all the data needed to construct a
+/// particle emitter.  You can safely re-use these definitions.
+struct b2ParticleEmitterDef
+{
+	b2ParticleEmitterDef()
+	{
+		position = b2Vec2_zero;
+		angle = 0;
+		spread = 0;
+		width = 0;
+		speed = 1;
+		speedVariation = 0;
+		rate = 0;
+		lifetime = 1;
+		capacity = 0;
+		flags = b2_waterParticle;
+		color = b2ParticleColor_zero;
+		group = NULL;
+		userData = NULL;
+	}
+
+	/// The world position of the center of the emitting segment.
+	b2Vec2 position;
+
+	/// The world angle of the emitting direction in radians.
+	float32 angle;
+
+	/// Half the angle of the cone of emitting directions in radians.
+	float32 spread;
+
+	/// The length of the segment the particles are emitted from,
+	/// perpendicular to the emitting direction.
+	float32 width;
+
+	/// The speed of the emitted particles.
+	float32 speed;
+
+	/// The speed of the emitted particles varies by up to this much.
+	float32 speedVariation;
+
+	/// The number of particles emitted per second.
+	float32 rate;
+
+	/// Lifetime of the emitted particles in seconds. A value <= 0 indicates
+	/// particles which live until their slot is recycled.
+	float32 lifetime;
+
+	/// The number of particles the emitter keeps alive at most. When 0,
+	/// rate * lifetime rounded up is used instead. It must not exceed the
+	/// maximum particle count of the particle system, if any.
+	int32 capacity;
+
+	/// The particle-behavior flags (See #b2ParticleFlag) of the emitted
+	/// particles.
+	uint32 flags;
+
+	/// The color of the emitted particles.
+	b2ParticleColor color;
+
+	/// An existing particle group to which the emitted particles will be
+	/// added. Adding a particle to a group moves the particles after it, so
+	/// emitters without a group are cheaper.
+	b2ParticleGroup* group;
+
+	/// Use this to store application-specific emitter data.
+	void* userData;
+};
+
+/// Emits particles continuously into a particle system.
+/// b2ParticleSystem::CreateParticleEmitter creates these.
+/// The emitted particles are kept in a ring of 'capacity' slots, from the
+/// oldest to the newest. A new particle recycles the oldest one in place
+/// when it expired, the ring is full or the particle system reached its
+/// maximum particle count, so a steady emitter neither allocates nor
+/// destroys particles. Expired particles which won't be recycled by the
+/// next step are destroyed.
+/// The emitters emit at the start of every step. Recycling a particle
+/// invalidates its handle and removes its pairs, triads and contact events,
+/// as destroying it would, and restarts its lifetime. A particle destroyed
+/// with b2ParticleSystem::DestroyParticle or moved to another group is
+/// destroyed instead of recycled.
+class b2ParticleEmitter
+{
+public:
+	/// Get the next particle emitter from the list of the particle system.
+	b2ParticleEmitter* GetNext();
+	const b2ParticleEmitter* GetNext() const;
+
+	/// Get the particle system that holds this emitter.
+	b2ParticleSystem* GetParticleSystem();
+	const b2ParticleSystem* GetParticleSystem() const;
+
+	/// Set the world position of the center of the emitting segment.
+	void SetPosition(const b2Vec2& position);
+	const b2Vec2& GetPosition() const;
+
+	/// Set the world angle of the emitting direction in radians.
+	void SetAngle(float32 angle);
+	float32 GetAngle() const;
+
+	/// Set the speed of the emitted particles.
+	void SetSpeed(float32 speed);
+	float32 GetSpeed() const;
+
+	/// Set the number of particles emitted per second. 0 stops the emitter,
+	/// its particles still expire.
+	void SetRate(float32 rate);
+	float32 GetRate() const;
+
+	/// Set the color of the particles emitted from now on.
+	void SetColor(const b2ParticleColor& color);
+	const b2ParticleColor& GetColor() const;
+
+	/// Get the number of slots of the ring.
+	int32 GetCapacity() const;
+
+	/// Get the number of particles alive.
+	int32 GetParticleCount() const;
+
+	/// Get the index of a particle alive, from 0 for the oldest to
+	/// GetParticleCount() - 1 for the newest.
+	int32 GetParticleIndex(int32 i) const;
+
+	/// Get the user data pointer that was provided in the emitter
+	/// definition.
+	void* GetUserData() const;
+
+	/// Set the user data. Use this to store your application specific data.
+	void SetUserData(void* data);
+
+private:
+	friend class b2ParticleSystem;
+
+	b2ParticleEmitter();
+	~b2ParticleEmitter();
+
+	/// Emit the particles of a step and recycle or destroy the expired ones.
+	void Step(float32 dt);
+
+	/// Describe the next particle to emit.
+	b2ParticleDef GetNextParticleDef();
+
+	/// The slot of the i-th particle alive from the oldest.
+	int32& GetSlot(int32 i);
+
+	/// The number of particles alive which expired, from the oldest.
+	int32 CountExpiredParticles() const;
+
+	/// Remove the oldest particle from the ring and return its index.
+	int32 PopOldestParticle();
+
+	/// Remove the oldest particle from the ring and replace it with a new
+	/// one, or destroy it if it can't be recycled, which returns
+	/// b2_invalidParticleIndex.
+	int32 RecycleOldestParticle(const b2ParticleDef& def);
+
+	/// Forget the particles destroyed by the particle system, whose slots
+	/// hold b2_invalidParticleIndex, keeping the others in order.
+	void RemoveInvalidSlots();
+
+	b2ParticleSystem* m_system;
+	b2ParticleEmitterDef m_def;
+	/// Particle indices, in a ring starting at m_head.
+	int32* m_slots;
+	/// Time each particle alive expires, in the same ring as m_slots.
+	float32* m_expirationTimes;
+	int32 m_capacity;
+	int32 m_head;
+	int32 m_count;
+	/// Time since the emitter was created, in seconds.
+	float32 m_time;
+	/// Fraction of a particle left to emit by the next step.
+	float32 m_emitRemainder;
+	/// Number of particles emitted, which places the next one.
+	uint32 m_emitCount;
+	b2ParticleEmitter* m_prev;
+	b2ParticleEmitter* m_next;
+};
+
+inline b2ParticleEmitter* b2ParticleEmitter::GetNext()
+{
+	return m_next;
+}
+
+inline const b2ParticleEmitter* b2ParticleEmitter::GetNext() const
+{
+	return m_next;
+}
+
+inline b2ParticleSystem* b2ParticleEmitter::GetParticleSystem()
+{
+	return m_system;
+}
+
+inline const b2ParticleSystem* b2ParticleEmitter::GetParticleSystem() const
+{
+	return m_system;
+}
+
+inline void b2ParticleEmitter::SetPosition(const b2Vec2& position)
+{
+	m_def.position = position;
+}
+
+inline const b2Vec2& b2ParticleEmitter::GetPosition() const
+{
+	return m_def.position;
+}
+
+inline void b2ParticleEmitter::SetAngle(float32 angle)
+{
+	m_def.angle = angle;
+}
+
+inline float32 b2ParticleEmitter::GetAngle() const
+{
+	return m_def.angle;
+}
+
+inline void b2ParticleEmitter::SetSpeed(float32 speed)
+{
+	m_def.speed = speed;
+}
+
+inline float32 b2ParticleEmitter::GetSpeed() const
+{
+	return m_def.speed;
+}
+
+inline void b2ParticleEmitter::SetRate(float32 rate)
+{
+	b2Assert(rate >= 0);
+	m_def.rate = rate;
+}
+
+inline float32 b2ParticleEmitter::GetRate() const
+{
+	return m_def.rate;
+}
+
+inline void b2ParticleEmitter::SetColor(const b2ParticleColor& color)
+{
+	m_def.color = color;
+}
+
+inline const b2ParticleColor& b2ParticleEmitter::GetColor() const
+{
+	return m_def.color;
+}
+
+inline int32 b2ParticleEmitter::GetCapacity() const
+{
+	return m_capacity;
+}
+
+inline int32 b2ParticleEmitter::GetParticleCount() const
+{
+	return m_count;
+}
+
+inline int32 b2ParticleEmitter::GetParticleIndex(int32 i) const
+{
+	b2Assert(0 <= i && i < m_count);
+	return m_slots[(m_head + i) % m_capacity];
+}
+
+inline void* b2ParticleEmitter::GetUserData() const
+{
+	return m_def.userData;
+}
+
+inline void b2ParticleEmitter::SetUserData(void* data)
+{
+	m_def.userData = data;
+}
+
+inline int32& b2ParticleEmitter::GetSlot(int32 i)
+{
+	return m_slots[(m_head + i) % m_capacity];
+}
+
+#endif
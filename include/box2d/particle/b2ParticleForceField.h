@@ -0,0 +1,231 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef B2_PARTICLE_FORCE_FIELD
+#define B2_PARTICLE_FORCE_FIELD
+
+#include "particle/b2Particle.h"
+#include "collision.h"
+
+class b2ParticleSystem;
+
+/// @file
+/// The particle force field.
+
+/// The shape of the force of a particle force field.
+enum b2ParticleForceFieldType
+{
+	/// Pushes the particles away from the center, or pulls them toward it
+	/// with a negative strength.
+	b2_radialForceField,
+	/// Turns the particles around the center, counterclockwise with a
+	/// positive strength.
+	b2_vortexForceField,
+	/// Applies a constant force to the particles inside a polygon.
+	b2_directionalForceField,
+	/// Applies forces sampled on a grid, interpolated between the samples.
+	b2_gridForceField,
+};
+
+/// A particle force field definition holds all the data needed to construct
+/// a particle force field.  You can safely re-use these definitions.
+struct b2ParticleForceFieldDef
+{
+	b2ParticleForceFieldDef()
+	{
+		type = b2_radialForceField;
+		position = b2Vec2_zero;
+		radius = 1;
+		strength = 0;
+		force = b2Vec2_zero;
+		polygon = b2MakeSquare(1);
+		gridForces = NULL;
+		gridWidth = 0;
+		gridHeight = 0;
+		gridSpacing = 1;
+		userData = NULL;
+	}
+
+	/// The type of the field.
+	b2ParticleForceFieldType type;
+
+	/// The world position of the field. It is the center of the radial and
+	/// vortex fields, the origin of the polygon of the directional fields and
+	/// the position of the first sample of the grid fields.
+	b2Vec2 position;
+
+	/// The radius of the radial and vortex fields.
+	float32 radius;
+
+	/// The force of the radial and vortex fields at their center. It falls
+	/// off linearly to zero at their radius.
+	float32 strength;
+
+	/// The force of the directional fields.
+	b2Vec2 force;
+
+	/// The region of the directional fields, relative to their position. The
+	/// radius of the polygon is ignored.
+	b2Polygon polygon;
+
+	/// The forces of the grid fields, gridWidth samples per row from the
+	/// bottom row to the top one. They are copied.
+	const b2Vec2* gridForces;
+
+	/// The number of samples per row of the grid fields, at least 2.
+	int32 gridWidth;
+
+	/// The number of rows of the grid fields, at least 2.
+	int32 gridHeight;
+
+	/// The distance between neighboring samples of the grid fields.
+	float32 gridSpacing;
+
+	/// Use this to store application-specific force field data.
+	void* userData;
+};
+
+/// Applies a spatially varying force to the particles of a particle system.
+/// b2ParticleSystem::CreateParticleForceField creates these.
+/// The force applies to every particle in the region of the field but the
+/// wall particles, at every particle iteration, like a force applied with
+/// b2ParticleSystem::ParticleApplyForce before every step.
+class b2ParticleForceField
+{
+public:
+	/// Get the next force field from the list of the particle system.
+	b2ParticleForceField* GetNext();
+	const b2ParticleForceField* GetNext() const;
+
+	/// Get the particle system that holds this force field.
+	b2ParticleSystem* GetParticleSystem();
+	const b2ParticleSystem* GetParticleSystem() const;
+
+	/// Get the type of the field.
+	b2ParticleForceFieldType GetType() const;
+
+	/// Set the world position of the field, see b2ParticleForceFieldDef.
+	void SetPosition(const b2Vec2& position);
+	const b2Vec2& GetPosition() const;
+
+	/// Set the force of the radial and vortex fields at their center.
+	void SetStrength(float32 strength);
+	float32 GetStrength() const;
+
+	/// Set the force of the directional fields.
+	void SetForce(const b2Vec2& force);
+	const b2Vec2& GetForce() const;
+
+	/// Replace the forces of the grid fields, see
+	/// b2ParticleForceFieldDef::gridForces.
+	void SetGridForces(const b2Vec2* forces);
+
+	/// Get the forces of the grid fields.
+	const b2Vec2* GetGridForces() const;
+
+	/// Get the world bounds of the region of the field.
+	b2AABB GetAABB() const;
+
+	/// Get the user data pointer that was provided in the force field
+	/// definition.
+	void* GetUserData() const;
+
+	/// Set the user data. Use this to store your application specific data.
+	void SetUserData(void* data);
+
+private:
+	friend class b2ParticleSystem;
+
+	b2ParticleForceField();
+	~b2ParticleForceField();
+
+	/// Compute the forces[i] of the particles indices[i] at positions for i
+	/// in [first, last).
+	void ComputeForces_Reference(const b2Vec2* positions,
+								 const int32* indices, int32 first,
+								 int32 last, b2Vec2* forces) const;
+
+	/// Compute the forces[i] of the particles indices[i] at positions for i
+	/// in [0, count) in batches of B2_SIMD_WIDTH.
+	void ComputeForces_Simd(const b2Vec2* positions, const int32* indices,
+							int32 count, b2Vec2* forces) const;
+
+	b2ParticleSystem* m_system;
+	b2ParticleForceFieldDef m_def;
+	/// Copy of the grid forces, or NULL.
+	b2Vec2* m_gridForces;
+	b2ParticleForceField* m_prev;
+	b2ParticleForceField* m_next;
+};
+
+inline b2ParticleForceField* b2ParticleForceField::GetNext()
+{
+	return m_next;
+}
+
+inline const b2ParticleForceField* b2ParticleForceField::GetNext() const
+{
+	return m_next;
+}
+
+inline b2ParticleSystem* b2ParticleForceField::GetParticleSystem()
+{
+	return m_system;
+}
+
+inline const b2ParticleSystem* b2ParticleForceField::GetParticleSystem() const
+{
+	return m_system;
+}
+
+inline b2ParticleForceFieldType b2ParticleForceField::GetType() const
+{
+	return m_def.type;
+}
+
+inline void b2ParticleForceField::SetPosition(const b2Vec2& position)
+{
+	m_def.position = position;
+}
+
+inline const b2Vec2& b2ParticleForceField::GetPosition() const
+{
+	return m_def.position;
+}
+
+inline void b2ParticleForceField::SetStrength(float32 strength)
+{
+	m_def.strength = strength;
+}
+
+inline float32 b2ParticleForceField::GetStrength() const
+{
+	return m_def.strength;
+}
+
+inline void b2ParticleForceField::SetForce(const b2Vec2& force)
+{
+	m_def.force = force;
+}
+
+inline const b2Vec2& b2ParticleForceField::GetForce() const
+{
+	return m_def.force;
+}
+
+inline const b2Vec2* b2ParticleForceField::GetGridForces() const
+{
+	return m_gridForces;
+}
+
+inline void* b2ParticleForceField::GetUserData() const
+{
+	return m_def.userData;
+}
+
+inline void b2ParticleForceField::SetUserData(void* data)
+{
+	m_def.userData = data;
+}
+
+#endif
@@ -250,6 +250,23 @@ private:
 	~b2ParticleGroup();
 	void UpdateStatistics() const;
 
+	/// Add the position and velocity components of the particles
+	/// [first, last) to the lane sums, see k_statisticsLaneCount.
+	void SumLinear_Reference(int32 first, int32 last,
+							 float32* positionSums,
+							 float32* velocitySums) const;
+
+	/// Add the inertia and angular momentum terms of the particles
+	/// [first, last) about m_center to the lane sums.
+	void SumAngular_Reference(int32 first, int32 last,
+							  float32* inertiaSums,
+							  float32* angularSums) const;
+
+	/// The same as the reference versions for the whole group, in batches of
+	/// k_statisticsLaneCount components.
+	void SumLinear_Simd(float32* positionSums, float32* velocitySums) const;
+	void SumAngular_Simd(float32* inertiaSums, float32* angularSums) const;
+
 };
 
 inline b2ParticleGroup* b2ParticleGroup::GetNext()
@@ -0,0 +1,179 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef B2_PARTICLE_SURFACE
+#define B2_PARTICLE_SURFACE
+
+#include "particle/b2Particle.h"
+
+class b2ParticleSystem;
+
+/// @file
+/// Extraction of the surface of a fluid for rendering.
+
+/// The geometry extracted by a b2ParticleSurface.
+enum b2ParticleSurfaceType
+{
+	/// Triangles covering the inside of the surface, counterclockwise.
+	b2_surfaceTriangles,
+	/// Segments of the contours of the surface, a pair of indices each. The
+	/// inside of the surface is on the left of the segments, so the segments
+	/// chain into closed counterclockwise polylines.
+	b2_surfaceContours,
+};
+
+/// A particle surface definition holds all the data needed to construct a
+/// particle surface.  You can safely re-use these definitions.
+struct b2ParticleSurfaceDef
+{
+	b2ParticleSurfaceDef()
+	{
+		type = b2_surfaceTriangles;
+		cellSize = 0;
+		smoothingLength = 0;
+		isoValue = 0.5f;
+		tileCellCount = 16;
+		incremental = false;
+		movementTolerance = 0;
+	}
+
+	/// The geometry to extract.
+	b2ParticleSurfaceType type;
+
+	/// The distance between the samples of the density grid. 0 selects the
+	/// particle radius.
+	float32 cellSize;
+
+	/// The radius of the density kernel of each particle. 0 selects two
+	/// particle diameters.
+	float32 smoothingLength;
+
+	/// The density of the surface. The density is normalized to about 1
+	/// inside a fluid at rest.
+	float32 isoValue;
+
+	/// The number of cells per side of a tile. Tiles are extracted in
+	/// parallel and are the units of the incremental updates.
+	int32 tileCellCount;
+
+	/// Only extract the tiles whose particles moved since the last update,
+	/// and keep the geometry of the others.
+	bool incremental;
+
+	/// Distance a particle has to move by to update its tiles, when
+	/// incremental. 0 selects a tenth of the cell size.
+	float32 movementTolerance;
+};
+
+/// Extracts the surface of the particles of a particle system as a mesh, by
+/// splatting their density onto a grid and running marching squares. The
+/// grid is split into tiles, which are extracted on the task system of the
+/// world and are kept between updates.
+/// The vertices and indices are owned by the surface and are valid until
+/// the next update.
+class b2ParticleSurface
+{
+public:
+	b2ParticleSurface(const b2ParticleSurfaceDef& def);
+	~b2ParticleSurface();
+
+	/// Extract the surface of the particles of a system. Call it between
+	/// steps of the world, it uses the particle grid of the last step.
+	/// @param system the particle system.
+	/// @param useWorkers extract the tiles on the task system of the world.
+	void Update(const b2ParticleSystem* system, bool useWorkers = false);
+
+	/// Get the definition of the surface.
+	const b2ParticleSurfaceDef& GetDef() const;
+
+	/// Get the vertices of the surface.
+	const b2Vec2* GetVertices() const;
+	int32 GetVertexCount() const;
+
+	/// Get the indices of the triangles or segments of the surface, see
+	/// b2ParticleSurfaceType.
+	const int32* GetIndices() const;
+	int32 GetIndexCount() const;
+
+	/// Get the number of tiles with particles.
+	int32 GetTileCount() const;
+
+	/// Get the number of tiles extracted by the last update, the others
+	/// were kept.
+	int32 GetUpdatedTileCount() const;
+
+private:
+	struct Tile;
+	struct TileParticle;
+	struct UpdateContext;
+
+	static void UpdateTileTask(int32 startIndex, int32 endIndex,
+							   uint32 workerIndex, void* context);
+	/// Extract the geometry of a tile.
+	static void ExtractTile(const UpdateContext& context, Tile* tile,
+							const TileParticle* particles);
+
+	/// Find the tiles of the particles, in proxy order within each tile.
+	int32 FindTileParticles(const b2ParticleSystem* system,
+							float32 smoothingLength, float32 tileSize);
+	/// Make the tiles of the tile particles, keeping the previous tiles.
+	void UpdateTiles();
+	/// Concatenate the geometry of the tiles.
+	void GatherTiles();
+
+	b2ParticleSurfaceDef m_def;
+
+	TileParticle* m_tileParticles;
+	int32 m_tileParticleCount;
+	int32 m_tileParticleCapacity;
+
+	/// Tiles sorted by key.
+	Tile* m_tiles;
+	int32 m_tileCount;
+	int32 m_tileCapacity;
+	int32 m_updatedTileCount;
+
+	b2Vec2* m_vertices;
+	int32 m_vertexCount;
+	int32 m_vertexCapacity;
+	int32* m_indices;
+	int32 m_indexCount;
+	int32 m_indexCapacity;
+};
+
+inline const b2ParticleSurfaceDef& b2ParticleSurface::GetDef() const
+{
+	return m_def;
+}
+
+inline const b2Vec2* b2ParticleSurface::GetVertices() const
+{
+	return m_vertices;
+}
+
+inline int32 b2ParticleSurface::GetVertexCount() const
+{
+	return m_vertexCount;
+}
+
+inline const int32* b2ParticleSurface::GetIndices() const
+{
+	return m_indices;
+}
+
+inline int32 b2ParticleSurface::GetIndexCount() const
+{
+	return m_indexCount;
+}
+
+inline int32 b2ParticleSurface::GetTileCount() const
+{
+	return m_tileCount;
+}
+
+inline int32 b2ParticleSurface::GetUpdatedTileCount() const
+{
+	return m_updatedTileCount;
+}
+
+#endif
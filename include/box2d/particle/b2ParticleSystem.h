@@ -25,6 +25,7 @@
 #include "particle/b2Particle.h"
 #include "id.h"
 #include "types.h"
+#include <stdio.h>
 
 #ifdef LIQUIDFUN_UNIT_TESTS
 #include <gtest/gtest.h>
@@ -34,13 +35,14 @@ struct b2World;
 struct b2Body;
 struct b2Shape;
 class b2ParticleGroup;
+class b2ParticleEmitter;
+class b2ParticleForceField;
 class b2BlockAllocator;
 class b2StackAllocator;
-class b2ContactFilter;
-class b2ContactListener;
-class b2ParticlePairSet;
-class FixtureParticleSet;
+class b2StaticDistanceField;
 struct b2ParticleGroupDef;
+struct b2ParticleEmitterDef;
+struct b2ParticleForceFieldDef;
 struct b2Vec2;
 struct b2AABB;
 struct FindContactInput;
@@ -66,6 +68,19 @@ public:
 };
 
 
+/// Callback class for batched AABB queries
+class b2ParticleBatchQueryCallback
+{
+public:
+	virtual ~b2ParticleBatchQueryCallback() {}
+
+	/// Called for each particle found in one of the query AABBs.
+	/// @param aabbIndex the index of the AABB in the query array.
+	/// @return false to terminate the query of this AABB.
+	virtual bool ReportParticle(const b2ParticleSystem* particleSystem,
+								int32 aabbIndex, int32 index) = 0;
+};
+
 /// Callback class for ray casts.
 /// See b2World::RayCast
 class b2ParticleRayCastCallback
@@ -105,6 +120,40 @@ public:
 };
 
 
+struct b2ParticleContact;
+
+/// A particle / shape pair that may be touching. See
+/// b2ParticleBodyContactFilterFcn.
+struct b2ParticleBodyContactCandidate
+{
+	/// Id of the shape
+	b2ShapeId shapeId;
+
+	/// Index of the particle
+	int32 index;
+};
+
+/// Prototype for a batched particle / particle contact filter. This is called
+/// once per particle iteration with the contacts that involve a particle with
+/// the b2_particleContactFilterParticle flag. Set keep[i] to false to discard
+/// contacts[i]; all entries of keep are true on entry.
+/// @warning do not create or destroy particles in this callback
+typedef void b2ParticleContactFilterFcn(b2ParticleSystem* particleSystem,
+										const b2ParticleContact* contacts,
+										int32 count, bool* keep,
+										void* context);
+
+/// Prototype for a batched particle / shape contact filter. This is called
+/// with the candidate contacts that involve a particle with the
+/// b2_fixtureContactFilterParticle flag, after the shapes were filtered by
+/// b2ParticleSystemDef::filter. Set keep[i] to false to discard
+/// candidates[i]; all entries of keep are true on entry.
+/// @warning do not create or destroy particles in this callback
+typedef void b2ParticleBodyContactFilterFcn(
+	b2ParticleSystem* particleSystem,
+	const b2ParticleBodyContactCandidate* candidates, int32 count,
+	bool* keep, void* context);
+
 struct b2ParticleContact
 {
 private:
@@ -172,6 +221,167 @@ struct b2ParticleBodyContact
 	float32 mass;
 };
 
+/// Memory held by a particle system. See b2ParticleSystem::GetMemoryStats.
+struct b2ParticleMemoryStats
+{
+	/// Size of the b2ParticleSystem object, which embeds its stack
+	/// allocator.
+	int32 systemBytes;
+
+	/// Bytes and number of the per-particle buffers allocated by the system.
+	/// User supplied buffers are not counted.
+	int32 particleBufferBytes;
+	int32 particleBufferCount;
+
+	/// Bytes of the contact, pair, triad, proxy and event buffers.
+	int32 contactBufferBytes;
+
+	/// Bytes of the particle group objects.
+	int32 groupBytes;
+
+	/// Bytes of the particle emitter objects and their rings of slots.
+	int32 emitterBytes;
+
+	/// Bytes of the particle force field objects and their grids.
+	int32 forceFieldBytes;
+
+	/// Bytes of the slabs of particle handles.
+	int32 handleBytes;
+
+	/// Peak allocation of the stack allocator.
+	int32 stackPeakBytes;
+
+	/// Bytes of the chunks of the block allocator, and how many of them are
+	/// on free lists.
+	int32 chunkBytes;
+	int32 freeChunkBytes;
+
+	/// Number and bytes of the block allocator's allocations larger than a
+	/// block. The particle buffers are among them.
+	int32 giantAllocationCount;
+	int32 giantBytes;
+};
+
+/// A begin touch event is generated when two particles begin touching and
+/// at least one of them has the b2_particleContactListenerParticle flag.
+struct b2ParticleContactBeginTouchEvent
+{
+	/// Indices of the particles, indexA < indexB.
+	int32 indexA, indexB;
+};
+
+/// An end touch event is generated when two particles stop touching and at
+/// least one of them had the b2_particleContactListenerParticle flag.
+/// Contacts of destroyed particles end without generating an event.
+struct b2ParticleContactEndTouchEvent
+{
+	/// Indices of the particles, indexA < indexB.
+	int32 indexA, indexB;
+};
+
+/// Particle contact events are buffered in the particle system and are
+/// available as event arrays after the time step is complete.
+/// Note: the indices become invalid when particles are created or destroyed.
+struct b2ParticleContactEvents
+{
+	/// Array of begin touch events
+	const b2ParticleContactBeginTouchEvent* beginEvents;
+
+	/// Array of end touch events
+	const b2ParticleContactEndTouchEvent* endEvents;
+
+	/// Number of begin touch events
+	int32 beginCount;
+
+	/// Number of end touch events
+	int32 endCount;
+};
+
+/// A begin touch event is generated when a particle with the
+/// b2_fixtureContactListenerParticle flag begins touching a shape.
+struct b2ParticleBodyContactBeginTouchEvent
+{
+	/// Id of the shape
+	b2ShapeId shapeId;
+
+	/// Index of the particle
+	int32 index;
+};
+
+/// An end touch event is generated when a particle with the
+/// b2_fixtureContactListenerParticle flag stops touching a shape.
+/// Contacts of destroyed particles end without generating an event.
+struct b2ParticleBodyContactEndTouchEvent
+{
+	/// Id of the shape
+	///	@warning this shape may have been destroyed
+	///	@see b2Shape_IsValid
+	b2ShapeId shapeId;
+
+	/// Index of the particle
+	int32 index;
+};
+
+/// Particle / shape contact events are buffered in the particle system and
+/// are available as event arrays after the time step is complete.
+/// Note: the indices become invalid when particles are created or destroyed.
+struct b2ParticleBodyContactEvents
+{
+	/// Array of begin touch events
+	const b2ParticleBodyContactBeginTouchEvent* beginEvents;
+
+	/// Array of end touch events
+	const b2ParticleBodyContactEndTouchEvent* endEvents;
+
+	/// Number of begin touch events
+	int32 beginCount;
+
+	/// Number of end touch events
+	int32 endCount;
+};
+
+/// The number of particles with the b2_fixtureContactListenerParticle flag
+/// touching a shape.
+struct b2ParticleShapeTouch
+{
+	/// Id of the shape
+	b2ShapeId shapeId;
+
+	/// Number of particles touching the shape
+	int32 particleCount;
+};
+
+/// A particle hit by a ray of a batched ray cast
+struct b2ParticleRayCastHit
+{
+	/// Index of the ray in the input arrays
+	int32 rayIndex;
+
+	/// Index of the particle, b2_invalidParticleIndex if the ray hit nothing
+	int32 index;
+
+	/// The point of intersection between the ray and the particle
+	b2Vec2 point;
+
+	/// The normal vector at the point of intersection
+	b2Vec2 normal;
+
+	/// The fraction (0.0~1.0) of the translation to the point of intersection
+	float32 fraction;
+};
+
+/// A run of consecutive particles whose compact positions are relative to
+/// the same tile. See b2ParticleSystem::ExportCompactPositions.
+struct b2ParticleCompactTile
+{
+	/// Coordinates of the tile. The origin of the tile is
+	/// (x, y) * b2ParticleSystem::GetCompactTileSize().
+	int32 x, y;
+
+	/// Number of consecutive particles in the tile.
+	int32 count;
+};
+
 /// Connection between two particles
 struct b2ParticlePair
 {
@@ -205,140 +415,34 @@ struct b2ParticleTriad
 	float32 ka, kb, kc, s;
 };
 
-struct b2ParticleSystemDef
-{
-	b2ParticleSystemDef()
-	{
-		strictContactCheck = false;
-		density = 1.0f;
-		gravityScale = 1.0f;
-		radius = 1.0f;
-		maxCount = 0;
-
-		// Initialize physical coefficients to the maximum values that
-		// maintain numerical stability.
-		pressureStrength = 0.05f;
-		dampingStrength = 1.0f;
-		elasticStrength = 0.25f;
-		springStrength = 0.25f;
-		viscousStrength = 0.25f;
-		surfaceTensionPressureStrength = 0.2f;
-		surfaceTensionNormalStrength = 0.2f;
-		repulsiveStrength = 1.0f;
-		powderStrength = 0.5f;
-		ejectionStrength = 0.5f;
-		staticPressureStrength = 0.2f;
-		staticPressureRelaxation = 0.2f;
-		staticPressureIterations = 8;
-		colorMixingStrength = 0.5f;
-		destroyByAge = true;
-		lifetimeGranularity = 1.0f / 60.0f;
-	}
-
-	/// Enable strict Particle/Body contact check.
-	/// See SetStrictContactCheck for details.
-	bool strictContactCheck;
-
-	/// Set the particle density.
-	/// See SetDensity for details.
-	float32 density;
-
-	/// Change the particle gravity scale. Adjusts the effect of the global
-	/// gravity vector on particles. Default value is 1.0f.
-	float32 gravityScale;
-
-	/// Particles behave as circles with this radius. In Box2D units.
-	float32 radius;
-
-	/// Set the maximum number of particles.
-	/// By default, there is no maximum. The particle buffers can continue to
-	/// grow while b2World's block allocator still has memory.
-	/// See SetMaxParticleCount for details.
-	int32 maxCount;
-
-	/// Increases pressure in response to compression
-	/// Smaller values allow more compression
-	float32 pressureStrength;
-
-	/// Reduces velocity along the collision normal
-	/// Smaller value reduces less
-	float32 dampingStrength;
-
-	/// Restores shape of elastic particle groups
-	/// Larger values increase elastic particle velocity
-	float32 elasticStrength;
-
-	/// Restores length of spring particle groups
-	/// Larger values increase spring particle velocity
-	float32 springStrength;
-
-	/// Reduces relative velocity of viscous particles
-	/// Larger values slow down viscous particles more
-	float32 viscousStrength;
-
-	/// Produces pressure on tensile particles
-	/// 0~0.2. Larger values increase the amount of surface tension.
-	float32 surfaceTensionPressureStrength;
-
-	/// Smoothes outline of tensile particles
-	/// 0~0.2. Larger values result in rounder, smoother, water-drop-like
-	/// clusters of particles.
-	float32 surfaceTensionNormalStrength;
-
-	/// Produces additional pressure on repulsive particles
-	/// Larger values repulse more
-	/// Negative values mean attraction. The range where particles behave
-	/// stably is about -0.2 to 2.0.
-	float32 repulsiveStrength;
-
-	/// Produces repulsion between powder particles
-	/// Larger values repulse more
-	float32 powderStrength;
-
-	/// Pushes particles out of solid particle group
-	/// Larger values repulse more
-	float32 ejectionStrength;
-
-	/// Produces static pressure
-	/// Larger values increase the pressure on neighboring partilces
-	/// For a description of static pressure, see
-	/// http://en.wikipedia.org/wiki/Static_pressure#Static_pressure_in_fluid_dynamics
-	float32 staticPressureStrength;
-
-	/// Reduces instability in static pressure calculation
-	/// Larger values make stabilize static pressure with fewer iterations
-	float32 staticPressureRelaxation;
-
-	/// Computes static pressure more precisely
-	/// See SetStaticPressureIterations for details
-	int32 staticPressureIterations;
-
-	/// Determines how fast colors are mixed
-	/// 1.0f ==> mixed immediately
-	/// 0.5f ==> mixed half way each simulation step (see b2World::Step())
-	float32 colorMixingStrength;
-
-	/// Whether to destroy particles by age when no more particles can be
-	/// created.  See #b2ParticleSystem::SetDestructionByAge() for
-	/// more information.
-	bool destroyByAge;
-
-	/// Granularity of particle lifetimes in seconds.  By default this is
-	/// set to (1.0f / 60.0f) seconds.  b2ParticleSystem uses a 32-bit signed
-	/// value to track particle lifetimes so the maximum lifetime of a
-	/// particle is (2^32 - 1) / (1.0f / lifetimeGranularity) seconds.
-	/// With the value set to 1/60 the maximum lifetime or age of a particle is
-	/// 2.27 years.
-	float32 lifetimeGranularity;
-};
-
 extern "C" {
 	b2ParticleSystem* b2CreateParticleSystem( b2WorldId worldId, const b2ParticleSystemDef* def);
 	void b2DestroyParticleSystem( b2ParticleSystem* system );
 	void b2ParticleSystemSolve( b2ParticleSystem* list, b2StepContext* stepContext );
 	void b2DrawParticleSystem( b2ParticleSystem* list, b2DebugDraw* draw);
+	void b2DumpParticleSystemMemoryStats( b2ParticleSystem* list, FILE* file );
+	b2WorldId b2ParticleSystem_GetWorld( b2ParticleSystemId systemId );
+	void b2ParticleSystem_ApplyForceToRange( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2 force );
+	void b2ParticleSystem_ApplyForces( b2ParticleSystemId systemId, const int* indices, const b2Vec2* forces, int count );
 }
 
+/// Query the particles of every particle system of a world for particles
+/// inside an AABB. Particle systems whose bounds don't overlap the AABB are
+/// skipped without visiting their particles, see b2ParticleSystem::GetAABB.
+/// Returning false from the callback terminates the query of the current
+/// particle system only.
+void b2World_QueryParticles(b2WorldId worldId,
+							b2ParticleQueryCallback* callback,
+							const b2AABB& aabb);
+
+/// Ray-cast the particles of every particle system of a world. Particle
+/// systems whose bounds don't overlap the ray are skipped. The fraction
+/// returned by the callback clips the ray of the current particle system
+/// only. See b2ParticleSystem::RayCast.
+void b2World_RayCastParticles(b2WorldId worldId,
+							  b2ParticleRayCastCallback* callback,
+							  const b2Vec2& point1, const b2Vec2& point2);
+
 class b2ParticleSystem
 {
 public:
@@ -406,6 +510,42 @@ public:
 	/// Get the number of particle groups.
 	int32 GetParticleGroupCount() const;
 
+	/// Create a particle emitter whose properties have been defined. No
+	/// reference to the definition is retained.
+	/// @warning This function is locked during callbacks.
+	b2ParticleEmitter* CreateParticleEmitter(const b2ParticleEmitterDef& def);
+
+	/// Destroy a particle emitter. The particles it emitted are not
+	/// destroyed, they no longer expire.
+	/// @warning This function is locked during callbacks.
+	void DestroyParticleEmitter(b2ParticleEmitter* emitter);
+
+	/// Get the particle emitter list. With the returned emitter, use
+	/// b2ParticleEmitter::GetNext to get the next emitter in the list.
+	b2ParticleEmitter* GetParticleEmitterList();
+	const b2ParticleEmitter* GetParticleEmitterList() const;
+
+	/// Get the number of particle emitters.
+	int32 GetParticleEmitterCount() const;
+
+	/// Create a particle force field whose properties have been defined. No
+	/// reference to the definition is retained.
+	/// @warning This function is locked during callbacks.
+	b2ParticleForceField* CreateParticleForceField(
+		const b2ParticleForceFieldDef& def);
+
+	/// Destroy a particle force field.
+	/// @warning This function is locked during callbacks.
+	void DestroyParticleForceField(b2ParticleForceField* field);
+
+	/// Get the particle force field list. With the returned field, use
+	/// b2ParticleForceField::GetNext to get the next field in the list.
+	b2ParticleForceField* GetParticleForceFieldList();
+	const b2ParticleForceField* GetParticleForceFieldList() const;
+
+	/// Get the number of particle force fields.
+	int32 GetParticleForceFieldCount() const;
+
 	/// Get the number of particles.
 	int32 GetParticleCount() const;
 
@@ -475,6 +615,66 @@ public:
 	/// Get the number of iterations for static pressure of particles.
 	int32 GetStaticPressureIterations() const;
 
+	/// Select the solver of the static pressure.
+	void SetStaticPressureSolver(b2StaticPressureSolver solver);
+
+	/// Get the solver of the static pressure.
+	b2StaticPressureSolver GetStaticPressureSolver() const;
+
+	/// Stop the static pressure iterations once no pressure changes by more
+	/// than this fraction of the pressure cap, b2_maxParticlePressure times
+	/// the critical pressure, which the pressures are clamped to. The
+	/// threshold doesn't depend on the pressures reached, so a shallow fluid
+	/// stops relatively earlier than a deep one. Each particle iteration
+	/// starts from the pressures of the previous one, so a calm fluid
+	/// converges within a few iterations and the static pressure iterations
+	/// then only bound the work of deep or moving fluid. By default 0, which
+	/// always runs all the iterations unless the pressures stop changing.
+	void SetStaticPressureTolerance(float32 tolerance);
+
+	/// Get the tolerance of the static pressure iterations.
+	float32 GetStaticPressureTolerance() const;
+
+	/// Get the number of static pressure iterations run by the last particle
+	/// iteration. It is below the static pressure iterations when the
+	/// pressures converged within the tolerance.
+	int32 GetStaticPressureIterationCount() const;
+
+	/// Select the incompressibility solver.
+	/// b2_positionBasedPressureSolver keeps the fluid about as stiff as the
+	/// linear solver does with two to four times more particle iterations.
+	/// pressureStrength is only used by b2_linearPressureSolver.
+	void SetPressureSolver(b2ParticlePressureSolver solver);
+
+	/// Get the incompressibility solver.
+	b2ParticlePressureSolver GetPressureSolver() const;
+
+	/// Set the number of iterations of b2_positionBasedPressureSolver in each
+	/// particle iteration. More iterations make the fluid less compressible.
+	void SetPressureIterations(int32 iterations);
+
+	/// Get the number of iterations of b2_positionBasedPressureSolver.
+	int32 GetPressureIterations() const;
+
+	/// Enable or disable adaptive particle iterations.
+	/// When enabled, each step runs the smallest number of particle
+	/// iterations which keeps the displacement of the fastest particle in
+	/// one iteration under iterationDisplacement particle
+	/// diameters, clamped to [minIterations, maxIterations]. Calm scenes then
+	/// cost less and violent splashes get more iterations. The count drops by
+	/// at most one per step because the stiffness of the fluid depends on
+	/// it, and minIterations should be high enough to keep the fluid at rest
+	/// stable.
+	void SetAdaptiveIterations(bool enable);
+
+	/// Whether adaptive particle iterations are enabled.
+	bool GetAdaptiveIterations() const;
+
+	/// Get the number of particle iterations run by the last step.
+	/// The largest count of all the particle systems of a world is also
+	/// reported in b2Profile::particleIterations.
+	int32 GetIterationCount() const;
+
 	/// Change the particle radius.
 	/// You should set this only once, on world start.
 	/// If you change the radius during execution, existing particles may
@@ -486,6 +686,7 @@ public:
 
 	/// Get the position of each particle
 	/// Array is length GetParticleCount()
+	/// Call InvalidateAABB() after writing positions through it.
 	/// @return the pointer to the head of the particle positions array.
 	b2Vec2* GetPositionBuffer();
 	const b2Vec2* GetPositionBuffer() const;
@@ -548,9 +749,84 @@ public:
 	void SetColorBuffer(b2ParticleColor* buffer, int32 capacity);
 	void SetUserDataBuffer(void** buffer, int32 capacity);
 
+	// The compact particle state below is an export format, to save or
+	// send snapshots. The solver keeps working on the float32 buffers.
+
+	/// Get the size of the tiles of the compact particle positions.
+	/// A tile is 65536 / b2_particleCompactPositionSubdivisions particle
+	/// diameters wide.
+	float32 GetCompactTileSize() const;
+
+	/// Encode the particle positions in a compact form of half the size.
+	/// Each coordinate is a 16-bit fixed point number relative to the origin
+	/// of a tile, with a precision of 1 / b2_particleCompactPositionSubdivisions
+	/// particle diameters. The particles are encoded in order and
+	/// consecutive particles in the same tile share a b2ParticleCompactTile,
+	/// so spatially coherent particles need few tiles.
+	/// The rounding moves each particle by at most half a step per axis,
+	/// plus the float32 rounding of the decoded coordinate.
+	/// @param positions receives two values per particle,
+	///   GetParticleCount() * 2 values.
+	/// @param tiles receives at most tileCapacity tiles.
+	/// @param tileCapacity the length of tiles.
+	/// @return the number of tiles, which may be larger than tileCapacity.
+	int32 ExportCompactPositions(uint16* positions,
+								 b2ParticleCompactTile* tiles,
+								 int32 tileCapacity) const;
+
+	/// Decode particle positions encoded by ExportCompactPositions. The tiles
+	/// must cover GetParticleCount() particles.
+	void ImportCompactPositions(const uint16* positions,
+								const b2ParticleCompactTile* tiles,
+								int32 tileCount);
+
+	/// Encode the particle velocities as half precision floats.
+	/// The relative error of each component is at most 2^-11, components
+	/// larger than 65504 become infinite.
+	/// @param velocities receives GetParticleCount() * 2 values.
+	void ExportCompactVelocities(uint16* velocities) const;
+
+	/// Decode particle velocities encoded by ExportCompactVelocities.
+	void ImportCompactVelocities(const uint16* velocities);
+
+	/// Enable or disable the static distance field.
+	/// When enabled, the distance, normal and shape of the nearest static
+	/// shape are sampled from nodes spaced by
+	/// 1 / b2_particleStaticFieldSubdivisions particle diameters, which are
+	/// computed the first time particles come near them. Contacts with static
+	/// shapes and continuous collision against them become bilinear lookups;
+	/// dynamic and kinematic shapes are still tested exactly. A particle has
+	/// at most one contact with static shapes, with the nearest one.
+	/// Details finer than the spacing are smoothed out, so static shapes
+	/// which only touch at a corner should overlap instead.
+	/// The field is dropped and rebuilt lazily whenever a static shape is
+	/// created, destroyed, moved or modified, so static bodies which move
+	/// often should be kinematic instead.
+	void SetStaticDistanceField(bool enable);
+
+	/// Whether the static distance field is enabled.
+	bool GetStaticDistanceField() const;
+
+	/// Reorder the particles every 'interval' steps, 0 disables it.
+	/// Particle indices follow the creation order, so after the particles
+	/// have moved around, the particles in contact are scattered in memory.
+	/// Reordering sorts the particles of each group, and the particles
+	/// without a group between two groups, by position, so that the contact
+	/// passes mostly access the particle buffers in order. It changes the
+	/// indices of the particles like destroying particles does; handles,
+	/// pairs, triads and lifetimes follow the particles.
+	void SetReorderInterval(int32 interval);
+
+	/// Get the number of steps between two reorderings of the particles.
+	int32 GetReorderInterval() const;
+
 	/// Get contacts between particles
 	/// Contact data can be used for many reasons, for example to trigger
 	/// rendering or audio effects.
+	/// Unlike in earlier versions, the contacts between two wall particles
+	/// are left out unless either of them is in a group or has flags which
+	/// use them, see k_wallContactFlags. Give such particles
+	/// b2_particleContactListenerParticle to keep their contacts.
 	const b2ParticleContact* GetContacts() const;
 	int32 GetContactCount() const;
 
@@ -560,6 +836,46 @@ public:
 	const b2ParticleBodyContact* GetBodyContacts() const;
 	int32 GetBodyContactCount() const;
 
+	/// Get the particle / particle begin and end touch events of the last
+	/// time step. Only contacts involving a particle with the
+	/// b2_particleContactListenerParticle flag are reported. The events of
+	/// all particle iterations of the step are accumulated, in order.
+	b2ParticleContactEvents GetParticleContactEvents() const;
+
+	/// Get the particle / shape begin and end touch events of the last time
+	/// step. Only particles with the b2_fixtureContactListenerParticle flag
+	/// are reported. The events of all particle iterations of the step are
+	/// accumulated, in order.
+	b2ParticleBodyContactEvents GetBodyContactEvents() const;
+
+	/// Get the shapes touched by particles with the
+	/// b2_fixtureContactListenerParticle flag at the end of the last time
+	/// step, together with the number of touching particles. The array is
+	/// sorted by shape index.
+	const b2ParticleShapeTouch* GetShapeTouches() const;
+	int32 GetShapeTouchCount() const;
+
+	/// Get the number of particles with the b2_fixtureContactListenerParticle
+	/// flag touching a shape at the end of the last time step.
+	int32 GetShapeParticleCount(b2ShapeId shapeId) const;
+
+	/// Set the contact filtering data of the particles against shapes.
+	/// See b2ParticleSystemDef::filter.
+	void SetFilter(b2Filter filter);
+
+	/// Get the contact filtering data of the particles against shapes.
+	b2Filter GetFilter() const;
+
+	/// Register a batched particle / particle contact filter. This is
+	/// optional. Pass NULL to remove the filter.
+	void SetParticleContactFilter(b2ParticleContactFilterFcn* fcn,
+								  void* context);
+
+	/// Register a batched particle / shape contact filter. This is
+	/// optional. Pass NULL to remove the filter.
+	void SetBodyContactFilter(b2ParticleBodyContactFilterFcn* fcn,
+							  void* context);
+
 	/// Get array of particle pairs. The particles in a pair:
 	///   (1) are contacting,
 	///   (2) are in the same particle group,
@@ -698,6 +1014,9 @@ public:
 	b2ParticleSystem* GetNext();
 	const b2ParticleSystem* GetNext() const;
 
+	/// Get the id of the particle system, used by the C interface.
+	b2ParticleSystemId GetId() const;
+
 	/// Query the particle system for all particles that potentially overlap
 	/// the provided AABB. b2QueryCallback::ShouldQueryParticleSystem is
 	/// ignored.
@@ -705,6 +1024,17 @@ public:
 	/// @param aabb the query box.
 	void QueryAABB(b2ParticleQueryCallback* callback, const b2AABB& aabb) const;
 
+	/// Query the particle system for all particles that potentially overlap
+	/// each of the provided AABBs. The AABBs are sorted by their lowest row
+	/// of the particle grid and answered in a single sweep over the sorted
+	/// particles, so this is much faster than calling QueryAABB for each of
+	/// many AABBs. The particles are not reported in any particular order.
+	/// @param callback a user implemented callback class.
+	/// @param aabbs the query boxes.
+	/// @param count the number of query boxes.
+	void QueryAABBs(b2ParticleBatchQueryCallback* callback,
+					const b2AABB* aabbs, int32 count) const;
+
 	/// Query the particle system for all particles that potentially overlap
 	/// the provided shape's AABB. Calls QueryAABB internally.
 	/// b2QueryCallback::ShouldQueryParticleSystem is ignored.
@@ -724,17 +1054,70 @@ public:
 	void RayCast(b2ParticleRayCastCallback* callback, const b2Vec2& point1,
 				 const b2Vec2& point2) const;
 
-	void QueryShapeParticle(b2ShapeParticleQueryCallback* callback, const b2AABB& aabb) const;
+	/// Ray-cast the particle system with many rays and find the closest
+	/// particle hit by each. Every ray only visits the rows of the particle
+	/// grid it crosses, so long diagonal rays do not pay for their AABB.
+	/// @param origins the ray starting points.
+	/// @param translations the ray translations, the ray ending points are
+	///   origins[i] + translations[i].
+	/// @param rayCount the number of rays.
+	/// @param hits receives rayCount results, one per ray in ray order.
+	/// @param useWorkers cast the rays on the task system of the world.
+	void RayCastClosest(const b2Vec2* origins, const b2Vec2* translations,
+						int32 rayCount, b2ParticleRayCastHit* hits,
+						bool useWorkers = false) const;
+
+	/// Ray-cast the particle system with many rays and find all the particles
+	/// hit by each. The hits are ordered by ray and then by fraction.
+	/// @param origins the ray starting points.
+	/// @param translations the ray translations.
+	/// @param rayCount the number of rays.
+	/// @param hits receives at most capacity hits.
+	/// @param capacity the length of hits.
+	/// @param useWorkers cast the rays on the task system of the world.
+	/// @return the total number of hits, which may be larger than capacity.
+	int32 RayCastAll(const b2Vec2* origins, const b2Vec2* translations,
+					 int32 rayCount, b2ParticleRayCastHit* hits,
+					 int32 capacity, bool useWorkers = false) const;
+
+	/// Query the shapes overlapping the AABB for the particles inside each.
+	/// @param includeStaticShapes false skips the shapes of static bodies.
+	void QueryShapeParticle(b2ShapeParticleQueryCallback* callback,
+							const b2AABB& aabb,
+							bool includeStaticShapes = true) const;
 
 	/// Compute the axis-aligned bounding box for all particles contained
 	/// within this particle system.
 	/// @param aabb Returns the axis-aligned bounding box of the system.
 	void ComputeAABB(b2AABB* const aabb) const;
 
+	/// Get the bounding box of the particle centers.
+	/// It is kept up to date by the position integration without a separate
+	/// pass over the particles, and only grows with particles created since
+	/// the last step. It is computed again when the position buffer was
+	/// replaced or InvalidateAABB() was called since.
+	/// The lower bound is above the upper bound when there are no particles.
+	const b2AABB& GetAABB() const;
+
+	/// Notify the particle system that particle positions were written
+	/// through GetPositionBuffer(), so that GetAABB() computes the bounds
+	/// again. Queries and ray casts skip the system outside of its bounds.
+	void InvalidateAABB();
+
+	/// Get the memory held by this particle system.
+	void GetMemoryStats(b2ParticleMemoryStats* stats) const;
+
+	/// Get the bytes of the allocated per-particle buffers used by the
+	/// particles of a group, plus the group itself.
+	int32 GetParticleGroupMemory(const b2ParticleGroup* group) const;
+
+	/// Write the size of each buffer, group and allocator to a file. This is
+	/// part of b2World_DumpMemoryStats.
+	void DumpMemoryStats(FILE* file) const;
+
 private:
 	friend class b2World;
 	friend class b2ParticleGroup;
-	friend class b2ParticleBodyContactRemovePredicate;
 	friend class b2FixtureParticleQueryCallback;
 #ifdef LIQUIDFUN_UNIT_TESTS
 	FRIEND_TEST(FunctionTests, GetParticleMass);
@@ -753,6 +1136,24 @@ private:
 		int32 userSuppliedCapacity;
 	};
 
+	/// A shape and a particle which may be touching.
+	struct ShapeParticle
+	{
+		b2Shape* shape;
+		int32 index;
+		/// Distance between the shape and the particle center, or 0 if it
+		/// is not known yet.
+		float32 distance;
+	};
+
+	/// Used for diffing consecutive particle / shape contact sets
+	struct BodyContactKey
+	{
+		/// Shape index in the high and particle index in the low 32 bits.
+		uint64 key;
+		uint16 generation;
+	};
+
 	/// Used for detecting particle contacts
 	struct Proxy
 	{
@@ -801,7 +1202,21 @@ private:
 		}
 	};
 
+	/// The line between two paired barrier particles during a substep,
+	/// which SolveBarrier() keeps the other particles from passing.
+	struct BarrierSegment
+	{
+		b2Vec2 pa, pba;
+		b2Vec2 va, vba;
+		const b2ParticleGroup* aGroup;
+		const b2ParticleGroup* bGroup;
+		/// The tags of the bounds of the segment expanded by one diameter.
+		uint32 lowerTag, upperTag;
+	};
+
 	/// InsideBoundsEnumerator enumerates all particles inside the given bounds.
+	/// The proxies are visited one row at a time. Each row is binary searched
+	/// for the x bounds, so the proxies outside of them are never touched.
 	class InsideBoundsEnumerator
 	{
 	public:
@@ -810,17 +1225,31 @@ private:
 			uint32 lower, uint32 upper,
 			const Proxy* first, const Proxy* last);
 
+		/// Construct an enumerator with bounds of tags and two ranges of
+		/// proxies, visited one after the other.
+		InsideBoundsEnumerator(
+			uint32 lower, uint32 upper,
+			const Proxy* first, const Proxy* last,
+			const Proxy* secondFirst, const Proxy* secondLast);
+
 		/// Get index of the next particle. Returns b2_invalidParticleIndex if
 		/// there are no more particles.
 		int32 GetNext();
 	private:
+		/// Find the proxies inside the x bounds in the next row which has any.
+		/// Returns false if there are no more such rows.
+		bool NextRow();
+
 		/// The lower and upper bound of x component in the tag.
 		uint32 m_xLower, m_xUpper;
-		/// The lower and upper bound of y component in the tag.
-		uint32 m_yLower, m_yUpper;
-		/// The range of proxies.
+		/// The proxies of the current row inside the x bounds.
 		const Proxy* m_first;
 		const Proxy* m_last;
+		/// The end of the range of proxies.
+		const Proxy* m_end;
+		/// The range of proxies visited after this one, if any.
+		const Proxy* m_nextFirst;
+		const Proxy* m_nextEnd;
 	};
 
 	/// Node of linked lists of connected particles
@@ -851,11 +1280,36 @@ private:
 	/// All particle types that apply extra damping force with bodies
 	static const int32 k_extraDampingFlags =
 		b2_staticPressureParticle;
+	/// All particle types that use their contacts with wall particles even
+	/// when they are wall particles themselves. Wall particles without any
+	/// of these and without a group are kept in the static proxy index.
+	static const int32 k_wallContactFlags =
+		b2_springParticle |
+		b2_elasticParticle |
+		b2_barrierParticle |
+		b2_tensileParticle |
+		b2_colorMixingParticle |
+		b2_staticPressureParticle |
+		b2_reactiveParticle |
+		b2_particleContactListenerParticle |
+		b2_particleContactFilterParticle;
+
+	/// Whether a particle with these flags and group belongs to the static
+	/// proxy index. Grouped wall particles stay in the dynamic one, as the
+	/// depth and the rigid and elastic passes of their group use their
+	/// contacts with each other.
+	static bool IsStaticProxyParticle(uint32 flags,
+									  const b2ParticleGroup* group)
+	{
+		return group == NULL &&
+			(flags & (b2_wallParticle | k_wallContactFlags)) ==
+			b2_wallParticle;
+	}
 
 	b2ParticleSystem(const b2ParticleSystemDef* def, b2World* world);
 	~b2ParticleSystem();
 
-	template <typename T> void FreeBuffer(T** b, int capacity);
+	template <typename T> void FreeBuffer(T** b);
 	template <typename T> void FreeUserOverridableBuffer(
 		UserOverridableBuffer<T>* b);
 	template <typename T> T* ReallocateBuffer(T* buffer, int32 oldCapacity,
@@ -873,6 +1327,10 @@ private:
 	void ReallocateHandleBuffers(int32 newCapacity);
 
 	void ReallocateInternalAllocatedBuffers(int32 capacity);
+	int32 CreateParticleInternal(const b2ParticleDef& def);
+	void InitializeParticle(int32 index, const b2ParticleDef& def);
+	bool RecycleParticle(int32 index, const b2ParticleDef& def);
+	void RemoveRecycledParticleReferences(int32 index);
 	int32 CreateParticleForGroup(
 		const b2ParticleGroupDef& groupDef,
 		const b2Transform& xf, const b2Vec2& position);
@@ -921,11 +1379,56 @@ private:
 	void ComputeDepth();
 
 	InsideBoundsEnumerator GetInsideBoundsEnumerator(const b2AABB& aabb) const;
+	InsideBoundsEnumerator GetInsideTagsEnumerator(uint32 lowerTag,
+												   uint32 upperTag) const;
+
+	/// Hits of all the rays in one block of a batched ray cast.
+	struct RayCastHitBlock
+	{
+		b2ParticleRayCastHit* hits;
+		int32 count;
+		int32 capacity;
+	};
+
+	/// Shared state of the tasks of a batched ray cast.
+	struct RayCastBatchContext
+	{
+		const b2ParticleSystem* system;
+		const b2Vec2* origins;
+		const b2Vec2* translations;
+		int32 rayCount;
+		/// Closest hit of each ray, or NULL to collect all the hits.
+		b2ParticleRayCastHit* closestHits;
+		RayCastHitBlock* blocks;
+	};
+
+	static void RayCastBatchTask(int32 startIndex, int32 endIndex,
+								 uint32 workerIndex, void* context);
+	void RayCastBatch(RayCastBatchContext* context, int32 blockCount,
+					  bool useWorkers) const;
+	void RayCastBatchRay(const b2Vec2& origin, const b2Vec2& translation,
+						 int32 rayIndex, b2ParticleRayCastHit* closestHit,
+						 RayCastHitBlock* block) const;
+	/// Compute pv[k], the projection of origin minus the particle position
+	/// of proxies[k] on the translation, and the discriminant of the
+	/// intersection of the ray with the particle for k in [first, last).
+	void RayCastDiscriminants_Reference(const b2Vec2& origin,
+										const b2Vec2& translation,
+										const Proxy* proxies, int32 first,
+										int32 last, float32* pv,
+										float32* determinant) const;
+	/// The same for k in [0, count) in batches of B2_SIMD_WIDTH.
+	void RayCastDiscriminants_Simd(const b2Vec2& origin,
+								   const b2Vec2& translation,
+								   const Proxy* proxies, int32 count,
+								   float32* pv, float32* determinant) const;
 
 	void UpdateAllParticleFlags();
 	void UpdateAllGroupFlags();
 	void AddContact(int32 a, int32 b,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
+	void AddStaticWeight(const Proxy* a, const Proxy* b,
+		float32* weights) const;
 	void FindContacts_Reference(
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	void ReorderForFindContact(FindContactInput* reordered,
@@ -941,6 +1444,8 @@ private:
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	void FindContacts(
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
+	void FindStaticContacts(
+		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	static void UpdateProxyTags(
 		const uint32* const tags,
 		b2GrowableBuffer<Proxy>& proxies);
@@ -954,44 +1459,166 @@ private:
 	void UpdateProxies_Simd(b2GrowableBuffer<Proxy>& proxies) const;
 	void UpdateProxies(b2GrowableBuffer<Proxy>& proxies) const;
 	void SortProxies(b2GrowableBuffer<Proxy>& proxies) const;
-	// void FilterContacts(b2GrowableBuffer<b2ParticleContact>& contacts);
-	// void NotifyContactListenerPreContact(
-	// 	b2ParticlePairSet* particlePairs) const;
-	// void NotifyContactListenerPostContact(b2ParticlePairSet& particlePairs);
+	void PartitionProxies();
+	uint32 ComputeStaticProxyChecksum() const;
+	void UpdateStaticProxies();
+	void FilterContacts(b2GrowableBuffer<b2ParticleContact>& contacts);
+	template <typename T> void FilterBodyContacts(
+		b2GrowableBuffer<T>& contacts);
 	void UpdateContacts(bool exceptZombie);
-	// void NotifyBodyContactListenerPreContact(
-	// 	FixtureParticleSet* fixtureSet) const;
-	// void NotifyBodyContactListenerPostContact(FixtureParticleSet& fixtureSet);
+	void UpdateContactEvents();
+	void UpdateShapeCandidates(const b2AABB& aabb);
 	void UpdateBodyContacts();
+	void UpdateBodyContactEvents();
 
 	void Solve(const b2StepContext& step);
 	void SolveCollision(const b2StepContext& step);
 	void LimitVelocity(const b2StepContext& step);
 	void SolveGravity(const b2StepContext& step);
 	void SolveBarrier(const b2StepContext& step);
+	void SolveBarrierParticle(const BarrierSegment& segment, int32 c,
+							  float32 tmax, const b2StepContext& step);
 	void SolveStaticPressure(const b2StepContext& step);
+	void SolveStaticPressureJacobi(float32 pressurePerWeight,
+								   float32 maxPressure, float32 relaxation,
+								   float32 tolerance);
+	void SolveStaticPressureGaussSeidel(float32 pressurePerWeight,
+										float32 maxPressure,
+										float32 relaxation, float32 tolerance);
+	static void SolveStaticPressureTask(int32 startIndex, int32 endIndex,
+										uint32 workerIndex, void* context);
 	void ComputeWeight();
+	void UpdateStaticDistanceField();
+	void UpdateStaticBodyContacts();
+	void AddStaticBodyContact(int32 a, b2Shape* shape, float32 d,
+							  const b2Vec2& n);
+	void SolveStaticCollision(const b2StepContext& step);
+	int32 ComputeIterationCount(const b2StepContext& step,
+								int32 previousCount) const;
+	/// Largest squared speed of the particles [first, last).
+	float32 ComputeMaxSpeedSquared_Reference(int32 first, int32 last) const;
+	/// The same for all the particles, in batches of B2_SIMD_WIDTH components.
+	float32 ComputeMaxSpeedSquared_Simd() const;
 	void SolvePressure(const b2StepContext& step);
+	void SolvePositionBasedPressure(const b2StepContext& step);
+	void ApplyPositionBasedPressure(const float32* pressure,
+									float32 velocityPerPressure);
 	void SolveDamping(const b2StepContext& step);
+	void SolveDamping_Reference(float32 linearDamping,
+								float32 quadraticDamping,
+								int32 firstBatch, int32 lastBatch);
+	void SolveDamping_Simd(float32 linearDamping, float32 quadraticDamping);
 	void SolveRigidLinearAngularDamping(const b2StepContext& step);
 	void SolveRigidDamping();
 	void SolveExtraDamping();
 	void SolveWall();
 	void SolveRigid(const b2StepContext& step);
+	/// Shared state of the tasks of SolveRigid().
+	struct RigidGroupContext
+	{
+		b2ParticleSystem* system;
+		b2ParticleGroup* const* groups;
+		float32 dt;
+	};
+	void UpdateRigidGroups();
+	static void SolveRigidTask(int32 startIndex, int32 endIndex,
+							   uint32 workerIndex, void* context);
+	void SolveRigidGroup(b2ParticleGroup* group, float32 dt);
+	void UpdateConnectionColors();
+	void ValidateConnectionColors(const int32* const* indices,
+								  int32 indexCount,
+								  const b2GrowableBuffer<int32>& colors);
+	/// Shared state of the tasks of SolveElastic() and SolveSpring(),
+	/// which solve the connections of one color.
+	struct ConnectionColorContext
+	{
+		b2ParticleSystem* system;
+		int32 firstConnection;
+		/// Whether the connections may share particles and must be solved
+		/// one after the other.
+		bool serial;
+		float32 dt;
+		float32 strength;
+	};
+	/// A static pressure contact of a particle, seen from that particle.
+	struct StaticPressureNeighbor
+	{
+		int32 index;
+		float32 weight;
+	};
+	/// Shared state of the tasks of SolveStaticPressureGaussSeidel(), which
+	/// update the static pressures of the particles of one color. The
+	/// connections of the color are the particles themselves.
+	struct StaticPressureColorContext : public ConnectionColorContext
+	{
+		/// The static pressure particles, sorted by color.
+		const int32* particles;
+		/// The neighbors of particle i are [firstNeighbors[i],
+		/// firstNeighbors[i + 1]) of neighbors.
+		const int32* firstNeighbors;
+		const StaticPressureNeighbor* neighbors;
+		float32 pressurePerWeight;
+		float32 maxPressure;
+		float32 relaxation;
+		/// The largest change of a pressure by each worker.
+		float32* maxChanges;
+	};
+	void SolveConnectionColors(b2TaskCallback* task, const int32* colors,
+							   ConnectionColorContext* context);
 	void SolveElastic(const b2StepContext& step);
+	static void SolveElasticTask(int32 startIndex, int32 endIndex,
+								 uint32 workerIndex, void* context);
+	void SolveElastic_Reference(float32 dt, float32 elasticStrength,
+								int32 firstTriad, int32 lastTriad);
+	void SolveElastic_Simd(float32 dt, float32 elasticStrength,
+						   int32 firstTriad, int32 lastTriad);
 	void SolveSpring(const b2StepContext& step);
+	static void SolveSpringTask(int32 startIndex, int32 endIndex,
+								uint32 workerIndex, void* context);
+	void SolveSpring_Reference(float32 dt, float32 springStrength,
+							   int32 firstPair, int32 lastPair);
+	void SolveSpring_Simd(float32 dt, float32 springStrength,
+						  int32 firstPair, int32 lastPair);
 	void SolveTensile(const b2StepContext& step);
+	void AccumulateTensileNormals_Reference(int32 firstContact,
+											int32 lastContact);
+	void AccumulateTensileNormals_Simd();
+	void SolveTensile_Reference(float32 pressureStrength,
+								float32 normalStrength,
+								float32 maxVelocityVariation,
+								int32 firstContact, int32 lastContact);
+	void SolveTensile_Simd(float32 pressureStrength, float32 normalStrength,
+						   float32 maxVelocityVariation);
 	void SolveViscous();
+	void SolveViscous_Reference(float32 viscousStrength,
+								int32 firstBatch, int32 lastBatch);
+	void SolveViscous_Simd(float32 viscousStrength);
 	void SolveRepulsive(const b2StepContext& step);
+	void SolveRepulsive_Reference(float32 repulsiveStrength,
+								  int32 firstContact, int32 lastContact);
+	void SolveRepulsive_Simd(float32 repulsiveStrength);
 	void SolvePowder(const b2StepContext& step);
+	void SolvePowder_Reference(float32 powderStrength,
+							   int32 firstContact, int32 lastContact);
+	void SolvePowder_Simd(float32 powderStrength);
 	void SolveSolid(const b2StepContext& step);
 	void SolveForce(const b2StepContext& step);
+	void SolveForceFields(float32 velocityPerForce);
+	/// Get the particles inside an AABB which forces can be applied to, from
+	/// the proxies.
+	int32 GetForceParticlesInAABB(const b2AABB& aabb, int32* indices) const;
 	void SolveColorMixing();
+	void SolveColorMixing_Reference(int32 strength,
+									int32 firstBatch, int32 lastBatch);
+	void SolveColorMixing_Simd(int32 strength);
 	void SolveZombie();
 	/// Destroy all particles which have outlived their lifetimes set by
 	/// SetParticleLifetime().
 	void SolveLifetimes(const b2StepContext& step);
 	void RotateBuffer(int32 start, int32 mid, int32 end);
+	template <typename T>
+	void RemapParticleIndices(const T& newIndices);
+	void ReorderParticles();
 
 	float32 GetCriticalVelocity(const b2StepContext& step) const;
 	float32 GetCriticalVelocitySquared(const b2StepContext& step) const;
@@ -1005,9 +1632,42 @@ private:
 
 	void SetGroupFlags(b2ParticleGroup* group, uint32 flags);
 
+	/// A per-particle buffer, see GetParticleBuffers().
+	struct ParticleBufferInfo
+	{
+		const char* name;
+		int32 elementSize;
+		/// Whether the system allocated the buffer.
+		bool allocated;
+	};
+	template <typename T>
+	static ParticleBufferInfo MakeParticleBufferInfo(
+		const char* name, const T* data, bool userSupplied);
+	/// Fill 'buffers' with one entry per buffer and return their number.
+	int32 GetParticleBuffers(ParticleBufferInfo* buffers) const;
+	/// Bytes of the allocated per-particle buffers for one particle.
+	int32 GetAllocatedBytesPerParticle() const;
+
+	/// Shared state of the tasks of RemoveSpuriousBodyContacts().
+	struct SpuriousBodyContactContext
+	{
+		const b2ParticleSystem* system;
+		/// Body contacts grouped by particle.
+		b2ParticleBodyContact* contacts;
+		/// The contacts of particle i are [offsets[i], offsets[i + 1]).
+		const int32* offsets;
+		/// Number of contacts kept for each particle.
+		int32* keptCounts;
+	};
+
 	void RemoveSpuriousBodyContacts();
-	static bool BodyContactCompare(const b2ParticleBodyContact& lhs,
-								   const b2ParticleBodyContact& rhs);
+	static void RemoveSpuriousBodyContactsTask(int32 startIndex,
+											   int32 endIndex,
+											   uint32 workerIndex,
+											   void* context);
+	int32 SelectBodyContacts(b2ParticleBodyContact* contacts,
+							 int32 count) const;
+	bool IsBodyContactPlausible(const b2ParticleBodyContact& contact) const;
 
 	void DetectStuckParticle(int32 particle);
 
@@ -1052,8 +1712,27 @@ private:
 	bool m_needsUpdateAllParticleFlags;
 	int32 m_allGroupFlags;
 	bool m_needsUpdateAllGroupFlags;
+	/// Whether some particles may belong to the other proxy index.
+	bool m_staticProxiesNeedPartition;
+	/// Whether m_staticProxyBuffer must be tagged and sorted again.
+	bool m_staticProxiesNeedUpdate;
+	/// ComputeStaticProxyChecksum() when m_staticProxyBuffer was last tagged
+	/// and sorted. A different one means that wall particles were moved.
+	uint32 m_staticProxyChecksum;
 	bool m_hasForce;
 	int32 m_iterationIndex;
+	int32 m_iterationCount;
+	int32 m_staticPressureIterationCount;
+	/// Steps since the particles were last reordered, see
+	/// b2ParticleSystemDef::reorderInterval.
+	int32 m_reorderStepCount;
+	/// Bounds of the particle centers, see GetAABB().
+	mutable b2AABB m_aabb;
+	/// Whether m_aabb must be computed again, see InvalidateAABB().
+	mutable bool m_aabbNeedsUpdate;
+	/// Created by UpdateStaticDistanceField() when
+	/// b2ParticleSystemDef::staticDistanceField is set.
+	b2StaticDistanceField* m_staticDistanceField;
 	float32 m_inverseDensity;
 	float32 m_particleDiameter;
 	float32 m_inverseDiameter;
@@ -1100,12 +1779,93 @@ private:
 	UserOverridableBuffer<int32> m_bodyContactCountBuffer;
 	UserOverridableBuffer<int32> m_consecutiveContactStepsBuffer;
 	b2GrowableBuffer<int32> m_stuckParticleBuffer;
+	/// Proxies of the particles which may move, tagged and sorted every
+	/// particle iteration.
 	b2GrowableBuffer<Proxy> m_proxyBuffer;
+	/// Proxies of the wall particles without k_wallContactFlags and without
+	/// a group. The particle system never moves them, so they are only
+	/// tagged and sorted when m_staticProxiesNeedUpdate is set or their
+	/// positions were written, and their contacts with each other are never
+	/// searched.
+	b2GrowableBuffer<Proxy> m_staticProxyBuffer;
+	/// The sum of the weights of the contacts of each static proxy with the
+	/// other static proxies, in the order of m_staticProxyBuffer. It stands
+	/// in for those contacts in ComputeWeight().
+	b2GrowableBuffer<float32> m_staticProxyWeightBuffer;
 	b2GrowableBuffer<b2ParticleContact> m_contactBuffer;
 	b2GrowableBuffer<b2ParticleBodyContact> m_bodyContactBuffer;
+	/// Shape / particle pairs found once per particle iteration by
+	/// UpdateBodyContacts() and reused by SolveCollision().
+	b2GrowableBuffer<ShapeParticle> m_shapeCandidateBuffer;
+	/// The bounds m_shapeCandidateBuffer was found within.
+	b2AABB m_shapeCandidateBounds;
 	b2GrowableBuffer<b2ParticlePair> m_pairBuffer;
 	b2GrowableBuffer<b2ParticleTriad> m_triadBuffer;
 
+	/// The elastic triads in structure-of-arrays form, sorted by color.
+	/// The triads of a color share no particle, except for the last color
+	/// which holds the triads left when the others are full.
+	struct ElasticTriads
+	{
+		ElasticTriads(b2BlockAllocator& allocator);
+		int32 GetCount() const;
+		void SetCount(int32 count);
+		size_t GetCapacityBytes() const;
+
+		b2GrowableBuffer<int32> indexA, indexB, indexC;
+		b2GrowableBuffer<float32> strength;
+		b2GrowableBuffer<float32> paX, paY, pbX, pbY, pcX, pcY;
+	};
+	/// The spring pairs in structure-of-arrays form, sorted by color like
+	/// ElasticTriads.
+	struct SpringPairs
+	{
+		SpringPairs(b2BlockAllocator& allocator);
+		int32 GetCount() const;
+		void SetCount(int32 count);
+		size_t GetCapacityBytes() const;
+
+		b2GrowableBuffer<int32> indexA, indexB;
+		b2GrowableBuffer<float32> strength, distance;
+	};
+	ElasticTriads m_elasticTriads;
+	SpringPairs m_springPairs;
+	/// The first elastic triad / spring pair of each color, followed by
+	/// their count.
+	b2GrowableBuffer<int32> m_elasticColorBuffer;
+	b2GrowableBuffer<int32> m_springColorBuffer;
+	/// Whether m_pairBuffer or m_triadBuffer changed since
+	/// UpdateConnectionColors().
+	bool m_connectionsNeedColoring;
+
+	/// Sorted (indexA, indexB) keys of the reported particle contacts found
+	/// by the last UpdateContactEvents(), used to diff against the next one.
+	b2GrowableBuffer<uint64> m_contactEventKeyBuffer;
+	/// Whether m_contactEventKeyBuffer was remapped and must be resorted.
+	bool m_contactEventKeysRequireSorting;
+	b2GrowableBuffer<b2ParticleContactBeginTouchEvent> m_contactBeginEventBuffer;
+	b2GrowableBuffer<b2ParticleContactEndTouchEvent> m_contactEndEventBuffer;
+
+	/// Sorted keys of the reported particle / shape contacts found by the
+	/// last UpdateBodyContactEvents(), used to diff against the next one.
+	b2GrowableBuffer<BodyContactKey> m_bodyContactEventKeyBuffer;
+	/// Whether m_bodyContactEventKeyBuffer was remapped and must be resorted.
+	bool m_bodyContactEventKeysRequireSorting;
+	b2GrowableBuffer<b2ParticleBodyContactBeginTouchEvent>
+		m_bodyContactBeginEventBuffer;
+	b2GrowableBuffer<b2ParticleBodyContactEndTouchEvent>
+		m_bodyContactEndEventBuffer;
+	b2GrowableBuffer<b2ParticleShapeTouch> m_shapeTouchBuffer;
+	/// The rigid particle groups, gathered once per step by
+	/// UpdateRigidGroups() so that the particle iterations do not walk
+	/// m_groupList.
+	b2GrowableBuffer<b2ParticleGroup*> m_rigidGroupBuffer;
+
+	b2ParticleContactFilterFcn* m_particleContactFilterFcn;
+	void* m_particleContactFilterContext;
+	b2ParticleBodyContactFilterFcn* m_bodyContactFilterFcn;
+	void* m_bodyContactFilterContext;
+
 	/// Time each particle should be destroyed relative to the last time
 	/// m_timeElapsed was initialized.  Each unit of time corresponds to
 	/// b2ParticleSystemDef::lifetimeGranularity seconds.
@@ -1122,9 +1882,16 @@ private:
 	int32 m_groupCount;
 	b2ParticleGroup* m_groupList;
 
+	int32 m_emitterCount;
+	b2ParticleEmitter* m_emitterList;
+
+	int32 m_forceFieldCount;
+	b2ParticleForceField* m_forceFieldList;
+
 	b2ParticleSystemDef m_def;
 
 	b2World* m_world;
+	b2ParticleSystemId m_id;
 	b2ParticleSystem* m_prev;
 	b2ParticleSystem* m_next;
 
@@ -1132,6 +1899,13 @@ private:
 	friend void b2DestroyParticleSystem( b2ParticleSystem* system );
 	friend void b2ParticleSystemSolve( b2ParticleSystem* list, b2StepContext* stepContext );
 	friend void b2DrawParticleSystem( b2ParticleSystem* list, b2DebugDraw* draw);
+	friend b2WorldId b2ParticleSystem_GetWorld( b2ParticleSystemId systemId );
+	friend void b2ParticleSystem_ApplyForceToRange( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2 force );
+	friend void b2ParticleSystem_ApplyForces( b2ParticleSystemId systemId, const int* indices, const b2Vec2* forces,
+											  int count );
+	friend class b2ParticleEmitter;
+	friend class b2ParticleForceField;
+	friend class b2ParticleSurface;
 };
 
 inline void b2ParticleContact::SetIndices(int32 a, int32 b)
@@ -1181,6 +1955,37 @@ inline int32 b2ParticleSystem::GetParticleGroupCount() const
 	return m_groupCount;
 }
 
+inline b2ParticleEmitter* b2ParticleSystem::GetParticleEmitterList()
+{
+	return m_emitterList;
+}
+
+inline const b2ParticleEmitter* b2ParticleSystem::GetParticleEmitterList() const
+{
+	return m_emitterList;
+}
+
+inline int32 b2ParticleSystem::GetParticleEmitterCount() const
+{
+	return m_emitterCount;
+}
+
+inline b2ParticleForceField* b2ParticleSystem::GetParticleForceFieldList()
+{
+	return m_forceFieldList;
+}
+
+inline const b2ParticleForceField*
+b2ParticleSystem::GetParticleForceFieldList() const
+{
+	return m_forceFieldList;
+}
+
+inline int32 b2ParticleSystem::GetParticleForceFieldCount() const
+{
+	return m_forceFieldCount;
+}
+
 inline int32 b2ParticleSystem::GetParticleCount() const
 {
 	return m_count;
@@ -1216,6 +2021,36 @@ inline int32 b2ParticleSystem::GetBodyContactCount() const
 	return m_bodyContactBuffer.GetCount();
 }
 
+inline b2ParticleContactEvents b2ParticleSystem::GetParticleContactEvents() const
+{
+	b2ParticleContactEvents events;
+	events.beginEvents = m_contactBeginEventBuffer.Data();
+	events.endEvents = m_contactEndEventBuffer.Data();
+	events.beginCount = m_contactBeginEventBuffer.GetCount();
+	events.endCount = m_contactEndEventBuffer.GetCount();
+	return events;
+}
+
+inline b2ParticleBodyContactEvents b2ParticleSystem::GetBodyContactEvents() const
+{
+	b2ParticleBodyContactEvents events;
+	events.beginEvents = m_bodyContactBeginEventBuffer.Data();
+	events.endEvents = m_bodyContactEndEventBuffer.Data();
+	events.beginCount = m_bodyContactBeginEventBuffer.GetCount();
+	events.endCount = m_bodyContactEndEventBuffer.GetCount();
+	return events;
+}
+
+inline const b2ParticleShapeTouch* b2ParticleSystem::GetShapeTouches() const
+{
+	return m_shapeTouchBuffer.Data();
+}
+
+inline int32 b2ParticleSystem::GetShapeTouchCount() const
+{
+	return m_shapeTouchBuffer.GetCount();
+}
+
 inline const b2ParticlePair* b2ParticleSystem::GetPairs() const
 {
 	return m_pairBuffer.Data();
@@ -1246,6 +2081,11 @@ inline const b2ParticleSystem* b2ParticleSystem::GetNext() const
 	return m_next;
 }
 
+inline b2ParticleSystemId b2ParticleSystem::GetId() const
+{
+	return m_id;
+}
+
 inline const int32* b2ParticleSystem::GetStuckCandidates() const
 {
 	return m_stuckParticleBuffer.Data();
@@ -1266,11 +2106,36 @@ inline bool b2ParticleSystem::GetStrictContactCheck() const
 	return m_def.strictContactCheck;
 }
 
+inline void b2ParticleSystem::SetFilter(b2Filter filter)
+{
+	m_def.filter = filter;
+}
+
+inline b2Filter b2ParticleSystem::GetFilter() const
+{
+	return m_def.filter;
+}
+
+inline void b2ParticleSystem::SetParticleContactFilter(
+	b2ParticleContactFilterFcn* fcn, void* context)
+{
+	m_particleContactFilterFcn = fcn;
+	m_particleContactFilterContext = context;
+}
+
+inline void b2ParticleSystem::SetBodyContactFilter(
+	b2ParticleBodyContactFilterFcn* fcn, void* context)
+{
+	m_bodyContactFilterFcn = fcn;
+	m_bodyContactFilterContext = context;
+}
+
 inline void b2ParticleSystem::SetRadius(float32 radius)
 {
 	m_particleDiameter = 2 * radius;
 	m_squaredDiameter = m_particleDiameter * m_particleDiameter;
 	m_inverseDiameter = 1 / m_particleDiameter;
+	m_staticProxiesNeedUpdate = true;
 }
 
 inline void b2ParticleSystem::SetDensity(float32 density)
@@ -1314,6 +2179,96 @@ inline int32 b2ParticleSystem::GetStaticPressureIterations() const
 	return m_def.staticPressureIterations;
 }
 
+inline void b2ParticleSystem::SetStaticPressureSolver(
+	b2StaticPressureSolver solver)
+{
+	m_def.staticPressureSolver = solver;
+}
+
+inline b2StaticPressureSolver b2ParticleSystem::GetStaticPressureSolver() const
+{
+	return m_def.staticPressureSolver;
+}
+
+inline void b2ParticleSystem::SetStaticPressureTolerance(float32 tolerance)
+{
+	b2Assert(tolerance >= 0);
+	m_def.staticPressureTolerance = tolerance;
+}
+
+inline float32 b2ParticleSystem::GetStaticPressureTolerance() const
+{
+	return m_def.staticPressureTolerance;
+}
+
+inline int32 b2ParticleSystem::GetStaticPressureIterationCount() const
+{
+	return m_staticPressureIterationCount;
+}
+
+inline void b2ParticleSystem::SetPressureSolver(
+	b2ParticlePressureSolver solver)
+{
+	m_def.pressureSolver = solver;
+}
+
+inline b2ParticlePressureSolver b2ParticleSystem::GetPressureSolver() const
+{
+	return m_def.pressureSolver;
+}
+
+inline void b2ParticleSystem::SetPressureIterations(int32 iterations)
+{
+	m_def.pressureIterations = iterations;
+}
+
+inline int32 b2ParticleSystem::GetPressureIterations() const
+{
+	return m_def.pressureIterations;
+}
+
+inline void b2ParticleSystem::SetAdaptiveIterations(bool enable)
+{
+	m_def.adaptiveIterations = enable;
+}
+
+inline bool b2ParticleSystem::GetAdaptiveIterations() const
+{
+	return m_def.adaptiveIterations;
+}
+
+inline int32 b2ParticleSystem::GetIterationCount() const
+{
+	return m_iterationCount;
+}
+
+inline float32 b2ParticleSystem::GetCompactTileSize() const
+{
+	return 65536.0f / b2_particleCompactPositionSubdivisions *
+		   m_particleDiameter;
+}
+
+inline void b2ParticleSystem::SetStaticDistanceField(bool enable)
+{
+	m_def.staticDistanceField = enable;
+}
+
+inline bool b2ParticleSystem::GetStaticDistanceField() const
+{
+	return m_def.staticDistanceField;
+}
+
+inline void b2ParticleSystem::SetReorderInterval(int32 interval)
+{
+	b2Assert(interval >= 0);
+	m_def.reorderInterval = interval;
+}
+
+inline int32 b2ParticleSystem::GetReorderInterval() const
+{
+	return m_def.reorderInterval;
+}
+
 inline float32 b2ParticleSystem::GetRadius() const
 {
 	return m_particleDiameter / 2;
@@ -1342,6 +2297,11 @@ inline b2Vec2* b2ParticleSystem::GetPositionBuffer()
 	return m_positionBuffer.data;
 }
 
+inline void b2ParticleSystem::InvalidateAABB()
+{
+	m_aabbNeedsUpdate = true;
+}
+
 inline b2Vec2* b2ParticleSystem::GetVelocityBuffer()
 {
 	return m_velocityBuffer.data;
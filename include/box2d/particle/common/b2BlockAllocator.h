@@ -45,11 +45,30 @@ public:
 	/// Free memory. This uses b2Free if the size is larger than b2_maxBlockSize.
 	void Free(void* p, int32 size);
 
+	/// Allocate memory aligned to b2_mallocAlignment whatever the size. It
+	/// is tracked as a giant allocation. Free it with FreeAligned().
+	void* AllocateAligned(int32 size);
+
+	/// Free memory returned by AllocateAligned().
+	void FreeAligned(void* p);
+
 	void Clear();
 
 	/// Returns the number of allocations larger than the max block size.
 	uint32 GetNumGiantAllocations() const;
 
+	/// Returns the number of bytes of the allocations larger than the max
+	/// block size, including their headers.
+	uint32 GetGiantBytes() const;
+
+	/// Returns the number of bytes of the chunks small blocks are carved
+	/// from.
+	int32 GetChunkBytes() const;
+
+	/// Returns the number of bytes of the free small blocks. Together with
+	/// GetChunkBytes() this measures the fragmentation of the chunks.
+	int32 GetFreeBytes() const;
+
 private:
 	b2Chunk* m_chunks;
 	int32 m_chunkCount;
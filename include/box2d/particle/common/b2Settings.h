@@ -108,6 +108,13 @@ typedef unsigned long long uint64;
 /// The minimum particle weight that produces pressure.
 #define b2_minParticleWeight			1.0f
 
+/// The number of steps of the compact particle positions per particle
+/// diameter. The tiles of the compact positions are 65536 steps wide.
+#define b2_particleCompactPositionSubdivisions	256
+
+/// The number of cells of the static distance field per particle diameter.
+#define b2_particleStaticFieldSubdivisions	4
+
 /// The upper limit for particle pressure.
 #define b2_maxParticlePressure		0.25f
 
@@ -203,6 +203,12 @@ public:
 		return m_freeList;
 	}
 
+	/// Get the number of bytes allocated for all the slabs.
+	std::size_t GetByteCount() const
+	{
+		return m_slabs.GetByteCount();
+	}
+
 private:
 	/// Destroy all objects in a slab and free the slab.
 	void FreeSlab(Slab * const slab)
@@ -20,9 +20,11 @@
 
 #include "particle/common/b2IntrusiveList.h"
 #include "particle/common/b2Settings.h"
+#include <cstddef>
 
-/// Alignment (in bytes) of user memory associated with b2TrackedBlock.
-const int32 b2_mallocAlignment = 32;
+/// Alignment (in bytes) of user memory associated with b2TrackedBlock. This
+/// is a cache line, so particle buffers can be read with aligned SIMD loads.
+const int32 b2_mallocAlignment = 64;
 
 /// Allocated block of memory that can be tracked in a b2IntrusiveList.
 class b2TrackedBlock : public b2TypedIntrusiveListNode<b2TrackedBlock>
@@ -37,6 +39,10 @@ public:
 	/// Get the allocated memory associated with this block.
 	void* GetMemory() const;
 
+	/// Get the number of bytes allocated for this block, including its
+	/// header and alignment padding.
+	std::size_t GetSize() const { return m_size; }
+
 private:
 	std::size_t m_size;
 
@@ -87,6 +93,9 @@ public:
 		return m_blocks;
 	}
 
+	/// Get the number of bytes allocated for all the blocks.
+	std::size_t GetByteCount() const;
+
 private:
 	b2TypedIntrusiveListNode<b2TrackedBlock> m_blocks;
 };
@@ -493,6 +493,7 @@ typedef struct b2Profile
 	float bullets;
 	float sleepIslands;
 	float sensors;
+	int particleIterations;
 } b2Profile;
 
 /// Counters that give details of the simulation size.
@@ -1383,7 +1384,16 @@ typedef enum b2HexColor
 	b2_colorBox2DYellow = 0xFFEE8C
 } b2HexColor;
 
+#ifdef __cplusplus
+// The C++ class with the same layout is in b2Particle.h.
 typedef struct b2ParticleColor b2ParticleColor;
+#else
+/// The color of a particle. Each element is 0 to 255, a is the opacity.
+typedef struct b2ParticleColor
+{
+	uint8_t r, g, b, a;
+} b2ParticleColor;
+#endif
 
 /// This struct holds callbacks you can implement to draw a Box2D world.
 /// This structure should be zero initialized.
@@ -1478,4 +1488,190 @@ typedef struct b2DebugDraw
 B2_API b2DebugDraw b2DefaultDebugDraw( void );
 
 typedef struct b2ParticleSystem b2ParticleSystem;
-typedef struct b2ParticleSystemDef b2ParticleSystemDef;
+
+/// The incompressibility solvers of a particle system.
+typedef enum b2ParticlePressureSolver
+{
+	/// Pressure is a linear function of the particle weight, scaled by
+	/// b2ParticleSystemDef::pressureStrength.
+	b2_linearPressureSolver,
+
+	/// Position-based fluids. Each substep iterates a per-particle pressure
+	/// against the weight the particles are predicted to reach at the end of
+	/// the substep, so a stiff fluid needs fewer particle iterations.
+	b2_positionBasedPressureSolver,
+} b2ParticlePressureSolver;
+
+/// The solvers of the static pressure of b2_staticPressureParticle.
+typedef enum b2StaticPressureSolver
+{
+	/// Each iteration updates all the pressures from the pressures of the
+	/// previous iteration.
+	b2_jacobiStaticPressureSolver,
+
+	/// Each iteration updates the pressures one color after the other, from
+	/// the pressures already updated by the iteration. The particles of a
+	/// color don't touch each other, so they are updated in parallel.
+	/// Reaches staticPressureTolerance in fewer iterations than
+	/// b2_jacobiStaticPressureSolver.
+	b2_gaussSeidelStaticPressureSolver,
+} b2StaticPressureSolver;
+
+/// A particle system definition is used to construct a particle system. In C initialize it with
+/// b2DefaultParticleSystemDef. In C++ the constructor sets the same defaults, see b2ParticleSystem.h.
+/// @ingroup particle_system
+typedef struct b2ParticleSystemDef
+{
+#ifdef __cplusplus
+	/// Set the default values, see b2DefaultParticleSystemDef.
+	b2ParticleSystemDef();
+#endif
+
+	/// Enable strict Particle/Body contact check.
+	/// See SetStrictContactCheck for details.
+	bool strictContactCheck;
+
+	/// Set the particle density.
+	/// See SetDensity for details.
+	float density;
+
+	/// Change the particle gravity scale. Adjusts the effect of the global
+	/// gravity vector on particles. Default value is 1.0f.
+	float gravityScale;
+
+	/// Particles behave as circles with this radius. In Box2D units.
+	float radius;
+
+	/// Set the maximum number of particles.
+	/// By default, there is no maximum. The particle buffers can continue to
+	/// grow while b2World's block allocator still has memory.
+	/// See SetMaxParticleCount for details.
+	int maxCount;
+
+	/// Increases pressure in response to compression
+	/// Smaller values allow more compression
+	float pressureStrength;
+
+	/// The incompressibility solver.
+	/// See SetPressureSolver for details.
+	b2ParticlePressureSolver pressureSolver;
+
+	/// Number of iterations of the position-based pressure solver per
+	/// particle iteration.
+	/// See SetPressureIterations for details.
+	int pressureIterations;
+
+	/// Choose the number of particle iterations of each step from the
+	/// fastest particle instead of the particleIterations argument of
+	/// b2World_Step. See SetAdaptiveIterations for details.
+	bool adaptiveIterations;
+
+	/// The largest distance a particle may move in one particle iteration
+	/// when adaptiveIterations is enabled, multiplied by the particle
+	/// diameter.
+	float iterationDisplacement;
+
+	/// The range of the number of particle iterations chosen when
+	/// adaptiveIterations is enabled.
+	int minIterations;
+	int maxIterations;
+
+	/// Reduces velocity along the collision normal
+	/// Smaller value reduces less
+	float dampingStrength;
+
+	/// Restores shape of elastic particle groups
+	/// Larger values increase elastic particle velocity
+	float elasticStrength;
+
+	/// Restores length of spring particle groups
+	/// Larger values increase spring particle velocity
+	float springStrength;
+
+	/// Reduces relative velocity of viscous particles
+	/// Larger values slow down viscous particles more
+	float viscousStrength;
+
+	/// Produces pressure on tensile particles
+	/// 0~0.2. Larger values increase the amount of surface tension.
+	float surfaceTensionPressureStrength;
+
+	/// Smoothes outline of tensile particles
+	/// 0~0.2. Larger values result in rounder, smoother, water-drop-like
+	/// clusters of particles.
+	float surfaceTensionNormalStrength;
+
+	/// Produces additional pressure on repulsive particles
+	/// Larger values repulse more
+	/// Negative values mean attraction. The range where particles behave
+	/// stably is about -0.2 to 2.0.
+	float repulsiveStrength;
+
+	/// Produces repulsion between powder particles
+	/// Larger values repulse more
+	float powderStrength;
+
+	/// Pushes particles out of solid particle group
+	/// Larger values repulse more
+	float ejectionStrength;
+
+	/// Produces static pressure
+	/// Larger values increase the pressure on neighboring partilces
+	/// For a description of static pressure, see
+	/// http://en.wikipedia.org/wiki/Static_pressure#Static_pressure_in_fluid_dynamics
+	float staticPressureStrength;
+
+	/// Reduces instability in static pressure calculation
+	/// Larger values make stabilize static pressure with fewer iterations
+	float staticPressureRelaxation;
+
+	/// Computes static pressure more precisely
+	/// See SetStaticPressureIterations for details
+	int staticPressureIterations;
+
+	/// See SetStaticPressureSolver for details.
+	b2StaticPressureSolver staticPressureSolver;
+
+	/// The static pressure iterations stop early once no pressure changes
+	/// by more than this fraction of the pressure cap.
+	/// See SetStaticPressureTolerance for details.
+	float staticPressureTolerance;
+
+	/// Determines how fast colors are mixed
+	/// 1.0f ==> mixed immediately
+	/// 0.5f ==> mixed half way each simulation step (see b2World::Step())
+	float colorMixingStrength;
+
+	/// Whether to destroy particles by age when no more particles can be
+	/// created.  See #b2ParticleSystem::SetDestructionByAge() for
+	/// more information.
+	bool destroyByAge;
+
+	/// Granularity of particle lifetimes in seconds.  By default this is
+	/// set to (1.0f / 60.0f) seconds.  b2ParticleSystem uses a 32-bit signed
+	/// value to track particle lifetimes so the maximum lifetime of a
+	/// particle is (2^32 - 1) / (1.0f / lifetimeGranularity) seconds.
+	/// With the value set to 1/60 the maximum lifetime or age of a particle is
+	/// 2.27 years.
+	float lifetimeGranularity;
+
+	/// Contact filtering data of the particles against shapes. It is tested
+	/// once per shape, like the b2Filter of two shapes.
+	b2Filter filter;
+
+	/// Collide the particles with static shapes through a distance field
+	/// baked around the particles instead of testing every shape each
+	/// particle iteration. See SetStaticDistanceField for details.
+	bool staticDistanceField;
+
+	/// Reorder the particles by position every reorderInterval steps so
+	/// that contacting particles are close in memory. 0 disables it.
+	/// See SetReorderInterval for details.
+	int reorderInterval;
+} b2ParticleSystemDef;
+
+#ifndef __cplusplus
+/// Use this to initialize your particle system definition in C.
+/// @ingroup particle_system
+B2_API b2ParticleSystemDef b2DefaultParticleSystemDef( void );
+#endif
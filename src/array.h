@@ -169,6 +169,7 @@ B2_ARRAY_DECLARE( b2Island, b2Island );
 B2_ARRAY_DECLARE( b2IslandSim, b2IslandSim );
 B2_ARRAY_DECLARE( b2Joint, b2Joint );
 B2_ARRAY_DECLARE( b2JointSim, b2JointSim );
+B2_ARRAY_DECLARE( b2ParticleSystemRef, b2ParticleSystemRef );
 B2_ARRAY_DECLARE( b2Sensor, b2Sensor );
 B2_ARRAY_DECLARE( b2SensorBeginTouchEvent, b2SensorBeginTouchEvent );
 B2_ARRAY_DECLARE( b2SensorEndTouchEvent, b2SensorEndTouchEvent );
@@ -707,6 +707,13 @@ void b2Body_SetTransform( b2BodyId bodyId, b2Vec2 position, b2Rot rotation )
 
 	b2BroadPhase* broadPhase = &world->broadPhase;
 
+	// The proxies of a static body may not move when the body moves less than
+	// their margin.
+	if ( body->type == b2_staticBody )
+	{
+		broadPhase->staticRevision += 1;
+	}
+
 	b2Transform transform = bodySim->transform;
 	const float margin = B2_AABB_MARGIN;
 	const float speculativeDistance = B2_SPECULATIVE_DISTANCE;
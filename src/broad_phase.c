@@ -41,6 +41,7 @@ void b2CreateBroadPhase( b2BroadPhase* bp )
 	bp->movePairCapacity = 0;
 	b2AtomicStoreInt(&bp->movePairIndex, 0);
 	bp->pairSet = b2CreateSet( 32 );
+	bp->staticRevision = 0;
 
 	for ( int i = 0; i < b2_bodyTypeCount; ++i )
 	{
@@ -98,6 +99,10 @@ int b2BroadPhase_CreateProxy( b2BroadPhase* bp, b2BodyType proxyType, b2AABB aab
 	{
 		b2BufferMove( bp, proxyKey );
 	}
+	if ( proxyType == b2_staticBody )
+	{
+		bp->staticRevision += 1;
+	}
 	return proxyKey;
 }
 
@@ -111,6 +116,10 @@ void b2BroadPhase_DestroyProxy( b2BroadPhase* bp, int proxyKey )
 
 	B2_ASSERT( 0 <= proxyType && proxyType <= b2_bodyTypeCount );
 	b2DynamicTree_DestroyProxy( bp->trees + proxyType, proxyId );
+	if ( proxyType == b2_staticBody )
+	{
+		bp->staticRevision += 1;
+	}
 }
 
 void b2BroadPhase_MoveProxy( b2BroadPhase* bp, int proxyKey, b2AABB aabb )
@@ -120,6 +129,10 @@ void b2BroadPhase_MoveProxy( b2BroadPhase* bp, int proxyKey, b2AABB aabb )
 
 	b2DynamicTree_MoveProxy( bp->trees + proxyType, proxyId, aabb );
 	b2BufferMove( bp, proxyKey );
+	if ( proxyType == b2_staticBody )
+	{
+		bp->staticRevision += 1;
+	}
 }
 
 void b2BroadPhase_EnlargeProxy( b2BroadPhase* bp, int proxyKey, b2AABB aabb )
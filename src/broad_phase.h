@@ -27,6 +27,11 @@ typedef struct b2BroadPhase
 {
 	b2DynamicTree trees[b2_bodyTypeCount];
 
+	// Incremented whenever a static proxy is created, destroyed or moved, or a
+	// static body is moved. Caches of the static shapes compare it to tell
+	// when they are out of date.
+	int staticRevision;
+
 	// The move set and array are used to track shapes that have moved significantly
 	// and need a pair query for new contacts. The array has a deterministic order.
 	// todo perhaps just a move set?
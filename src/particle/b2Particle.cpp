@@ -32,6 +32,10 @@ const float32 b2ParticleColor::k_inverseMaxValue =
 
 b2ParticleColor b2ParticleColor_zero(0, 0, 0, 0);
 
+// The C API passes colors as the b2ParticleColor struct of types.h.
+static_assert(sizeof(b2ParticleColor) == 4 * sizeof(uint8_t),
+			  "b2ParticleColor must have the layout of the C struct");
+
 b2ParticleColor::b2ParticleColor(const b2Color& color)
 {
 	Set(color);
@@ -0,0 +1,151 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "particle/b2ParticleEmitter.h"
+#include "particle/b2ParticleSystem.h"
+#include <math.h>
+
+// The fractional parts of the multiples of these numbers are spread evenly
+// over [0, 1) in three dimensions, which places the emitted particles
+// deterministically without clumps.
+static const double k_emitSequence[3] = {
+	0.8191725133961645, 0.6710436067037893, 0.5497004779019703
+};
+
+static inline float32 b2EmitSequence(uint32 n, int32 dimension)
+{
+	double x = 0.5 + n * k_emitSequence[dimension];
+	return (float32) (x - floor(x));
+}
+
+b2ParticleEmitter::b2ParticleEmitter()
+{
+	m_system = NULL;
+	m_slots = NULL;
+	m_expirationTimes = NULL;
+	m_capacity = 0;
+	m_head = 0;
+	m_count = 0;
+	m_time = 0;
+	m_emitRemainder = 0;
+	m_emitCount = 0;
+	m_prev = NULL;
+	m_next = NULL;
+}
+
+b2ParticleEmitter::~b2ParticleEmitter()
+{
+}
+
+b2ParticleDef b2ParticleEmitter::GetNextParticleDef()
+{
+	const uint32 n = m_emitCount++;
+	const float32 angle =
+		m_def.angle + m_def.spread * (2 * b2EmitSequence(n, 0) - 1);
+	const float32 speed =
+		m_def.speed + m_def.speedVariation * (2 * b2EmitSequence(n, 1) - 1);
+	const b2Rot direction = b2MakeRot(angle);
+	const b2Rot axis = b2MakeRot(m_def.angle);
+	b2ParticleDef def;
+	def.flags = m_def.flags;
+	def.position = m_def.position + (m_def.width * (b2EmitSequence(n, 2) - 0.5f)) *
+		b2LeftPerp(b2Rot_GetXAxis(axis));
+	def.velocity = speed * b2Rot_GetXAxis(direction);
+	def.color = m_def.color;
+	def.group = m_def.group;
+	return def;
+}
+
+void b2ParticleEmitter::Step(float32 dt)
+{
+	m_time += dt;
+
+	m_emitRemainder += m_def.rate * dt;
+	const int32 emitCount = (int32) m_emitRemainder;
+	m_emitRemainder -= emitCount;
+	for (int32 i = 0; i < emitCount; i++)
+	{
+		const b2ParticleDef def = GetNextParticleDef();
+		// Recycle the oldest particle in place when it expired or the ring is
+		// full. Otherwise create a particle, or recycle the oldest one anyway
+		// when the particle system is full, so that the emitter never makes
+		// the system destroy and compact particles during the step.
+		int32 index = b2_invalidParticleIndex;
+		if (m_count < m_capacity && CountExpiredParticles() == 0)
+		{
+			index = m_system->CreateParticleInternal(def);
+		}
+		while (index == b2_invalidParticleIndex && m_count > 0)
+		{
+			index = RecycleOldestParticle(def);
+		}
+		if (index == b2_invalidParticleIndex)
+		{
+			break;
+		}
+		const int32 tail = (m_head + m_count) % m_capacity;
+		m_slots[tail] = index;
+		m_expirationTimes[tail] = m_time + m_def.lifetime;
+		m_count++;
+	}
+
+	// Keep the expired particles the next step is expected to recycle.
+	const int32 recycledCount = (int32) ceilf(m_def.rate * dt);
+	while (CountExpiredParticles() > recycledCount)
+	{
+		m_system->DestroyParticle(PopOldestParticle());
+	}
+}
+
+int32 b2ParticleEmitter::CountExpiredParticles() const
+{
+	// The expiration times grow from the oldest to the newest particle.
+	int32 expiredCount = 0;
+	if (m_def.lifetime > 0)
+	{
+		while (expiredCount < m_count &&
+			   m_expirationTimes[(m_head + expiredCount) % m_capacity] <= m_time)
+		{
+			expiredCount++;
+		}
+	}
+	return expiredCount;
+}
+
+int32 b2ParticleEmitter::PopOldestParticle()
+{
+	b2Assert(m_count > 0);
+	const int32 index = GetSlot(0);
+	m_head = (m_head + 1) % m_capacity;
+	m_count--;
+	return index;
+}
+
+int32 b2ParticleEmitter::RecycleOldestParticle(const b2ParticleDef& def)
+{
+	const int32 index = PopOldestParticle();
+	if (m_system->RecycleParticle(index, def))
+	{
+		return index;
+	}
+	// The particle is already being destroyed or was moved to another group.
+	m_system->DestroyParticle(index);
+	return b2_invalidParticleIndex;
+}
+
+void b2ParticleEmitter::RemoveInvalidSlots()
+{
+	int32 count = 0;
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const int32 slot = (m_head + i) % m_capacity;
+		if (m_slots[slot] != b2_invalidParticleIndex)
+		{
+			const int32 newSlot = (m_head + count) % m_capacity;
+			m_slots[newSlot] = m_slots[slot];
+			m_expirationTimes[newSlot] = m_expirationTimes[slot];
+			count++;
+		}
+	}
+	m_count = count;
+}
@@ -0,0 +1,253 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "particle/b2ParticleForceField.h"
+#include "particle/b2ParticleSystem.h"
+#include "particle/b2ParticleSimd.h"
+#include <string.h>
+
+b2ParticleForceField::b2ParticleForceField()
+{
+	m_system = NULL;
+	m_gridForces = NULL;
+	m_prev = NULL;
+	m_next = NULL;
+}
+
+b2ParticleForceField::~b2ParticleForceField()
+{
+}
+
+void b2ParticleForceField::SetGridForces(const b2Vec2* forces)
+{
+	b2Assert(m_def.type == b2_gridForceField);
+	memcpy(m_gridForces, forces,
+		   sizeof(b2Vec2) * m_def.gridWidth * m_def.gridHeight);
+}
+
+b2AABB b2ParticleForceField::GetAABB() const
+{
+	b2AABB aabb;
+	switch (m_def.type)
+	{
+	case b2_radialForceField:
+	case b2_vortexForceField:
+	{
+		const b2Vec2 extents = {m_def.radius, m_def.radius};
+		aabb.lowerBound = m_def.position - extents;
+		aabb.upperBound = m_def.position + extents;
+		break;
+	}
+	case b2_directionalForceField:
+	{
+		const b2Transform xf = {m_def.position, b2Rot_identity};
+		aabb = b2ComputePolygonAABB(&m_def.polygon, xf);
+		break;
+	}
+	case b2_gridForceField:
+	{
+		const b2Vec2 extents = {
+			(m_def.gridWidth - 1) * m_def.gridSpacing,
+			(m_def.gridHeight - 1) * m_def.gridSpacing};
+		aabb.lowerBound = m_def.position;
+		aabb.upperBound = m_def.position + extents;
+		break;
+	}
+	default:
+		b2Assert(false);
+		aabb.lowerBound = aabb.upperBound = m_def.position;
+		break;
+	}
+	return aabb;
+}
+
+void b2ParticleForceField::ComputeForces_Reference(const b2Vec2* positions,
+												   const int32* indices,
+												   int32 first, int32 last,
+												   b2Vec2* forces) const
+{
+	const float32 invRadius = m_def.radius > 0 ? 1 / m_def.radius : 0;
+	const float32 invSpacing = 1 / m_def.gridSpacing;
+	const int32 width = m_def.gridWidth;
+	for (int32 i = first; i < last; i++)
+	{
+		const b2Vec2 d = positions[indices[i]] - m_def.position;
+		b2Vec2 f = b2Vec2_zero;
+		switch (m_def.type)
+		{
+		case b2_radialForceField:
+		case b2_vortexForceField:
+		{
+			const float32 distance = b2Length(d);
+			if (b2_epsilon < distance && distance < m_def.radius)
+			{
+				// Falls off linearly from the center to the radius.
+				const float32 s =
+					m_def.strength * (1 - distance * invRadius) / distance;
+				f = m_def.type == b2_radialForceField ?
+					s * d : s * b2LeftPerp(d);
+			}
+			break;
+		}
+		case b2_directionalForceField:
+		{
+			// Inside a convex polygon, the point is behind all the edges.
+			float32 separation = -b2_maxFloat;
+			for (int32 k = 0; k < m_def.polygon.count; k++)
+			{
+				separation = b2MaxFloat(separation,
+					b2Dot(m_def.polygon.normals[k],
+						  d - m_def.polygon.vertices[k]));
+			}
+			if (separation < 0)
+			{
+				f = m_def.force;
+			}
+			break;
+		}
+		case b2_gridForceField:
+		{
+			// Interpolate the samples of the cell around the particle.
+			const float32 u = b2ClampFloat(d.x * invSpacing, 0,
+										   (float32) (width - 1));
+			const float32 v = b2ClampFloat(d.y * invSpacing, 0,
+										   (float32) (m_def.gridHeight - 1));
+			const float32 cu = b2MinFloat((float32) (int32) u,
+										  (float32) (width - 2));
+			const float32 cv = b2MinFloat((float32) (int32) v,
+										  (float32) (m_def.gridHeight - 2));
+			const b2Vec2* g =
+				m_gridForces + (int32) cv * width + (int32) cu;
+			const float32 tu = u - cu;
+			const float32 tv = v - cv;
+			const b2Vec2 lower = g[0] + tu * (g[1] - g[0]);
+			const b2Vec2 upper = g[width] + tu * (g[width + 1] - g[width]);
+			f = lower + tv * (upper - lower);
+			break;
+		}
+		default:
+			b2Assert(false);
+			break;
+		}
+		forces[i] = f;
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleForceField::ComputeForces_Simd(const b2Vec2* positions,
+											  const int32* indices,
+											  int32 count,
+											  b2Vec2* forces) const
+{
+	const b2FloatW zero = b2ZeroW();
+	const b2FloatW one = b2SplatW(1);
+	const b2FloatW originX = b2SplatW(m_def.position.x);
+	const b2FloatW originY = b2SplatW(m_def.position.y);
+	const b2FloatW epsilon = b2SplatW(b2_epsilon);
+	const b2FloatW radius = b2SplatW(m_def.radius);
+	const b2FloatW invRadius =
+		b2SplatW(m_def.radius > 0 ? 1 / m_def.radius : 0);
+	const b2FloatW strength = b2SplatW(m_def.strength);
+	const b2FloatW invSpacing = b2SplatW(1 / m_def.gridSpacing);
+	const int32 width = m_def.gridWidth;
+	const b2FloatW maxU = b2SplatW((float32) (width - 1));
+	const b2FloatW maxV = b2SplatW((float32) (m_def.gridHeight - 1));
+	const b2FloatW maxCellU = b2SplatW((float32) (width - 2));
+	const b2FloatW maxCellV = b2SplatW((float32) (m_def.gridHeight - 2));
+	int32 i = 0;
+	for (; i + B2_SIMD_WIDTH <= count; i += B2_SIMD_WIDTH)
+	{
+		b2FloatW dx, dy;
+		b2GatherVec2W(positions, indices + i, &dx, &dy);
+		dx = b2SubW(dx, originX);
+		dy = b2SubW(dy, originY);
+		b2FloatW fx, fy;
+		switch (m_def.type)
+		{
+		case b2_radialForceField:
+		case b2_vortexForceField:
+		{
+			const b2FloatW distance =
+				b2SqrtW(b2AddW(b2MulW(dx, dx), b2MulW(dy, dy)));
+			const b2FloatW inside =
+				b2AndW(b2GreaterThanW(distance, epsilon),
+					   b2GreaterThanW(radius, distance));
+			const b2FloatW s = b2AndW(inside, b2DivW(
+				b2MulW(strength, b2SubW(one, b2MulW(distance, invRadius))),
+				b2MaxW(distance, epsilon)));
+			if (m_def.type == b2_radialForceField)
+			{
+				fx = b2MulW(s, dx);
+				fy = b2MulW(s, dy);
+			}
+			else
+			{
+				fx = b2SubW(zero, b2MulW(s, dy));
+				fy = b2MulW(s, dx);
+			}
+			break;
+		}
+		case b2_directionalForceField:
+		{
+			b2FloatW separation = b2SplatW(-b2_maxFloat);
+			for (int32 k = 0; k < m_def.polygon.count; k++)
+			{
+				const b2Vec2 n = m_def.polygon.normals[k];
+				const b2Vec2 v = m_def.polygon.vertices[k];
+				separation = b2MaxW(separation, b2AddW(
+					b2MulW(b2SplatW(n.x), b2SubW(dx, b2SplatW(v.x))),
+					b2MulW(b2SplatW(n.y), b2SubW(dy, b2SplatW(v.y)))));
+			}
+			const b2FloatW inside = b2GreaterThanW(zero, separation);
+			fx = b2AndW(inside, b2SplatW(m_def.force.x));
+			fy = b2AndW(inside, b2SplatW(m_def.force.y));
+			break;
+		}
+		case b2_gridForceField:
+		{
+			const b2FloatW u = b2MinW(b2MaxW(b2MulW(dx, invSpacing), zero),
+									  maxU);
+			const b2FloatW v = b2MinW(b2MaxW(b2MulW(dy, invSpacing), zero),
+									  maxV);
+			const b2FloatW cu = b2MinW(b2TruncateW(u), maxCellU);
+			const b2FloatW cv = b2MinW(b2TruncateW(v), maxCellV);
+			const b2FloatW tu = b2SubW(u, cu);
+			const b2FloatW tv = b2SubW(v, cv);
+			int32 cells[B2_SIMD_WIDTH], rows[B2_SIMD_WIDTH];
+			b2StoreIntW(cells, cu);
+			b2StoreIntW(rows, cv);
+			for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
+			{
+				cells[j] += rows[j] * width;
+			}
+			b2FloatW g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+			b2GatherVec2W(m_gridForces, cells, &g00x, &g00y);
+			b2GatherVec2W(m_gridForces + 1, cells, &g10x, &g10y);
+			b2GatherVec2W(m_gridForces + width, cells, &g01x, &g01y);
+			b2GatherVec2W(m_gridForces + width + 1, cells, &g11x, &g11y);
+			const b2FloatW lowerX = b2AddW(g00x, b2MulW(tu, b2SubW(g10x, g00x)));
+			const b2FloatW lowerY = b2AddW(g00y, b2MulW(tu, b2SubW(g10y, g00y)));
+			const b2FloatW upperX = b2AddW(g01x, b2MulW(tu, b2SubW(g11x, g01x)));
+			const b2FloatW upperY = b2AddW(g01y, b2MulW(tu, b2SubW(g11y, g01y)));
+			fx = b2AddW(lowerX, b2MulW(tv, b2SubW(upperX, lowerX)));
+			fy = b2AddW(lowerY, b2MulW(tv, b2SubW(upperY, lowerY)));
+			break;
+		}
+		default:
+			b2Assert(false);
+			fx = fy = zero;
+			break;
+		}
+		float32 x[B2_SIMD_WIDTH], y[B2_SIMD_WIDTH];
+		b2StoreW(x, fx);
+		b2StoreW(y, fy);
+		for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
+		{
+			forces[i + j] = b2Vec2{x[j], y[j]};
+		}
+	}
+	ComputeForces_Reference(positions, indices, i, count, forces);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
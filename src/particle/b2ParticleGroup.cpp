@@ -17,6 +17,7 @@
 */
 #include "particle/b2ParticleGroup.h"
 #include "particle/b2ParticleSystem.h"
+#include "particle/b2ParticleSimd.h"
 #include "world.h"
 
 b2ParticleGroup::b2ParticleGroup()
@@ -59,34 +60,96 @@ void b2ParticleGroup::SetGroupFlags(uint32 flags)
 	m_system->SetGroupFlags(this, flags);
 }
 
+// The statistics are summed in k_statisticsLaneCount lanes holding the
+// interleaved components of k_statisticsParticleCount particles, as in the
+// buffers. The SIMD and reference versions add them in the same order for any
+// SIMD width.
+static const int32 k_statisticsParticleCount = 8;
+static const int32 k_statisticsLaneCount = 2 * k_statisticsParticleCount;
+
+// Sum the lanes of the x (component 0) or y (component 1) components.
+static inline float32 b2SumLanes(const float32* sums, int32 component)
+{
+	const float32* s = sums + component;
+	return ((s[0] + s[2]) + (s[4] + s[6])) +
+		   ((s[8] + s[10]) + (s[12] + s[14]));
+}
+
+#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+
+// The SIMD versions don't contract multiplies and adds, the compiler may do
+// it in the reference versions.
+static void b2CheckLaneSums(const float32* sums, const float32* reference)
+{
+	static const float32 MAX_RELATIVE_DIFF = 1e-4f;
+	for (int32 i = 0; i < k_statisticsLaneCount; i++)
+	{
+		b2Assert(b2AbsFloat(sums[i] - reference[i]) <= MAX_RELATIVE_DIFF *
+				 b2MaxFloat(1, b2AbsFloat(reference[i])));
+	}
+}
+
+#endif // defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+
 void b2ParticleGroup::UpdateStatistics() const
 {
 	if (m_timestamp != m_system->m_timestamp)
 	{
+		const int32 count = m_lastIndex - m_firstIndex;
 		float32 m = m_system->GetParticleMass();
-		m_mass = 0;
-		m_center = b2Vec2_zero;
-		m_linearVelocity = b2Vec2_zero;
-		for (int32 i = m_firstIndex; i < m_lastIndex; i++)
+
+		float32 positionSums[k_statisticsLaneCount] = {0};
+		float32 velocitySums[k_statisticsLaneCount] = {0};
+		#if defined(B2_PARTICLE_SIMD)
+			SumLinear_Simd(positionSums, velocitySums);
+		#else
+			SumLinear_Reference(m_firstIndex, m_lastIndex, positionSums,
+								velocitySums);
+		#endif
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 		{
-			m_mass += m;
-			m_center += m * m_system->m_positionBuffer.data[i];
-			m_linearVelocity += m * m_system->m_velocityBuffer.data[i];
+			float32 positions[k_statisticsLaneCount] = {0};
+			float32 velocities[k_statisticsLaneCount] = {0};
+			SumLinear_Reference(m_firstIndex, m_lastIndex, positions,
+								velocities);
+			b2CheckLaneSums(positionSums, positions);
+			b2CheckLaneSums(velocitySums, velocities);
 		}
-		if (m_mass > 0)
+		#endif
+		m_mass = m * count;
+		m_center.x = b2SumLanes(positionSums, 0);
+		m_center.y = b2SumLanes(positionSums, 1);
+		m_linearVelocity.x = b2SumLanes(velocitySums, 0);
+		m_linearVelocity.y = b2SumLanes(velocitySums, 1);
+		if (count > 0)
 		{
-			m_center *= 1 / m_mass;
-			m_linearVelocity *= 1 / m_mass;
+			// The particles share one mass, so it cancels out.
+			m_center *= 1.0f / count;
+			m_linearVelocity *= 1.0f / count;
 		}
-		m_inertia = 0;
-		m_angularVelocity = 0;
-		for (int32 i = m_firstIndex; i < m_lastIndex; i++)
+
+		float32 inertiaSums[k_statisticsLaneCount] = {0};
+		float32 angularSums[k_statisticsLaneCount] = {0};
+		#if defined(B2_PARTICLE_SIMD)
+			SumAngular_Simd(inertiaSums, angularSums);
+		#else
+			SumAngular_Reference(m_firstIndex, m_lastIndex, inertiaSums,
+								 angularSums);
+		#endif
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 		{
-			b2Vec2 p = m_system->m_positionBuffer.data[i] - m_center;
-			b2Vec2 v = m_system->m_velocityBuffer.data[i] - m_linearVelocity;
-			m_inertia += m * b2Dot(p, p);
-			m_angularVelocity += m * b2Cross(p, v);
+			float32 inertia[k_statisticsLaneCount] = {0};
+			float32 angular[k_statisticsLaneCount] = {0};
+			SumAngular_Reference(m_firstIndex, m_lastIndex, inertia, angular);
+			b2CheckLaneSums(inertiaSums, inertia);
+			b2CheckLaneSums(angularSums, angular);
 		}
+		#endif
+		// The angular lanes hold r.x * u.y in x and r.y * u.x in y.
+		m_inertia = m * (b2SumLanes(inertiaSums, 0) +
+						 b2SumLanes(inertiaSums, 1));
+		m_angularVelocity = m * (b2SumLanes(angularSums, 0) -
+								 b2SumLanes(angularSums, 1));
 		if (m_inertia > 0)
 		{
 			m_angularVelocity *= 1 / m_inertia;
@@ -95,6 +158,127 @@ void b2ParticleGroup::UpdateStatistics() const
 	}
 }
 
+void b2ParticleGroup::SumLinear_Reference(int32 first, int32 last,
+										  float32* positionSums,
+										  float32* velocitySums) const
+{
+	const b2Vec2* positions = m_system->m_positionBuffer.data;
+	const b2Vec2* velocities = m_system->m_velocityBuffer.data;
+	for (int32 i = first; i < last; i++)
+	{
+		const int32 lane =
+			2 * ((i - m_firstIndex) % k_statisticsParticleCount);
+		positionSums[lane] += positions[i].x;
+		positionSums[lane + 1] += positions[i].y;
+		velocitySums[lane] += velocities[i].x;
+		velocitySums[lane + 1] += velocities[i].y;
+	}
+}
+
+void b2ParticleGroup::SumAngular_Reference(int32 first, int32 last,
+										   float32* inertiaSums,
+										   float32* angularSums) const
+{
+	const b2Vec2* positions = m_system->m_positionBuffer.data;
+	const b2Vec2* velocities = m_system->m_velocityBuffer.data;
+	for (int32 i = first; i < last; i++)
+	{
+		const int32 lane =
+			2 * ((i - m_firstIndex) % k_statisticsParticleCount);
+		const b2Vec2 r = positions[i] - m_center;
+		const b2Vec2 u = velocities[i] - m_linearVelocity;
+		inertiaSums[lane] += r.x * r.x;
+		inertiaSums[lane + 1] += r.y * r.y;
+		angularSums[lane] += r.x * u.y;
+		angularSums[lane + 1] += r.y * u.x;
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+// The lanes of a batch of particles fill this many wide floats.
+static const int32 k_statisticsRegisterCount =
+	k_statisticsLaneCount / B2_SIMD_WIDTH;
+
+void b2ParticleGroup::SumLinear_Simd(float32* positionSums,
+									 float32* velocitySums) const
+{
+	const float32* positions = &m_system->m_positionBuffer.data->x;
+	const float32* velocities = &m_system->m_velocityBuffer.data->x;
+	const int32 count = m_lastIndex - m_firstIndex;
+	const int32 batchEnd =
+		m_lastIndex - count % k_statisticsParticleCount;
+	b2FloatW p[k_statisticsRegisterCount], v[k_statisticsRegisterCount];
+	for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+	{
+		p[k] = b2LoadW(positionSums + k * B2_SIMD_WIDTH);
+		v[k] = b2LoadW(velocitySums + k * B2_SIMD_WIDTH);
+	}
+	for (int32 i = m_firstIndex; i < batchEnd;
+		 i += k_statisticsParticleCount)
+	{
+		for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+		{
+			const int32 offset = 2 * i + k * B2_SIMD_WIDTH;
+			p[k] = b2AddW(p[k], b2LoadW(positions + offset));
+			v[k] = b2AddW(v[k], b2LoadW(velocities + offset));
+		}
+	}
+	for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+	{
+		b2StoreW(positionSums + k * B2_SIMD_WIDTH, p[k]);
+		b2StoreW(velocitySums + k * B2_SIMD_WIDTH, v[k]);
+	}
+	SumLinear_Reference(batchEnd, m_lastIndex, positionSums, velocitySums);
+}
+
+void b2ParticleGroup::SumAngular_Simd(float32* inertiaSums,
+									  float32* angularSums) const
+{
+	const float32* positions = &m_system->m_positionBuffer.data->x;
+	const float32* velocities = &m_system->m_velocityBuffer.data->x;
+	const int32 count = m_lastIndex - m_firstIndex;
+	const int32 batchEnd =
+		m_lastIndex - count % k_statisticsParticleCount;
+	float32 center[B2_SIMD_WIDTH], linearVelocity[B2_SIMD_WIDTH];
+	for (int32 j = 0; j < B2_SIMD_WIDTH; j += 2)
+	{
+		center[j] = m_center.x;
+		center[j + 1] = m_center.y;
+		linearVelocity[j] = m_linearVelocity.x;
+		linearVelocity[j + 1] = m_linearVelocity.y;
+	}
+	const b2FloatW c = b2LoadW(center);
+	const b2FloatW lv = b2LoadW(linearVelocity);
+	b2FloatW inertia[k_statisticsRegisterCount];
+	b2FloatW angular[k_statisticsRegisterCount];
+	for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+	{
+		inertia[k] = b2LoadW(inertiaSums + k * B2_SIMD_WIDTH);
+		angular[k] = b2LoadW(angularSums + k * B2_SIMD_WIDTH);
+	}
+	for (int32 i = m_firstIndex; i < batchEnd;
+		 i += k_statisticsParticleCount)
+	{
+		for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+		{
+			const int32 offset = 2 * i + k * B2_SIMD_WIDTH;
+			const b2FloatW r = b2SubW(b2LoadW(positions + offset), c);
+			const b2FloatW u = b2SubW(b2LoadW(velocities + offset), lv);
+			inertia[k] = b2AddW(inertia[k], b2MulW(r, r));
+			angular[k] = b2AddW(angular[k], b2MulW(r, b2SwapPairsW(u)));
+		}
+	}
+	for (int32 k = 0; k < k_statisticsRegisterCount; k++)
+	{
+		b2StoreW(inertiaSums + k * B2_SIMD_WIDTH, inertia[k]);
+		b2StoreW(angularSums + k * B2_SIMD_WIDTH, angular[k]);
+	}
+	SumAngular_Reference(batchEnd, m_lastIndex, inertiaSums, angularSums);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
 void b2ParticleGroup::ApplyForce(const b2Vec2& force)
 {
 	m_system->ApplyForce(m_firstIndex, m_lastIndex, force);
@@ -0,0 +1,291 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef B2_PARTICLE_SIMD_H
+#define B2_PARTICLE_SIMD_H
+
+#include "particle/common/b2Settings.h"
+#include "core.h"
+#include "box2d/math_functions.h"
+
+// Wide floats for the particle contact solvers, following the conventions
+// of the contact solver. B2_PARTICLE_SIMD is defined when they map to
+// SSE2 or AVX2; the solvers use their scalar reference versions otherwise.
+#if defined( B2_SIMD_AVX2 )
+
+#include <immintrin.h>
+
+#define B2_PARTICLE_SIMD
+
+// wide float holds 8 numbers
+typedef __m256 b2FloatW;
+
+static inline b2FloatW b2ZeroW()
+{
+	return _mm256_setzero_ps();
+}
+
+static inline b2FloatW b2SplatW( float32 scalar )
+{
+	return _mm256_set1_ps( scalar );
+}
+
+static inline b2FloatW b2LoadW( const float32* data )
+{
+	return _mm256_loadu_ps( data );
+}
+
+static inline void b2StoreW( float32* data, b2FloatW a )
+{
+	_mm256_storeu_ps( data, a );
+}
+
+static inline b2FloatW b2AddW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_add_ps( a, b );
+}
+
+static inline b2FloatW b2SubW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_sub_ps( a, b );
+}
+
+static inline b2FloatW b2MulW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_mul_ps( a, b );
+}
+
+static inline b2FloatW b2DivW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_div_ps( a, b );
+}
+
+static inline b2FloatW b2SqrtW( b2FloatW a )
+{
+	return _mm256_sqrt_ps( a );
+}
+
+static inline b2FloatW b2AndW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_and_ps( a, b );
+}
+
+// Round toward zero.
+static inline b2FloatW b2TruncateW( b2FloatW a )
+{
+	return _mm256_round_ps( a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+}
+
+// Store the components, rounded toward zero, as integers.
+static inline void b2StoreIntW( int32* data, b2FloatW a )
+{
+	_mm256_storeu_si256( (__m256i*)data, _mm256_cvttps_epi32( a ) );
+}
+
+static inline b2FloatW b2MinW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_min_ps( a, b );
+}
+
+static inline b2FloatW b2MaxW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_max_ps( a, b );
+}
+
+static inline b2FloatW b2GreaterThanW( b2FloatW a, b2FloatW b )
+{
+	return _mm256_cmp_ps( a, b, _CMP_GT_OQ );
+}
+
+// One bit per component, set when the component of a mask is set.
+static inline int32 b2MaskBitsW( b2FloatW mask )
+{
+	return _mm256_movemask_ps( mask );
+}
+
+// Load values[indices[i]] into component i.
+static inline b2FloatW b2GatherW( const float32* values, const int32* indices )
+{
+	__m256i index = _mm256_loadu_si256( (const __m256i*)indices );
+	return _mm256_i32gather_ps( values, index, 4 );
+}
+
+// Load the components of values[indices[i]] into component i of x and y.
+static inline void b2GatherVec2W( const b2Vec2* values, const int32* indices, b2FloatW* x, b2FloatW* y )
+{
+	__m256i index = _mm256_loadu_si256( (const __m256i*)indices );
+	*x = _mm256_i32gather_ps( &values->x, index, 8 );
+	*y = _mm256_i32gather_ps( &values->y, index, 8 );
+}
+
+// Swap the components of each pair, (a0, a1, a2, a3...) -> (a1, a0, a3, a2...).
+static inline b2FloatW b2SwapPairsW( b2FloatW a )
+{
+	return _mm256_permute_ps( a, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+}
+
+// The same approximation as b2InvSqrt.
+static inline b2FloatW b2InvSqrtW( b2FloatW a )
+{
+	__m256i i = _mm256_sub_epi32( _mm256_set1_epi32( 0x5f3759df ), _mm256_srai_epi32( _mm256_castps_si256( a ), 1 ) );
+	__m256 x = _mm256_castsi256_ps( i );
+	__m256 xhalf = _mm256_mul_ps( _mm256_set1_ps( 0.5f ), a );
+	return _mm256_mul_ps( x, _mm256_sub_ps( _mm256_set1_ps( 1.5f ), _mm256_mul_ps( _mm256_mul_ps( xhalf, x ), x ) ) );
+}
+
+#elif defined( B2_SIMD_SSE2 )
+
+#include <emmintrin.h>
+
+#define B2_PARTICLE_SIMD
+
+// wide float holds 4 numbers
+typedef __m128 b2FloatW;
+
+static inline b2FloatW b2ZeroW()
+{
+	return _mm_setzero_ps();
+}
+
+static inline b2FloatW b2SplatW( float32 scalar )
+{
+	return _mm_set1_ps( scalar );
+}
+
+static inline b2FloatW b2LoadW( const float32* data )
+{
+	return _mm_loadu_ps( data );
+}
+
+static inline void b2StoreW( float32* data, b2FloatW a )
+{
+	_mm_storeu_ps( data, a );
+}
+
+static inline b2FloatW b2AddW( b2FloatW a, b2FloatW b )
+{
+	return _mm_add_ps( a, b );
+}
+
+static inline b2FloatW b2SubW( b2FloatW a, b2FloatW b )
+{
+	return _mm_sub_ps( a, b );
+}
+
+static inline b2FloatW b2MulW( b2FloatW a, b2FloatW b )
+{
+	return _mm_mul_ps( a, b );
+}
+
+static inline b2FloatW b2DivW( b2FloatW a, b2FloatW b )
+{
+	return _mm_div_ps( a, b );
+}
+
+static inline b2FloatW b2SqrtW( b2FloatW a )
+{
+	return _mm_sqrt_ps( a );
+}
+
+static inline b2FloatW b2AndW( b2FloatW a, b2FloatW b )
+{
+	return _mm_and_ps( a, b );
+}
+
+// Round toward zero. SSE2 has no rounding, the components must fit in int32.
+static inline b2FloatW b2TruncateW( b2FloatW a )
+{
+	return _mm_cvtepi32_ps( _mm_cvttps_epi32( a ) );
+}
+
+// Store the components, rounded toward zero, as integers.
+static inline void b2StoreIntW( int32* data, b2FloatW a )
+{
+	_mm_storeu_si128( (__m128i*)data, _mm_cvttps_epi32( a ) );
+}
+
+static inline b2FloatW b2MinW( b2FloatW a, b2FloatW b )
+{
+	return _mm_min_ps( a, b );
+}
+
+static inline b2FloatW b2MaxW( b2FloatW a, b2FloatW b )
+{
+	return _mm_max_ps( a, b );
+}
+
+static inline b2FloatW b2GreaterThanW( b2FloatW a, b2FloatW b )
+{
+	return _mm_cmpgt_ps( a, b );
+}
+
+// One bit per component, set when the component of a mask is set.
+static inline int32 b2MaskBitsW( b2FloatW mask )
+{
+	return _mm_movemask_ps( mask );
+}
+
+// Load values[indices[i]] into component i. SSE2 has no gather.
+static inline b2FloatW b2GatherW( const float32* values, const int32* indices )
+{
+	return _mm_setr_ps( values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]] );
+}
+
+// Load the components of values[indices[i]] into component i of x and y.
+static inline void b2GatherVec2W( const b2Vec2* values, const int32* indices, b2FloatW* x, b2FloatW* y )
+{
+	// Two vectors per register, then split the x and y components.
+	__m128 ab = _mm_loadl_pi( _mm_setzero_ps(), (const __m64*)( values + indices[0] ) );
+	ab = _mm_loadh_pi( ab, (const __m64*)( values + indices[1] ) );
+	__m128 cd = _mm_loadl_pi( _mm_setzero_ps(), (const __m64*)( values + indices[2] ) );
+	cd = _mm_loadh_pi( cd, (const __m64*)( values + indices[3] ) );
+	*x = _mm_shuffle_ps( ab, cd, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+	*y = _mm_shuffle_ps( ab, cd, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+}
+
+// Swap the components of each pair, (a0, a1, a2, a3) -> (a1, a0, a3, a2).
+static inline b2FloatW b2SwapPairsW( b2FloatW a )
+{
+	return _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+}
+
+// The same approximation as b2InvSqrt.
+static inline b2FloatW b2InvSqrtW( b2FloatW a )
+{
+	__m128i i = _mm_sub_epi32( _mm_set1_epi32( 0x5f3759df ), _mm_srai_epi32( _mm_castps_si128( a ), 1 ) );
+	__m128 x = _mm_castsi128_ps( i );
+	__m128 xhalf = _mm_mul_ps( _mm_set1_ps( 0.5f ), a );
+	return _mm_mul_ps( x, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( _mm_mul_ps( xhalf, x ), x ) ) );
+}
+
+#endif
+
+#if defined( B2_PARTICLE_SIMD )
+
+// Mix 4 pairs of colors, each packed into 32 bits, the same way as
+// b2ParticleColor::MixColors. 'strength' must be in [0, 128].
+static inline void b2MixColors4( __m128i* colorsA, __m128i* colorsB, int32 strength )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowByte = _mm_set1_epi16( 0xff );
+	const __m128i s = _mm_set1_epi16( (int16)strength );
+	__m128i aLo = _mm_unpacklo_epi8( *colorsA, zero );
+	__m128i aHi = _mm_unpackhi_epi8( *colorsA, zero );
+	__m128i bLo = _mm_unpacklo_epi8( *colorsB, zero );
+	__m128i bHi = _mm_unpackhi_epi8( *colorsB, zero );
+	// strength <= 128 so the products fit in 16 bits. The shift is
+	// b2ParticleColor::k_bitsPerComponent.
+	__m128i dLo = _mm_srai_epi16( _mm_mullo_epi16( s, _mm_sub_epi16( bLo, aLo ) ), 8 );
+	__m128i dHi = _mm_srai_epi16( _mm_mullo_epi16( s, _mm_sub_epi16( bHi, aHi ) ), 8 );
+	// The components wrap around like the uint8 arithmetic of MixColors.
+	aLo = _mm_and_si128( _mm_add_epi16( aLo, dLo ), lowByte );
+	aHi = _mm_and_si128( _mm_add_epi16( aHi, dHi ), lowByte );
+	bLo = _mm_and_si128( _mm_sub_epi16( bLo, dLo ), lowByte );
+	bHi = _mm_and_si128( _mm_sub_epi16( bHi, dHi ), lowByte );
+	*colorsA = _mm_packus_epi16( aLo, aHi );
+	*colorsB = _mm_packus_epi16( bLo, bHi );
+}
+
+#endif
+
+#endif
@@ -0,0 +1,600 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "particle/b2ParticleSurface.h"
+#include "particle/b2ParticleSystem.h"
+#include "core.h"
+#include "world.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// A particle and one of the tiles its density kernel overlaps.
+struct b2ParticleSurface::TileParticle
+{
+	uint64 key;
+	/// Position of the particle in the proxy buffer, which keeps the
+	/// particles of a tile close in space.
+	int32 order;
+	int32 index;
+
+	bool operator<(const TileParticle& b) const
+	{
+		return key < b.key || (key == b.key && order < b.order);
+	}
+};
+
+struct b2ParticleSurface::Tile
+{
+	uint64 key;
+	int32 x, y;
+	/// Range of the tile in the tile particles.
+	int32 firstParticle;
+	int32 particleCount;
+	/// Hash of the quantized particle positions of the last extraction.
+	uint64 signature;
+	bool extracted;
+	bool updated;
+	b2Vec2* vertices;
+	int32 vertexCount;
+	int32 vertexCapacity;
+	int32* indices;
+	int32 indexCount;
+	int32 indexCapacity;
+
+	int32 AddVertex(const b2Vec2& vertex)
+	{
+		if (vertexCount == vertexCapacity)
+		{
+			const int32 capacity = b2MaxInt(2 * vertexCapacity, 64);
+			b2Vec2* grown = (b2Vec2*) b2Alloc(sizeof(b2Vec2) * capacity);
+			if (vertices)
+			{
+				memcpy(grown, vertices, sizeof(b2Vec2) * vertexCount);
+				b2Free(vertices, sizeof(b2Vec2) * vertexCapacity);
+			}
+			vertices = grown;
+			vertexCapacity = capacity;
+		}
+		vertices[vertexCount] = vertex;
+		return vertexCount++;
+	}
+
+	void AddIndex(int32 index)
+	{
+		if (indexCount == indexCapacity)
+		{
+			const int32 capacity = b2MaxInt(2 * indexCapacity, 128);
+			int32* grown = (int32*) b2Alloc(sizeof(int32) * capacity);
+			if (indices)
+			{
+				memcpy(grown, indices, sizeof(int32) * indexCount);
+				b2Free(indices, sizeof(int32) * indexCapacity);
+			}
+			indices = grown;
+			indexCapacity = capacity;
+		}
+		indices[indexCount++] = index;
+	}
+
+	void Free()
+	{
+		if (vertices)
+		{
+			b2Free(vertices, sizeof(b2Vec2) * vertexCapacity);
+		}
+		if (indices)
+		{
+			b2Free(indices, sizeof(int32) * indexCapacity);
+		}
+		vertices = NULL;
+		indices = NULL;
+		vertexCapacity = indexCapacity = 0;
+		vertexCount = indexCount = 0;
+		extracted = false;
+	}
+};
+
+struct b2ParticleSurface::UpdateContext
+{
+	const b2Vec2* positions;
+	const TileParticle* particles;
+	Tile* tiles;
+	b2ParticleSurfaceType type;
+	bool incremental;
+	int32 cellCount;
+	float32 cellSize;
+	float32 smoothingLength;
+	/// The density of the surface, before normalization.
+	float32 threshold;
+	float32 invTolerance;
+};
+
+// Keys sort the tiles by row, then by column.
+static inline uint64 b2MakeTileKey(int32 x, int32 y)
+{
+	return ((uint64) ((uint32) y ^ 0x80000000u) << 32) |
+		(uint64) ((uint32) x ^ 0x80000000u);
+}
+
+// Mixes the bits of a quantized position, see splitmix64.
+static inline uint64 b2HashCell(int32 x, int32 y)
+{
+	uint64 h = ((uint64) (uint32) x << 32) | (uint32) y;
+	h += 0x9e3779b97f4a7c15ull;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+	return h ^ (h >> 31);
+}
+
+b2ParticleSurface::b2ParticleSurface(const b2ParticleSurfaceDef& def)
+{
+	b2Assert(def.cellSize >= 0 && def.smoothingLength >= 0);
+	b2Assert(def.tileCellCount > 0);
+	m_def = def;
+	m_tileParticles = NULL;
+	m_tileParticleCount = 0;
+	m_tileParticleCapacity = 0;
+	m_tiles = NULL;
+	m_tileCount = 0;
+	m_tileCapacity = 0;
+	m_updatedTileCount = 0;
+	m_vertices = NULL;
+	m_vertexCount = 0;
+	m_vertexCapacity = 0;
+	m_indices = NULL;
+	m_indexCount = 0;
+	m_indexCapacity = 0;
+}
+
+b2ParticleSurface::~b2ParticleSurface()
+{
+	for (int32 k = 0; k < m_tileCount; k++)
+	{
+		m_tiles[k].Free();
+	}
+	if (m_tiles)
+	{
+		b2Free(m_tiles, sizeof(Tile) * m_tileCapacity);
+	}
+	if (m_tileParticles)
+	{
+		b2Free(m_tileParticles, sizeof(TileParticle) * m_tileParticleCapacity);
+	}
+	if (m_vertices)
+	{
+		b2Free(m_vertices, sizeof(b2Vec2) * m_vertexCapacity);
+	}
+	if (m_indices)
+	{
+		b2Free(m_indices, sizeof(int32) * m_indexCapacity);
+	}
+}
+
+int32 b2ParticleSurface::FindTileParticles(const b2ParticleSystem* system,
+										   float32 smoothingLength,
+										   float32 tileSize)
+{
+	const b2Vec2* positions = system->m_positionBuffer.data;
+	const uint32* flags = system->m_flagsBuffer.data;
+	// The dynamic proxies, then the static ones.
+	const b2ParticleSystem::Proxy* proxies = system->m_proxyBuffer.Data();
+	const int32 dynamicCount = system->m_proxyBuffer.GetCount();
+	const b2ParticleSystem::Proxy* staticProxies =
+		system->m_staticProxyBuffer.Data();
+	const int32 proxyCount =
+		dynamicCount + system->m_staticProxyBuffer.GetCount();
+	const float32 invTileSize = 1 / tileSize;
+	int32 count = 0;
+	for (int32 order = 0; order < proxyCount; order++)
+	{
+		const int32 i = order < dynamicCount ? proxies[order].index :
+			staticProxies[order - dynamicCount].index;
+		if (flags[i] & b2_zombieParticle)
+		{
+			continue;
+		}
+		const b2Vec2& p = positions[i];
+		const int32 x0 = (int32) floorf((p.x - smoothingLength) * invTileSize);
+		const int32 x1 = (int32) floorf((p.x + smoothingLength) * invTileSize);
+		const int32 y0 = (int32) floorf((p.y - smoothingLength) * invTileSize);
+		const int32 y1 = (int32) floorf((p.y + smoothingLength) * invTileSize);
+		// The tiles are at least as large as the kernel, so a particle
+		// overlaps at most 3 x 3 tiles.
+		const int32 required = count + (x1 - x0 + 1) * (y1 - y0 + 1);
+		if (required > m_tileParticleCapacity)
+		{
+			const int32 capacity = b2MaxInt(2 * m_tileParticleCapacity,
+				b2MaxInt(required, 2 * proxyCount));
+			TileParticle* grown =
+				(TileParticle*) b2Alloc(sizeof(TileParticle) * capacity);
+			if (m_tileParticles)
+			{
+				memcpy(grown, m_tileParticles, sizeof(TileParticle) * count);
+				b2Free(m_tileParticles,
+					   sizeof(TileParticle) * m_tileParticleCapacity);
+			}
+			m_tileParticles = grown;
+			m_tileParticleCapacity = capacity;
+		}
+		for (int32 y = y0; y <= y1; y++)
+		{
+			for (int32 x = x0; x <= x1; x++)
+			{
+				TileParticle& particle = m_tileParticles[count++];
+				particle.key = b2MakeTileKey(x, y);
+				particle.order = order;
+				particle.index = i;
+			}
+		}
+	}
+	std::sort(m_tileParticles, m_tileParticles + count);
+	return count;
+}
+
+void b2ParticleSurface::UpdateTiles()
+{
+	int32 tileCount = 0;
+	for (int32 k = 0; k < m_tileParticleCount; k++)
+	{
+		tileCount += k == 0 ||
+			m_tileParticles[k].key != m_tileParticles[k - 1].key;
+	}
+	const int32 capacity = b2MaxInt(tileCount, 1);
+	Tile* tiles = (Tile*) b2Alloc(sizeof(Tile) * capacity);
+
+	// Both lists are sorted by key, the tiles which still have particles
+	// keep their geometry.
+	int32 previous = 0;
+	int32 count = 0;
+	for (int32 k = 0; k < m_tileParticleCount; )
+	{
+		const uint64 key = m_tileParticles[k].key;
+		int32 end = k + 1;
+		while (end < m_tileParticleCount && m_tileParticles[end].key == key)
+		{
+			end++;
+		}
+		while (previous < m_tileCount && m_tiles[previous].key < key)
+		{
+			m_tiles[previous++].Free();
+		}
+		Tile& tile = tiles[count++];
+		if (previous < m_tileCount && m_tiles[previous].key == key)
+		{
+			tile = m_tiles[previous++];
+		}
+		else
+		{
+			memset(&tile, 0, sizeof(Tile));
+			tile.key = key;
+			tile.x = (int32) ((uint32) key ^ 0x80000000u);
+			tile.y = (int32) ((uint32) (key >> 32) ^ 0x80000000u);
+		}
+		tile.firstParticle = k;
+		tile.particleCount = end - k;
+		tile.updated = false;
+		k = end;
+	}
+	while (previous < m_tileCount)
+	{
+		m_tiles[previous++].Free();
+	}
+	b2Assert(count == tileCount);
+
+	if (m_tiles)
+	{
+		b2Free(m_tiles, sizeof(Tile) * m_tileCapacity);
+	}
+	m_tiles = tiles;
+	m_tileCount = tileCount;
+	m_tileCapacity = capacity;
+}
+
+void b2ParticleSurface::ExtractTile(const UpdateContext& context, Tile* tile,
+									const TileParticle* particles)
+{
+	const int32 cellCount = context.cellCount;
+	const int32 sampleCount = cellCount + 1;
+	const float32 cellSize = context.cellSize;
+	const float32 h = context.smoothingLength;
+	const float32 invH2 = 1 / (h * h);
+	const float32 threshold = context.threshold;
+	const b2Vec2 origin = {
+		tile->x * cellCount * cellSize, tile->y * cellCount * cellSize};
+
+	// Density samples, then the vertices of the sample points and of the
+	// crossings of the horizontal and vertical cell edges.
+	const int32 scratchCount =
+		2 * sampleCount * sampleCount + 2 * sampleCount * cellCount;
+	void* scratch = b2Alloc(sizeof(int32) * scratchCount);
+	float32* density = (float32*) scratch;
+	int32* sampleVertices = (int32*) (density + sampleCount * sampleCount);
+	int32* xEdgeVertices = sampleVertices + sampleCount * sampleCount;
+	int32* yEdgeVertices = xEdgeVertices + sampleCount * cellCount;
+	memset(density, 0, sizeof(float32) * sampleCount * sampleCount);
+	memset(sampleVertices, 0xff, sizeof(int32) *
+		   (sampleCount * sampleCount + 2 * sampleCount * cellCount));
+
+	// Splat the density kernel (1 - r^2 / h^2)^2 of the particles.
+	const float32 invCellSize = 1 / cellSize;
+	for (int32 k = 0; k < tile->particleCount; k++)
+	{
+		const b2Vec2 p = context.positions[particles[k].index] - origin;
+		const int32 i0 = b2MaxInt((int32) ceilf((p.x - h) * invCellSize), 0);
+		const int32 i1 = b2MinInt((int32) floorf((p.x + h) * invCellSize),
+								  cellCount);
+		const int32 j0 = b2MaxInt((int32) ceilf((p.y - h) * invCellSize), 0);
+		const int32 j1 = b2MinInt((int32) floorf((p.y + h) * invCellSize),
+								  cellCount);
+		for (int32 j = j0; j <= j1; j++)
+		{
+			const float32 dy = j * cellSize - p.y;
+			float32* row = density + j * sampleCount;
+			for (int32 i = i0; i <= i1; i++)
+			{
+				const float32 dx = i * cellSize - p.x;
+				const float32 r2 = dx * dx + dy * dy;
+				if (r2 < h * h)
+				{
+					const float32 w = 1 - r2 * invH2;
+					row[i] += w * w;
+				}
+			}
+		}
+	}
+
+	// March the squares. The corners and the edges of a cell are numbered
+	// counterclockwise from the bottom left corner and the bottom edge.
+	static const int32 k_cornerOffsets[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+	const bool triangles = context.type == b2_surfaceTriangles;
+	tile->vertexCount = 0;
+	tile->indexCount = 0;
+	for (int32 j = 0; j < cellCount; j++)
+	{
+		for (int32 i = 0; i < cellCount; i++)
+		{
+			float32 values[4];
+			int32 inside = 0;
+			for (int32 c = 0; c < 4; c++)
+			{
+				values[c] = density[(j + k_cornerOffsets[c][1]) * sampleCount +
+									i + k_cornerOffsets[c][0]];
+				inside |= (values[c] >= threshold) << c;
+			}
+			if (inside == 0 || (inside == 15 && !triangles))
+			{
+				continue;
+			}
+
+			// Walk around the cell and collect the inside corners and the
+			// crossings, negated to tell them apart.
+			int32 ring[8];
+			int32 ringCount = 0;
+			for (int32 c = 0; c < 4; c++)
+			{
+				const int32 d = (c + 1) & 3;
+				const bool insideC = (inside >> c) & 1;
+				if (insideC && triangles)
+				{
+					const int32 si = i + k_cornerOffsets[c][0];
+					const int32 sj = j + k_cornerOffsets[c][1];
+					int32& vertex = sampleVertices[sj * sampleCount + si];
+					if (vertex < 0)
+					{
+						vertex = tile->AddVertex(origin +
+							b2Vec2{si * cellSize, sj * cellSize});
+					}
+					ring[ringCount++] = vertex;
+				}
+				else if (insideC)
+				{
+					// Corners only matter to the triangles.
+					ring[ringCount++] = b2_invalidParticleIndex;
+				}
+				if (insideC != (bool) ((inside >> d) & 1))
+				{
+					int32* vertex;
+					switch (c)
+					{
+					case 0: vertex = &xEdgeVertices[j * cellCount + i]; break;
+					case 1: vertex = &yEdgeVertices[j * sampleCount + i + 1]; break;
+					case 2: vertex = &xEdgeVertices[(j + 1) * cellCount + i]; break;
+					default: vertex = &yEdgeVertices[j * sampleCount + i]; break;
+					}
+					if (*vertex < 0)
+					{
+						const float32 t =
+							(threshold - values[c]) / (values[d] - values[c]);
+						const b2Vec2 a = {
+							(float32) (i + k_cornerOffsets[c][0]),
+							(float32) (j + k_cornerOffsets[c][1])};
+						const b2Vec2 b = {
+							(float32) (i + k_cornerOffsets[d][0]),
+							(float32) (j + k_cornerOffsets[d][1])};
+						*vertex = tile->AddVertex(origin +
+							cellSize * (a + t * (b - a)));
+					}
+					ring[ringCount++] = -2 - *vertex;
+				}
+			}
+
+			// The saddles split into two triangles around their inside
+			// corners, unless the center of the cell is inside.
+			int32 polygonStarts[3] = {0, ringCount, ringCount};
+			int32 polygonCount = 1;
+			if ((inside == 5 || inside == 10) &&
+				values[0] + values[1] + values[2] + values[3] < 4 * threshold)
+			{
+				// The ring is [c0, e0, e1, c2, e2, e3] for case 5 and
+				// [e0, c1, e1, e2, c3, e3] for case 10. Rotate the first into
+				// [e3, c0, e0, e1, c2, e2] to cut both rings in halves.
+				if (inside == 5)
+				{
+					const int32 last = ring[5];
+					memmove(ring + 1, ring, sizeof(int32) * 5);
+					ring[0] = last;
+				}
+				polygonStarts[1] = 3;
+				polygonStarts[2] = 6;
+				polygonCount = 2;
+			}
+
+			for (int32 g = 0; g < polygonCount; g++)
+			{
+				const int32* polygon = ring + polygonStarts[g];
+				const int32 n = polygonStarts[g + 1] - polygonStarts[g];
+				for (int32 k = 0; k < n; k++)
+				{
+					const int32 a = polygon[k];
+					const int32 b = polygon[(k + 1) % n];
+					if (triangles)
+					{
+						if (k >= 1 && k + 1 < n)
+						{
+							const int32 first = polygon[0];
+							tile->AddIndex(first < -1 ? -2 - first : first);
+							tile->AddIndex(a < -1 ? -2 - a : a);
+							tile->AddIndex(b < -1 ? -2 - b : b);
+						}
+					}
+					else if (a < -1 && b < -1)
+					{
+						// Consecutive crossings bound the inside on their
+						// left.
+						tile->AddIndex(-2 - a);
+						tile->AddIndex(-2 - b);
+					}
+				}
+			}
+		}
+	}
+	b2Free(scratch, sizeof(int32) * scratchCount);
+}
+
+void b2ParticleSurface::UpdateTileTask(int32 startIndex, int32 endIndex,
+									   uint32 workerIndex, void* context)
+{
+	B2_NOT_USED(workerIndex);
+	const UpdateContext& update = *(const UpdateContext*) context;
+	for (int32 k = startIndex; k < endIndex; k++)
+	{
+		Tile* tile = &update.tiles[k];
+		const TileParticle* particles = update.particles + tile->firstParticle;
+		// The order of the particles of a tile changes with the proxies, so
+		// their hashes are summed.
+		uint64 signature = (uint64) tile->particleCount;
+		for (int32 i = 0; i < tile->particleCount; i++)
+		{
+			const b2Vec2& p = update.positions[particles[i].index];
+			signature += b2HashCell(
+				(int32) floorf(p.x * update.invTolerance),
+				(int32) floorf(p.y * update.invTolerance));
+		}
+		if (update.incremental && tile->extracted &&
+			tile->signature == signature)
+		{
+			continue;
+		}
+		tile->signature = signature;
+		ExtractTile(update, tile, particles);
+		tile->extracted = true;
+		tile->updated = true;
+	}
+}
+
+void b2ParticleSurface::GatherTiles()
+{
+	int32 vertexCount = 0;
+	int32 indexCount = 0;
+	m_updatedTileCount = 0;
+	for (int32 k = 0; k < m_tileCount; k++)
+	{
+		vertexCount += m_tiles[k].vertexCount;
+		indexCount += m_tiles[k].indexCount;
+		m_updatedTileCount += m_tiles[k].updated;
+	}
+	if (vertexCount > m_vertexCapacity)
+	{
+		if (m_vertices)
+		{
+			b2Free(m_vertices, sizeof(b2Vec2) * m_vertexCapacity);
+		}
+		m_vertexCapacity = b2MaxInt(vertexCount, 2 * m_vertexCapacity);
+		m_vertices = (b2Vec2*) b2Alloc(sizeof(b2Vec2) * m_vertexCapacity);
+	}
+	if (indexCount > m_indexCapacity)
+	{
+		if (m_indices)
+		{
+			b2Free(m_indices, sizeof(int32) * m_indexCapacity);
+		}
+		m_indexCapacity = b2MaxInt(indexCount, 2 * m_indexCapacity);
+		m_indices = (int32*) b2Alloc(sizeof(int32) * m_indexCapacity);
+	}
+	m_vertexCount = 0;
+	m_indexCount = 0;
+	for (int32 k = 0; k < m_tileCount; k++)
+	{
+		const Tile& tile = m_tiles[k];
+		memcpy(m_vertices + m_vertexCount, tile.vertices,
+			   sizeof(b2Vec2) * tile.vertexCount);
+		for (int32 i = 0; i < tile.indexCount; i++)
+		{
+			m_indices[m_indexCount + i] = m_vertexCount + tile.indices[i];
+		}
+		m_vertexCount += tile.vertexCount;
+		m_indexCount += tile.indexCount;
+	}
+}
+
+void b2ParticleSurface::Update(const b2ParticleSystem* system, bool useWorkers)
+{
+	const float32 cellSize =
+		m_def.cellSize > 0 ? m_def.cellSize : system->GetRadius();
+	const float32 smoothingLength = m_def.smoothingLength > 0 ?
+		m_def.smoothingLength : 4 * system->GetRadius();
+	// The tiles are at least as large as the kernel.
+	const int32 cellCount = b2MaxInt(m_def.tileCellCount,
+		(int32) ceilf(smoothingLength / cellSize));
+	const float32 tileSize = cellCount * cellSize;
+
+	m_tileParticleCount =
+		FindTileParticles(system, smoothingLength, tileSize);
+	UpdateTiles();
+
+	// Inside a fluid at rest, a particle per stride^2 and a kernel of
+	// integral pi h^2 / 3 give a density of about 1.
+	const float32 stride = system->GetParticleStride();
+	const float32 densityScale =
+		3 * stride * stride / (b2_pi * smoothingLength * smoothingLength);
+	UpdateContext context;
+	context.positions = system->m_positionBuffer.data;
+	context.particles = m_tileParticles;
+	context.tiles = m_tiles;
+	context.type = m_def.type;
+	context.incremental = m_def.incremental;
+	context.cellCount = cellCount;
+	context.cellSize = cellSize;
+	context.smoothingLength = smoothingLength;
+	context.threshold = m_def.isoValue / densityScale;
+	context.invTolerance = 1 / (m_def.movementTolerance > 0 ?
+		m_def.movementTolerance : 0.1f * cellSize);
+	if (useWorkers && m_tileCount > 1)
+	{
+		b2World* world = system->m_world;
+		b2Assert(world->locked == false);
+		void* task = world->enqueueTaskFcn(&UpdateTileTask, m_tileCount, 1,
+										   &context, world->userTaskContext);
+		world->taskCount += 1;
+		if (task != NULL)
+		{
+			world->finishTaskFcn(task, world->userTaskContext);
+		}
+	}
+	else
+	{
+		UpdateTileTask(0, m_tileCount, 0, &context);
+	}
+	GatherTiles();
+}
@@ -17,13 +17,18 @@
 */
 #include "particle/b2ParticleSystem.h"
 #include "particle/b2ParticleGroup.h"
+#include "particle/b2ParticleEmitter.h"
+#include "particle/b2ParticleForceField.h"
 #include "particle/b2VoronoiDiagram.h"
+#include "particle/b2StaticDistanceField.h"
+#include "particle/b2ParticleSimd.h"
 #include "particle/b2ParticleAssembly.h"
 #include "particle/common/b2BlockAllocator.h"
 #include "body.h"
 #include "world.h"
 #include "shape.h"
 #include "solver.h"
+#include "ctz.h"
 #include "box2d.h"
 #include <algorithm>
 
@@ -37,94 +42,95 @@
 // to the top of the function to re-run the test.
 #define LIQUIDFUN_SIMD_INLINE inline
 
+#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 
-static const uint32 xTruncBits = 12;
-static const uint32 yTruncBits = 12;
-static const uint32 tagBits = 8u * sizeof(uint32);
-static const uint32 yOffset = 1u << (yTruncBits - 1u);
-static const uint32 yShift = tagBits - yTruncBits;
-static const uint32 xShift = tagBits - yTruncBits - xTruncBits;
-static const uint32 xScale = 1u << xShift;
-static const uint32 xOffset = xScale * (1u << (xTruncBits - 1u));
-static const uint32 yMask = ((1u << yTruncBits) - 1u) << yShift;
-static const uint32 xMask = ~yMask;
-static const uint32 relativeTagRight = 1u << xShift;
-static const uint32 relativeTagBottomLeft = (uint32)((1 << yShift) +
-                                                    ((~uint32(0)) << xShift));
+// The SIMD versions don't contract multiplies and adds, the compiler may do
+// it in the reference versions.
+static inline bool b2ApproximatelyEqual(const b2Vec2& a, const b2Vec2& b)
+{
+	static const float32 MAX_RELATIVE_DIFF = 1e-4f;
+	return b2Length(a - b) <= MAX_RELATIVE_DIFF * b2MaxFloat(1, b2Length(b));
+}
 
-static const uint32 relativeTagBottomRight = (1u << yShift) + (1u << xShift);
+static inline bool b2ApproximatelyEqual(float32 a, float32 b, float32 scale)
+{
+	static const float32 MAX_RELATIVE_DIFF = 1e-4f;
+	return b2AbsFloat(a - b) <= MAX_RELATIVE_DIFF * b2MaxFloat(1, scale);
+}
 
-// This functor is passed to std::remove_if in RemoveSpuriousBodyContacts
-// to implement the algorithm described there.  It was hoisted out and friended
-// as it would not compile with g++ 4.6.3 as a local class.  It is only used in
-// that function.
-class b2ParticleBodyContactRemovePredicate
+static inline bool b2ApproximatelyEqual(const b2ParticleColor& a,
+										const b2ParticleColor& b)
 {
-public:
-	b2ParticleBodyContactRemovePredicate(b2ParticleSystem* system,
-										 int32* discarded)
-		: m_system(system), m_lastIndex(-1), m_currentContacts(0),
-		  m_discarded(discarded) {}
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
 
-	bool operator()(const b2ParticleBodyContact& contact)
+// Keeps the input of a solver to run its reference version on the same
+// input as its SIMD version, and checks that both give the same output.
+template <typename T>
+class b2ReferenceCheck
+{
+public:
+	b2ReferenceCheck(b2StackAllocator* allocator, T* buffer, int32 count) :
+		m_allocator(allocator), m_buffer(buffer), m_count(count),
+		m_output(NULL)
 	{
-		// This implements the selection criteria described in
-		// RemoveSpuriousBodyContacts().
-		// This functor is iterating through a list of Body contacts per
-		// Particle, ordered from near to far.  For up to the maximum number of
-		// contacts we allow per point per step, we verify that the contact
-		// normal of the Body that genenerated the contact makes physical sense
-		// by projecting a point back along that normal and seeing if it
-		// intersects the fixture generating the contact.
-
-		if (contact.index != m_lastIndex)
-		{
-			m_currentContacts = 0;
-			m_lastIndex = contact.index;
-		}
+		m_input = (T*) m_allocator->Allocate(sizeof(T) * count);
+		std::copy(buffer, buffer + count, m_input);
+	}
 
-		if (m_currentContacts++ > k_maxContactsPerPoint)
+	~b2ReferenceCheck()
+	{
+		if (m_output)
 		{
-			++(*m_discarded);
-			return true;
+			m_allocator->Free(m_output);
 		}
+		m_allocator->Free(m_input);
+	}
 
-		// Project along inverse normal (as returned in the contact) to get the
-		// point to check.
-		b2Vec2 n = contact.normal;
-		// weight is 1-(inv(diameter) * distance)
-		n *= m_system->m_particleDiameter * (1 - contact.weight);
-		b2Vec2 pos = m_system->m_positionBuffer.data[contact.index] + n;
+	/// Keep the output of the SIMD version and restore the input.
+	void Restore()
+	{
+		m_output = (T*) m_allocator->Allocate(sizeof(T) * m_count);
+		std::copy(m_buffer, m_buffer + m_count, m_output);
+		std::copy(m_input, m_input + m_count, m_buffer);
+	}
 
-		// pos is now a point projected back along the contact normal to the
-		// contact distance. If the surface makes sense for a contact, pos will
-		// now lie on or in the fixture generating
-		b2Transform transform = b2GetBodyTransform( m_system->m_world, contact.shape->bodyId );
-		if (!b2TestPointInternal(contact.shape, transform, pos))
+	/// Check the output of the reference version.
+	void Check() const
+	{
+		for (int32 i = 0; i < m_count; i++)
 		{
-			if (b2ShapeComputeDistance(contact.shape, transform, pos, NULL) < B2_LINEAR_SLOP) {
-				return false;
-			}
-			++(*m_discarded);
-			return true;
+			b2Assert(b2ApproximatelyEqual(m_output[i], m_buffer[i]));
 		}
-
-		return false;
 	}
+
 private:
-	// Max number of contacts processed per particle, from nearest to farthest.
-	// This must be at least 2 for correctness with concave shapes; 3 was
-	// experimentally arrived at as looking reasonable.
-	static const int32 k_maxContactsPerPoint = 3;
-	const b2ParticleSystem* m_system;
-	// Index of last particle processed.
-	int32 m_lastIndex;
-	// Number of contacts processed for the current particle.
-	int32 m_currentContacts;
-	// Output the number of discarded contacts.
-	int32* m_discarded;
+	b2StackAllocator* m_allocator;
+	T* m_buffer;
+	int32 m_count;
+	T* m_input;
+	T* m_output;
 };
 
+#endif // defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+
+
+static const uint32 xTruncBits = 12;
+static const uint32 yTruncBits = 12;
+static const uint32 tagBits = 8u * sizeof(uint32);
+static const uint32 yOffset = 1u << (yTruncBits - 1u);
+static const uint32 yShift = tagBits - yTruncBits;
+static const uint32 xShift = tagBits - yTruncBits - xTruncBits;
+static const uint32 xScale = 1u << xShift;
+static const uint32 xOffset = xScale * (1u << (xTruncBits - 1u));
+static const uint32 yMask = ((1u << yTruncBits) - 1u) << yShift;
+static const uint32 xMask = ~yMask;
+static const uint32 relativeTagRight = 1u << xShift;
+static const uint32 relativeTagBottomLeft = (uint32)((1 << yShift) +
+                                                    ((~uint32(0)) << xShift));
+
+static const uint32 relativeTagBottomRight = (1u << yShift) + (1u << xShift);
+
 namespace {
 
 // Compares the expiration time of two particle indices.
@@ -165,173 +171,8 @@ private:
 	const int32* m_expirationTimes;
 };
 
-// *Very* lightweight pair implementation.
-template<typename A, typename B>
-struct LightweightPair
-{
-	A first;
-	B second;
-
-	// Compares the value of two FixtureParticle objects returning
-	// true if left is a smaller value than right.
-	static bool Compare(const LightweightPair& left,
-						const LightweightPair& right)
-	{
-		return left.first < right.first &&
-			left.second < right.second;
-	}
-
-};
-
-// Allocator for a fixed set of items.
-class FixedSetAllocator
-{
-public:
-	// Associate a memory allocator with this object.
-	FixedSetAllocator(b2StackAllocator* allocator);
-	// Deallocate storage for this class.
-	~FixedSetAllocator()
-	{
-		Clear();
-	}
-
-	// Allocate internal storage for this object returning the size.
-	int32 Allocate(const int32 itemSize, const int32 count);
-
-	// Deallocate the internal buffer if it's allocated.
-	void Clear();
-
-	// Get the number of items in the set.
-	int32 GetCount() const { return m_count; }
-
-	// Invalidate an item from the set by index.
-	void Invalidate(const int32 itemIndex)
-	{
-		b2Assert(m_valid);
-		m_valid[itemIndex] = 0;
-	}
-
-	// Get the buffer which indicates whether items are valid in the set.
-	const int8* GetValidBuffer() const { return m_valid; }
-
-protected:
-	// Get the internal buffer.
-	void* GetBuffer() const { return m_buffer; }
-	void* GetBuffer() { return m_buffer; }
-
-	// Reduce the number of items in the set.
-	void SetCount(int32 count)
-	{
-		b2Assert(count <= m_count);
-		m_count = count;
-	}
-
-private:
-	// Set buffer.
-	void* m_buffer;
-	// Array of size m_count which indicates whether an item is in the
-	// corresponding index of m_set (1) or the item is invalid (0).
-	int8* m_valid;
-	// Number of items in m_set.
-	int32 m_count;
-	// Allocator used to allocate / free the set.
-	b2StackAllocator* m_allocator;
-};
-
-// Allocator for a fixed set of objects.
-template<typename T>
-class TypedFixedSetAllocator : public FixedSetAllocator
-{
-public:
-	// Initialize members of this class.
-	TypedFixedSetAllocator(b2StackAllocator* allocator) :
-		FixedSetAllocator(allocator) { }
-
-	// Allocate a set of objects, returning the new size of the set.
-	int32 Allocate(const int32 numberOfObjects)
-	{
-		Clear();
-		return FixedSetAllocator::Allocate(sizeof(T), numberOfObjects);
-	}
-
-	// Get the index of an item in the set if it's valid return an index
-	// >= 0, -1 otherwise.
-	int32 GetIndex(const T* item) const
-	{
-		if (item)
-		{
-			b2Assert(item >= GetBuffer() &&
-					 item < GetBuffer() + GetCount());
-			const int32 index =
-				(int32)(((uint8*)item - (uint8*)GetBuffer()) /
-						sizeof(*item));
-			if (GetValidBuffer()[index])
-			{
-				return index;
-			}
-		}
-		return -1;
-	}
-
-	// Get the internal buffer.
-	const T* GetBuffer() const
-	{
-		return (const T*)FixedSetAllocator::GetBuffer();
-	}
-	T* GetBuffer() { return (T*)FixedSetAllocator::GetBuffer(); }
-};
-
-// Associates a fixture with a particle index.
-typedef LightweightPair<b2Shape*,int32> FixtureParticle;
-
-// Associates a fixture with a particle index.
-typedef LightweightPair<int32,int32> ParticlePair;
-
 }  // namespace
 
-// Set of fixture / particle indices.
-class FixtureParticleSet :
-	public TypedFixedSetAllocator<FixtureParticle>
-{
-public:
-	// Initialize members of this class.
-	FixtureParticleSet(b2StackAllocator* allocator) :
-		TypedFixedSetAllocator<FixtureParticle>(allocator) { }
-
-
-	// Initialize from a set of particle / body contacts for particles
-	// that have the b2_fixtureContactListenerParticle flag set.
-	void Initialize(const b2ParticleBodyContact * const bodyContacts,
-					const int32 numBodyContacts,
-					const uint32 * const particleFlagsBuffer);
-
-	// Find the index of a particle / fixture pair in the set or -1
-	// if it's not present.
-	// NOTE: This was not written as a template function to avoid
-	// exposing any dependencies via this header.
-	int32 Find(const FixtureParticle& fixtureParticle) const;
-};
-
-// Set of particle / particle pairs.
-class b2ParticlePairSet : public TypedFixedSetAllocator<ParticlePair>
-{
-public:
-	// Initialize members of this class.
-	b2ParticlePairSet(b2StackAllocator* allocator) :
-		TypedFixedSetAllocator<ParticlePair>(allocator) { }
-
-	// Initialize from a set of particle contacts.
-	void Initialize(const b2ParticleContact * const contacts,
-					const int32 numContacts,
-					const uint32 * const particleFlagsBuffer);
-
-	// Find the index of a particle pair in the set or -1
-	// if it's not present.
-	// NOTE: This was not written as a template function to avoid
-	// exposing any dependencies via this header.
-	int32 Find(const ParticlePair& pair) const;
-};
-
 static inline uint32 computeTag(float32 x, float32 y)
 {
 	return ((uint32)(y + yOffset) << yShift) + (uint32)(xScale * x + xOffset);
@@ -342,35 +183,110 @@ static inline uint32 computeRelativeTag(uint32 tag, int32 x, int32 y)
 	return tag + (y << yShift) + (x << xShift);
 }
 
+static inline b2ShapeId b2MakeParticleShapeId(const b2World* world,
+											  int32 shapeIndex,
+											  uint16 generation)
+{
+	b2ShapeId id = { shapeIndex + 1, world->worldId, generation };
+	return id;
+}
+
 b2ParticleSystem::InsideBoundsEnumerator::InsideBoundsEnumerator(
 	uint32 lower, uint32 upper, const Proxy* first, const Proxy* last)
 {
 	m_xLower = lower & xMask;
 	m_xUpper = upper & xMask;
-	m_yLower = lower & yMask;
-	m_yUpper = upper & yMask;
 	m_first = first;
-	m_last = last;
-	b2Assert(m_first <= m_last);
+	m_last = first;
+	m_end = last;
+	m_nextFirst = NULL;
+	m_nextEnd = NULL;
+	b2Assert(m_first <= m_end);
+}
+
+b2ParticleSystem::InsideBoundsEnumerator::InsideBoundsEnumerator(
+	uint32 lower, uint32 upper, const Proxy* first, const Proxy* last,
+	const Proxy* secondFirst, const Proxy* secondLast)
+{
+	m_xLower = lower & xMask;
+	m_xUpper = upper & xMask;
+	m_first = first;
+	m_last = first;
+	m_end = last;
+	m_nextFirst = secondFirst;
+	m_nextEnd = secondLast;
+	b2Assert(m_first <= m_end);
+	b2Assert(m_nextFirst <= m_nextEnd);
+}
+
+bool b2ParticleSystem::InsideBoundsEnumerator::NextRow()
+{
+	// m_last is the first proxy which has not been visited yet.
+	while (m_last < m_end)
+	{
+		const uint32 row = m_last->tag & yMask;
+		if ((m_last->tag & xMask) > m_xUpper)
+		{
+			// Skip the rest of the row.
+			if (row == yMask)
+			{
+				return false;
+			}
+			m_last = std::lower_bound(m_last, m_end, row + (1u << yShift));
+			continue;
+		}
+		m_first = std::lower_bound(m_last, m_end, row | m_xLower);
+		m_last = std::upper_bound(m_first, m_end, row | m_xUpper);
+		if (m_first < m_last)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 int32 b2ParticleSystem::InsideBoundsEnumerator::GetNext()
 {
-	while (m_first < m_last)
+	while (m_first == m_last && !NextRow())
 	{
-		uint32 xTag = m_first->tag & xMask;
-#if B2_ASSERT_ENABLED
-		uint32 yTag = m_first->tag & yMask;
-		b2Assert(yTag >= m_yLower);
-		b2Assert(yTag <= m_yUpper);
-#endif
-		if (xTag >= m_xLower && xTag <= m_xUpper)
+		if (m_nextFirst == m_nextEnd)
 		{
-			return (m_first++)->index;
+			return b2_invalidParticleIndex;
 		}
-		m_first++;
+		// Continue with the second range.
+		m_first = m_nextFirst;
+		m_last = m_nextFirst;
+		m_end = m_nextEnd;
+		m_nextFirst = NULL;
+		m_nextEnd = NULL;
 	}
-	return b2_invalidParticleIndex;
+	return (m_first++)->index;
+}
+
+static inline b2AABB b2MakeEmptyAABB()
+{
+	b2AABB aabb;
+	aabb.lowerBound.x = +b2_maxFloat;
+	aabb.lowerBound.y = +b2_maxFloat;
+	aabb.upperBound.x = -b2_maxFloat;
+	aabb.upperBound.y = -b2_maxFloat;
+	return aabb;
+}
+
+static b2AABB b2ComputeParticleAABB(const b2Vec2* positions, int32 count)
+{
+	b2AABB aabb = b2MakeEmptyAABB();
+	for (int32 i = 0; i < count; i++)
+	{
+		aabb.lowerBound = b2Min(aabb.lowerBound, positions[i]);
+		aabb.upperBound = b2Max(aabb.upperBound, positions[i]);
+	}
+	return aabb;
+}
+
+b2ParticleSystemDef::b2ParticleSystemDef()
+{
+	b2SetDefaultParticleSystemDef(this);
 }
 
 b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
@@ -378,10 +294,25 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	m_handleAllocator(b2_minParticleSystemBufferCapacity),
 	m_stuckParticleBuffer(m_blockAllocator),
 	m_proxyBuffer(m_blockAllocator),
+	m_staticProxyBuffer(m_blockAllocator),
+	m_staticProxyWeightBuffer(m_blockAllocator),
 	m_contactBuffer(m_blockAllocator),
 	m_bodyContactBuffer(m_blockAllocator),
+	m_shapeCandidateBuffer(m_blockAllocator),
 	m_pairBuffer(m_blockAllocator),
-	m_triadBuffer(m_blockAllocator)
+	m_triadBuffer(m_blockAllocator),
+	m_elasticTriads(m_blockAllocator),
+	m_springPairs(m_blockAllocator),
+	m_elasticColorBuffer(m_blockAllocator),
+	m_springColorBuffer(m_blockAllocator),
+	m_contactEventKeyBuffer(m_blockAllocator),
+	m_contactBeginEventBuffer(m_blockAllocator),
+	m_contactEndEventBuffer(m_blockAllocator),
+	m_bodyContactEventKeyBuffer(m_blockAllocator),
+	m_bodyContactBeginEventBuffer(m_blockAllocator),
+	m_bodyContactEndEventBuffer(m_blockAllocator),
+	m_shapeTouchBuffer(m_blockAllocator),
+	m_rigidGroupBuffer(m_blockAllocator)
 {
 	b2Assert(def);
 	m_paused = false;
@@ -390,8 +321,21 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	m_needsUpdateAllParticleFlags = false;
 	m_allGroupFlags = 0;
 	m_needsUpdateAllGroupFlags = false;
+	m_staticProxiesNeedPartition = false;
+	m_staticProxiesNeedUpdate = false;
+	m_staticProxyChecksum = 0;
+	m_connectionsNeedColoring = false;
 	m_hasForce = false;
 	m_iterationIndex = 0;
+	m_iterationCount = 0;
+	m_staticPressureIterationCount = 0;
+	m_contactEventKeysRequireSorting = false;
+	m_bodyContactEventKeysRequireSorting = false;
+	m_particleContactFilterFcn = NULL;
+	m_particleContactFilterContext = NULL;
+	m_bodyContactFilterFcn = NULL;
+	m_bodyContactFilterContext = NULL;
+	m_count = 0;
 
 	SetStrictContactCheck(def->strictContactCheck);
 	SetDensity(def->density);
@@ -399,11 +343,15 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	SetRadius(def->radius);
 	SetMaxParticleCount(def->maxCount);
 
-	m_count = 0;
 	m_internalAllocatedCapacity = 0;
 	m_forceBuffer = NULL;
 	m_weightBuffer = NULL;
 	m_staticPressureBuffer = NULL;
+	m_reorderStepCount = 0;
+	m_aabb = b2MakeEmptyAABB();
+	m_aabbNeedsUpdate = false;
+	m_shapeCandidateBounds = b2MakeEmptyAABB();
+	m_staticDistanceField = NULL;
 	m_accumulationBuffer = NULL;
 	m_accumulation2Buffer = NULL;
 	m_depthBuffer = NULL;
@@ -411,6 +359,10 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 
 	m_groupCount = 0;
 	m_groupList = NULL;
+	m_emitterCount = 0;
+	m_emitterList = NULL;
+	m_forceFieldCount = 0;
+	m_forceFieldList = NULL;
 
 	b2Assert(def->lifetimeGranularity > 0.0f);
 	m_def = *def;
@@ -427,11 +379,27 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 
 b2ParticleSystem::~b2ParticleSystem()
 {
+	while (m_emitterList)
+	{
+		DestroyParticleEmitter(m_emitterList);
+	}
+
+	while (m_forceFieldList)
+	{
+		DestroyParticleForceField(m_forceFieldList);
+	}
+
 	while (m_groupList)
 	{
 		DestroyParticleGroup(m_groupList);
 	}
 
+	if (m_staticDistanceField)
+	{
+		m_staticDistanceField->~b2StaticDistanceField();
+		b2Free(m_staticDistanceField, sizeof(b2StaticDistanceField));
+	}
+
 	FreeUserOverridableBuffer(&m_handleIndexBuffer);
 	FreeUserOverridableBuffer(&m_flagsBuffer);
 	FreeUserOverridableBuffer(&m_lastBodyContactStepBuffer);
@@ -443,21 +411,21 @@ b2ParticleSystem::~b2ParticleSystem()
 	FreeUserOverridableBuffer(&m_userDataBuffer);
 	FreeUserOverridableBuffer(&m_expirationTimeBuffer);
 	FreeUserOverridableBuffer(&m_indexByExpirationTimeBuffer);
-	FreeBuffer(&m_forceBuffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_weightBuffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_staticPressureBuffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_accumulationBuffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_accumulation2Buffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_depthBuffer, m_internalAllocatedCapacity);
-	FreeBuffer(&m_groupBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_forceBuffer);
+	FreeBuffer(&m_weightBuffer);
+	FreeBuffer(&m_staticPressureBuffer);
+	FreeBuffer(&m_accumulationBuffer);
+	FreeBuffer(&m_accumulation2Buffer);
+	FreeBuffer(&m_depthBuffer);
+	FreeBuffer(&m_groupBuffer);
 }
 
-template <typename T> void b2ParticleSystem::FreeBuffer(T** b, int capacity)
+template <typename T> void b2ParticleSystem::FreeBuffer(T** b)
 {
 	if (*b == NULL)
 		return;
 
-	m_blockAllocator.Free(*b, sizeof(**b) * capacity);
+	m_blockAllocator.FreeAligned(*b);
 	*b = NULL;
 }
 
@@ -467,7 +435,7 @@ template <typename T> void b2ParticleSystem::FreeUserOverridableBuffer(
 {
 	if (b->userSuppliedCapacity == 0)
 	{
-		FreeBuffer(&b->data, m_internalAllocatedCapacity);
+		FreeBuffer(&b->data);
 	}
 }
 
@@ -476,12 +444,13 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	T* oldBuffer, int32 oldCapacity, int32 newCapacity)
 {
 	b2Assert(newCapacity > oldCapacity);
-	T* newBuffer = (T*) m_blockAllocator.Allocate(
+	// Particle buffers are aligned to a cache line for SIMD loads.
+	T* newBuffer = (T*) m_blockAllocator.AllocateAligned(
 		sizeof(T) * newCapacity);
 	if (oldBuffer)
 	{
 		memcpy(newBuffer, oldBuffer, sizeof(T) * oldCapacity);
-		m_blockAllocator.Free(oldBuffer, sizeof(T) * oldCapacity);
+		m_blockAllocator.FreeAligned(oldBuffer);
 	}
 	return newBuffer;
 }
@@ -537,7 +506,7 @@ template <typename T> T* b2ParticleSystem::RequestBuffer(T* buffer)
 			ReallocateInternalAllocatedBuffers(
 				b2_minParticleSystemBufferCapacity);
 		}
-		buffer = (T*) (m_blockAllocator.Allocate(
+		buffer = (T*) (m_blockAllocator.AllocateAligned(
 						   sizeof(T) * m_internalAllocatedCapacity));
 		b2Assert(buffer);
 		memset(buffer, 0, sizeof(T) * m_internalAllocatedCapacity);
@@ -631,7 +600,24 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	{
 		return 0;
 	}
+	int32 index = CreateParticleInternal(def);
+	// If the oldest particle should be destroyed...
+	if (index == b2_invalidParticleIndex && m_def.destroyByAge && m_count > 0)
+	{
+		DestroyOldestParticle(0);
+		// Need to destroy this particle *now* so that it's possible to
+		// create a new particle.
+		SolveZombie();
+		index = CreateParticleInternal(def);
+	}
+	return index;
+}
 
+// CreateParticle() without the lock check and without destroying old
+// particles when the system is full, for the emitters which create particles
+// during the step and recycle their own particles instead.
+int32 b2ParticleSystem::CreateParticleInternal(const b2ParticleDef& def)
+{
 	if (m_count >= m_internalAllocatedCapacity)
 	{
 		// Double the particle capacity.
@@ -641,20 +627,58 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	}
 	if (m_count >= m_internalAllocatedCapacity)
 	{
-		// If the oldest particle should be destroyed...
-		if (m_def.destroyByAge)
+		return b2_invalidParticleIndex;
+	}
+	int32 index = m_count++;
+	InitializeParticle(index, def);
+	if (m_handleIndexBuffer.data)
+	{
+		m_handleIndexBuffer.data[index] = NULL;
+	}
+	Proxy& proxy = m_proxyBuffer.Append();
+
+	// If particle lifetimes are enabled or the lifetime is set in the particle
+	// definition, initialize the lifetime.
+	const bool finiteLifetime = def.lifetime > 0;
+	if (m_expirationTimeBuffer.data || finiteLifetime)
+	{
+		SetParticleLifetime(index, finiteLifetime ? def.lifetime :
+								ExpirationTimeToLifetime(
+									-GetQuantizedTimeElapsed()));
+		// Add a reference to the newly added particle to the end of the
+		// queue.
+		m_indexByExpirationTimeBuffer.data[index] = index;
+	}
+
+	proxy.index = index;
+	b2ParticleGroup* group = def.group;
+	m_groupBuffer[index] = group;
+	if (group)
+	{
+		if (group->m_firstIndex < group->m_lastIndex)
 		{
-			DestroyOldestParticle(0);
-			// Need to destroy this particle *now* so that it's possible to
-			// create a new particle.
-			SolveZombie();
+			// Move particles in the group just before the new particle.
+			RotateBuffer(group->m_firstIndex, group->m_lastIndex, index);
+			b2Assert(group->m_lastIndex == index);
+			// Update the index range of the group to contain the new particle.
+			group->m_lastIndex = index + 1;
 		}
 		else
 		{
-			return b2_invalidParticleIndex;
+			// If the group is empty, reset the index range to contain only the
+			// new particle.
+			group->m_firstIndex = index;
+			group->m_lastIndex = index + 1;
 		}
 	}
-	int32 index = m_count++;
+	SetParticleFlags(index, def.flags);
+	return index;
+}
+
+// Reset the state of a particle to the one of a new particle, except for
+// its group, handle and lifetime.
+void b2ParticleSystem::InitializeParticle(int32 index, const b2ParticleDef& def)
+{
 	m_flagsBuffer.data[index] = 0;
 	if (m_lastBodyContactStepBuffer.data)
 	{
@@ -669,6 +693,8 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 		m_consecutiveContactStepsBuffer.data[index] = 0;
 	}
 	m_positionBuffer.data[index] = def.position;
+	m_aabb.lowerBound = b2Min(m_aabb.lowerBound, def.position);
+	m_aabb.upperBound = b2Max(m_aabb.upperBound, def.position);
 	m_velocityBuffer.data[index] = def.velocity;
 	m_weightBuffer[index] = 0;
 	m_forceBuffer[index] = b2Vec2_zero;
@@ -690,59 +716,53 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 		m_userDataBuffer.data= RequestBuffer(m_userDataBuffer.data);
 		m_userDataBuffer.data[index] = def.userData;
 	}
+}
+
+// Replace a particle with a new one in place, for the emitters. The old
+// particle loses its flags, handle, pairs, triads and contact event keys as
+// if it were destroyed, and the new one gets the lifetime of a new particle.
+// A particle waiting to be destroyed or in another group than the new one
+// can't be replaced, which returns false.
+bool b2ParticleSystem::RecycleParticle(int32 index, const b2ParticleDef& def)
+{
+	if ((m_flagsBuffer.data[index] & b2_zombieParticle) ||
+		m_groupBuffer[index] != def.group)
+	{
+		return false;
+	}
+	SetParticleFlags(index, 0);
 	if (m_handleIndexBuffer.data)
 	{
-		m_handleIndexBuffer.data[index] = NULL;
+		b2ParticleHandle* const handle = m_handleIndexBuffer.data[index];
+		if (handle)
+		{
+			handle->SetIndex(b2_invalidParticleIndex);
+			m_handleIndexBuffer.data[index] = NULL;
+			m_handleAllocator.Free(handle);
+		}
 	}
-	Proxy& proxy = m_proxyBuffer.Append();
 
-	// If particle lifetimes are enabled or the lifetime is set in the particle
-	// definition, initialize the lifetime.
-	const bool finiteLifetime = def.lifetime > 0;
-	if (m_expirationTimeBuffer.data || finiteLifetime)
+	RemoveRecycledParticleReferences(index);
+	InitializeParticle(index, def);
+	if (m_expirationTimeBuffer.data)
 	{
-		SetParticleLifetime(index, finiteLifetime ? def.lifetime :
+		SetParticleLifetime(index, def.lifetime > 0 ? def.lifetime :
 								ExpirationTimeToLifetime(
 									-GetQuantizedTimeElapsed()));
-		// Add a reference to the newly added particle to the end of the
-		// queue.
-		m_indexByExpirationTimeBuffer.data[index] = index;
 	}
+	SetParticleFlags(index, def.flags);
+	return true;
+}
 
-	proxy.index = index;
-	b2ParticleGroup* group = def.group;
-	m_groupBuffer[index] = group;
-	if (group)
-	{
-		if (group->m_firstIndex < group->m_lastIndex)
-		{
-			// Move particles in the group just before the new particle.
-			RotateBuffer(group->m_firstIndex, group->m_lastIndex, index);
-			b2Assert(group->m_lastIndex == index);
-			// Update the index range of the group to contain the new particle.
-			group->m_lastIndex = index + 1;
-		}
-		else
-		{
-			// If the group is empty, reset the index range to contain only the
-			// new particle.
-			group->m_firstIndex = index;
-			group->m_lastIndex = index + 1;
-		}
-	}
-	SetParticleFlags(index, def.flags);
-	return index;
-}
-
-/// Retrieve a handle to the particle at the specified index.
-const b2ParticleHandle* b2ParticleSystem::GetParticleHandleFromIndex(
-	const int32 index)
-{
-	b2Assert(index >= 0 && index < GetParticleCount() &&
-			 index != b2_invalidParticleIndex);
-	m_handleIndexBuffer.data = RequestBuffer(m_handleIndexBuffer.data);
-	b2ParticleHandle* handle = m_handleIndexBuffer.data[index];
-	if (handle)
+/// Retrieve a handle to the particle at the specified index.
+const b2ParticleHandle* b2ParticleSystem::GetParticleHandleFromIndex(
+	const int32 index)
+{
+	b2Assert(index >= 0 && index < GetParticleCount() &&
+			 index != b2_invalidParticleIndex);
+	m_handleIndexBuffer.data = RequestBuffer(m_handleIndexBuffer.data);
+	b2ParticleHandle* handle = m_handleIndexBuffer.data[index];
+	if (handle)
 	{
 		return handle;
 	}
@@ -986,6 +1006,11 @@ b2ParticleGroup* b2ParticleSystem::CreateParticleGroup(
 	{
 		m_groupBuffer[i] = group;
 	}
+	if (m_allParticleFlags & b2_wallParticle)
+	{
+		// Grouped wall particles leave the static proxy index.
+		m_staticProxiesNeedPartition = true;
+	}
 	SetGroupFlags(group, groupDef.groupFlags);
 
 	// Create pairs and triads between particles in the group.
@@ -1265,6 +1290,7 @@ void b2ParticleSystem::UpdatePairsAndTriadsWithParticleList(
 			triad.indexC = nodeBuffer[c - bufferIndex].index;
 		}
 	}
+	m_connectionsNeedColoring = true;
 }
 
 int32 b2ParticleSystem::CloneParticle(int32 oldIndex, b2ParticleGroup* group)
@@ -1409,6 +1435,7 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 		std::stable_sort(
 			m_pairBuffer.Begin(), m_pairBuffer.End(), ComparePairIndices);
 		m_pairBuffer.Unique(MatchPairIndices);
+		m_connectionsNeedColoring = true;
 	}
 	if (particleFlags & k_triadFlags)
 	{
@@ -1487,6 +1514,7 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 		std::stable_sort(
 			m_triadBuffer.Begin(), m_triadBuffer.End(), CompareTriadIndices);
 		m_triadBuffer.Unique(MatchTriadIndices);
+		m_connectionsNeedColoring = true;
 	}
 }
 
@@ -1531,6 +1559,11 @@ void b2ParticleSystem::DestroyParticleGroup(b2ParticleGroup* group)
 	{
 		m_groupBuffer[i] = NULL;
 	}
+	if (m_allParticleFlags & b2_wallParticle)
+	{
+		// Ungrouped wall particles may join the static proxy index.
+		m_staticProxiesNeedPartition = true;
+	}
 
 	if (group->m_prev)
 	{
@@ -1548,6 +1581,145 @@ void b2ParticleSystem::DestroyParticleGroup(b2ParticleGroup* group)
 	--m_groupCount;
 	group->~b2ParticleGroup();
 	m_blockAllocator.Free(group, sizeof(b2ParticleGroup));
+
+	// The emitters keep emitting without a group.
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		if (emitter->m_def.group == group)
+		{
+			emitter->m_def.group = NULL;
+		}
+	}
+}
+
+b2ParticleEmitter* b2ParticleSystem::CreateParticleEmitter(
+	const b2ParticleEmitterDef& def)
+{
+	b2Assert(m_world->locked == false);
+	if (m_world->locked)
+	{
+		return 0;
+	}
+	b2Assert(def.rate >= 0);
+
+	int32 capacity = def.capacity;
+	if (capacity <= 0)
+	{
+		capacity = (int32) ceilf(def.rate * def.lifetime);
+	}
+	b2Assert(capacity > 0);
+	capacity = b2MaxInt(capacity, 1);
+	// A full particle system makes the emitter recycle its particles early.
+	b2Assert(m_def.maxCount == 0 || capacity <= m_def.maxCount);
+
+	void* mem = m_blockAllocator.Allocate(sizeof(b2ParticleEmitter));
+	b2ParticleEmitter* emitter = new (mem) b2ParticleEmitter();
+	emitter->m_system = this;
+	emitter->m_def = def;
+	emitter->m_capacity = capacity;
+	emitter->m_slots = (int32*) m_blockAllocator.Allocate(
+		sizeof(int32) * capacity);
+	emitter->m_expirationTimes = (float32*) m_blockAllocator.Allocate(
+		sizeof(float32) * capacity);
+	emitter->m_prev = NULL;
+	emitter->m_next = m_emitterList;
+	if (m_emitterList)
+	{
+		m_emitterList->m_prev = emitter;
+	}
+	m_emitterList = emitter;
+	++m_emitterCount;
+	return emitter;
+}
+
+void b2ParticleSystem::DestroyParticleEmitter(b2ParticleEmitter* emitter)
+{
+	b2Assert(m_emitterCount > 0);
+	b2Assert(emitter && emitter->m_system == this);
+
+	if (emitter->m_prev)
+	{
+		emitter->m_prev->m_next = emitter->m_next;
+	}
+	if (emitter->m_next)
+	{
+		emitter->m_next->m_prev = emitter->m_prev;
+	}
+	if (emitter == m_emitterList)
+	{
+		m_emitterList = emitter->m_next;
+	}
+
+	--m_emitterCount;
+	m_blockAllocator.Free(emitter->m_slots,
+						  sizeof(int32) * emitter->m_capacity);
+	m_blockAllocator.Free(emitter->m_expirationTimes,
+						  sizeof(float32) * emitter->m_capacity);
+	emitter->~b2ParticleEmitter();
+	m_blockAllocator.Free(emitter, sizeof(b2ParticleEmitter));
+}
+
+b2ParticleForceField* b2ParticleSystem::CreateParticleForceField(
+	const b2ParticleForceFieldDef& def)
+{
+	b2Assert(m_world->locked == false);
+	if (m_world->locked)
+	{
+		return 0;
+	}
+
+	void* mem = m_blockAllocator.Allocate(sizeof(b2ParticleForceField));
+	b2ParticleForceField* field = new (mem) b2ParticleForceField();
+	field->m_system = this;
+	field->m_def = def;
+	if (def.type == b2_gridForceField)
+	{
+		b2Assert(def.gridForces);
+		b2Assert(def.gridWidth >= 2 && def.gridHeight >= 2);
+		b2Assert(def.gridSpacing > 0);
+		field->m_gridForces = (b2Vec2*) m_blockAllocator.Allocate(
+			sizeof(b2Vec2) * def.gridWidth * def.gridHeight);
+		field->SetGridForces(def.gridForces);
+	}
+	field->m_def.gridForces = field->m_gridForces;
+	field->m_prev = NULL;
+	field->m_next = m_forceFieldList;
+	if (m_forceFieldList)
+	{
+		m_forceFieldList->m_prev = field;
+	}
+	m_forceFieldList = field;
+	++m_forceFieldCount;
+	return field;
+}
+
+void b2ParticleSystem::DestroyParticleForceField(b2ParticleForceField* field)
+{
+	b2Assert(m_forceFieldCount > 0);
+	b2Assert(field && field->m_system == this);
+
+	if (field->m_prev)
+	{
+		field->m_prev->m_next = field->m_next;
+	}
+	if (field->m_next)
+	{
+		field->m_next->m_prev = field->m_prev;
+	}
+	if (field == m_forceFieldList)
+	{
+		m_forceFieldList = field->m_next;
+	}
+
+	--m_forceFieldCount;
+	if (field->m_gridForces)
+	{
+		m_blockAllocator.Free(field->m_gridForces, sizeof(b2Vec2) *
+			field->m_def.gridWidth * field->m_def.gridHeight);
+	}
+	field->~b2ParticleForceField();
+	m_blockAllocator.Free(field, sizeof(b2ParticleForceField));
 }
 
 void b2ParticleSystem::ComputeWeight()
@@ -1571,6 +1743,15 @@ void b2ParticleSystem::ComputeWeight()
 		m_weightBuffer[a] += w;
 		m_weightBuffer[b] += w;
 	}
+	// The contacts between static particles are never found, their weights
+	// were summed when the static proxies were sorted.
+	b2Assert(m_staticProxyWeightBuffer.GetCount() ==
+			 m_staticProxyBuffer.GetCount());
+	for (int32 k = 0; k < m_staticProxyBuffer.GetCount(); k++)
+	{
+		m_weightBuffer[m_staticProxyBuffer[k].index] +=
+			m_staticProxyWeightBuffer[k];
+	}
 }
 
 void b2ParticleSystem::ComputeDepth()
@@ -1688,11 +1869,27 @@ b2ParticleSystem::GetInsideBoundsEnumerator(const b2AABB& aabb) const
 								 m_inverseDiameter * aabb.lowerBound.y - 1);
 	uint32 upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x + 1,
 								 m_inverseDiameter * aabb.upperBound.y + 1);
+	return GetInsideTagsEnumerator(lowerTag, upperTag);
+}
+
+// Enumerate the particles of both proxy indices whose tags are inside the
+// bounds of tags.
+b2ParticleSystem::InsideBoundsEnumerator
+b2ParticleSystem::GetInsideTagsEnumerator(uint32 lowerTag,
+										  uint32 upperTag) const
+{
 	const Proxy* beginProxy = m_proxyBuffer.Begin();
 	const Proxy* endProxy = m_proxyBuffer.End();
 	const Proxy* firstProxy = std::lower_bound(beginProxy, endProxy, lowerTag);
 	const Proxy* lastProxy = std::upper_bound(firstProxy, endProxy, upperTag);
-	return InsideBoundsEnumerator(lowerTag, upperTag, firstProxy, lastProxy);
+	const Proxy* beginStatic = m_staticProxyBuffer.Begin();
+	const Proxy* endStatic = m_staticProxyBuffer.End();
+	const Proxy* firstStatic = std::lower_bound(beginStatic, endStatic,
+												lowerTag);
+	const Proxy* lastStatic = std::upper_bound(firstStatic, endStatic,
+											   upperTag);
+	return InsideBoundsEnumerator(lowerTag, upperTag, firstProxy, lastProxy,
+								  firstStatic, lastStatic);
 }
 
 inline void b2ParticleSystem::AddContact(int32 a, int32 b,
@@ -1741,13 +1938,50 @@ void b2ParticleSystem::FindContacts_Reference(
 	}
 }
 
+// Find the contacts between the particles of the dynamic proxy index and
+// those of the static one. As both are sorted by tag, the static proxies of
+// the rows above, at and below each dynamic proxy are found by cursors which
+// only move forward.
+void b2ParticleSystem::FindStaticContacts(
+	b2GrowableBuffer<b2ParticleContact>& contacts) const
+{
+	const Proxy* beginStatic = m_staticProxyBuffer.Begin();
+	const Proxy* endStatic = m_staticProxyBuffer.End();
+	if (beginStatic == endStatic)
+	{
+		return;
+	}
+	const Proxy* rowProxies[3] = { beginStatic, beginStatic, beginStatic };
+	const Proxy* endProxy = m_proxyBuffer.End();
+	for (const Proxy* a = m_proxyBuffer.Begin(); a < endProxy; a++)
+	{
+		for (int32 row = 0; row < 3; row++)
+		{
+			uint32 leftTag = computeRelativeTag(a->tag, -1, row - 1);
+			uint32 rightTag = computeRelativeTag(a->tag, 1, row - 1);
+			const Proxy* b = rowProxies[row];
+			for (; b < endStatic; b++)
+			{
+				if (leftTag <= b->tag) break;
+			}
+			rowProxies[row] = b;
+			for (; b < endStatic; b++)
+			{
+				if (rightTag < b->tag) break;
+				AddContact(a->index, b->index, contacts);
+			}
+		}
+	}
+}
+
 // Put the positions and indices in proxy-order. This allows us to process
 // particles with SIMD, since adjacent particles are adjacent in memory.
 void b2ParticleSystem::ReorderForFindContact(FindContactInput* reordered,
 	                                         int alignedCount) const
 {
+	const int proxyCount = m_proxyBuffer.GetCount();
 	int i = 0;
-	for (; i < m_count; ++i)
+	for (; i < proxyCount; ++i)
 	{
 		const int proxyIndex = m_proxyBuffer[i].index;
 		FindContactInput& r = reordered[i];
@@ -1781,7 +2015,7 @@ inline void b2ParticleSystem::GatherChecksOneParticle(
 	// loop to iterate more than once. In almost all situations, it will
 	// iterate less than twice.
 	for (int comparatorIndex = startIndex;
-		 comparatorIndex < m_count;
+		 comparatorIndex < m_proxyBuffer.GetCount();
 	     comparatorIndex += NUM_V32_SLOTS)
 	{
 		if (m_proxyBuffer[comparatorIndex].tag > bound)
@@ -1802,8 +2036,9 @@ inline void b2ParticleSystem::GatherChecksOneParticle(
 void b2ParticleSystem::GatherChecks(
 	b2GrowableBuffer<FindContactCheck>& checks) const
 {
+	const int proxyCount = m_proxyBuffer.GetCount();
 	int bottomLeftIndex = 0;
-	for (int particleIndex = 0; particleIndex < m_count; ++particleIndex)
+	for (int particleIndex = 0; particleIndex < proxyCount; ++particleIndex)
 	{
 		const uint32 particleTag = m_proxyBuffer[particleIndex].tag;
 
@@ -1818,7 +2053,7 @@ void b2ParticleSystem::GatherChecks(
 
 		// Find comparator index below and to left of particle.
 		const uint32 bottomLeftTag = particleTag + relativeTagBottomLeft;
-		for (; bottomLeftIndex < m_count; ++bottomLeftIndex)
+		for (; bottomLeftIndex < proxyCount; ++bottomLeftIndex)
 		{
 			if (bottomLeftTag <= m_proxyBuffer[bottomLeftIndex].tag)
 				break;
@@ -1841,7 +2076,7 @@ void b2ParticleSystem::FindContacts_Simd(
 {
 	contacts.SetCount(0);
 
-	const int alignedCount = m_count + NUM_V32_SLOTS;
+	const int alignedCount = m_proxyBuffer.GetCount() + NUM_V32_SLOTS;
 	FindContactInput* reordered = (FindContactInput*)
 		m_stackAllocator.Allocate(
 			sizeof(FindContactInput) * alignedCount);
@@ -1855,7 +2090,8 @@ void b2ParticleSystem::FindContacts_Simd(
 	// that use actual positions.
 	static const int MAX_EXPECTED_CHECKS_PER_PARTICLE = 3;
 	b2GrowableBuffer<FindContactCheck> checks(m_blockAllocator);
-	checks.Reserve(MAX_EXPECTED_CHECKS_PER_PARTICLE * m_count);
+	checks.Reserve(MAX_EXPECTED_CHECKS_PER_PARTICLE *
+				   m_proxyBuffer.GetCount());
 	GatherChecks(checks);
 
 	// Perform narrow-band contact checks using actual positions.
@@ -1878,11 +2114,13 @@ void b2ParticleSystem::FindContacts(
 	#else
 		FindContacts_Reference(contacts);
 	#endif
+	FindStaticContacts(contacts);
 
 	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 		b2GrowableBuffer<b2ParticleContact>
-			reference(m_blockAllocator);
+			reference(const_cast<b2BlockAllocator&>(m_blockAllocator));
 		FindContacts_Reference(reference);
+		FindStaticContacts(reference);
 
 		b2Assert(contacts.GetCount() == reference.GetCount());
 		for (int32 i = 0; i < contacts.GetCount(); ++i)
@@ -2034,112 +2272,191 @@ void b2ParticleSystem::SortProxies(b2GrowableBuffer<Proxy>& proxies) const
 	std::sort(proxies.Begin(), proxies.End());
 }
 
-// class b2ParticleContactRemovePredicate
-// {
-// public:
-// 	b2ParticleContactRemovePredicate(
-// 		b2ParticleSystem* system,
-// 		b2ContactFilter* contactFilter) :
-// 		m_system(system),
-// 		m_contactFilter(contactFilter)
-// 	{}
-
-// 	bool operator()(const b2ParticleContact& contact)
-// 	{
-// 	    return (contact.GetFlags() & b2_particleContactFilterParticle)
-// 	        && !m_contactFilter->ShouldCollide(m_system, contact.GetIndexA(),
-// 	        								   contact.GetIndexB());
-// 	}
-
-// private:
-// 	b2ParticleSystem* m_system;
-// 	b2ContactFilter* m_contactFilter;
-// };
-
-// Only changes 'contacts', but the contact filter has a non-const 'this'
-// pointer, so this member function cannot be const.
-// void b2ParticleSystem::FilterContacts(
-// 	b2GrowableBuffer<b2ParticleContact>& contacts)
-// {
-// 	// Optionally filter the contact.
-// 	b2ContactFilter* const contactFilter = GetParticleContactFilter();
-// 	if (contactFilter == NULL)
-// 		return;
-
-// 	contacts.RemoveIf(b2ParticleContactRemovePredicate(this, contactFilter));
-// }
-
-// void b2ParticleSystem::NotifyContactListenerPreContact(
-// 	b2ParticlePairSet* particlePairs) const
-// {
-// 	b2ContactListener* const contactListener = GetParticleContactListener();
-// 	if (contactListener == NULL)
-// 		return;
-
-// 	particlePairs->Initialize(m_contactBuffer.Begin(),
-// 							  m_contactBuffer.GetCount(),
-// 						      GetFlagsBuffer());
-// }
-
-// // Note: This function is not const because 'this' in BeginContact and
-// // EndContact callbacks must be non-const. However, this function itself
-// // does not change any internal data (though the callbacks might).
-// void b2ParticleSystem::NotifyContactListenerPostContact(
-// 	b2ParticlePairSet& particlePairs)
-// {
-// 	b2ContactListener* const contactListener = GetParticleContactListener();
-// 	if (contactListener == NULL)
-// 		return;
-
-// 	// Loop through all new contacts, reporting any new ones, and
-// 	// "invalidating" the ones that still exist.
-// 	const b2ParticleContact* const endContact = m_contactBuffer.End();
-// 	for (b2ParticleContact* contact = m_contactBuffer.Begin();
-// 		 contact < endContact; ++contact)
-// 	{
-// 		ParticlePair pair;
-// 		pair.first = contact->GetIndexA();
-// 		pair.second = contact->GetIndexB();
-// 		const int32 itemIndex = particlePairs.Find(pair);
-// 		if (itemIndex >= 0)
-// 		{
-// 			// Already touching, ignore this contact.
-// 			particlePairs.Invalidate(itemIndex);
-// 		}
-// 		else
-// 		{
-// 			// Just started touching, inform the listener.
-// 			contactListener->BeginContact(this, contact);
-// 		}
-// 	}
-
-// 	// Report particles that are no longer touching.
-// 	// That is, any pairs that were not invalidated above.
-// 	const int32 pairCount = particlePairs.GetCount();
-// 	const ParticlePair* const pairs = particlePairs.GetBuffer();
-// 	const int8* const valid = particlePairs.GetValidBuffer();
-// 	for (int32 i = 0; i < pairCount; ++i)
-// 	{
-// 		if (valid[i])
-// 		{
-// 			contactListener->EndContact(this, pairs[i].first,
-// 										pairs[i].second);
-// 		}
-// 	}
-// }
+// Add the weight of the contact between two static proxies, if they touch,
+// to 'weights' in the order of m_staticProxyBuffer.
+inline void b2ParticleSystem::AddStaticWeight(const Proxy* a, const Proxy* b,
+											  float32* weights) const
+{
+	b2Vec2 d = m_positionBuffer.data[b->index] -
+		m_positionBuffer.data[a->index];
+	float32 distBtParticlesSq = b2Dot(d, d);
+	if (distBtParticlesSq < m_squaredDiameter)
+	{
+		float32 invD = b2InvSqrt(distBtParticlesSq);
+		// 1 - distBtParticles / diameter
+		float32 w = 1 - distBtParticlesSq * invD * m_inverseDiameter;
+		weights[a - m_staticProxyBuffer.Begin()] += w;
+		weights[b - m_staticProxyBuffer.Begin()] += w;
+	}
+}
+
+// Move the proxies of the particles which became, or stopped being, static
+// to the other proxy index.
+void b2ParticleSystem::PartitionProxies()
+{
+	const int32 staticCount = m_staticProxyBuffer.GetCount();
+	int32 newCount = 0;
+	for (int32 k = 0; k < m_proxyBuffer.GetCount(); k++)
+	{
+		const Proxy proxy = m_proxyBuffer[k];
+		if (IsStaticProxyParticle(m_flagsBuffer.data[proxy.index],
+								  m_groupBuffer[proxy.index]))
+		{
+			m_staticProxyBuffer.Append() = proxy;
+		}
+		else
+		{
+			m_proxyBuffer[newCount++] = proxy;
+		}
+	}
+	m_proxyBuffer.SetCount(newCount);
+	newCount = 0;
+	for (int32 k = 0; k < m_staticProxyBuffer.GetCount(); k++)
+	{
+		const Proxy proxy = m_staticProxyBuffer[k];
+		if (k >= staticCount ||
+			IsStaticProxyParticle(m_flagsBuffer.data[proxy.index],
+								  m_groupBuffer[proxy.index]))
+		{
+			m_staticProxyBuffer[newCount++] = proxy;
+		}
+		else
+		{
+			m_proxyBuffer.Append() = proxy;
+		}
+	}
+	m_staticProxyBuffer.SetCount(newCount);
+	m_staticProxiesNeedPartition = false;
+	m_staticProxiesNeedUpdate = true;
+}
+
+// Hash the positions of the static proxies in their order. It is cheap
+// next to tagging and sorting them, and tells whether wall particles were
+// moved through the position buffer since they were last sorted.
+uint32 b2ParticleSystem::ComputeStaticProxyChecksum() const
+{
+	// FNV-1a over the bits of the coordinates.
+	uint32 checksum = 2166136261u;
+	const Proxy* endProxy = m_staticProxyBuffer.End();
+	for (const Proxy* proxy = m_staticProxyBuffer.Begin(); proxy < endProxy;
+		 proxy++)
+	{
+		uint32 bits[2];
+		memcpy(bits, &m_positionBuffer.data[proxy->index], sizeof(bits));
+		checksum = (checksum ^ bits[0]) * 16777619u;
+		checksum = (checksum ^ bits[1]) * 16777619u;
+	}
+	return checksum;
+}
+
+// Tag and sort the static proxies, and sum the weights of their contacts
+// with each other, which FindContacts() skips.
+void b2ParticleSystem::UpdateStaticProxies()
+{
+	UpdateProxies(m_staticProxyBuffer);
+	SortProxies(m_staticProxyBuffer);
+
+	const int32 staticCount = m_staticProxyBuffer.GetCount();
+	m_staticProxyWeightBuffer.Reserve(staticCount);
+	m_staticProxyWeightBuffer.SetCount(staticCount);
+	float32* weights = m_staticProxyWeightBuffer.Data();
+	for (int32 k = 0; k < staticCount; k++)
+	{
+		weights[k] = 0;
+	}
+	const Proxy* beginProxy = m_staticProxyBuffer.Begin();
+	const Proxy* endProxy = m_staticProxyBuffer.End();
+	for (const Proxy *a = beginProxy, *c = beginProxy; a < endProxy; a++)
+	{
+		uint32 rightTag = computeRelativeTag(a->tag, 1, 0);
+		for (const Proxy* b = a + 1; b < endProxy; b++)
+		{
+			if (rightTag < b->tag) break;
+			AddStaticWeight(a, b, weights);
+		}
+		uint32 bottomLeftTag = computeRelativeTag(a->tag, -1, 1);
+		for (; c < endProxy; c++)
+		{
+			if (bottomLeftTag <= c->tag) break;
+		}
+		uint32 bottomRightTag = computeRelativeTag(a->tag, 1, 1);
+		for (const Proxy* b = c; b < endProxy; b++)
+		{
+			if (bottomRightTag < b->tag) break;
+			AddStaticWeight(a, b, weights);
+		}
+	}
+	m_staticProxyChecksum = ComputeStaticProxyChecksum();
+	m_staticProxiesNeedUpdate = false;
+}
+
+// Pass the contacts involving a particle with the
+// b2_particleContactFilterParticle flag to the batched filter in a single
+// call, and remove the rejected ones.
+void b2ParticleSystem::FilterContacts(
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	if (m_particleContactFilterFcn == NULL ||
+		!(m_allParticleFlags & b2_particleContactFilterParticle))
+	{
+		return;
+	}
+
+	const int32 contactCount = contacts.GetCount();
+	b2ParticleContact* candidates = (b2ParticleContact*)
+		m_stackAllocator.Allocate(sizeof(b2ParticleContact) * contactCount);
+	int32 candidateCount = 0;
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		if (contacts[k].GetFlags() & b2_particleContactFilterParticle)
+		{
+			candidates[candidateCount++] = contacts[k];
+		}
+	}
+
+	bool* keep = (bool*) m_stackAllocator.Allocate(
+		sizeof(bool) * candidateCount);
+	memset(keep, 1, sizeof(bool) * candidateCount);
+	if (candidateCount)
+	{
+		m_particleContactFilterFcn(this, candidates, candidateCount, keep,
+								   m_particleContactFilterContext);
+	}
+
+	// Compact the contacts in place, preserving their order.
+	int32 candidateIndex = 0;
+	int32 newCount = 0;
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleContact& contact = contacts[k];
+		if (!(contact.GetFlags() & b2_particleContactFilterParticle) ||
+			keep[candidateIndex++])
+		{
+			contacts[newCount++] = contact;
+		}
+	}
+	contacts.SetCount(newCount);
+
+	m_stackAllocator.Free(keep);
+	m_stackAllocator.Free(candidates);
+}
 
 void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 {
+	if (m_staticProxiesNeedPartition)
+	{
+		PartitionProxies();
+	}
+	if (m_staticProxiesNeedUpdate ||
+		ComputeStaticProxyChecksum() != m_staticProxyChecksum)
+	{
+		UpdateStaticProxies();
+	}
 	UpdateProxies(m_proxyBuffer);
 	SortProxies(m_proxyBuffer);
 
-	b2ParticlePairSet particlePairs(&m_stackAllocator);
-	// NotifyContactListenerPreContact(&particlePairs);
-
 	FindContacts(m_contactBuffer);
-	// FilterContacts(m_contactBuffer);
-
-	// NotifyContactListenerPostContact(particlePairs);
+	FilterContacts(m_contactBuffer);
 
 	if (exceptZombie)
 	{
@@ -2147,6 +2464,95 @@ void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 	}
 }
 
+static inline uint64 b2MakeParticleContactKey(int32 a, int32 b)
+{
+	return a < b ? ((uint64)a << 32) | (uint32)b : ((uint64)b << 32) | (uint32)a;
+}
+
+static inline int32 b2ParticleContactKeyIndexA(uint64 key)
+{
+	return (int32)(key >> 32);
+}
+
+static inline int32 b2ParticleContactKeyIndexB(uint64 key)
+{
+	return (int32)(key & 0xffffffffu);
+}
+
+// Generate begin / end touch events by diffing the contacts found by the last
+// UpdateContacts() against the ones found in the previous particle iteration.
+// Both lists are kept as sorted keys so the diff is a single linear merge.
+void b2ParticleSystem::UpdateContactEvents()
+{
+	const int32 previousCount = m_contactEventKeyBuffer.GetCount();
+	if (!(m_allParticleFlags & b2_particleContactListenerParticle) &&
+		previousCount == 0)
+	{
+		return;
+	}
+	if (m_contactEventKeysRequireSorting)
+	{
+		std::sort(m_contactEventKeyBuffer.Begin(),
+				  m_contactEventKeyBuffer.End());
+		m_contactEventKeysRequireSorting = false;
+	}
+
+	// Gather the keys of the contacts that should be reported.
+	const int32 contactCount = m_contactBuffer.GetCount();
+	uint64* keys = (uint64*) m_stackAllocator.Allocate(
+		sizeof(uint64) * contactCount);
+	int32 keyCount = 0;
+	if (m_allParticleFlags & b2_particleContactListenerParticle)
+	{
+		for (int32 k = 0; k < contactCount; k++)
+		{
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			if (contact.GetFlags() & b2_particleContactListenerParticle)
+			{
+				keys[keyCount++] = b2MakeParticleContactKey(
+					contact.GetIndexA(), contact.GetIndexB());
+			}
+		}
+		std::sort(keys, keys + keyCount);
+	}
+
+	// Keys only in the current list began touching, keys only in the
+	// previous list stopped touching.
+	const uint64* previous = m_contactEventKeyBuffer.Data();
+	int32 i = 0;
+	int32 j = 0;
+	while (i < previousCount || j < keyCount)
+	{
+		if (j == keyCount || (i < previousCount && previous[i] < keys[j]))
+		{
+			b2ParticleContactEndTouchEvent& event =
+				m_contactEndEventBuffer.Append();
+			event.indexA = b2ParticleContactKeyIndexA(previous[i]);
+			event.indexB = b2ParticleContactKeyIndexB(previous[i]);
+			i++;
+		}
+		else if (i == previousCount || keys[j] < previous[i])
+		{
+			b2ParticleContactBeginTouchEvent& event =
+				m_contactBeginEventBuffer.Append();
+			event.indexA = b2ParticleContactKeyIndexA(keys[j]);
+			event.indexB = b2ParticleContactKeyIndexB(keys[j]);
+			j++;
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+
+	m_contactEventKeyBuffer.SetCount(0);
+	m_contactEventKeyBuffer.Reserve(keyCount);
+	m_contactEventKeyBuffer.SetCount(keyCount);
+	memcpy(m_contactEventKeyBuffer.Data(), keys, sizeof(uint64) * keyCount);
+	m_stackAllocator.Free(keys);
+}
+
 void b2ParticleSystem::DetectStuckParticle(int32 particle)
 {
 	// Detect stuck particles
@@ -2186,175 +2592,34 @@ void b2ParticleSystem::DetectStuckParticle(int32 particle)
 	*lastStep = m_timestamp;
 }
 
+const b2AABB& b2ParticleSystem::GetAABB() const
+{
+	if (m_aabbNeedsUpdate)
+	{
+		m_aabb = b2ComputeParticleAABB(m_positionBuffer.data, m_count);
+		m_aabbNeedsUpdate = false;
+	}
+	return m_aabb;
+}
+
 /// Compute the axis-aligned bounding box for all particles contained
 /// within this particle system.
 /// @param aabb Returns the axis-aligned bounding box of the system.
 void b2ParticleSystem::ComputeAABB(b2AABB* const aabb) const
 {
-	const int32 particleCount = GetParticleCount();
 	b2Assert(aabb);
-	aabb->lowerBound.x = +b2_maxFloat;
-	aabb->lowerBound.y = +b2_maxFloat;
-	aabb->upperBound.x = -b2_maxFloat;
-	aabb->upperBound.y = -b2_maxFloat;
-
-	for (int32 i = 0; i < particleCount; i++)
-	{
-		b2Vec2 p = m_positionBuffer.data[i];
-		aabb->lowerBound = b2Min(aabb->lowerBound, p);
-		aabb->upperBound = b2Max(aabb->upperBound, p);
-	}
+	*aabb = b2ComputeParticleAABB(m_positionBuffer.data, GetParticleCount());
 	aabb->lowerBound.x -= m_particleDiameter;
 	aabb->lowerBound.y -= m_particleDiameter;
 	aabb->upperBound.x += m_particleDiameter;
 	aabb->upperBound.y += m_particleDiameter;
 }
 
-// Associate a memory allocator with this object.
-FixedSetAllocator::FixedSetAllocator(
-		b2StackAllocator* allocator) :
-	m_buffer(NULL), m_valid(NULL), m_count(0), m_allocator(allocator)
-{
-	b2Assert(allocator);
-}
-
-// Allocate internal storage for this object.
-int32 FixedSetAllocator::Allocate(
-	const int32 itemSize, const int32 count)
-{
-	Clear();
-	if (count)
-	{
-		m_buffer = m_allocator->Allocate(
-			(itemSize + sizeof(*m_valid)) * count);
-		b2Assert(m_buffer);
-		m_valid = (int8*)m_buffer + (itemSize * count);
-		memset(m_valid, 1, sizeof(*m_valid) * count);
-		m_count = count;
-	}
-	return m_count;
-}
-
-// Deallocate the internal buffer if it's allocated.
-void FixedSetAllocator::Clear()
-{
-	if (m_buffer)
+void b2ParticleSystem::QueryShapeParticle(b2ShapeParticleQueryCallback* callback, const b2AABB& aabb, bool includeStaticShapes) const {
+	struct WorldQueryContext
 	{
-		m_allocator->Free(m_buffer);
-		m_buffer = NULL;
-        m_count = 0;
-	}
-}
-
-// Search set for item returning the index of the item if it's found, -1
-// otherwise.
-template<typename T>
-static int32 FindItemIndexInFixedSet(const TypedFixedSetAllocator<T>& set,
-									 const T& item)
-{
-	if (set.GetCount())
-	{
-		const T* buffer = set.GetBuffer();
-		const T* last = buffer + set.GetCount();
-		const T* found = std::lower_bound( buffer, buffer + set.GetCount(),
-											item, T::Compare);
-		if( found != last )
-		{
-			return set.GetIndex( found );
-		}
-	}
-	return -1;
-}
-
-// Initialize from a set of particle / body contacts for particles
-// that have the b2_fixtureContactListenerParticle flag set.
-void FixtureParticleSet::Initialize(
-	const b2ParticleBodyContact * const bodyContacts,
-	const int32 numBodyContacts,
-	const uint32 * const particleFlagsBuffer)
-{
-	Clear();
-	if (Allocate(numBodyContacts))
-	{
-		FixtureParticle* set = GetBuffer();
-		int32 insertedContacts = 0;
-		for (int32 i = 0; i < numBodyContacts; ++i)
-		{
-			FixtureParticle* const fixtureParticle = &set[i];
-			const b2ParticleBodyContact& bodyContact = bodyContacts[i];
-			if (bodyContact.index == b2_invalidParticleIndex ||
-				!(particleFlagsBuffer[bodyContact.index] &
-				  b2_fixtureContactListenerParticle))
-			{
-				continue;
-			}
-			fixtureParticle->first = bodyContact.shape;
-			fixtureParticle->second = bodyContact.index;
-			insertedContacts++;
-		}
-		SetCount(insertedContacts);
-		std::sort(set, set + insertedContacts, FixtureParticle::Compare);
-	}
-}
-
-// Find the index of a particle / fixture pair in the set or -1 if it's not
-// present.
-int32 FixtureParticleSet::Find(
-	const FixtureParticle& fixtureParticle) const
-{
-	return FindItemIndexInFixedSet(*this, fixtureParticle);
-}
-
-// Initialize from a set of particle contacts.
-void b2ParticlePairSet::Initialize(
-	const b2ParticleContact * const contacts, const int32 numContacts,
-	const uint32 * const particleFlagsBuffer)
-{
-	Clear();
-	if (Allocate(numContacts))
-	{
-		ParticlePair* set = GetBuffer();
-		int32 insertedContacts = 0;
-		for (int32 i = 0; i < numContacts; ++i)
-		{
-			ParticlePair* const pair = &set[i];
-			const b2ParticleContact& contact = contacts[i];
-			if (contact.GetIndexA() == b2_invalidParticleIndex ||
-				contact.GetIndexB() == b2_invalidParticleIndex ||
-				!((particleFlagsBuffer[contact.GetIndexA()] |
-				   particleFlagsBuffer[contact.GetIndexB()]) &
-				  b2_particleContactListenerParticle))
-			{
-				continue;
-			}
-			pair->first = contact.GetIndexA();
-			pair->second = contact.GetIndexB();
-			insertedContacts++;
-		}
-		SetCount(insertedContacts);
-		std::sort(set, set + insertedContacts, ParticlePair::Compare);
-	}
-}
-
-// Find the index of a particle pair in the set or -1 if it's not present.
-int32 b2ParticlePairSet::Find(const ParticlePair& pair) const
-{
-	int32 index = FindItemIndexInFixedSet(*this, pair);
-	if (index < 0)
-	{
-		ParticlePair swapped;
-		swapped.first = pair.second;
-		swapped.second = pair.first;
-		index = FindItemIndexInFixedSet(*this, swapped);
-	}
-	return index;
-}
-
-void b2ParticleSystem::QueryShapeParticle(b2ShapeParticleQueryCallback* callback, const b2AABB& aabb) const {
-	struct WorldQueryContext
-	{
-		const b2ParticleSystem* system;
-		b2ShapeParticleQueryCallback* fcn;
+		const b2ParticleSystem* system;
+		b2ShapeParticleQueryCallback* fcn;
 
 		static bool TreeQueryCallback( int proxyId, uint64_t userData, void* context )
 		{
@@ -2371,6 +2636,11 @@ void b2ParticleSystem::QueryShapeParticle(b2ShapeParticleQueryCallback* callback
 				return true;
 			}
 
+			if (!b2ShouldShapesCollide(worldContext->system->m_def.filter,
+									   shape->filter)) {
+				return true;
+			}
+
 			b2AABB aabb = shape->aabb;
 			b2ParticleSystem::InsideBoundsEnumerator enumerator =
 					worldContext->system->GetInsideBoundsEnumerator(aabb);
@@ -2384,81 +2654,103 @@ void b2ParticleSystem::QueryShapeParticle(b2ShapeParticleQueryCallback* callback
 		}
 	} context{this, callback};
 
-	for ( int i = 0; i < b2_bodyTypeCount; ++i )
-	{
-		b2DynamicTree_Query( m_world->broadPhase.trees + i, aabb, B2_DEFAULT_MASK_BITS, &WorldQueryContext::TreeQueryCallback, &context );
-	}
-}
-
-// void b2ParticleSystem::NotifyBodyContactListenerPreContact(
-// 	FixtureParticleSet* fixtureSet) const
-// {
-// 	b2ContactListener* const contactListener = GetFixtureContactListener();
-// 	if (contactListener == NULL)
-// 		return;
-
-// 	fixtureSet->Initialize(m_bodyContactBuffer.Begin(),
-// 						   m_bodyContactBuffer.GetCount(),
-// 						   GetFlagsBuffer());
-// }
-
-// // If a contact listener is present and the contact is just starting
-// // report the contact.  If the contact is already in progress invalid
-// // the contact from m_fixtureSet.
-// void b2ParticleSystem::NotifyBodyContactListenerPostContact(
-// 	FixtureParticleSet& fixtureSet)
-// {
-// 	b2ContactListener* const contactListener = GetFixtureContactListener();
-// 	if (contactListener == NULL)
-// 		return;
-
-// 	// Loop through all new contacts, reporting any new ones, and
-// 	// "invalidating" the ones that still exist.
-// 	for (b2ParticleBodyContact* contact = m_bodyContactBuffer.Begin();
-// 		 contact != m_bodyContactBuffer.End(); ++contact)
-// 	{
-// 		b2Assert(contact);
-// 		FixtureParticle fixtureParticleToFind;
-// 		fixtureParticleToFind.first = contact->fixture;
-// 		fixtureParticleToFind.second = contact->index;
-// 		const int32 index = fixtureSet.Find(fixtureParticleToFind);
-// 		if (index >= 0)
-// 		{
-// 			// Already touching remove this from the set.
-// 			fixtureSet.Invalidate(index);
-// 		}
-// 		else
-// 		{
-// 			// Just started touching, report it!
-// 			contactListener->BeginContact(this, contact);
-// 		}
-// 	}
-
-// 	// If the contact listener is enabled, report all fixtures that are no
-// 	// longer in contact with particles.
-// 	const FixtureParticle* const fixtureParticles = fixtureSet.GetBuffer();
-// 	const int8* const fixtureParticlesValid = fixtureSet.GetValidBuffer();
-// 	const int32 fixtureParticleCount = fixtureSet.GetCount();
-// 	for (int32 i = 0; i < fixtureParticleCount; ++i)
-// 	{
-// 		if (fixtureParticlesValid[i])
-// 		{
-// 			const FixtureParticle* const fixtureParticle =
-// 				&fixtureParticles[i];
-// 			contactListener->EndContact(fixtureParticle->first, this,
-// 										fixtureParticle->second);
-// 		}
-// 	}
-// }
+	// A shared group index can override the mask bits, so only a system
+	// without a group can let the tree cull shapes by category.
+	const uint64_t maskBits = m_def.filter.groupIndex == 0 ?
+		m_def.filter.maskBits : B2_DEFAULT_MASK_BITS;
+	for ( int i = includeStaticShapes ? 0 : b2_staticBody + 1; i < b2_bodyTypeCount; ++i )
+	{
+		b2DynamicTree_Query( m_world->broadPhase.trees + i, aabb, maskBits, &WorldQueryContext::TreeQueryCallback, &context );
+	}
+}
+
+// Pass the contacts of particles with the b2_fixtureContactFilterParticle
+// flag to the batched filter in a single call, and remove the rejected ones.
+// T must have 'shape' and 'index' members.
+template <typename T>
+void b2ParticleSystem::FilterBodyContacts(b2GrowableBuffer<T>& contacts)
+{
+	if (m_bodyContactFilterFcn == NULL ||
+		!(m_allParticleFlags & b2_fixtureContactFilterParticle))
+	{
+		return;
+	}
+
+	const int32 contactCount = contacts.GetCount();
+	b2ParticleBodyContactCandidate* candidates =
+		(b2ParticleBodyContactCandidate*) m_stackAllocator.Allocate(
+			sizeof(b2ParticleBodyContactCandidate) * contactCount);
+	int32 candidateCount = 0;
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const T& contact = contacts[k];
+		if (m_flagsBuffer.data[contact.index] &
+			b2_fixtureContactFilterParticle)
+		{
+			b2ParticleBodyContactCandidate& candidate =
+				candidates[candidateCount++];
+			candidate.shapeId = b2MakeParticleShapeId(
+				m_world, contact.shape->id, contact.shape->generation);
+			candidate.index = contact.index;
+		}
+	}
 
+	bool* keep = (bool*) m_stackAllocator.Allocate(
+		sizeof(bool) * candidateCount);
+	memset(keep, 1, sizeof(bool) * candidateCount);
+	if (candidateCount)
+	{
+		m_bodyContactFilterFcn(this, candidates, candidateCount, keep,
+							   m_bodyContactFilterContext);
+	}
 
-void b2ParticleSystem::UpdateBodyContacts()
+	// Compact the contacts in place, preserving their order.
+	int32 candidateIndex = 0;
+	int32 newCount = 0;
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const T& contact = contacts[k];
+		if (!(m_flagsBuffer.data[contact.index] &
+			  b2_fixtureContactFilterParticle) || keep[candidateIndex++])
+		{
+			contacts[newCount++] = contact;
+		}
+	}
+	contacts.SetCount(newCount);
+
+	m_stackAllocator.Free(keep);
+	m_stackAllocator.Free(candidates);
+}
+
+void b2ParticleSystem::UpdateShapeCandidates(const b2AABB& aabb)
 {
-	// If the particle contact listener is enabled, generate a set of
-	// fixture / particle contacts.
-	FixtureParticleSet fixtureSet(&m_stackAllocator);
-	// NotifyBodyContactListenerPreContact(&fixtureSet);
+	class UpdateShapeCandidatesCallback : public b2ShapeParticleQueryCallback
+	{
+		void ReportShapeAndParticle(b2Shape* shape, int32 a)
+		{
+			ShapeParticle& candidate = m_candidates->Append();
+			candidate.shape = shape;
+			candidate.index = a;
+			candidate.distance = 0;
+		}
 
+		b2GrowableBuffer<ShapeParticle>* m_candidates;
+
+	public:
+		UpdateShapeCandidatesCallback(
+			b2GrowableBuffer<ShapeParticle>* candidates)
+		{
+			m_candidates = candidates;
+		}
+	} callback(&m_shapeCandidateBuffer);
+
+	m_shapeCandidateBuffer.SetCount(0);
+	m_shapeCandidateBounds = aabb;
+	QueryShapeParticle(&callback, aabb, m_staticDistanceField == NULL);
+}
+
+void b2ParticleSystem::UpdateBodyContacts()
+{
 	if (m_stuckThreshold > 0)
 	{
 		const int32 particleCount = GetParticleCount();
@@ -2476,364 +2768,1092 @@ void b2ParticleSystem::UpdateBodyContacts()
 	m_bodyContactBuffer.SetCount(0);
 	m_stuckParticleBuffer.SetCount(0);
 
-	struct UpdateBodyContactsCallback : public b2ShapeParticleQueryCallback
+	// The bounds are kept up to date by Solve() and save a pass over the
+	// particles. LimitVelocity() keeps the particles within one diameter of
+	// their current positions during this particle iteration, so these
+	// candidates also serve SolveCollision().
+	const b2AABB& bounds = GetAABB();
+	b2Vec2 padding = {m_particleDiameter, m_particleDiameter};
+	b2AABB aabb = {bounds.lowerBound - padding, bounds.upperBound + padding};
+	UpdateShapeCandidates(aabb);
+
+	for (int32 k = 0; k < m_shapeCandidateBuffer.GetCount(); k++)
 	{
-	private:
-		// Call the contact filter if it's set, to determine whether to
-		// filter this contact.  Returns true if contact calculations should
-		// be performed, false otherwise.
-		inline bool ShouldCollide(b2Shape * const shape,
-								  int32 particleIndex)
-		{
-			return true;
-		}
+		ShapeParticle& candidate = m_shapeCandidateBuffer[k];
+		b2Shape* shape = candidate.shape;
+		int32 a = candidate.index;
+		b2Vec2 ap = m_positionBuffer.data[a];
 
-		void ReportShapeAndParticle(b2Shape* shape, int32 a)
+		b2Body* body = b2BodyArray_Get( &m_world->bodies, shape->bodyId );
+		b2Transform transform = b2GetBodyTransformQuick( m_world, body );
+
+		b2Vec2 n;
+		float32 d = b2ShapeComputeDistance(shape, transform, ap, &n);
+		candidate.distance = d;
+
+		if (d < m_particleDiameter)
 		{
-			b2Vec2 ap = m_system->m_positionBuffer.data[a];
-			
-			b2Body* body = b2BodyArray_Get( &m_system->m_world->bodies, shape->bodyId );
-			b2Transform transform = b2GetBodyTransformQuick( m_system->m_world, body );
+			b2BodySim* bodySim = b2GetBodySim( m_world, body );
 
-			b2Vec2 n;
-			float32 d = b2ShapeComputeDistance(shape, transform, ap, &n);
-			
-			if (d < m_system->m_particleDiameter && ShouldCollide(shape, a))
-			{
-				b2BodySim* bodySim = b2GetBodySim( m_system->m_world, body );
-				
-				b2Vec2 bp = bodySim->center;
-				float32 bm = body->mass;
-				float32 bI = body->inertia - bm * b2LengthSquared(bodySim->localCenter);
-				float32 invBm = bm > 0 ? 1 / bm : 0;
-				float32 invBI = bI > 0 ? 1 / bI : 0;
-				float32 invAm =
-					m_system->m_flagsBuffer.data[a] &
-					b2_wallParticle ? 0 : m_system->GetParticleInvMass();
-				b2Vec2 rp = ap - bp;
-				float32 rpn = b2Cross(rp, n);
-				float32 invM = invAm + invBm + invBI * rpn * rpn;
-
-				b2ParticleBodyContact& contact =
-					m_system->m_bodyContactBuffer.Append();
-				contact.index = a;
-				contact.body = body;
-				contact.shape = shape;
-				contact.weight = 1 - d * m_system->m_inverseDiameter;
-				contact.normal = -n;
-				contact.mass = invM > 0 ? 1 / invM : 0;
-				m_system->DetectStuckParticle(a);
-			}
-		}
+			b2Vec2 bp = bodySim->center;
+			float32 bm = body->mass;
+			float32 bI = body->inertia - bm * b2LengthSquared(bodySim->localCenter);
+			float32 invBm = bm > 0 ? 1 / bm : 0;
+			float32 invBI = bI > 0 ? 1 / bI : 0;
+			float32 invAm =
+				m_flagsBuffer.data[a] &
+				b2_wallParticle ? 0 : GetParticleInvMass();
+			b2Vec2 rp = ap - bp;
+			float32 rpn = b2Cross(rp, n);
+			float32 invM = invAm + invBm + invBI * rpn * rpn;
 
-		b2ParticleSystem* m_system;
-	
-	public:
-		explicit UpdateBodyContactsCallback(b2ParticleSystem* system) : m_system(system) {}
-	} callback{this};
+			b2ParticleBodyContact& contact = m_bodyContactBuffer.Append();
+			contact.index = a;
+			contact.body = body;
+			contact.shape = shape;
+			contact.weight = 1 - d * m_inverseDiameter;
+			contact.normal = -n;
+			contact.mass = invM > 0 ? 1 / invM : 0;
+		}
+	}
+	if (m_staticDistanceField)
+	{
+		UpdateStaticBodyContacts();
+	}
+	FilterBodyContacts(m_bodyContactBuffer);
 
-	b2AABB aabb;
-	ComputeAABB(&aabb);
-	QueryShapeParticle(&callback, aabb);
+	if (m_stuckThreshold > 0)
+	{
+		for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+		{
+			DetectStuckParticle(m_bodyContactBuffer[k].index);
+		}
+	}
 
 	if (m_def.strictContactCheck)
 	{
 		RemoveSpuriousBodyContacts();
 	}
 
-	// NotifyBodyContactListenerPostContact(fixtureSet);
+	UpdateBodyContactEvents();
 }
 
-void b2ParticleSystem::RemoveSpuriousBodyContacts()
+void b2ParticleSystem::UpdateStaticDistanceField()
 {
-	// At this point we have a list of contact candidates based on AABB
-	// overlap.The AABB query that  generated this returns all collidable
-	// fixtures overlapping particle bounding boxes.  This breaks down around
-	// vertices where two shapes intersect, such as a "ground" surface made
-	// of multiple b2PolygonShapes; it potentially applies a lot of spurious
-	// impulses from normals that should not actually contribute.  See the
-	// Ramp example in Testbed.
-	//
-	// To correct for this, we apply this algorithm:
-	//   * sort contacts by particle and subsort by weight (nearest to farthest)
-	//   * for each contact per particle:
-	//      - project a point at the contact distance along the inverse of the
-	//        contact normal
-	//      - if this intersects the fixture that generated the contact, apply
-	//         it, otherwise discard as impossible
-	//      - repeat for up to n nearest contacts, currently we get good results
-	//        from n=3.
-	std::sort(m_bodyContactBuffer.Begin(), m_bodyContactBuffer.End(),
-				b2ParticleSystem::BodyContactCompare);
-
-	int32 discarded = 0;
-	std::remove_if(m_bodyContactBuffer.Begin(),
-					m_bodyContactBuffer.End(),
-					b2ParticleBodyContactRemovePredicate(this, &discarded));
-
-	m_bodyContactBuffer.SetCount(m_bodyContactBuffer.GetCount() - discarded);
+	const float32 spacing =
+		m_particleDiameter / b2_particleStaticFieldSubdivisions;
+	if (m_staticDistanceField &&
+		(!m_def.staticDistanceField ||
+		 m_staticDistanceField->GetSpacing() != spacing))
+	{
+		m_staticDistanceField->~b2StaticDistanceField();
+		b2Free(m_staticDistanceField, sizeof(b2StaticDistanceField));
+		m_staticDistanceField = NULL;
+	}
+	if (!m_def.staticDistanceField)
+	{
+		return;
+	}
+	if (!m_staticDistanceField)
+	{
+		// The band covers the contact distance and the largest move of a
+		// particle in one particle iteration.
+		void* mem = b2Alloc(sizeof(b2StaticDistanceField));
+		m_staticDistanceField = new (mem) b2StaticDistanceField(
+			m_world, spacing, 2 * m_particleDiameter);
+		m_staticDistanceField->SetFilter(m_def.filter);
+	}
+	else
+	{
+		const b2Filter& filter = m_staticDistanceField->GetFilter();
+		if (filter.categoryBits != m_def.filter.categoryBits ||
+			filter.maskBits != m_def.filter.maskBits ||
+			filter.groupIndex != m_def.filter.groupIndex)
+		{
+			m_staticDistanceField->SetFilter(m_def.filter);
+		}
+	}
+	m_staticDistanceField->Validate();
 }
 
-bool b2ParticleSystem::BodyContactCompare(const b2ParticleBodyContact &lhs,
-										  const b2ParticleBodyContact &rhs)
+static inline bool b2IsInside(const b2AABB& aabb, const b2Vec2& p)
 {
-	if (lhs.index == rhs.index)
-	{
-		// Subsort by weight, decreasing.
-		return lhs.weight > rhs.weight;
-	}
-	return lhs.index < rhs.index;
+	return p.x >= aabb.lowerBound.x && p.y >= aabb.lowerBound.y &&
+		   p.x <= aabb.upperBound.x && p.y <= aabb.upperBound.y;
 }
 
+// The most static shapes tested one by one near a particle, see
+// b2StaticDistanceField::Sample().
+static const int32 k_maxStaticShapes = 8;
 
-void b2ParticleSystem::SolveCollision(const b2StepContext& step)
+void b2ParticleSystem::UpdateStaticBodyContacts()
 {
-	// This function detects particles which are crossing boundary of bodies
-	// and modifies velocities of them so that they will move just in front of
-	// boundary. This function function also applies the reaction force to
-	// bodies as precisely as the numerical stability is kept.
-	b2AABB aabb;
-	aabb.lowerBound.x = +b2_maxFloat;
-	aabb.lowerBound.y = +b2_maxFloat;
-	aabb.upperBound.x = -b2_maxFloat;
-	aabb.upperBound.y = -b2_maxFloat;
-	for (int32 i = 0; i < m_count; i++)
-	{
-		b2Vec2 v = m_velocityBuffer.data[i];
-		b2Vec2 p1 = m_positionBuffer.data[i];
-		b2Vec2 p2 = p1 + step.dt * v;
-		aabb.lowerBound = b2Min(aabb.lowerBound, b2Min(p1, p2));
-		aabb.upperBound = b2Max(aabb.upperBound, b2Max(p1, p2));
-	}
-	class SolveCollisionCallback : public b2ShapeParticleQueryCallback
+	const b2AABB& bounds = m_staticDistanceField->GetBounds();
+	for (int32 a = 0; a < m_count; a++)
 	{
-		// Call the contact filter if it's set, to determine whether to
-		// filter this contact.  Returns true if contact calculations should
-		// be performed, false otherwise.
-		inline bool ShouldCollide(b2Shape * const fixture,
-								  int32 particleIndex)
+		b2Vec2 ap = m_positionBuffer.data[a];
+		if (!b2IsInside(bounds, ap))
 		{
-			return true;
+			continue;
 		}
-
-		void ReportShapeAndParticle(b2Shape* shape, int32 a)
+		float32 d;
+		b2Vec2 n;
+		bool multiple;
+		b2Shape* shape = m_staticDistanceField->Sample(ap, &d, &n, &multiple);
+		if (multiple)
 		{
-			if (ShouldCollide(shape, a)) {
-				b2Body* body = b2BodyArray_Get( &m_system->m_world->bodies, shape->bodyId );
-				b2BodySim* bodySim = b2GetBodySim( m_system->m_world, body );
-				b2Vec2 ap = m_system->m_positionBuffer.data[a];
-				b2Vec2 av = m_system->m_velocityBuffer.data[a];
-				b2RayCastInput input;
-				if (m_system->m_iterationIndex == 0)
-				{
-					// Put 'ap' in the local space of the previous frame
-					b2Vec2 p1 = b2InvTransformPoint(bodySim->transform0, ap);
-					if (shape->type == b2_circleShape)
-					{
-						// Make relative to the center of the circle
-						p1 -= bodySim->localCenter;
-						// Re-apply rotation about the center of the
-						// circle
-						p1 = b2RotateVector(bodySim->transform0.q, p1);
-						// Subtract rotation of the current frame
-						p1 = b2InvRotateVector(bodySim->transform.q, p1);
-						// Return to local space
-						p1 += bodySim->localCenter;
-					}
-					// Return to global space and apply rotation of current frame
-					input.origin = b2TransformPoint(bodySim->transform, p1);
-				}
-				else
-				{
-					input.origin = ap;
-				}
-				input.translation = ap + m_step.dt * av - input.origin;
-				input.maxFraction = 1;
-				b2Transform transform = bodySim->transform;
-				b2CastOutput output = b2RayCastShape(&input, shape, transform);
-				if (output.hit)
+			// The nearest shape does not bound the particle, each shape near
+			// it may touch it.
+			b2Shape* shapes[k_maxStaticShapes];
+			const int32 count = m_staticDistanceField->QueryShapes(
+				ap, shapes, k_maxStaticShapes);
+			for (int32 k = 0; k < count; k++)
+			{
+				d = m_staticDistanceField->ComputeDistance(shapes[k], ap, &n);
+				if (d < m_particleDiameter)
 				{
-					b2Vec2 n = output.normal;
-					b2Vec2 p = input.origin + output.fraction * input.translation + B2_LINEAR_SLOP * n;
-					b2Vec2 v = m_step.inv_dt * (p - ap);
-					m_system->m_velocityBuffer.data[a] = v;
-					b2Vec2 f = m_step.inv_dt *
-						m_system->GetParticleMass() * (av - v);
-					m_system->ParticleApplyForce(a, f);
+					AddStaticBodyContact(a, shapes[k], d, n);
 				}
 			}
 		}
-
-		b2ParticleSystem* m_system;
-		b2StepContext m_step;
-
-	public:
-		SolveCollisionCallback(
-			b2ParticleSystem* system, const b2StepContext& step)
+		else if (shape && d < m_particleDiameter)
 		{
-			m_system = system;
-			m_step = step;
+			AddStaticBodyContact(a, shape, d, n);
 		}
-	} callback(this, step);
-	QueryShapeParticle(&callback, aabb);
+	}
 }
 
-void b2ParticleSystem::SolveBarrier(const b2StepContext& step)
+void b2ParticleSystem::AddStaticBodyContact(int32 a, b2Shape* shape,
+											float32 d, const b2Vec2& n)
 {
-	// If a particle is passing between paired barrier particles,
-	// its velocity will be decelerated to avoid passing.
-	for (int32 i = 0; i < m_count; i++)
+	// Like b2ShapeComputeDistance(), penetration counts as touching.
+	d = b2MaxFloat(d, 0.0f);
+	b2ParticleBodyContact& contact = m_bodyContactBuffer.Append();
+	contact.index = a;
+	contact.body = b2BodyArray_Get(&m_world->bodies, shape->bodyId);
+	contact.shape = shape;
+	contact.weight = 1 - d * m_inverseDiameter;
+	contact.normal = -n;
+	// Static bodies have no mass, only the particle moves.
+	contact.mass = m_flagsBuffer.data[a] & b2_wallParticle ?
+		0 : GetParticleMass();
+}
+
+// Change the velocity v of a particle at p which would end the substep
+// behind the plane at the distance d along the normal n, so that it stops
+// just in front of it.
+static inline void b2StopInFrontOfPlane(const b2Vec2& p, float32 d,
+										const b2Vec2& n,
+										const b2StepContext& step, b2Vec2* v)
+{
+	b2Vec2 p2 = p + step.dt * *v;
+	float32 front = d + b2Dot(p2 - p, n);
+	if (front < B2_LINEAR_SLOP)
 	{
-		uint32 flags = m_flagsBuffer.data[i];
-		static const uint32 k_barrierWallFlags =
-										b2_barrierParticle | b2_wallParticle;
-		if ((flags & k_barrierWallFlags) == k_barrierWallFlags)
-		{
-			m_velocityBuffer.data[i] = b2Vec2_zero;
-		}
+		*v = step.inv_dt * (p2 + (B2_LINEAR_SLOP - front) * n - p);
 	}
-	float32 tmax = b2_barrierCollisionTime * step.dt;
-	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+}
+
+void b2ParticleSystem::SolveStaticCollision(const b2StepContext& step)
+{
+	// The static shapes near a particle are approximated by the plane
+	// through the nearest point of their surface. A particle which would end
+	// the substep behind the plane is stopped just in front of it, like the
+	// ray casts of SolveCollision() do for the other shapes. Near more than
+	// one shape, such as in a corner, the particle is stopped in front of
+	// the plane of each.
+	const b2AABB& bounds = m_staticDistanceField->GetBounds();
+	for (int32 a = 0; a < m_count; a++)
 	{
-		const b2ParticlePair& pair = m_pairBuffer[k];
-		if (pair.flags & b2_barrierParticle)
-		{
-			int32 a = pair.indexA;
-			int32 b = pair.indexB;
-			b2Vec2 pa = m_positionBuffer.data[a];
-			b2Vec2 pb = m_positionBuffer.data[b];
-			b2AABB aabb;
-			aabb.lowerBound = b2Min(pa, pb);
-			aabb.upperBound = b2Max(pa, pb);
-			b2ParticleGroup *aGroup = m_groupBuffer[a];
-			b2ParticleGroup *bGroup = m_groupBuffer[b];
-			b2Vec2 va = GetLinearVelocity(aGroup, a, pa);
-			b2Vec2 vb = GetLinearVelocity(bGroup, b, pb);
-			b2Vec2 pba = pb - pa;
-			b2Vec2 vba = vb - va;
-			InsideBoundsEnumerator enumerator = GetInsideBoundsEnumerator(aabb);
-			int32 c;
-			while ((c = enumerator.GetNext()) >= 0)
+		b2Vec2 ap = m_positionBuffer.data[a];
+		if (!b2IsInside(bounds, ap))
+		{
+			continue;
+		}
+		float32 d;
+		b2Vec2 n;
+		bool multiple;
+		if (!m_staticDistanceField->Sample(ap, &d, &n, &multiple))
+		{
+			continue;
+		}
+		b2Vec2 av = m_velocityBuffer.data[a];
+		b2Vec2 v = av;
+		if (multiple)
+		{
+			b2Shape* shapes[k_maxStaticShapes];
+			const int32 count = m_staticDistanceField->QueryShapes(
+				ap, shapes, k_maxStaticShapes);
+			for (int32 k = 0; k < count; k++)
 			{
-				b2Vec2 pc = m_positionBuffer.data[c];
-				b2ParticleGroup *cGroup = m_groupBuffer[c];
-				if (aGroup != cGroup && bGroup != cGroup)
+				d = m_staticDistanceField->ComputeDistance(shapes[k], ap, &n);
+				if (d < m_particleDiameter)
 				{
-					b2Vec2 vc = GetLinearVelocity(cGroup, c, pc);
-					// Solve the equation below:
-					//   (1-s)*(pa+t*va)+s*(pb+t*vb) = pc+t*vc
-					// which expresses that the particle c will pass a line
-					// connecting the particles a and b at the time of t.
-					// if s is between 0 and 1, c will pass between a and b.
-					b2Vec2 pca = pc - pa;
-					b2Vec2 vca = vc - va;
-					float32 e2 = b2Cross(vba, vca);
-					float32 e1 = b2Cross(pba, vca) - b2Cross(pca, vba);
-					float32 e0 = b2Cross(pba, pca);
-					float32 s, t;
-					b2Vec2 qba, qca;
-					if (e2 == 0)
-					{
-						if (e1 == 0) continue;
-						t = - e0 / e1;
-						if (!(t >= 0 && t < tmax)) continue;
-						qba = pba + t * vba;
-						qca = pca + t * vca;
-						s = b2Dot(qba, qca) / b2Dot(qba, qba);
-						if (!(s >= 0 && s <= 1)) continue;
-					}
-					else
-					{
-						float32 det = e1 * e1 - 4 * e0 * e2;
-						if (det < 0) continue;
-						float32 sqrtDet = sqrtf(det);
-						float32 t1 = (- e1 - sqrtDet) / (2 * e2);
-						float32 t2 = (- e1 + sqrtDet) / (2 * e2);
-						if (t1 > t2) std::swap(t1, t2);
-						t = t1;
-						qba = pba + t * vba;
-						qca = pca + t * vca;
-						s = b2Dot(qba, qca) / b2Dot(qba, qba);
-						if (!(t >= 0 && t < tmax && s >= 0 && s <= 1))
-						{
-							t = t2;
-							if (!(t >= 0 && t < tmax)) continue;
-							qba = pba + t * vba;
-							qca = pca + t * vca;
-							s = b2Dot(qba, qca) / b2Dot(qba, qba);
-							if (!(s >= 0 && s <= 1)) continue;
-						}
-					}
-					// Apply a force to particle c so that it will have the
-					// interpolated velocity at the collision point on line ab.
-					b2Vec2 dv = va + s * vba - vc;
-					b2Vec2 f = GetParticleMass() * dv;
-					if (IsRigidGroup(cGroup))
-					{
-						// If c belongs to a rigid group, the force will be
-						// distributed in the group.
-						float32 mass = cGroup->GetMass();
-						float32 inertia = cGroup->GetInertia();
-						if (mass > 0)
-						{
-							cGroup->m_linearVelocity += 1 / mass * f;
-						}
-						if (inertia > 0)
-						{
-							cGroup->m_angularVelocity +=
-								b2Cross(pc - cGroup->GetCenter(), f) / inertia;
-						}
-					}
-					else
-					{
-						m_velocityBuffer.data[c] += dv;
-					}
-					// Apply a reversed force to particle c after particle
-					// movement so that momentum will be preserved.
-					ParticleApplyForce(c, -step.inv_dt * f);
+					b2StopInFrontOfPlane(ap, d, n, step, &v);
 				}
 			}
 		}
+		else if (n.x != 0 || n.y != 0)
+		{
+			b2StopInFrontOfPlane(ap, d, n, step, &v);
+		}
+		if (v.x != av.x || v.y != av.y)
+		{
+			m_velocityBuffer.data[a] = v;
+			b2Vec2 f = step.inv_dt *
+				GetParticleMass() * (av - v);
+			ParticleApplyForce(a, f);
+		}
 	}
 }
 
-void b2ParticleSystem::Solve(const b2StepContext& step)
+// Sort items with a 64-bit 'key' member using a least significant digit radix
+// sort on 8-bit digits. Digits that are equal for all items are skipped, so
+// keys made of a shape index and a particle index take only a few passes.
+// 'temp' must have room for 'count' items.
+template<typename T>
+static void RadixSortByKey(T* items, T* temp, int32 count)
 {
-	if (m_count == 0)
+	static const int32 k_digitCount = 8;
+	if (count < 2)
 	{
 		return;
 	}
-	// If particle lifetimes are enabled, destroy particles that are too old.
-	if (m_expirationTimeBuffer.data)
+	int32 histograms[k_digitCount][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (int32 i = 0; i < count; i++)
 	{
-		SolveLifetimes(step);
+		const uint64 key = items[i].key;
+		for (int32 d = 0; d < k_digitCount; d++)
+		{
+			histograms[d][(key >> (8 * d)) & 0xff]++;
+		}
 	}
-	if (m_allParticleFlags & b2_zombieParticle)
+
+	T* source = items;
+	T* destination = temp;
+	for (int32 d = 0; d < k_digitCount; d++)
 	{
-		SolveZombie();
+		int32* const histogram = histograms[d];
+		const uint32 shift = 8 * d;
+		if (histogram[(source[0].key >> shift) & 0xff] == count)
+		{
+			continue;
+		}
+		int32 offset = 0;
+		for (int32 digit = 0; digit < 256; digit++)
+		{
+			const int32 digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+		for (int32 i = 0; i < count; i++)
+		{
+			destination[histogram[(source[i].key >> shift) & 0xff]++] =
+				source[i];
+		}
+		std::swap(source, destination);
 	}
-	if (m_needsUpdateAllParticleFlags)
+	if (source != items)
 	{
-		UpdateAllParticleFlags();
+		memcpy(items, source, sizeof(T) * count);
 	}
-	if (m_needsUpdateAllGroupFlags)
+}
+
+static inline uint64 b2MakeBodyContactKey(int32 shapeIndex, int32 index)
+{
+	return ((uint64)(uint32)shapeIndex << 32) | (uint32)index;
+}
+
+static inline int32 b2BodyContactKeyShapeIndex(uint64 key)
+{
+	return (int32)(key >> 32);
+}
+
+static inline int32 b2BodyContactKeyIndex(uint64 key)
+{
+	return (int32)(key & 0xffffffffu);
+}
+
+// Generate particle / shape begin and end touch events by diffing the body
+// contacts found by this UpdateBodyContacts() against the previous ones, and
+// count the particles touching each shape. Both sets are radix sorted by
+// (shape, particle) so the whole update is linear in the number of contacts.
+void b2ParticleSystem::UpdateBodyContactEvents()
+{
+	const int32 previousCount = m_bodyContactEventKeyBuffer.GetCount();
+	if (!(m_allParticleFlags & b2_fixtureContactListenerParticle) &&
+		previousCount == 0)
 	{
-		UpdateAllGroupFlags();
+		return;
 	}
-	if (m_paused)
+	if (m_bodyContactEventKeysRequireSorting)
 	{
-		return;
+		BodyContactKey* temp = (BodyContactKey*) m_stackAllocator.Allocate(
+			sizeof(BodyContactKey) * previousCount);
+		RadixSortByKey(m_bodyContactEventKeyBuffer.Data(), temp,
+					   previousCount);
+		m_stackAllocator.Free(temp);
+		m_bodyContactEventKeysRequireSorting = false;
 	}
-	for (m_iterationIndex = 0;
-		m_iterationIndex < step.particleIterations;
-		m_iterationIndex++)
+
+	// Gather the keys of the contacts that should be reported.
+	const int32 contactCount = m_bodyContactBuffer.GetCount();
+	BodyContactKey* keys = (BodyContactKey*) m_stackAllocator.Allocate(
+		2 * sizeof(BodyContactKey) * contactCount);
+	int32 keyCount = 0;
+	if (m_allParticleFlags & b2_fixtureContactListenerParticle)
 	{
-		++m_timestamp;
-		b2StepContext subStep = step;
-		subStep.dt /= step.particleIterations;
-		subStep.inv_dt *= step.particleIterations;
-		UpdateContacts(false);
-		UpdateBodyContacts();
+		for (int32 k = 0; k < contactCount; k++)
+		{
+			const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+			if (m_flagsBuffer.data[contact.index] &
+				b2_fixtureContactListenerParticle)
+			{
+				BodyContactKey& key = keys[keyCount++];
+				key.key = b2MakeBodyContactKey(contact.shape->id,
+											   contact.index);
+				key.generation = contact.shape->generation;
+			}
+		}
+		RadixSortByKey(keys, keys + contactCount, keyCount);
+	}
+
+	// Keys only in the current set began touching, keys only in the
+	// previous set stopped touching. A shape index that was reused by a new
+	// shape ends the old contact and begins a new one.
+	const BodyContactKey* previous = m_bodyContactEventKeyBuffer.Data();
+	int32 i = 0;
+	int32 j = 0;
+	while (i < previousCount || j < keyCount)
+	{
+		const bool endPrevious = j == keyCount ||
+			(i < previousCount && previous[i].key <= keys[j].key);
+		const bool beginCurrent = i == previousCount ||
+			(j < keyCount && keys[j].key <= previous[i].key);
+		if (endPrevious && beginCurrent &&
+			previous[i].generation == keys[j].generation)
+		{
+			i++;
+			j++;
+			continue;
+		}
+		if (endPrevious)
+		{
+			b2ParticleBodyContactEndTouchEvent& event =
+				m_bodyContactEndEventBuffer.Append();
+			event.shapeId = b2MakeParticleShapeId(
+				m_world, b2BodyContactKeyShapeIndex(previous[i].key),
+				previous[i].generation);
+			event.index = b2BodyContactKeyIndex(previous[i].key);
+			i++;
+		}
+		if (beginCurrent)
+		{
+			b2ParticleBodyContactBeginTouchEvent& event =
+				m_bodyContactBeginEventBuffer.Append();
+			event.shapeId = b2MakeParticleShapeId(
+				m_world, b2BodyContactKeyShapeIndex(keys[j].key),
+				keys[j].generation);
+			event.index = b2BodyContactKeyIndex(keys[j].key);
+			j++;
+		}
+	}
+
+	// The keys are grouped by shape, so the touch counts are run lengths.
+	m_shapeTouchBuffer.SetCount(0);
+	for (int32 k = 0; k < keyCount; k++)
+	{
+		const int32 shapeIndex = b2BodyContactKeyShapeIndex(keys[k].key);
+		if (k == 0 ||
+			shapeIndex != b2BodyContactKeyShapeIndex(keys[k - 1].key))
+		{
+			b2ParticleShapeTouch& touch = m_shapeTouchBuffer.Append();
+			touch.shapeId = b2MakeParticleShapeId(m_world, shapeIndex,
+												  keys[k].generation);
+			touch.particleCount = 0;
+		}
+		m_shapeTouchBuffer[m_shapeTouchBuffer.GetCount() - 1].particleCount++;
+	}
+
+	m_bodyContactEventKeyBuffer.SetCount(0);
+	m_bodyContactEventKeyBuffer.Reserve(keyCount);
+	m_bodyContactEventKeyBuffer.SetCount(keyCount);
+	memcpy(m_bodyContactEventKeyBuffer.Data(), keys,
+		   sizeof(BodyContactKey) * keyCount);
+	m_stackAllocator.Free(keys);
+}
+
+// Remove the pairs, triads and contact event keys of a particle recycled by
+// an emitter, like SolveZombie() does for a destroyed particle. The recycled
+// particle rarely has any, so the scans only run when the system has some.
+void b2ParticleSystem::RemoveRecycledParticleReferences(int32 index)
+{
+	struct Test
+	{
+		bool operator()(const b2ParticlePair& pair) const
+		{
+			return pair.indexA == index || pair.indexB == index;
+		}
+		bool operator()(const b2ParticleTriad& triad) const
+		{
+			return triad.indexA == index || triad.indexB == index ||
+				   triad.indexC == index;
+		}
+		bool operator()(uint64 key) const
+		{
+			return b2ParticleContactKeyIndexA(key) == index ||
+				   b2ParticleContactKeyIndexB(key) == index;
+		}
+		bool operator()(const BodyContactKey& key) const
+		{
+			return b2BodyContactKeyIndex(key.key) == index;
+		}
+		int32 index;
+	} test;
+	test.index = index;
+
+	const int32 pairCount = m_pairBuffer.GetCount();
+	const int32 triadCount = m_triadBuffer.GetCount();
+	if (pairCount || triadCount)
+	{
+		m_pairBuffer.RemoveIf(test);
+		m_triadBuffer.RemoveIf(test);
+		if (m_pairBuffer.GetCount() != pairCount ||
+			m_triadBuffer.GetCount() != triadCount)
+		{
+			m_connectionsNeedColoring = true;
+		}
+	}
+	// The surviving keys stay sorted. The recycled particle gets no end
+	// events, like a destroyed one.
+	if (m_contactEventKeyBuffer.GetCount())
+	{
+		m_contactEventKeyBuffer.RemoveIf(test);
+	}
+	if (m_bodyContactEventKeyBuffer.GetCount())
+	{
+		m_bodyContactEventKeyBuffer.RemoveIf(test);
+	}
+}
+
+int32 b2ParticleSystem::GetShapeParticleCount(b2ShapeId shapeId) const
+{
+	struct ShapeTouchComparator
+	{
+		bool operator()(const b2ParticleShapeTouch& touch, int32 index1) const
+		{
+			return touch.shapeId.index1 < index1;
+		}
+	};
+	const b2ParticleShapeTouch* end = m_shapeTouchBuffer.End();
+	const b2ParticleShapeTouch* touch = std::lower_bound(
+		m_shapeTouchBuffer.Begin(), end, shapeId.index1,
+		ShapeTouchComparator());
+	if (touch != end && touch->shapeId.index1 == shapeId.index1 &&
+		touch->shapeId.generation == shapeId.generation &&
+		touch->shapeId.world0 == shapeId.world0)
+	{
+		return touch->particleCount;
+	}
+	return 0;
+}
+
+// Max number of contacts processed per particle, from nearest to farthest.
+// This must be at least 2 for correctness with concave shapes; 3 was
+// experimentally arrived at as looking reasonable.
+static const int32 k_maxContactsPerPoint = 3;
+// Number of particles below which RemoveSpuriousBodyContacts() does not
+// split its work into tasks.
+static const int32 k_spuriousBodyContactTaskRange = 256;
+
+void b2ParticleSystem::RemoveSpuriousBodyContacts()
+{
+	// At this point we have a list of contact candidates based on AABB
+	// overlap.The AABB query that  generated this returns all collidable
+	// fixtures overlapping particle bounding boxes.  This breaks down around
+	// vertices where two shapes intersect, such as a "ground" surface made
+	// of multiple b2PolygonShapes; it potentially applies a lot of spurious
+	// impulses from normals that should not actually contribute.  See the
+	// Ramp example in Testbed.
+	//
+	// To correct for this, we apply this algorithm:
+	//   * bucket contacts by particle with a counting sort
+	//   * for each of the n nearest contacts per particle:
+	//      - project a point at the contact distance along the inverse of the
+	//        contact normal
+	//      - if this intersects the fixture that generated the contact, apply
+	//         it, otherwise discard as impossible
+	//   * discard the farther contacts, currently we get good results from
+	//     n=3.
+	const int32 contactCount = m_bodyContactBuffer.GetCount();
+	if (contactCount == 0)
+	{
+		return;
+	}
+
+	int32* offsets = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * (m_count + 1));
+	int32* keptCounts = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * m_count);
+	b2ParticleBodyContact* contacts =
+		(b2ParticleBodyContact*) m_stackAllocator.Allocate(
+			sizeof(b2ParticleBodyContact) * contactCount);
+	memset(offsets, 0, sizeof(int32) * (m_count + 1));
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		offsets[m_bodyContactBuffer[k].index + 1]++;
+	}
+	for (int32 i = 0; i < m_count; i++)
+	{
+		offsets[i + 1] += offsets[i];
+		// Used as the insertion point of each bucket until the tasks set
+		// the number of contacts kept.
+		keptCounts[i] = offsets[i];
+	}
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		contacts[keptCounts[contact.index]++] = contact;
+	}
+
+	SpuriousBodyContactContext context;
+	context.system = this;
+	context.contacts = contacts;
+	context.offsets = offsets;
+	context.keptCounts = keptCounts;
+	if (m_world->workerCount > 1 && m_count > k_spuriousBodyContactTaskRange)
+	{
+		void* task = m_world->enqueueTaskFcn(
+			&RemoveSpuriousBodyContactsTask, m_count,
+			k_spuriousBodyContactTaskRange, &context,
+			m_world->userTaskContext);
+		m_world->taskCount += 1;
+		if (task != NULL)
+		{
+			m_world->finishTaskFcn(task, m_world->userTaskContext);
+		}
+	}
+	else
+	{
+		RemoveSpuriousBodyContactsTask(0, m_count, 0, &context);
+	}
+
+	// Compact the kept contacts, in particle order and nearest first.
+	int32 newCount = 0;
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const b2ParticleBodyContact* bucket = contacts + offsets[i];
+		for (int32 k = 0; k < keptCounts[i]; k++)
+		{
+			m_bodyContactBuffer[newCount++] = bucket[k];
+		}
+	}
+	m_bodyContactBuffer.SetCount(newCount);
+
+	m_stackAllocator.Free(contacts);
+	m_stackAllocator.Free(keptCounts);
+	m_stackAllocator.Free(offsets);
+}
+
+void b2ParticleSystem::RemoveSpuriousBodyContactsTask(int32 startIndex,
+													  int32 endIndex,
+													  uint32 workerIndex,
+													  void* context)
+{
+	B2_NOT_USED(workerIndex);
+	SpuriousBodyContactContext* spurious =
+		(SpuriousBodyContactContext*) context;
+	for (int32 i = startIndex; i < endIndex; i++)
+	{
+		const int32 offset = spurious->offsets[i];
+		const int32 count = spurious->offsets[i + 1] - offset;
+		spurious->keptCounts[i] = count ?
+			spurious->system->SelectBodyContacts(
+				spurious->contacts + offset, count) : 0;
+	}
+}
+
+int32 b2ParticleSystem::SelectBodyContacts(b2ParticleBodyContact* contacts,
+										   int32 count) const
+{
+	// Select the nearest contacts one at a time instead of sorting the
+	// bucket, and move the plausible ones to its front.
+	const int32 selectedCount = b2MinInt(count, k_maxContactsPerPoint);
+	int32 keptCount = 0;
+	for (int32 j = 0; j < selectedCount; j++)
+	{
+		int32 nearest = j;
+		for (int32 k = j + 1; k < count; k++)
+		{
+			if (contacts[k].weight > contacts[nearest].weight)
+			{
+				nearest = k;
+			}
+		}
+		std::swap(contacts[j], contacts[nearest]);
+		if (IsBodyContactPlausible(contacts[j]))
+		{
+			contacts[keptCount++] = contacts[j];
+		}
+	}
+	return keptCount;
+}
+
+bool b2ParticleSystem::IsBodyContactPlausible(
+	const b2ParticleBodyContact& contact) const
+{
+	// Verify that the contact normal of the Body that genenerated the contact
+	// makes physical sense by projecting a point back along that normal and
+	// seeing if it intersects the fixture generating the contact.
+
+	// Project along inverse normal (as returned in the contact) to get the
+	// point to check.
+	b2Vec2 n = contact.normal;
+	// weight is 1-(inv(diameter) * distance)
+	n *= m_particleDiameter * (1 - contact.weight);
+	b2Vec2 pos = m_positionBuffer.data[contact.index] + n;
+
+	// pos is now a point projected back along the contact normal to the
+	// contact distance. If the surface makes sense for a contact, pos will
+	// now lie on or in the fixture generating
+	b2Transform transform = b2GetBodyTransform( m_world, contact.shape->bodyId );
+	if (!b2TestPointInternal(contact.shape, transform, pos))
+	{
+		return b2ShapeComputeDistance(contact.shape, transform, pos, NULL) <
+			B2_LINEAR_SLOP;
+	}
+	return true;
+}
+
+
+void b2ParticleSystem::SolveCollision(const b2StepContext& step)
+{
+	// This function detects particles which are crossing boundary of bodies
+	// and modifies velocities of them so that they will move just in front of
+	// boundary. This function function also applies the reaction force to
+	// bodies as precisely as the numerical stability is kept.
+	if (m_allParticleFlags & b2_barrierParticle ||
+		m_allGroupFlags & b2_rigidParticleGroup)
+	{
+		// SolveBarrier() and SolveRigidDamping() change the velocities after
+		// LimitVelocity(), so the particles may leave the bounds the
+		// candidates were found within.
+		b2AABB aabb = b2MakeEmptyAABB();
+		for (int32 i = 0; i < m_count; i++)
+		{
+			b2Vec2 v = m_velocityBuffer.data[i];
+			b2Vec2 p1 = m_positionBuffer.data[i];
+			b2Vec2 p2 = p1 + step.dt * v;
+			aabb.lowerBound = b2Min(aabb.lowerBound, b2Min(p1, p2));
+			aabb.upperBound = b2Max(aabb.upperBound, b2Max(p1, p2));
+		}
+		if (!b2AABB_Contains(m_shapeCandidateBounds, aabb))
+		{
+			UpdateShapeCandidates(aabb);
+		}
+	}
+	b2GrowableBuffer<ShapeParticle>& candidates = m_shapeCandidateBuffer;
+	FilterBodyContacts(candidates);
+	if (m_staticDistanceField)
+	{
+		SolveStaticCollision(step);
+	}
+
+	for (int32 k = 0; k < candidates.GetCount(); k++)
+	{
+		b2Shape* shape = candidates[k].shape;
+		int32 a = candidates[k].index;
+		b2Vec2 av = m_velocityBuffer.data[a];
+		b2Body* body = b2BodyArray_Get( &m_world->bodies, shape->bodyId );
+		// Rays start at the particle except in the first particle iteration,
+		// where they start where the particle was relative to a moving body
+		// at the previous step. Such a ray cannot reach a shape which is
+		// farther than its length.
+		const float32 distance = candidates[k].distance;
+		if ((m_iterationIndex > 0 || body->type == b2_staticBody) &&
+			distance * distance > step.dt * step.dt * b2Dot(av, av))
+		{
+			continue;
+		}
+		b2BodySim* bodySim = b2GetBodySim( m_world, body );
+		b2Vec2 ap = m_positionBuffer.data[a];
+		b2RayCastInput input;
+		if (m_iterationIndex == 0)
+		{
+			// Put 'ap' in the local space of the previous frame
+			b2Vec2 p1 = b2InvTransformPoint(bodySim->transform0, ap);
+			if (shape->type == b2_circleShape)
+			{
+				// Make relative to the center of the circle
+				p1 -= bodySim->localCenter;
+				// Re-apply rotation about the center of the
+				// circle
+				p1 = b2RotateVector(bodySim->transform0.q, p1);
+				// Subtract rotation of the current frame
+				p1 = b2InvRotateVector(bodySim->transform.q, p1);
+				// Return to local space
+				p1 += bodySim->localCenter;
+			}
+			// Return to global space and apply rotation of current frame
+			input.origin = b2TransformPoint(bodySim->transform, p1);
+		}
+		else
+		{
+			input.origin = ap;
+		}
+		input.translation = ap + step.dt * av - input.origin;
+		input.maxFraction = 1;
+		b2Transform transform = bodySim->transform;
+		b2CastOutput output = b2RayCastShape(&input, shape, transform);
+		if (output.hit)
+		{
+			b2Vec2 n = output.normal;
+			b2Vec2 p = input.origin + output.fraction * input.translation + B2_LINEAR_SLOP * n;
+			b2Vec2 v = step.inv_dt * (p - ap);
+			m_velocityBuffer.data[a] = v;
+			b2Vec2 f = step.inv_dt *
+				GetParticleMass() * (av - v);
+			ParticleApplyForce(a, f);
+		}
+	}
+}
+
+// Decelerate particle c if it is passing between the paired barrier
+// particles of a segment.
+void b2ParticleSystem::SolveBarrierParticle(const BarrierSegment& segment,
+											int32 c, float32 tmax,
+											const b2StepContext& step)
+{
+	b2Vec2 pc = m_positionBuffer.data[c];
+	b2ParticleGroup *cGroup = m_groupBuffer[c];
+	if (segment.aGroup == cGroup || segment.bGroup == cGroup)
+	{
+		return;
+	}
+	b2Vec2 pa = segment.pa;
+	b2Vec2 pba = segment.pba;
+	b2Vec2 va = segment.va;
+	b2Vec2 vba = segment.vba;
+	b2Vec2 vc = GetLinearVelocity(cGroup, c, pc);
+	// Solve the equation below:
+	//   (1-s)*(pa+t*va)+s*(pb+t*vb) = pc+t*vc
+	// which expresses that the particle c will pass a line
+	// connecting the particles a and b at the time of t.
+	// if s is between 0 and 1, c will pass between a and b.
+	b2Vec2 pca = pc - pa;
+	b2Vec2 vca = vc - va;
+	float32 e2 = b2Cross(vba, vca);
+	float32 e1 = b2Cross(pba, vca) - b2Cross(pca, vba);
+	float32 e0 = b2Cross(pba, pca);
+	float32 s, t;
+	b2Vec2 qba, qca;
+	if (e2 == 0)
+	{
+		if (e1 == 0) return;
+		t = - e0 / e1;
+		if (!(t >= 0 && t < tmax)) return;
+		qba = pba + t * vba;
+		qca = pca + t * vca;
+		s = b2Dot(qba, qca) / b2Dot(qba, qba);
+		if (!(s >= 0 && s <= 1)) return;
+	}
+	else
+	{
+		float32 det = e1 * e1 - 4 * e0 * e2;
+		if (det < 0) return;
+		float32 sqrtDet = sqrtf(det);
+		float32 t1 = (- e1 - sqrtDet) / (2 * e2);
+		float32 t2 = (- e1 + sqrtDet) / (2 * e2);
+		if (t1 > t2) std::swap(t1, t2);
+		t = t1;
+		qba = pba + t * vba;
+		qca = pca + t * vca;
+		s = b2Dot(qba, qca) / b2Dot(qba, qba);
+		if (!(t >= 0 && t < tmax && s >= 0 && s <= 1))
+		{
+			t = t2;
+			if (!(t >= 0 && t < tmax)) return;
+			qba = pba + t * vba;
+			qca = pca + t * vca;
+			s = b2Dot(qba, qca) / b2Dot(qba, qba);
+			if (!(s >= 0 && s <= 1)) return;
+		}
+	}
+	// Apply a force to particle c so that it will have the
+	// interpolated velocity at the collision point on line ab.
+	b2Vec2 dv = va + s * vba - vc;
+	b2Vec2 f = GetParticleMass() * dv;
+	if (IsRigidGroup(cGroup))
+	{
+		// If c belongs to a rigid group, the force will be
+		// distributed in the group.
+		float32 mass = cGroup->GetMass();
+		float32 inertia = cGroup->GetInertia();
+		if (mass > 0)
+		{
+			cGroup->m_linearVelocity += 1 / mass * f;
+		}
+		if (inertia > 0)
+		{
+			cGroup->m_angularVelocity +=
+				b2Cross(pc - cGroup->GetCenter(), f) / inertia;
+		}
+	}
+	else
+	{
+		m_velocityBuffer.data[c] += dv;
+	}
+	// Apply a reversed force to particle c after particle
+	// movement so that momentum will be preserved.
+	ParticleApplyForce(c, -step.inv_dt * f);
+}
+
+void b2ParticleSystem::SolveBarrier(const b2StepContext& step)
+{
+	// If a particle is passing between paired barrier particles,
+	// its velocity will be decelerated to avoid passing.
+	for (int32 i = 0; i < m_count; i++)
+	{
+		uint32 flags = m_flagsBuffer.data[i];
+		static const uint32 k_barrierWallFlags =
+										b2_barrierParticle | b2_wallParticle;
+		if ((flags & k_barrierWallFlags) == k_barrierWallFlags)
+		{
+			m_velocityBuffer.data[i] = b2Vec2_zero;
+		}
+	}
+
+	// Index the barrier segments of this substep by the rows of the tags
+	// they overlap. A particle is tested against a segment if its tag is
+	// inside the bounds of the segment expanded by one diameter, like
+	// GetInsideBoundsEnumerator() would find it.
+	// The positions and velocities of the barrier particles are captured
+	// here, before any particle is decelerated, and the particles are then
+	// visited in proxy order, testing each against all of its segments.
+	// Earlier versions visited the segments in pair order and read the
+	// barrier particles' velocities as they went, so a barrier particle
+	// decelerated by one segment moved the next segment. Only barrier
+	// particles which are also caught by another barrier see a difference.
+	int32 segmentCount = 0;
+	int32 rowCount = 0;
+	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+	{
+		if (m_pairBuffer[k].flags & b2_barrierParticle)
+		{
+			segmentCount++;
+		}
+	}
+	if (segmentCount == 0)
+	{
+		return;
+	}
+	BarrierSegment* segments = (BarrierSegment*) m_stackAllocator.Allocate(
+		sizeof(BarrierSegment) * segmentCount);
+	segmentCount = 0;
+	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+	{
+		const b2ParticlePair& pair = m_pairBuffer[k];
+		if (!(pair.flags & b2_barrierParticle))
+		{
+			continue;
+		}
+		int32 a = pair.indexA;
+		int32 b = pair.indexB;
+		b2Vec2 pa = m_positionBuffer.data[a];
+		b2Vec2 pb = m_positionBuffer.data[b];
+		b2ParticleGroup *aGroup = m_groupBuffer[a];
+		b2ParticleGroup *bGroup = m_groupBuffer[b];
+		BarrierSegment& segment = segments[segmentCount++];
+		segment.pa = pa;
+		segment.pba = pb - pa;
+		segment.va = GetLinearVelocity(aGroup, a, pa);
+		segment.vba = GetLinearVelocity(bGroup, b, pb) - segment.va;
+		segment.aGroup = aGroup;
+		segment.bGroup = bGroup;
+		b2Vec2 lower = b2Min(pa, pb);
+		b2Vec2 upper = b2Max(pa, pb);
+		segment.lowerTag = computeTag(m_inverseDiameter * lower.x - 1,
+									  m_inverseDiameter * lower.y - 1);
+		segment.upperTag = computeTag(m_inverseDiameter * upper.x + 1,
+									  m_inverseDiameter * upper.y + 1);
+		if ((segment.lowerTag & xMask) <= (segment.upperTag & xMask) &&
+			segment.lowerTag <= segment.upperTag)
+		{
+			rowCount += (int32) ((segment.upperTag >> yShift) -
+				(segment.lowerTag >> yShift)) + 1;
+		}
+	}
+	// One key per row of each segment: the lowest tag of the segment in the
+	// row, then the index of the segment.
+	uint64* rows = (uint64*) m_stackAllocator.Allocate(
+		sizeof(uint64) * b2MaxInt(rowCount, 1));
+	int32* active = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * segmentCount);
+	rowCount = 0;
+	for (int32 k = 0; k < segmentCount; k++)
+	{
+		const BarrierSegment& segment = segments[k];
+		const uint32 xLower = segment.lowerTag & xMask;
+		if (xLower > (segment.upperTag & xMask))
+		{
+			continue;
+		}
+		for (uint32 y = segment.lowerTag >> yShift;
+			 y <= segment.upperTag >> yShift; y++)
+		{
+			rows[rowCount++] = ((uint64) ((y << yShift) | xLower) << 32) |
+				(uint32) k;
+		}
+	}
+	std::sort(rows, rows + rowCount);
+
+	// Walk the rows of the segments and the proxies of both indices in tag
+	// order. Within a row, the segments whose x bounds contain the proxy
+	// are kept active, and the proxies outside of all of them are skipped,
+	// so only the particles near the barriers are visited.
+	float32 tmax = b2_barrierCollisionTime * step.dt;
+	const Proxy* beginProxies[2] = {
+		m_proxyBuffer.Begin(), m_staticProxyBuffer.Begin()
+	};
+	const Proxy* endProxies[2] = {
+		m_proxyBuffer.End(), m_staticProxyBuffer.End()
+	};
+	for (int32 pass = 0; pass < 2; pass++)
+	{
+		const Proxy* proxy = beginProxies[pass];
+		const Proxy* endProxy = endProxies[pass];
+		for (int32 first = 0, last; first < rowCount; first = last)
+		{
+			const uint32 row = (uint32) (rows[first] >> 32) & yMask;
+			for (last = first + 1; last < rowCount &&
+				 ((uint32) (rows[last] >> 32) & yMask) == row; last++)
+			{
+			}
+			int32 next = first;
+			int32 activeCount = 0;
+			while (proxy < endProxy)
+			{
+				if (activeCount == 0)
+				{
+					// Skip the proxies until the next segment starts.
+					if (next == last)
+					{
+						break;
+					}
+					proxy = std::lower_bound(proxy, endProxy,
+											 (uint32) (rows[next] >> 32));
+					if (proxy == endProxy || (proxy->tag & yMask) != row)
+					{
+						break;
+					}
+				}
+				const uint32 tag = proxy->tag;
+				while (next < last && (uint32) (rows[next] >> 32) <= tag)
+				{
+					active[activeCount++] = (int32) (uint32) rows[next++];
+				}
+				int32 stillActive = 0;
+				for (int32 k = 0; k < activeCount; k++)
+				{
+					if ((tag & xMask) <=
+						(segments[active[k]].upperTag & xMask))
+					{
+						active[stillActive++] = active[k];
+					}
+				}
+				activeCount = stillActive;
+				for (int32 k = 0; k < activeCount; k++)
+				{
+					SolveBarrierParticle(segments[active[k]], proxy->index,
+										 tmax, step);
+				}
+				proxy++;
+				if (proxy < endProxy && (proxy->tag & yMask) != row)
+				{
+					break;
+				}
+			}
+		}
+	}
+	m_stackAllocator.Free(active);
+	m_stackAllocator.Free(rows);
+	m_stackAllocator.Free(segments);
+}
+
+void b2ParticleSystem::Solve(const b2StepContext& step)
+{
+	m_contactBeginEventBuffer.SetCount(0);
+	m_contactEndEventBuffer.SetCount(0);
+	m_bodyContactBeginEventBuffer.SetCount(0);
+	m_bodyContactEndEventBuffer.SetCount(0);
+	const int32 previousIterationCount = m_iterationCount;
+	m_iterationCount = 0;
+	if (!m_paused)
+	{
+		for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+			 emitter = emitter->GetNext())
+		{
+			emitter->Step(step.dt);
+		}
+	}
+	if (m_count == 0)
+	{
+		m_aabb = b2MakeEmptyAABB();
+		m_aabbNeedsUpdate = false;
+		return;
+	}
+	// If particle lifetimes are enabled, destroy particles that are too old.
+	if (m_expirationTimeBuffer.data)
+	{
+		SolveLifetimes(step);
+	}
+	if (m_allParticleFlags & b2_zombieParticle)
+	{
+		SolveZombie();
+	}
+	// Particles may have been moved, created or destroyed since the last
+	// step. The position integration keeps the bounds up to date after this.
+	m_aabb = b2ComputeParticleAABB(m_positionBuffer.data, m_count);
+	m_aabbNeedsUpdate = false;
+	if (m_def.staticDistanceField || m_staticDistanceField)
+	{
+		UpdateStaticDistanceField();
+	}
+	if (m_needsUpdateAllParticleFlags)
+	{
+		UpdateAllParticleFlags();
+	}
+	if (m_needsUpdateAllGroupFlags)
+	{
+		UpdateAllGroupFlags();
+	}
+	if (m_paused)
+	{
+		return;
+	}
+	if (m_def.reorderInterval > 0 &&
+		++m_reorderStepCount >= m_def.reorderInterval)
+	{
+		ReorderParticles();
+		m_reorderStepCount = 0;
+	}
+	m_iterationCount = ComputeIterationCount(step, previousIterationCount);
+	if (m_allGroupFlags & b2_rigidParticleGroup)
+	{
+		UpdateRigidGroups();
+	}
+	for (m_iterationIndex = 0;
+		m_iterationIndex < m_iterationCount;
+		m_iterationIndex++)
+	{
+		++m_timestamp;
+		b2StepContext subStep = step;
+		subStep.dt /= m_iterationCount;
+		subStep.inv_dt *= m_iterationCount;
+		UpdateContacts(false);
+		UpdateContactEvents();
+		UpdateBodyContacts();
 		ComputeWeight();
 		if (m_allGroupFlags & b2_particleGroupNeedsUpdateDepth)
 		{
@@ -2843,7 +3863,7 @@ void b2ParticleSystem::Solve(const b2StepContext& step)
 		{
 			UpdatePairsAndTriadsWithReactiveParticles();
 		}
-		if (m_hasForce)
+		if (m_hasForce || m_forceFieldList)
 		{
 			SolveForce(subStep);
 		}
@@ -2918,10 +3938,20 @@ void b2ParticleSystem::Solve(const b2StepContext& step)
 			SolveWall();
 		}
 		// The particle positions can be updated only at the end of substep.
+		// SolveWall() stopped the wall particles, which keeps the static
+		// proxies valid.
+		b2AABB aabb = b2MakeEmptyAABB();
 		for (int32 i = 0; i < m_count; i++)
 		{
-			m_positionBuffer.data[i] += subStep.dt * m_velocityBuffer.data[i];
+			b2Vec2& p = m_positionBuffer.data[i];
+			if (!(m_flagsBuffer.data[i] & b2_wallParticle))
+			{
+				p += subStep.dt * m_velocityBuffer.data[i];
+			}
+			aabb.lowerBound = b2Min(aabb.lowerBound, p);
+			aabb.upperBound = b2Max(aabb.upperBound, p);
 		}
+		m_aabb = aabb;
 	}
 }
 
@@ -2960,6 +3990,84 @@ void b2ParticleSystem::LimitVelocity(const b2StepContext& step)
 	}
 }
 
+int32 b2ParticleSystem::ComputeIterationCount(
+	const b2StepContext& step, int32 previousCount) const
+{
+	if (!m_def.adaptiveIterations)
+	{
+		return step.particleIterations;
+	}
+	b2Assert(0 < m_def.minIterations &&
+			 m_def.minIterations <= m_def.maxIterations);
+	// Every particle counts: the contacts of this step are not found yet,
+	// and particles without contacts in the last step, such as newly
+	// created ones, may well have some now.
+	#if defined(B2_PARTICLE_SIMD)
+		const float32 maxSpeedSquared = ComputeMaxSpeedSquared_Simd();
+	#else
+		const float32 maxSpeedSquared =
+			ComputeMaxSpeedSquared_Reference(0, m_count);
+	#endif
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+	{
+		const float32 reference = ComputeMaxSpeedSquared_Reference(0, m_count);
+		b2Assert(b2ApproximatelyEqual(maxSpeedSquared, reference, reference));
+	}
+	#endif
+	// The gravity of this step is included so that particles at rest in a
+	// falling stream are not under-simulated.
+	float32 maxSpeed = sqrtf(maxSpeedSquared) + step.dt *
+		m_def.gravityScale * b2Length(m_world->gravity);
+	float32 maxDisplacement = m_def.iterationDisplacement * m_particleDiameter;
+	float32 count = ceilf(maxSpeed * step.dt / maxDisplacement);
+	count = b2ClampFloat(count, (float32) m_def.minIterations,
+						 (float32) m_def.maxIterations);
+	// Lowers the count gradually, an abrupt change of the stiffness would
+	// make the fluid slosh.
+	return b2MaxInt((int32) count, previousCount - 1);
+}
+
+float32 b2ParticleSystem::ComputeMaxSpeedSquared_Reference(
+	int32 first, int32 last) const
+{
+	float32 maxSpeedSquared = 0;
+	for (int32 i = first; i < last; i++)
+	{
+		const b2Vec2& v = m_velocityBuffer.data[i];
+		maxSpeedSquared = b2MaxFloat(maxSpeedSquared, v.x * v.x + v.y * v.y);
+	}
+	return maxSpeedSquared;
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+float32 b2ParticleSystem::ComputeMaxSpeedSquared_Simd() const
+{
+	// The components are loaded interleaved, as in the buffer, and each
+	// squared speed ends up in both lanes of its particle.
+	static const int32 k_particleCount = B2_SIMD_WIDTH / 2;
+	const float32* velocities = &m_velocityBuffer.data->x;
+	b2FloatW maxSpeedSquared = b2ZeroW();
+	int32 i = 0;
+	for (; i + k_particleCount <= m_count; i += k_particleCount)
+	{
+		const b2FloatW v = b2LoadW(velocities + 2 * i);
+		const b2FloatW v2 = b2MulW(v, v);
+		maxSpeedSquared =
+			b2MaxW(maxSpeedSquared, b2AddW(v2, b2SwapPairsW(v2)));
+	}
+	float32 lanes[B2_SIMD_WIDTH];
+	b2StoreW(lanes, maxSpeedSquared);
+	float32 result = ComputeMaxSpeedSquared_Reference(i, m_count);
+	for (int32 k = 0; k < B2_SIMD_WIDTH; k++)
+	{
+		result = b2MaxFloat(result, lanes[k]);
+	}
+	return result;
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
 void b2ParticleSystem::SolveGravity(const b2StepContext& step)
 {
 	b2Vec2 gravity = step.dt * m_def.gravityScale * m_world->gravity;
@@ -2969,6 +4077,15 @@ void b2ParticleSystem::SolveGravity(const b2StepContext& step)
 	}
 }
 
+// Number of colors of the elastic triads, spring pairs and static pressure
+// particles. Like the overflow of the constraint graph, the last color holds
+// the connections which don't fit the others.
+static const int32 k_connectionColorCount = 24;
+static const int32 k_overflowConnectionColor = k_connectionColorCount - 1;
+// Number of connections of a color below which SolveConnectionColors() does
+// not split its work into tasks.
+static const int32 k_connectionTaskRange = 256;
+
 void b2ParticleSystem::SolveStaticPressure(const b2StepContext& step)
 {
 	m_staticPressureBuffer = RequestBuffer(m_staticPressureBuffer);
@@ -2976,6 +4093,7 @@ void b2ParticleSystem::SolveStaticPressure(const b2StepContext& step)
 	float32 pressurePerWeight = m_def.staticPressureStrength * criticalPressure;
 	float32 maxPressure = b2_maxParticlePressure * criticalPressure;
 	float32 relaxation = m_def.staticPressureRelaxation;
+	float32 tolerance = m_def.staticPressureTolerance * maxPressure;
 	/// Compute pressure satisfying the modified Poisson equation:
 	///     Sum_for_j((p_i - p_j) * w_ij) + relaxation * p_i =
 	///     pressurePerWeight * (w_i - b2_minParticleWeight)
@@ -2986,8 +4104,29 @@ void b2ParticleSystem::SolveStaticPressure(const b2StepContext& step)
 	///     p_i and p_j are static pressure of particle i and j
 	///     w_ij is contact weight between particle i and j
 	///     w_i is sum of contact weight of particle i
-	for (int32 t = 0; t < m_def.staticPressureIterations; t++)
+	/// The iterations start from the pressures of the previous particle
+	/// iteration, and stop once no pressure changes by more than tolerance.
+	if (m_def.staticPressureSolver == b2_gaussSeidelStaticPressureSolver)
+	{
+		SolveStaticPressureGaussSeidel(pressurePerWeight, maxPressure,
+									   relaxation, tolerance);
+	}
+	else
 	{
+		SolveStaticPressureJacobi(pressurePerWeight, maxPressure, relaxation,
+								  tolerance);
+	}
+}
+
+void b2ParticleSystem::SolveStaticPressureJacobi(float32 pressurePerWeight,
+												 float32 maxPressure,
+												 float32 relaxation,
+												 float32 tolerance)
+{
+	m_staticPressureIterationCount = 0;
+	while (m_staticPressureIterationCount < m_def.staticPressureIterations)
+	{
+		m_staticPressureIterationCount++;
 		memset(m_accumulationBuffer, 0,
 			   sizeof(*m_accumulationBuffer) * m_count);
 		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
@@ -3004,27 +4143,210 @@ void b2ParticleSystem::SolveStaticPressure(const b2StepContext& step)
 					w * m_staticPressureBuffer[a]; // b <- a
 			}
 		}
+		float32 maxChange = 0;
 		for (int32 i = 0; i < m_count; i++)
 		{
 			float32 w = m_weightBuffer[i];
+			float32 h = 0;
 			if (m_flagsBuffer.data[i] & b2_staticPressureParticle)
 			{
 				float32 wh = m_accumulationBuffer[i];
-				float32 h =
+				h = b2ClampFloat(
 					(wh + pressurePerWeight * (w - b2_minParticleWeight)) /
-					(w + relaxation);
-				m_staticPressureBuffer[i] = b2ClampFloat(h, 0.0f, maxPressure);
-			}
-			else
-			{
-				m_staticPressureBuffer[i] = 0;
+					(w + relaxation), 0.0f, maxPressure);
 			}
+			maxChange = b2MaxFloat(
+				maxChange, b2AbsFloat(h - m_staticPressureBuffer[i]));
+			m_staticPressureBuffer[i] = h;
+		}
+		// The next iterations would not change the pressures either.
+		if (maxChange <= tolerance)
+		{
+			break;
+		}
+	}
+}
+
+void b2ParticleSystem::SolveStaticPressureGaussSeidel(float32 pressurePerWeight,
+													  float32 maxPressure,
+													  float32 relaxation,
+													  float32 tolerance)
+{
+	// Multicolor Gauss-Seidel. The particles are colored like the elastic
+	// triads and spring pairs, so that no two particles in contact share a
+	// color. The pressures of a color only depend on those of the other
+	// colors, so each color is updated in parallel from the pressures the
+	// previous colors just updated, and the result doesn't depend on the
+	// order of the particles within a color or on the workers.
+
+	// The static pressure contacts of each particle, in the order of the
+	// particles.
+	const int32 contactCount = m_contactBuffer.GetCount();
+	int32* firstNeighbors = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * (m_count + 1));
+	StaticPressureNeighbor* neighbors = (StaticPressureNeighbor*)
+		m_stackAllocator.Allocate(
+			sizeof(StaticPressureNeighbor) * 2 * contactCount);
+	memset(firstNeighbors, 0, sizeof(int32) * (m_count + 1));
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		if (contact.GetFlags() & b2_staticPressureParticle)
+		{
+			firstNeighbors[contact.GetIndexA()]++;
+			firstNeighbors[contact.GetIndexB()]++;
+		}
+	}
+	// Turn the counts into the end of the neighbors of each particle, which
+	// filling the neighbors backward moves to their first neighbor.
+	for (int32 i = 1; i <= m_count; i++)
+	{
+		firstNeighbors[i] += firstNeighbors[i - 1];
+	}
+	for (int32 k = contactCount - 1; k >= 0; k--)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		if (contact.GetFlags() & b2_staticPressureParticle)
+		{
+			int32 a = contact.GetIndexA();
+			int32 b = contact.GetIndexB();
+			float32 w = contact.GetWeight();
+			StaticPressureNeighbor& neighborA = neighbors[--firstNeighbors[a]];
+			neighborA.index = b;
+			neighborA.weight = w;
+			StaticPressureNeighbor& neighborB = neighbors[--firstNeighbors[b]];
+			neighborB.index = a;
+			neighborB.weight = w;
+		}
+	}
+
+	// Greedy coloring in the order of the particles. Like the connections,
+	// a particle whose neighbors have all the other colors goes to the
+	// overflow color, which is solved serially. The other particles have no
+	// pressure.
+	uint32* colorMasks =
+		(uint32*) m_stackAllocator.Allocate(sizeof(uint32) * m_count);
+	int32* particleColors =
+		(int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	int32 counts[k_connectionColorCount];
+	memset(colorMasks, 0, sizeof(uint32) * m_count);
+	memset(counts, 0, sizeof(counts));
+	for (int32 i = 0; i < m_count; i++)
+	{
+		if (!(m_flagsBuffer.data[i] & b2_staticPressureParticle))
+		{
+			m_staticPressureBuffer[i] = 0;
+			particleColors[i] = -1;
+			continue;
+		}
+		uint32 used = 0;
+		for (int32 n = firstNeighbors[i]; n < firstNeighbors[i + 1]; n++)
+		{
+			used |= colorMasks[neighbors[n].index];
+		}
+		const uint32 available =
+			~used & ((1u << k_overflowConnectionColor) - 1);
+		int32 color = k_overflowConnectionColor;
+		if (available)
+		{
+			color = (int32) b2CTZ32(available);
+			colorMasks[i] = 1u << color;
+		}
+		particleColors[i] = color;
+		counts[color]++;
+	}
+	int32 colors[k_connectionColorCount + 1];
+	colors[0] = 0;
+	for (int32 c = 0; c < k_connectionColorCount; c++)
+	{
+		colors[c + 1] = colors[c] + counts[c];
+		counts[c] = colors[c];
+	}
+	int32* particles = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * b2MaxInt(colors[k_connectionColorCount], 1));
+	for (int32 i = 0; i < m_count; i++)
+	{
+		if (particleColors[i] >= 0)
+		{
+			particles[counts[particleColors[i]]++] = i;
+		}
+	}
+
+	const int32 workerCount = b2MaxInt(m_world->workerCount, 1);
+	float32* maxChanges =
+		(float32*) m_stackAllocator.Allocate(sizeof(float32) * workerCount);
+	StaticPressureColorContext context;
+	context.system = this;
+	context.particles = particles;
+	context.firstNeighbors = firstNeighbors;
+	context.neighbors = neighbors;
+	context.pressurePerWeight = pressurePerWeight;
+	context.maxPressure = maxPressure;
+	context.relaxation = relaxation;
+	context.maxChanges = maxChanges;
+	m_staticPressureIterationCount = 0;
+	while (m_staticPressureIterationCount < m_def.staticPressureIterations)
+	{
+		m_staticPressureIterationCount++;
+		memset(maxChanges, 0, sizeof(float32) * workerCount);
+		SolveConnectionColors(&SolveStaticPressureTask, colors, &context);
+		float32 maxChange = 0;
+		for (int32 w = 0; w < workerCount; w++)
+		{
+			maxChange = b2MaxFloat(maxChange, maxChanges[w]);
+		}
+		if (maxChange <= tolerance)
+		{
+			break;
+		}
+	}
+
+	m_stackAllocator.Free(maxChanges);
+	m_stackAllocator.Free(particles);
+	m_stackAllocator.Free(particleColors);
+	m_stackAllocator.Free(colorMasks);
+	m_stackAllocator.Free(neighbors);
+	m_stackAllocator.Free(firstNeighbors);
+}
+
+// Update the static pressures of the particles of one color.
+void b2ParticleSystem::SolveStaticPressureTask(int32 startIndex,
+											   int32 endIndex,
+											   uint32 workerIndex,
+											   void* context)
+{
+	StaticPressureColorContext* color = (StaticPressureColorContext*) context;
+	b2ParticleSystem* system = color->system;
+	float32* pressures = system->m_staticPressureBuffer;
+	float32 maxChange = color->maxChanges[workerIndex];
+	for (int32 k = color->firstConnection + startIndex,
+		 end = color->firstConnection + endIndex; k < end; k++)
+	{
+		const int32 i = color->particles[k];
+		float32 wh = 0;
+		for (int32 n = color->firstNeighbors[i];
+			 n < color->firstNeighbors[i + 1]; n++)
+		{
+			wh += color->neighbors[n].weight *
+				  pressures[color->neighbors[n].index];
 		}
+		float32 w = system->m_weightBuffer[i];
+		float32 h = b2ClampFloat(
+			(wh + color->pressurePerWeight * (w - b2_minParticleWeight)) /
+			(w + color->relaxation), 0.0f, color->maxPressure);
+		maxChange = b2MaxFloat(maxChange, b2AbsFloat(h - pressures[i]));
+		pressures[i] = h;
 	}
+	color->maxChanges[workerIndex] = maxChange;
 }
 
 void b2ParticleSystem::SolvePressure(const b2StepContext& step)
 {
+	if (m_def.pressureSolver == b2_positionBasedPressureSolver)
+	{
+		SolvePositionBasedPressure(step);
+		return;
+	}
 	// calculates pressure as a linear function of density
 	float32 criticalPressure = GetCriticalPressure(step);
 	float32 pressurePerWeight = m_def.pressureStrength * criticalPressure;
@@ -3090,6 +4412,268 @@ void b2ParticleSystem::SolvePressure(const b2StepContext& step)
 	}
 }
 
+void b2ParticleSystem::ApplyPositionBasedPressure(
+	const float32* pressure, float32 velocityPerPressure)
+{
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		int32 a = contact.index;
+		if (pressure[a] == 0)
+		{
+			continue;
+		}
+		b2Body* b = contact.body;
+		b2BodyState* state = b2GetBodyState(m_world, b);
+		b2BodySim* bodySim = b2GetBodySim(m_world, b);
+		b2Vec2 p = m_positionBuffer.data[a];
+		b2Vec2 f = velocityPerPressure * contact.weight * contact.mass *
+				   pressure[a] * contact.normal;
+		m_velocityBuffer.data[a] -= GetParticleInvMass() * f;
+		b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, f, p, true);
+	}
+	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		int32 a = contact.GetIndexA();
+		int32 b = contact.GetIndexB();
+		b2Vec2 f = velocityPerPressure * contact.GetWeight() *
+				   (pressure[a] + pressure[b]) * contact.GetNormal();
+		m_velocityBuffer.data[a] -= f;
+		m_velocityBuffer.data[b] += f;
+	}
+}
+
+void b2ParticleSystem::SolvePositionBasedPressure(const b2StepContext& step)
+{
+	// The weight of a contact changes by velocityPerPressure for each unit
+	// of approaching velocity. The pressure of each particle is the
+	// multiplier of the constraint which keeps the weight the particle is
+	// predicted to have at the end of the substep below
+	// b2_minParticleWeight. The multipliers are found with a relaxed Jacobi
+	// iteration and can only push the particles apart. The impulses are
+	// scaled by the contact weights like in the linear solver, which avoids
+	// jitter when contacts appear and disappear at one diameter.
+	const float32 velocityPerPressure = step.dt * m_inverseDiameter;
+	const float32 relaxation = 0.25f;
+	float32* pressure =
+		(float32*) m_stackAllocator.Allocate(sizeof(float32) * m_count);
+	float32* invDiagonal =
+		(float32*) m_stackAllocator.Allocate(sizeof(float32) * m_count);
+	float32* deltaPressure =
+		(float32*) m_stackAllocator.Allocate(sizeof(float32) * m_count);
+	b2Vec2* gradient =
+		(b2Vec2*) m_stackAllocator.Allocate(sizeof(b2Vec2) * m_count);
+	for (int32 i = 0; i < m_count; i++)
+	{
+		invDiagonal[i] = 0;
+		gradient[i] = b2Vec2_zero;
+	}
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		gradient[contact.index] += contact.weight * contact.normal;
+		invDiagonal[contact.index] += contact.weight;
+	}
+	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		int32 a = contact.GetIndexA();
+		int32 b = contact.GetIndexB();
+		float32 w = contact.GetWeight();
+		gradient[a] += w * contact.GetNormal();
+		gradient[b] -= w * contact.GetNormal();
+		invDiagonal[a] += w;
+		invDiagonal[b] += w;
+	}
+	for (int32 i = 0; i < m_count; i++)
+	{
+		// ignores particles which have their own repulsive force
+		float32 diagonal = invDiagonal[i] + b2Dot(gradient[i], gradient[i]);
+		bool solved = diagonal > 0 &&
+					  !(m_flagsBuffer.data[i] & k_noPressureFlags);
+		invDiagonal[i] = solved ?
+			relaxation / (velocityPerPressure * velocityPerPressure *
+						  diagonal) : 0;
+		pressure[i] = 0;
+	}
+
+	for (int32 iteration = 0; iteration < m_def.pressureIterations;
+		 iteration++)
+	{
+		// predicts the weight of each particle at the end of the substep
+		for (int32 i = 0; i < m_count; i++)
+		{
+			m_accumulationBuffer[i] = m_weightBuffer[i] - b2_minParticleWeight;
+		}
+		for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+		{
+			const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+			int32 a = contact.index;
+			b2Body* b = contact.body;
+			b2BodyState* state = b2GetBodyState(m_world, b);
+			b2BodySim* bodySim = b2GetBodySim(m_world, b);
+			b2Vec2 p = m_positionBuffer.data[a];
+			b2Vec2 v = m_velocityBuffer.data[a] -
+				b2GetLinearVelocityFromWorldPointInternal(state, bodySim, p);
+			m_accumulationBuffer[a] +=
+				velocityPerPressure * b2Dot(v, contact.normal);
+		}
+		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		{
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			int32 a = contact.GetIndexA();
+			int32 b = contact.GetIndexB();
+			b2Vec2 v = m_velocityBuffer.data[a] - m_velocityBuffer.data[b];
+			float32 dw = velocityPerPressure * b2Dot(v, contact.GetNormal());
+			m_accumulationBuffer[a] += dw;
+			m_accumulationBuffer[b] += dw;
+		}
+		for (int32 i = 0; i < m_count; i++)
+		{
+			float32 h = b2MaxFloat(
+				0.0f, pressure[i] + m_accumulationBuffer[i] * invDiagonal[i]);
+			deltaPressure[i] = h - pressure[i];
+			pressure[i] = h;
+		}
+		ApplyPositionBasedPressure(deltaPressure, velocityPerPressure);
+	}
+	m_stackAllocator.Free(gradient);
+	m_stackAllocator.Free(deltaPressure);
+	m_stackAllocator.Free(invDiagonal);
+	m_stackAllocator.Free(pressure);
+
+	// static pressure
+	if (m_allParticleFlags & b2_staticPressureParticle)
+	{
+		b2Assert(m_staticPressureBuffer);
+		float32 velocityPerStaticPressure =
+			step.dt / (m_def.density * m_particleDiameter);
+		for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+		{
+			const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+			int32 a = contact.index;
+			if (!(m_flagsBuffer.data[a] & b2_staticPressureParticle))
+			{
+				continue;
+			}
+			b2Body* b = contact.body;
+			b2BodyState* state = b2GetBodyState(m_world, b);
+			b2BodySim* bodySim = b2GetBodySim(m_world, b);
+			b2Vec2 p = m_positionBuffer.data[a];
+			b2Vec2 f = velocityPerStaticPressure * contact.weight *
+					   contact.mass * m_staticPressureBuffer[a] *
+					   contact.normal;
+			m_velocityBuffer.data[a] -= GetParticleInvMass() * f;
+			b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, f, p,
+										 true);
+		}
+		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		{
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			int32 a = contact.GetIndexA();
+			int32 b = contact.GetIndexB();
+			float32 h = 0;
+			if (m_flagsBuffer.data[a] & b2_staticPressureParticle)
+			{
+				h += m_staticPressureBuffer[a];
+			}
+			if (m_flagsBuffer.data[b] & b2_staticPressureParticle)
+			{
+				h += m_staticPressureBuffer[b];
+			}
+			b2Vec2 f = velocityPerStaticPressure * contact.GetWeight() * h *
+					   contact.GetNormal();
+			m_velocityBuffer.data[a] -= f;
+			m_velocityBuffer.data[b] += f;
+		}
+	}
+}
+
+// The contact passes which read the velocities or colors they write visit
+// the contacts in an order which lets k_contactLaneCount of them be solved
+// at once: the contact buffer is split into k_contactLaneCount segments of
+// b2GetContactLaneStride() contacts and batch i visits the i-th contact of
+// each segment. Contacts of different segments are far apart, so a batch
+// rarely has two contacts sharing a particle. Every build visits the contacts
+// in this order, including the reference versions and builds without SIMD,
+// so that all builds produce the same results.
+static const int32 k_contactLaneCount = 8;
+
+static inline int32 b2GetContactLaneStride(int32 contactCount)
+{
+	return (contactCount + k_contactLaneCount - 1) / k_contactLaneCount;
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+// The number of wide floats holding a batch of ordered contact lanes.
+static const int32 k_contactLaneVectorCount =
+	k_contactLaneCount / B2_SIMD_WIDTH;
+
+// B2_SIMD_WIDTH particle contacts, with their weights and normals in wide
+// floats.
+struct b2ParticleContactW
+{
+	int32 indexA[B2_SIMD_WIDTH];
+	int32 indexB[B2_SIMD_WIDTH];
+	uint32 flags[B2_SIMD_WIDTH];
+	b2FloatW weight;
+	b2FloatW normalX;
+	b2FloatW normalY;
+};
+
+// Load contacts[i * stride] into lane i.
+static inline void b2LoadParticleContactsW(b2ParticleContactW* lanes,
+										   const b2ParticleContact* contacts,
+										   int32 stride)
+{
+	float32 weight[B2_SIMD_WIDTH];
+	float32 normalX[B2_SIMD_WIDTH];
+	float32 normalY[B2_SIMD_WIDTH];
+	for (int32 i = 0; i < B2_SIMD_WIDTH; i++)
+	{
+		const b2ParticleContact& contact = contacts[i * stride];
+		lanes->indexA[i] = contact.GetIndexA();
+		lanes->indexB[i] = contact.GetIndexB();
+		lanes->flags[i] = contact.GetFlags();
+		weight[i] = contact.GetWeight();
+		normalX[i] = contact.GetNormal().x;
+		normalY[i] = contact.GetNormal().y;
+	}
+	lanes->weight = b2LoadW(weight);
+	lanes->normalX = b2LoadW(normalX);
+	lanes->normalY = b2LoadW(normalY);
+}
+
+// Whether the first 'count' lanes in 'mask' share no particle with each
+// other or with lanes previously checked for the same batch. 'marks' holds
+// the last batch which touched each particle.
+static inline bool b2AreContactLanesIndependent(const int32* indicesA,
+												const int32* indicesB,
+												int32 count, int32 mask,
+												int32 batch, int32* marks)
+{
+	for (int32 i = 0; i < count; i++)
+	{
+		if (mask & (1 << i))
+		{
+			const int32 a = indicesA[i];
+			const int32 b = indicesB[i];
+			if (marks[a] == batch || marks[b] == batch)
+			{
+				return false;
+			}
+			marks[a] = batch;
+			marks[b] = batch;
+		}
+	}
+	return true;
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveDamping(const b2StepContext& step)
 {
 	// reduces normal velocity of each contact
@@ -3118,26 +4702,141 @@ void b2ParticleSystem::SolveDamping(const b2StepContext& step)
 			b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, -f, p, true);
 		}
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	#if defined(B2_PARTICLE_SIMD)
+		SolveDamping_Simd(linearDamping, quadraticDamping);
+	#else
+		SolveDamping_Reference(linearDamping, quadraticDamping, 0,
+			b2GetContactLaneStride(m_contactBuffer.GetCount()));
+	#endif
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveDamping_Reference(linearDamping, quadraticDamping, 0,
+			b2GetContactLaneStride(m_contactBuffer.GetCount()));
+		check.Check();
+	#endif
+}
+
+// Damp the particle contacts of the batches [firstBatch, lastBatch), see
+// k_contactLaneCount.
+void b2ParticleSystem::SolveDamping_Reference(float32 linearDamping,
+											  float32 quadraticDamping,
+											  int32 firstBatch,
+											  int32 lastBatch)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	for (int32 i = firstBatch; i < lastBatch; i++)
 	{
-		const b2ParticleContact& contact = m_contactBuffer[k];
-		int32 a = contact.GetIndexA();
-		int32 b = contact.GetIndexB();
-		float32 w = contact.GetWeight();
-		b2Vec2 n = contact.GetNormal();
-		b2Vec2 v = m_velocityBuffer.data[b] - m_velocityBuffer.data[a];
-		float32 vn = b2Dot(v, n);
-		if (vn < 0)
+		for (int32 k = i; k < contactCount; k += stride)
 		{
-			float32 damping =
-				b2MaxFloat(linearDamping * w, b2MinFloat(- quadraticDamping * vn, 0.5f));
-			b2Vec2 f = damping * vn * n;
-			m_velocityBuffer.data[a] += f;
-			m_velocityBuffer.data[b] -= f;
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			int32 a = contact.GetIndexA();
+			int32 b = contact.GetIndexB();
+			float32 w = contact.GetWeight();
+			b2Vec2 n = contact.GetNormal();
+			b2Vec2 v = m_velocityBuffer.data[b] - m_velocityBuffer.data[a];
+			float32 vn = b2Dot(v, n);
+			if (vn < 0)
+			{
+				float32 damping =
+					b2MaxFloat(linearDamping * w, b2MinFloat(- quadraticDamping * vn, 0.5f));
+				b2Vec2 f = damping * vn * n;
+				m_velocityBuffer.data[a] += f;
+				m_velocityBuffer.data[b] -= f;
+			}
+		}
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::SolveDamping_Simd(float32 linearDamping,
+										 float32 quadraticDamping)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	// The batches past fullBatchCount lack their last lanes.
+	const int32 fullBatchCount =
+		b2MaxInt(contactCount - (k_contactLaneCount - 1) * stride, 0);
+	const b2ParticleContact* contacts = m_contactBuffer.Data();
+	b2Vec2* velocities = m_velocityBuffer.data;
+	int32* marks = (int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	memset(marks, 0xff, sizeof(int32) * m_count);
+
+	const b2FloatW zero = b2ZeroW();
+	const b2FloatW half = b2SplatW(0.5f);
+	const b2FloatW linear = b2SplatW(linearDamping);
+	const b2FloatW quadratic = b2SplatW(- quadraticDamping);
+	for (int32 i = 0; i < fullBatchCount; i++)
+	{
+		b2ParticleContactW lanes[k_contactLaneVectorCount];
+		bool independent = true;
+		for (int32 h = 0; h < k_contactLaneVectorCount; h++)
+		{
+			b2LoadParticleContactsW(&lanes[h],
+				contacts + h * B2_SIMD_WIDTH * stride + i, stride);
+			// Whether a contact is damped depends on the velocities, so all
+			// the lanes must be independent.
+			independent = independent &&
+				b2AreContactLanesIndependent(lanes[h].indexA,
+					lanes[h].indexB, B2_SIMD_WIDTH,
+					(1 << B2_SIMD_WIDTH) - 1, i, marks);
+		}
+		if (!independent)
+		{
+			SolveDamping_Reference(linearDamping, quadraticDamping, i, i + 1);
+			continue;
+		}
+		for (int32 h = 0; h < k_contactLaneVectorCount; h++)
+		{
+			const b2ParticleContactW& c = lanes[h];
+			b2FloatW vax, vay, vbx, vby;
+			b2GatherVec2W(velocities, c.indexA, &vax, &vay);
+			b2GatherVec2W(velocities, c.indexB, &vbx, &vby);
+			b2FloatW vx = b2SubW(vbx, vax);
+			b2FloatW vy = b2SubW(vby, vay);
+			b2FloatW vn = b2AddW(b2MulW(vx, c.normalX), b2MulW(vy, c.normalY));
+			const int32 active = b2MaskBitsW(b2GreaterThanW(zero, vn));
+			if (active == 0)
+			{
+				continue;
+			}
+			b2FloatW damping = b2MaxW(b2MulW(linear, c.weight),
+									  b2MinW(b2MulW(quadratic, vn), half));
+			b2FloatW s = b2MulW(damping, vn);
+			b2FloatW fx = b2MulW(s, c.normalX);
+			b2FloatW fy = b2MulW(s, c.normalY);
+			float32 ax[B2_SIMD_WIDTH], ay[B2_SIMD_WIDTH];
+			float32 bx[B2_SIMD_WIDTH], by[B2_SIMD_WIDTH];
+			b2StoreW(ax, b2AddW(vax, fx));
+			b2StoreW(ay, b2AddW(vay, fy));
+			b2StoreW(bx, b2SubW(vbx, fx));
+			b2StoreW(by, b2SubW(vby, fy));
+			for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
+			{
+				if (active & (1 << j))
+				{
+					velocities[c.indexA[j]] = b2Vec2{ax[j], ay[j]};
+					velocities[c.indexB[j]] = b2Vec2{bx[j], by[j]};
+				}
+			}
 		}
 	}
+	SolveDamping_Reference(linearDamping, quadraticDamping, fullBatchCount,
+						   stride);
+
+	m_stackAllocator.Free(marks);
 }
 
+#endif // defined(B2_PARTICLE_SIMD)
+
 inline bool b2ParticleSystem::IsRigidGroup(b2ParticleGroup *group) const
 {
 	return group && (group->m_groupFlags & b2_rigidParticleGroup);
@@ -3311,150 +5010,685 @@ void b2ParticleSystem::SolveRigidDamping()
 	}
 }
 
-void b2ParticleSystem::SolveExtraDamping()
+void b2ParticleSystem::SolveExtraDamping()
+{
+	// Applies additional damping force between bodies and particles which can
+	// produce strong repulsive force. Applying damping force multiple times
+	// is effective in suppressing vibration.
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		int32 a = contact.index;
+		if (m_flagsBuffer.data[a] & k_extraDampingFlags)
+		{
+			b2Body* b = contact.body;
+			b2BodyState* state = b2GetBodyState(m_world, b);
+			b2BodySim* bodySim = b2GetBodySim(m_world, b);
+			float32 m = contact.mass;
+			b2Vec2 n = contact.normal;
+			b2Vec2 p = m_positionBuffer.data[a];
+			b2Vec2 v =
+				b2GetLinearVelocityFromWorldPointInternal(state, bodySim, p) -
+				m_velocityBuffer.data[a];
+			float32 vn = b2Dot(v, n);
+			if (vn < 0)
+			{
+				b2Vec2 f = 0.5f * m * vn * n;
+				m_velocityBuffer.data[a] += GetParticleInvMass() * f;
+				b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, -f, p, true);
+			}
+		}
+	}
+}
+
+void b2ParticleSystem::SolveWall()
+{
+	for (int32 i = 0; i < m_count; i++)
+	{
+		if (m_flagsBuffer.data[i] & b2_wallParticle)
+		{
+			m_velocityBuffer.data[i] = b2Vec2_zero;
+		}
+	}
+}
+
+void b2ParticleSystem::SolveRigidLinearAngularDamping(const b2StepContext& step)
+{
+	for (int32 k = 0; k < m_rigidGroupBuffer.GetCount(); k++)
+	{
+		b2ParticleGroup* group = m_rigidGroupBuffer[k];
+		group->m_linearVelocity = group->m_linearVelocity * (1 / (1.0f + step.dt * group->m_linearDamping));
+		group->m_angularVelocity /= (1.0 + step.dt * group->m_angularDamping);
+	}
+}
+
+void b2ParticleSystem::UpdateRigidGroups()
+{
+	m_rigidGroupBuffer.SetCount(0);
+	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
+	{
+		if (group->m_groupFlags & b2_rigidParticleGroup)
+		{
+			m_rigidGroupBuffer.Append() = group;
+		}
+	}
+}
+
+// Number of rigid groups below which SolveRigid() does not split its work
+// into tasks.
+static const int32 k_rigidGroupTaskRange = 16;
+
+void b2ParticleSystem::SolveRigid(const b2StepContext& step)
+{
+	// Each group only touches its own statistics and particles, so the
+	// groups are solved in parallel.
+	RigidGroupContext context;
+	context.system = this;
+	context.groups = m_rigidGroupBuffer.Data();
+	context.dt = step.dt;
+	const int32 groupCount = m_rigidGroupBuffer.GetCount();
+	if (m_world->workerCount > 1 && groupCount > k_rigidGroupTaskRange)
+	{
+		void* task = m_world->enqueueTaskFcn(&SolveRigidTask, groupCount,
+											 k_rigidGroupTaskRange, &context,
+											 m_world->userTaskContext);
+		m_world->taskCount += 1;
+		if (task != NULL)
+		{
+			m_world->finishTaskFcn(task, m_world->userTaskContext);
+		}
+	}
+	else
+	{
+		SolveRigidTask(0, groupCount, 0, &context);
+	}
+}
+
+void b2ParticleSystem::SolveRigidTask(int32 startIndex, int32 endIndex,
+									  uint32 workerIndex, void* context)
+{
+	B2_NOT_USED(workerIndex);
+	RigidGroupContext* rigid = (RigidGroupContext*) context;
+	for (int32 k = startIndex; k < endIndex; k++)
+	{
+		rigid->system->SolveRigidGroup(rigid->groups[k], rigid->dt);
+	}
+}
+
+void b2ParticleSystem::SolveRigidGroup(b2ParticleGroup* group, float32 dt)
+{
+	group->UpdateStatistics();
+	b2Rot rotation = b2MakeRot(dt * group->m_angularVelocity);
+	b2Transform transform{
+		group->m_center + dt * group->m_linearVelocity -
+		b2RotateVector(rotation, group->m_center), rotation};
+	group->m_transform = b2MulTransforms(transform, group->m_transform);
+	const b2Vec2 c = group->m_center;
+	const b2Vec2 v = group->m_linearVelocity;
+	const float32 w = group->m_angularVelocity;
+	for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++)
+	{
+		b2Vec2 r = b2Sub( m_positionBuffer.data[i], c );
+		m_velocityBuffer.data[i] = b2Add( v, b2CrossSV( w, r ) );
+	}
+}
+
+template <typename T>
+static inline void b2ResizeBuffer(b2GrowableBuffer<T>& buffer, int32 count)
 {
-	// Applies additional damping force between bodies and particles which can
-	// produce strong repulsive force. Applying damping force multiple times
-	// is effective in suppressing vibration.
-	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	buffer.Reserve(count);
+	buffer.SetCount(count);
+}
+
+b2ParticleSystem::ElasticTriads::ElasticTriads(b2BlockAllocator& allocator) :
+	indexA(allocator), indexB(allocator), indexC(allocator),
+	strength(allocator),
+	paX(allocator), paY(allocator), pbX(allocator), pbY(allocator),
+	pcX(allocator), pcY(allocator)
+{
+}
+
+int32 b2ParticleSystem::ElasticTriads::GetCount() const
+{
+	return indexA.GetCount();
+}
+
+void b2ParticleSystem::ElasticTriads::SetCount(int32 count)
+{
+	b2ResizeBuffer(indexA, count);
+	b2ResizeBuffer(indexB, count);
+	b2ResizeBuffer(indexC, count);
+	b2ResizeBuffer(strength, count);
+	b2ResizeBuffer(paX, count);
+	b2ResizeBuffer(paY, count);
+	b2ResizeBuffer(pbX, count);
+	b2ResizeBuffer(pbY, count);
+	b2ResizeBuffer(pcX, count);
+	b2ResizeBuffer(pcY, count);
+}
+
+size_t b2ParticleSystem::ElasticTriads::GetCapacityBytes() const
+{
+	// All the buffers have the same capacity.
+	return indexA.GetCapacity() * (3 * sizeof(int32) + 7 * sizeof(float32));
+}
+
+b2ParticleSystem::SpringPairs::SpringPairs(b2BlockAllocator& allocator) :
+	indexA(allocator), indexB(allocator),
+	strength(allocator), distance(allocator)
+{
+}
+
+int32 b2ParticleSystem::SpringPairs::GetCount() const
+{
+	return indexA.GetCount();
+}
+
+void b2ParticleSystem::SpringPairs::SetCount(int32 count)
+{
+	b2ResizeBuffer(indexA, count);
+	b2ResizeBuffer(indexB, count);
+	b2ResizeBuffer(strength, count);
+	b2ResizeBuffer(distance, count);
+}
+
+size_t b2ParticleSystem::SpringPairs::GetCapacityBytes() const
+{
+	// All the buffers have the same capacity.
+	return indexA.GetCapacity() * (2 * sizeof(int32) + 2 * sizeof(float32));
+}
+
+// Give a connection the first color none of its particles has yet, or the
+// overflow color when they have all the others.
+static int32 b2AssignConnectionColor(uint32* particleColors,
+									 const int32* indices, int32 count)
+{
+	uint32 used = 0;
+	for (int32 i = 0; i < count; i++)
 	{
-		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
-		int32 a = contact.index;
-		if (m_flagsBuffer.data[a] & k_extraDampingFlags)
-		{
-			b2Body* b = contact.body;
-			b2BodyState* state = b2GetBodyState(m_world, b);
-			b2BodySim* bodySim = b2GetBodySim(m_world, b);
-			float32 m = contact.mass;
-			b2Vec2 n = contact.normal;
-			b2Vec2 p = m_positionBuffer.data[a];
-			b2Vec2 v =
-				b2GetLinearVelocityFromWorldPointInternal(state, bodySim, p) -
-				m_velocityBuffer.data[a];
-			float32 vn = b2Dot(v, n);
-			if (vn < 0)
-			{
-				b2Vec2 f = 0.5f * m * vn * n;
-				m_velocityBuffer.data[a] += GetParticleInvMass() * f;
-				b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, -f, p, true);
-			}
-		}
+		used |= particleColors[indices[i]];
+	}
+	const uint32 available = ~used & ((1u << k_overflowConnectionColor) - 1);
+	if (available == 0)
+	{
+		return k_overflowConnectionColor;
 	}
+	const int32 color = (int32) b2CTZ32(available);
+	for (int32 i = 0; i < count; i++)
+	{
+		particleColors[indices[i]] |= 1u << color;
+	}
+	return color;
 }
 
-void b2ParticleSystem::SolveWall()
+// Turn the number of connections of each color into the first connection
+// of each color, followed by their count.
+static void b2ComputeConnectionColors(const int32* counts,
+									  b2GrowableBuffer<int32>& colors)
 {
-	for (int32 i = 0; i < m_count; i++)
+	b2ResizeBuffer(colors, k_connectionColorCount + 1);
+	int32 first = 0;
+	for (int32 i = 0; i < k_connectionColorCount; i++)
 	{
-		if (m_flagsBuffer.data[i] & b2_wallParticle)
+		colors[i] = first;
+		first += counts[i];
+	}
+	colors[k_connectionColorCount] = first;
+}
+
+void b2ParticleSystem::UpdateConnectionColors()
+{
+	// Greedy coloring, like the constraint graph. The connections keep
+	// the order of their buffers within a color, which keeps the particles
+	// of consecutive lanes close in memory.
+	const int32 triadCount = m_triadBuffer.GetCount();
+	const int32 pairCount = m_pairBuffer.GetCount();
+	uint32* particleColors =
+		(uint32*) m_stackAllocator.Allocate(sizeof(uint32) * m_count);
+	int32* connectionColors = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * b2MaxInt(b2MaxInt(triadCount, pairCount), 1));
+	int32 counts[k_connectionColorCount];
+
+	memset(particleColors, 0, sizeof(uint32) * m_count);
+	memset(counts, 0, sizeof(counts));
+	for (int32 k = 0; k < triadCount; k++)
+	{
+		const b2ParticleTriad& triad = m_triadBuffer[k];
+		int32 color = -1;
+		if (triad.flags & b2_elasticParticle)
 		{
-			m_velocityBuffer.data[i] = b2Vec2_zero;
+			const int32 indices[3] = {triad.indexA, triad.indexB, triad.indexC};
+			color = b2AssignConnectionColor(particleColors, indices, 3);
+			counts[color]++;
+		}
+		connectionColors[k] = color;
+	}
+	b2ComputeConnectionColors(counts, m_elasticColorBuffer);
+	m_elasticTriads.SetCount(m_elasticColorBuffer[k_connectionColorCount]);
+	memcpy(counts, m_elasticColorBuffer.Data(), sizeof(counts));
+	for (int32 k = 0; k < triadCount; k++)
+	{
+		if (connectionColors[k] < 0)
+		{
+			continue;
+		}
+		const b2ParticleTriad& triad = m_triadBuffer[k];
+		const int32 i = counts[connectionColors[k]]++;
+		m_elasticTriads.indexA[i] = triad.indexA;
+		m_elasticTriads.indexB[i] = triad.indexB;
+		m_elasticTriads.indexC[i] = triad.indexC;
+		m_elasticTriads.strength[i] = triad.strength;
+		m_elasticTriads.paX[i] = triad.pa.x;
+		m_elasticTriads.paY[i] = triad.pa.y;
+		m_elasticTriads.pbX[i] = triad.pb.x;
+		m_elasticTriads.pbY[i] = triad.pb.y;
+		m_elasticTriads.pcX[i] = triad.pc.x;
+		m_elasticTriads.pcY[i] = triad.pc.y;
+	}
+
+	memset(particleColors, 0, sizeof(uint32) * m_count);
+	memset(counts, 0, sizeof(counts));
+	for (int32 k = 0; k < pairCount; k++)
+	{
+		const b2ParticlePair& pair = m_pairBuffer[k];
+		int32 color = -1;
+		if (pair.flags & b2_springParticle)
+		{
+			const int32 indices[2] = {pair.indexA, pair.indexB};
+			color = b2AssignConnectionColor(particleColors, indices, 2);
+			counts[color]++;
+		}
+		connectionColors[k] = color;
+	}
+	b2ComputeConnectionColors(counts, m_springColorBuffer);
+	m_springPairs.SetCount(m_springColorBuffer[k_connectionColorCount]);
+	memcpy(counts, m_springColorBuffer.Data(), sizeof(counts));
+	for (int32 k = 0; k < pairCount; k++)
+	{
+		if (connectionColors[k] < 0)
+		{
+			continue;
 		}
+		const b2ParticlePair& pair = m_pairBuffer[k];
+		const int32 i = counts[connectionColors[k]]++;
+		m_springPairs.indexA[i] = pair.indexA;
+		m_springPairs.indexB[i] = pair.indexB;
+		m_springPairs.strength[i] = pair.strength;
+		m_springPairs.distance[i] = pair.distance;
 	}
+
+	m_stackAllocator.Free(connectionColors);
+	m_stackAllocator.Free(particleColors);
+	m_connectionsNeedColoring = false;
+
+#if B2_VALIDATE
+	const int32* const triadIndices[3] = {
+		m_elasticTriads.indexA.Data(), m_elasticTriads.indexB.Data(),
+		m_elasticTriads.indexC.Data()
+	};
+	ValidateConnectionColors(triadIndices, 3, m_elasticColorBuffer);
+	const int32* const pairIndices[2] = {
+		m_springPairs.indexA.Data(), m_springPairs.indexB.Data()
+	};
+	ValidateConnectionColors(pairIndices, 2, m_springColorBuffer);
+#endif
 }
 
-void b2ParticleSystem::SolveRigidLinearAngularDamping(const b2StepContext& step)
+// Check that no particle is in two connections of a color, except for the
+// overflow color, which is solved serially.
+void b2ParticleSystem::ValidateConnectionColors(
+	const int32* const* indices, int32 indexCount,
+	const b2GrowableBuffer<int32>& colors)
 {
-	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
+	int32* lastColor =
+		(int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	for (int32 i = 0; i < m_count; i++)
 	{
-		if (group->m_groupFlags & b2_rigidParticleGroup)
+		lastColor[i] = -1;
+	}
+	for (int32 color = 0; color < k_overflowConnectionColor; color++)
+	{
+		for (int32 k = colors[color]; k < colors[color + 1]; k++)
 		{
-			group->m_linearVelocity = group->m_linearVelocity * (1 / (1.0f + step.dt * group->m_linearDamping));
-			group->m_angularVelocity /= (1.0 + step.dt * group->m_angularDamping);
+			for (int32 j = 0; j < indexCount; j++)
+			{
+				const int32 index = indices[j][k];
+				b2Assert(0 <= index && index < m_count);
+				b2Assert(lastColor[index] != color);
+				lastColor[index] = color;
+			}
 		}
 	}
+	m_stackAllocator.Free(lastColor);
 }
 
-void b2ParticleSystem::SolveRigid(const b2StepContext& step)
+void b2ParticleSystem::SolveConnectionColors(
+	b2TaskCallback* task, const int32* colors,
+	ConnectionColorContext* context)
 {
-	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
+	// The colors are solved one after the other, each connection seeing
+	// the velocities updated by the previous colors. The connections of a
+	// color share no particle, so they are solved in parallel.
+	for (int32 i = 0; i < k_connectionColorCount; i++)
 	{
-		if (group->m_groupFlags & b2_rigidParticleGroup)
+		const int32 count = colors[i + 1] - colors[i];
+		context->firstConnection = colors[i];
+		context->serial = i == k_overflowConnectionColor;
+		if (!context->serial && m_world->workerCount > 1 &&
+			count > k_connectionTaskRange)
 		{
-			group->UpdateStatistics();
-			b2Rot rotation = b2MakeRot(step.dt * group->m_angularVelocity);
-			b2Transform transform{
-				group->m_center + step.dt * group->m_linearVelocity -
-				b2RotateVector(rotation, group->m_center), rotation};
-			group->m_transform = b2MulTransforms(transform, group->m_transform);
-			for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++)
+			void* colorTask = m_world->enqueueTaskFcn(
+				task, count, k_connectionTaskRange, context,
+				m_world->userTaskContext);
+			m_world->taskCount += 1;
+			if (colorTask != NULL)
 			{
-				b2Vec2 r = b2Sub( m_positionBuffer.data[i], group->m_center );
-				m_velocityBuffer.data[i]  = b2Add( group->m_linearVelocity, b2CrossSV( group->m_angularVelocity, r ) );
+				m_world->finishTaskFcn(colorTask, m_world->userTaskContext);
 			}
 		}
+		else if (count > 0)
+		{
+			task(0, count, 0, context);
+		}
 	}
 }
 
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveElastic(const b2StepContext& step)
 {
-	float32 elasticStrength = step.inv_dt * m_def.elasticStrength;
-	for (int32 k = 0; k < m_triadBuffer.GetCount(); k++)
+	if (m_connectionsNeedColoring)
 	{
-		const b2ParticleTriad& triad = m_triadBuffer[k];
-		if (triad.flags & b2_elasticParticle)
+		UpdateConnectionColors();
+	}
+	ConnectionColorContext context;
+	context.system = this;
+	context.dt = step.dt;
+	context.strength = step.inv_dt * m_def.elasticStrength;
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	SolveConnectionColors(&SolveElasticTask, m_elasticColorBuffer.Data(),
+						  &context);
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveElastic_Reference(context.dt, context.strength, 0,
+							   m_elasticTriads.GetCount());
+		check.Check();
+	#endif
+}
+
+void b2ParticleSystem::SolveElasticTask(int32 startIndex, int32 endIndex,
+										uint32 workerIndex, void* context)
+{
+	B2_NOT_USED(workerIndex);
+	ConnectionColorContext* color = (ConnectionColorContext*) context;
+	const int32 firstTriad = color->firstConnection + startIndex;
+	const int32 lastTriad = color->firstConnection + endIndex;
+	#if defined(B2_PARTICLE_SIMD)
+		if (!color->serial)
+		{
+			color->system->SolveElastic_Simd(color->dt, color->strength,
+											 firstTriad, lastTriad);
+			return;
+		}
+	#endif
+	color->system->SolveElastic_Reference(color->dt, color->strength,
+										  firstTriad, lastTriad);
+}
+
+// Solve the elastic triads [firstTriad, lastTriad) of m_elasticTriads.
+void b2ParticleSystem::SolveElastic_Reference(float32 dt,
+											  float32 elasticStrength,
+											  int32 firstTriad,
+											  int32 lastTriad)
+{
+	const ElasticTriads& triads = m_elasticTriads;
+	for (int32 k = firstTriad; k < lastTriad; k++)
+	{
+		int32 a = triads.indexA[k];
+		int32 b = triads.indexB[k];
+		int32 c = triads.indexC[k];
+		const b2Vec2 oa = {triads.paX[k], triads.paY[k]};
+		const b2Vec2 ob = {triads.pbX[k], triads.pbY[k]};
+		const b2Vec2 oc = {triads.pcX[k], triads.pcY[k]};
+		b2Vec2 pa = m_positionBuffer.data[a];
+		b2Vec2 pb = m_positionBuffer.data[b];
+		b2Vec2 pc = m_positionBuffer.data[c];
+		b2Vec2& va = m_velocityBuffer.data[a];
+		b2Vec2& vb = m_velocityBuffer.data[b];
+		b2Vec2& vc = m_velocityBuffer.data[c];
+		pa += dt * va;
+		pb += dt * vb;
+		pc += dt * vc;
+		b2Vec2 midPoint = (float32) 1 / 3 * (pa + pb + pc);
+		pa -= midPoint;
+		pb -= midPoint;
+		pc -= midPoint;
+		b2Rot r;
+		r.s = b2Cross(oa, pa) + b2Cross(ob, pb) + b2Cross(oc, pc);
+		r.c = b2Dot(oa, pa) + b2Dot(ob, pb) + b2Dot(oc, pc);
+		float32 r2 = r.s * r.s + r.c * r.c;
+		float32 invR = b2InvSqrt(r2);
+		r.s *= invR;
+		r.c *= invR;
+		float32 strength = elasticStrength * triads.strength[k];
+		va += strength * (b2RotateVector(r, oa) - pa);
+		vb += strength * (b2RotateVector(r, ob) - pb);
+		vc += strength * (b2RotateVector(r, oc) - pc);
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+// The triads [firstTriad, lastTriad) must share no particle.
+void b2ParticleSystem::SolveElastic_Simd(float32 dt, float32 elasticStrength,
+										 int32 firstTriad, int32 lastTriad)
+{
+	const ElasticTriads& triads = m_elasticTriads;
+	const b2Vec2* positions = m_positionBuffer.data;
+	b2Vec2* velocities = m_velocityBuffer.data;
+	const b2FloatW step = b2SplatW(dt);
+	const b2FloatW third = b2SplatW((float32) 1 / 3);
+	const b2FloatW elastic = b2SplatW(elasticStrength);
+	int32 k = firstTriad;
+	for (; k + B2_SIMD_WIDTH <= lastTriad; k += B2_SIMD_WIDTH)
+	{
+		const int32* indexA = triads.indexA.Data() + k;
+		const int32* indexB = triads.indexB.Data() + k;
+		const int32* indexC = triads.indexC.Data() + k;
+		b2FloatW pax, pay, pbx, pby, pcx, pcy;
+		b2FloatW vax, vay, vbx, vby, vcx, vcy;
+		b2GatherVec2W(positions, indexA, &pax, &pay);
+		b2GatherVec2W(positions, indexB, &pbx, &pby);
+		b2GatherVec2W(positions, indexC, &pcx, &pcy);
+		b2GatherVec2W(velocities, indexA, &vax, &vay);
+		b2GatherVec2W(velocities, indexB, &vbx, &vby);
+		b2GatherVec2W(velocities, indexC, &vcx, &vcy);
+		pax = b2AddW(pax, b2MulW(step, vax));
+		pay = b2AddW(pay, b2MulW(step, vay));
+		pbx = b2AddW(pbx, b2MulW(step, vbx));
+		pby = b2AddW(pby, b2MulW(step, vby));
+		pcx = b2AddW(pcx, b2MulW(step, vcx));
+		pcy = b2AddW(pcy, b2MulW(step, vcy));
+		b2FloatW midX = b2MulW(third, b2AddW(b2AddW(pax, pbx), pcx));
+		b2FloatW midY = b2MulW(third, b2AddW(b2AddW(pay, pby), pcy));
+		pax = b2SubW(pax, midX);
+		pay = b2SubW(pay, midY);
+		pbx = b2SubW(pbx, midX);
+		pby = b2SubW(pby, midY);
+		pcx = b2SubW(pcx, midX);
+		pcy = b2SubW(pcy, midY);
+		b2FloatW oax = b2LoadW(triads.paX.Data() + k);
+		b2FloatW oay = b2LoadW(triads.paY.Data() + k);
+		b2FloatW obx = b2LoadW(triads.pbX.Data() + k);
+		b2FloatW oby = b2LoadW(triads.pbY.Data() + k);
+		b2FloatW ocx = b2LoadW(triads.pcX.Data() + k);
+		b2FloatW ocy = b2LoadW(triads.pcY.Data() + k);
+		b2FloatW rs = b2AddW(b2AddW(
+			b2SubW(b2MulW(oax, pay), b2MulW(oay, pax)),
+			b2SubW(b2MulW(obx, pby), b2MulW(oby, pbx))),
+			b2SubW(b2MulW(ocx, pcy), b2MulW(ocy, pcx)));
+		b2FloatW rc = b2AddW(b2AddW(
+			b2AddW(b2MulW(oax, pax), b2MulW(oay, pay)),
+			b2AddW(b2MulW(obx, pbx), b2MulW(oby, pby))),
+			b2AddW(b2MulW(ocx, pcx), b2MulW(ocy, pcy)));
+		b2FloatW invR = b2InvSqrtW(b2AddW(b2MulW(rs, rs), b2MulW(rc, rc)));
+		rs = b2MulW(rs, invR);
+		rc = b2MulW(rc, invR);
+		b2FloatW s = b2MulW(elastic, b2LoadW(triads.strength.Data() + k));
+		float32 ax[B2_SIMD_WIDTH], ay[B2_SIMD_WIDTH];
+		float32 bx[B2_SIMD_WIDTH], by[B2_SIMD_WIDTH];
+		float32 cx[B2_SIMD_WIDTH], cy[B2_SIMD_WIDTH];
+		b2StoreW(ax, b2AddW(vax, b2MulW(s, b2SubW(
+			b2SubW(b2MulW(rc, oax), b2MulW(rs, oay)), pax))));
+		b2StoreW(ay, b2AddW(vay, b2MulW(s, b2SubW(
+			b2AddW(b2MulW(rs, oax), b2MulW(rc, oay)), pay))));
+		b2StoreW(bx, b2AddW(vbx, b2MulW(s, b2SubW(
+			b2SubW(b2MulW(rc, obx), b2MulW(rs, oby)), pbx))));
+		b2StoreW(by, b2AddW(vby, b2MulW(s, b2SubW(
+			b2AddW(b2MulW(rs, obx), b2MulW(rc, oby)), pby))));
+		b2StoreW(cx, b2AddW(vcx, b2MulW(s, b2SubW(
+			b2SubW(b2MulW(rc, ocx), b2MulW(rs, ocy)), pcx))));
+		b2StoreW(cy, b2AddW(vcy, b2MulW(s, b2SubW(
+			b2AddW(b2MulW(rs, ocx), b2MulW(rc, ocy)), pcy))));
+		for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
 		{
-			int32 a = triad.indexA;
-			int32 b = triad.indexB;
-			int32 c = triad.indexC;
-			const b2Vec2& oa = triad.pa;
-			const b2Vec2& ob = triad.pb;
-			const b2Vec2& oc = triad.pc;
-			b2Vec2 pa = m_positionBuffer.data[a];
-			b2Vec2 pb = m_positionBuffer.data[b];
-			b2Vec2 pc = m_positionBuffer.data[c];
-			b2Vec2& va = m_velocityBuffer.data[a];
-			b2Vec2& vb = m_velocityBuffer.data[b];
-			b2Vec2& vc = m_velocityBuffer.data[c];
-			pa += step.dt * va;
-			pb += step.dt * vb;
-			pc += step.dt * vc;
-			b2Vec2 midPoint = (float32) 1 / 3 * (pa + pb + pc);
-			pa -= midPoint;
-			pb -= midPoint;
-			pc -= midPoint;
-			b2Rot r;
-			r.s = b2Cross(oa, pa) + b2Cross(ob, pb) + b2Cross(oc, pc);
-			r.c = b2Dot(oa, pa) + b2Dot(ob, pb) + b2Dot(oc, pc);
-			float32 r2 = r.s * r.s + r.c * r.c;
-			float32 invR = b2InvSqrt(r2);
-			r.s *= invR;
-			r.c *= invR;
-			float32 strength = elasticStrength * triad.strength;
-			va += strength * (b2RotateVector(r, oa) - pa);
-			vb += strength * (b2RotateVector(r, ob) - pb);
-			vc += strength * (b2RotateVector(r, oc) - pc);
+			velocities[indexA[j]] = b2Vec2{ax[j], ay[j]};
+			velocities[indexB[j]] = b2Vec2{bx[j], by[j]};
+			velocities[indexC[j]] = b2Vec2{cx[j], cy[j]};
 		}
 	}
+	SolveElastic_Reference(dt, elasticStrength, k, lastTriad);
 }
 
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveSpring(const b2StepContext& step)
 {
-	float32 springStrength = step.inv_dt * m_def.springStrength;
-	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+	if (m_connectionsNeedColoring)
 	{
-		const b2ParticlePair& pair = m_pairBuffer[k];
-		if (pair.flags & b2_springParticle)
+		UpdateConnectionColors();
+	}
+	ConnectionColorContext context;
+	context.system = this;
+	context.dt = step.dt;
+	context.strength = step.inv_dt * m_def.springStrength;
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	SolveConnectionColors(&SolveSpringTask, m_springColorBuffer.Data(),
+						  &context);
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveSpring_Reference(context.dt, context.strength, 0,
+							  m_springPairs.GetCount());
+		check.Check();
+	#endif
+}
+
+void b2ParticleSystem::SolveSpringTask(int32 startIndex, int32 endIndex,
+									   uint32 workerIndex, void* context)
+{
+	B2_NOT_USED(workerIndex);
+	ConnectionColorContext* color = (ConnectionColorContext*) context;
+	const int32 firstPair = color->firstConnection + startIndex;
+	const int32 lastPair = color->firstConnection + endIndex;
+	#if defined(B2_PARTICLE_SIMD)
+		if (!color->serial)
 		{
-			int32 a = pair.indexA;
-			int32 b = pair.indexB;
-			b2Vec2 pa = m_positionBuffer.data[a];
-			b2Vec2 pb = m_positionBuffer.data[b];
-			b2Vec2& va = m_velocityBuffer.data[a];
-			b2Vec2& vb = m_velocityBuffer.data[b];
-			pa += step.dt * va;
-			pb += step.dt * vb;
-			b2Vec2 d = pb - pa;
-			float32 r0 = pair.distance;
-			float32 r1 = b2Length(d);
-			float32 strength = springStrength * pair.strength;
-			b2Vec2 f = strength * (r0 - r1) / r1 * d;
-			va -= f;
-			vb += f;
+			color->system->SolveSpring_Simd(color->dt, color->strength,
+											firstPair, lastPair);
+			return;
+		}
+	#endif
+	color->system->SolveSpring_Reference(color->dt, color->strength,
+										 firstPair, lastPair);
+}
+
+// Solve the spring pairs [firstPair, lastPair) of m_springPairs.
+void b2ParticleSystem::SolveSpring_Reference(float32 dt,
+											 float32 springStrength,
+											 int32 firstPair, int32 lastPair)
+{
+	const SpringPairs& pairs = m_springPairs;
+	for (int32 k = firstPair; k < lastPair; k++)
+	{
+		int32 a = pairs.indexA[k];
+		int32 b = pairs.indexB[k];
+		b2Vec2 pa = m_positionBuffer.data[a];
+		b2Vec2 pb = m_positionBuffer.data[b];
+		b2Vec2& va = m_velocityBuffer.data[a];
+		b2Vec2& vb = m_velocityBuffer.data[b];
+		pa += dt * va;
+		pb += dt * vb;
+		b2Vec2 d = pb - pa;
+		float32 r0 = pairs.distance[k];
+		float32 r1 = b2Length(d);
+		float32 strength = springStrength * pairs.strength[k];
+		b2Vec2 f = strength * (r0 - r1) / r1 * d;
+		va -= f;
+		vb += f;
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+// The pairs [firstPair, lastPair) must share no particle.
+void b2ParticleSystem::SolveSpring_Simd(float32 dt, float32 springStrength,
+										int32 firstPair, int32 lastPair)
+{
+	const SpringPairs& pairs = m_springPairs;
+	const b2Vec2* positions = m_positionBuffer.data;
+	b2Vec2* velocities = m_velocityBuffer.data;
+	const b2FloatW step = b2SplatW(dt);
+	const b2FloatW spring = b2SplatW(springStrength);
+	int32 k = firstPair;
+	for (; k + B2_SIMD_WIDTH <= lastPair; k += B2_SIMD_WIDTH)
+	{
+		const int32* indexA = pairs.indexA.Data() + k;
+		const int32* indexB = pairs.indexB.Data() + k;
+		b2FloatW pax, pay, pbx, pby, vax, vay, vbx, vby;
+		b2GatherVec2W(positions, indexA, &pax, &pay);
+		b2GatherVec2W(positions, indexB, &pbx, &pby);
+		b2GatherVec2W(velocities, indexA, &vax, &vay);
+		b2GatherVec2W(velocities, indexB, &vbx, &vby);
+		b2FloatW dx = b2SubW(b2AddW(pbx, b2MulW(step, vbx)),
+							 b2AddW(pax, b2MulW(step, vax)));
+		b2FloatW dy = b2SubW(b2AddW(pby, b2MulW(step, vby)),
+							 b2AddW(pay, b2MulW(step, vay)));
+		b2FloatW r0 = b2LoadW(pairs.distance.Data() + k);
+		b2FloatW r1 = b2SqrtW(b2AddW(b2MulW(dx, dx), b2MulW(dy, dy)));
+		b2FloatW strength = b2MulW(spring, b2LoadW(pairs.strength.Data() + k));
+		b2FloatW s = b2DivW(b2MulW(strength, b2SubW(r0, r1)), r1);
+		b2FloatW fx = b2MulW(s, dx);
+		b2FloatW fy = b2MulW(s, dy);
+		float32 ax[B2_SIMD_WIDTH], ay[B2_SIMD_WIDTH];
+		float32 bx[B2_SIMD_WIDTH], by[B2_SIMD_WIDTH];
+		b2StoreW(ax, b2SubW(vax, fx));
+		b2StoreW(ay, b2SubW(vay, fy));
+		b2StoreW(bx, b2AddW(vbx, fx));
+		b2StoreW(by, b2AddW(vby, fy));
+		for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
+		{
+			velocities[indexA[j]] = b2Vec2{ax[j], ay[j]};
+			velocities[indexB[j]] = b2Vec2{bx[j], by[j]};
 		}
 	}
+	SolveSpring_Reference(dt, springStrength, k, lastPair);
 }
 
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveTensile(const b2StepContext& step)
 {
 	b2Assert(m_accumulation2Buffer);
@@ -3462,7 +5696,58 @@ void b2ParticleSystem::SolveTensile(const b2StepContext& step)
 	{
 		m_accumulation2Buffer[i] = b2Vec2_zero;
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	{
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+										   m_accumulation2Buffer, m_count);
+		#endif
+
+		#if defined(B2_PARTICLE_SIMD)
+			AccumulateTensileNormals_Simd();
+		#else
+			AccumulateTensileNormals_Reference(0, m_contactBuffer.GetCount());
+		#endif
+
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			check.Restore();
+			AccumulateTensileNormals_Reference(0, m_contactBuffer.GetCount());
+			check.Check();
+		#endif
+	}
+	float32 criticalVelocity = GetCriticalVelocity(step);
+	float32 pressureStrength = m_def.surfaceTensionPressureStrength
+							 * criticalVelocity;
+	float32 normalStrength = m_def.surfaceTensionNormalStrength
+						   * criticalVelocity;
+	float32 maxVelocityVariation = b2_maxParticleForce * criticalVelocity;
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	#if defined(B2_PARTICLE_SIMD)
+		SolveTensile_Simd(pressureStrength, normalStrength,
+						  maxVelocityVariation);
+	#else
+		SolveTensile_Reference(pressureStrength, normalStrength,
+							   maxVelocityVariation, 0,
+							   m_contactBuffer.GetCount());
+	#endif
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveTensile_Reference(pressureStrength, normalStrength,
+							   maxVelocityVariation, 0,
+							   m_contactBuffer.GetCount());
+		check.Check();
+	#endif
+}
+
+void b2ParticleSystem::AccumulateTensileNormals_Reference(int32 firstContact,
+														  int32 lastContact)
+{
+	for (int32 k = firstContact; k < lastContact; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_tensileParticle)
@@ -3476,13 +5761,15 @@ void b2ParticleSystem::SolveTensile(const b2StepContext& step)
 			m_accumulation2Buffer[b] += weightedNormal;
 		}
 	}
-	float32 criticalVelocity = GetCriticalVelocity(step);
-	float32 pressureStrength = m_def.surfaceTensionPressureStrength
-							 * criticalVelocity;
-	float32 normalStrength = m_def.surfaceTensionNormalStrength
-						   * criticalVelocity;
-	float32 maxVelocityVariation = b2_maxParticleForce * criticalVelocity;
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+}
+
+void b2ParticleSystem::SolveTensile_Reference(float32 pressureStrength,
+											  float32 normalStrength,
+											  float32 maxVelocityVariation,
+											  int32 firstContact,
+											  int32 lastContact)
+{
+	for (int32 k = firstContact; k < lastContact; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_tensileParticle)
@@ -3503,49 +5790,273 @@ void b2ParticleSystem::SolveTensile(const b2StepContext& step)
 	}
 }
 
-void b2ParticleSystem::SolveViscous()
+#if defined(B2_PARTICLE_SIMD)
+
+// The contact passes which only add to the buffers they write compute
+// B2_SIMD_WIDTH consecutive contacts at once and add the results in the
+// contact order, so they give the same results as the reference versions.
+
+// Add 'f' to buffer[indicesB[i]] and subtract it from buffer[indicesA[i]]
+// for the lanes in 'mask'.
+static inline void b2ScatterContactLanes(b2Vec2* buffer,
+										 const int32* indicesA,
+										 const int32* indicesB, int32 mask,
+										 b2FloatW fx, b2FloatW fy)
+{
+	float32 x[B2_SIMD_WIDTH];
+	float32 y[B2_SIMD_WIDTH];
+	b2StoreW(x, fx);
+	b2StoreW(y, fy);
+	for (int32 i = 0; i < B2_SIMD_WIDTH; i++)
+	{
+		if (mask & (1 << i))
+		{
+			b2Vec2 f = {x[i], y[i]};
+			buffer[indicesA[i]] -= f;
+			buffer[indicesB[i]] += f;
+		}
+	}
+}
+
+// The lanes whose contacts have any of 'flags'.
+static inline int32 b2GetContactLaneMask(const b2ParticleContactW& lanes,
+										 uint32 flags)
+{
+	int32 mask = 0;
+	for (int32 i = 0; i < B2_SIMD_WIDTH; i++)
+	{
+		if (lanes.flags[i] & flags)
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+}
+
+void b2ParticleSystem::AccumulateTensileNormals_Simd()
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const b2FloatW one = b2SplatW(1);
+	int32 k = 0;
+	for (; k + B2_SIMD_WIDTH <= contactCount; k += B2_SIMD_WIDTH)
+	{
+		b2ParticleContactW c;
+		b2LoadParticleContactsW(&c, &m_contactBuffer[k], 1);
+		const int32 active = b2GetContactLaneMask(c, b2_tensileParticle);
+		if (active == 0)
+		{
+			continue;
+		}
+		b2FloatW s = b2MulW(b2SubW(one, c.weight), c.weight);
+		b2ScatterContactLanes(m_accumulation2Buffer, c.indexA, c.indexB,
+							  active, b2MulW(s, c.normalX),
+							  b2MulW(s, c.normalY));
+	}
+	AccumulateTensileNormals_Reference(k, contactCount);
+}
+
+void b2ParticleSystem::SolveTensile_Simd(float32 pressureStrength,
+										 float32 normalStrength,
+										 float32 maxVelocityVariation)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const b2FloatW two = b2SplatW(2);
+	const b2FloatW pressure = b2SplatW(pressureStrength);
+	const b2FloatW normal = b2SplatW(normalStrength);
+	const b2FloatW maxVariation = b2SplatW(maxVelocityVariation);
+	int32 k = 0;
+	for (; k + B2_SIMD_WIDTH <= contactCount; k += B2_SIMD_WIDTH)
+	{
+		b2ParticleContactW c;
+		b2LoadParticleContactsW(&c, &m_contactBuffer[k], 1);
+		const int32 active = b2GetContactLaneMask(c, b2_tensileParticle);
+		if (active == 0)
+		{
+			continue;
+		}
+		b2FloatW h = b2AddW(b2GatherW(m_weightBuffer, c.indexA),
+							b2GatherW(m_weightBuffer, c.indexB));
+		b2FloatW ax, ay, bx, by;
+		b2GatherVec2W(m_accumulation2Buffer, c.indexA, &ax, &ay);
+		b2GatherVec2W(m_accumulation2Buffer, c.indexB, &bx, &by);
+		b2FloatW sn = b2AddW(b2MulW(b2SubW(bx, ax), c.normalX),
+							 b2MulW(b2SubW(by, ay), c.normalY));
+		b2FloatW fn = b2MulW(b2MinW(b2AddW(b2MulW(pressure, b2SubW(h, two)),
+										   b2MulW(normal, sn)),
+									maxVariation),
+							 c.weight);
+		b2ScatterContactLanes(m_velocityBuffer.data, c.indexA, c.indexB,
+							  active, b2MulW(fn, c.normalX),
+							  b2MulW(fn, c.normalY));
+	}
+	SolveTensile_Reference(pressureStrength, normalStrength,
+						   maxVelocityVariation, k, contactCount);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
+void b2ParticleSystem::SolveViscous()
+{
+	float32 viscousStrength = m_def.viscousStrength;
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		int32 a = contact.index;
+		if (m_flagsBuffer.data[a] & b2_viscousParticle)
+		{
+			b2Body* b = contact.body;
+			b2BodyState* state = b2GetBodyState(m_world, b);
+			b2BodySim* bodySim = b2GetBodySim(m_world, b);
+			float32 w = contact.weight;
+			float32 m = contact.mass;
+			b2Vec2 p = m_positionBuffer.data[a];
+			b2Vec2 v = b2GetLinearVelocityFromWorldPointInternal(state, bodySim, p) -
+					   m_velocityBuffer.data[a];
+			b2Vec2 f = viscousStrength * m * w * v;
+			m_velocityBuffer.data[a] += GetParticleInvMass() * f;
+			b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, -f, p, true);
+		}
+	}
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	#if defined(B2_PARTICLE_SIMD)
+		SolveViscous_Simd(viscousStrength);
+	#else
+		SolveViscous_Reference(viscousStrength, 0,
+			b2GetContactLaneStride(m_contactBuffer.GetCount()));
+	#endif
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveViscous_Reference(viscousStrength, 0,
+			b2GetContactLaneStride(m_contactBuffer.GetCount()));
+		check.Check();
+	#endif
+}
+
+// Apply the viscosity of the particle contacts of the batches
+// [firstBatch, lastBatch), see k_contactLaneCount.
+void b2ParticleSystem::SolveViscous_Reference(float32 viscousStrength,
+											  int32 firstBatch,
+											  int32 lastBatch)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	for (int32 i = firstBatch; i < lastBatch; i++)
+	{
+		for (int32 k = i; k < contactCount; k += stride)
+		{
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			if (contact.GetFlags() & b2_viscousParticle)
+			{
+				int32 a = contact.GetIndexA();
+				int32 b = contact.GetIndexB();
+				float32 w = contact.GetWeight();
+				b2Vec2 v = m_velocityBuffer.data[b] - m_velocityBuffer.data[a];
+				b2Vec2 f = viscousStrength * w * v;
+				m_velocityBuffer.data[a] += f;
+				m_velocityBuffer.data[b] -= f;
+			}
+		}
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::SolveViscous_Simd(float32 viscousStrength)
 {
-	float32 viscousStrength = m_def.viscousStrength;
-	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	const int32 fullBatchCount =
+		b2MaxInt(contactCount - (k_contactLaneCount - 1) * stride, 0);
+	const b2ParticleContact* contacts = m_contactBuffer.Data();
+	b2Vec2* velocities = m_velocityBuffer.data;
+	int32* marks = (int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	memset(marks, 0xff, sizeof(int32) * m_count);
+
+	const b2FloatW strength = b2SplatW(viscousStrength);
+	for (int32 i = 0; i < fullBatchCount; i++)
 	{
-		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
-		int32 a = contact.index;
-		if (m_flagsBuffer.data[a] & b2_viscousParticle)
+		b2ParticleContactW lanes[k_contactLaneVectorCount];
+		int32 active[k_contactLaneVectorCount];
+		bool independent = true;
+		for (int32 h = 0; h < k_contactLaneVectorCount; h++)
 		{
-			b2Body* b = contact.body;
-			b2BodyState* state = b2GetBodyState(m_world, b);
-			b2BodySim* bodySim = b2GetBodySim(m_world, b);
-			float32 w = contact.weight;
-			float32 m = contact.mass;
-			b2Vec2 p = m_positionBuffer.data[a];
-			b2Vec2 v = b2GetLinearVelocityFromWorldPointInternal(state, bodySim, p) -
-					   m_velocityBuffer.data[a];
-			b2Vec2 f = viscousStrength * m * w * v;
-			m_velocityBuffer.data[a] += GetParticleInvMass() * f;
-			b2ApplyLinearImpulseInternal(m_world, b, state, bodySim, -f, p, true);
+			b2LoadParticleContactsW(&lanes[h],
+				contacts + h * B2_SIMD_WIDTH * stride + i, stride);
+			active[h] = b2GetContactLaneMask(lanes[h], b2_viscousParticle);
+			independent = independent &&
+				b2AreContactLanesIndependent(lanes[h].indexA,
+					lanes[h].indexB, B2_SIMD_WIDTH,
+					active[h], i, marks);
+		}
+		if (!independent)
+		{
+			SolveViscous_Reference(viscousStrength, i, i + 1);
+			continue;
 		}
-	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
-	{
-		const b2ParticleContact& contact = m_contactBuffer[k];
-		if (contact.GetFlags() & b2_viscousParticle)
+		for (int32 h = 0; h < k_contactLaneVectorCount; h++)
 		{
-			int32 a = contact.GetIndexA();
-			int32 b = contact.GetIndexB();
-			float32 w = contact.GetWeight();
-			b2Vec2 v = m_velocityBuffer.data[b] - m_velocityBuffer.data[a];
-			b2Vec2 f = viscousStrength * w * v;
-			m_velocityBuffer.data[a] += f;
-			m_velocityBuffer.data[b] -= f;
+			if (active[h] == 0)
+			{
+				continue;
+			}
+			const b2ParticleContactW& c = lanes[h];
+			b2FloatW vax, vay, vbx, vby;
+			b2GatherVec2W(velocities, c.indexA, &vax, &vay);
+			b2GatherVec2W(velocities, c.indexB, &vbx, &vby);
+			b2FloatW s = b2MulW(strength, c.weight);
+			b2FloatW fx = b2MulW(s, b2SubW(vbx, vax));
+			b2FloatW fy = b2MulW(s, b2SubW(vby, vay));
+			// The lanes are independent, so this is the same as adding the
+			// impulses in the contact order.
+			b2ScatterContactLanes(velocities, c.indexB, c.indexA, active[h],
+								  fx, fy);
 		}
 	}
+	SolveViscous_Reference(viscousStrength, fullBatchCount, stride);
+
+	m_stackAllocator.Free(marks);
 }
 
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveRepulsive(const b2StepContext& step)
 {
 	float32 repulsiveStrength =
 		m_def.repulsiveStrength * GetCriticalVelocity(step);
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	#if defined(B2_PARTICLE_SIMD)
+		SolveRepulsive_Simd(repulsiveStrength);
+	#else
+		SolveRepulsive_Reference(repulsiveStrength, 0,
+								 m_contactBuffer.GetCount());
+	#endif
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolveRepulsive_Reference(repulsiveStrength, 0,
+								 m_contactBuffer.GetCount());
+		check.Check();
+	#endif
+}
+
+void b2ParticleSystem::SolveRepulsive_Reference(float32 repulsiveStrength,
+												int32 firstContact,
+												int32 lastContact)
+{
+	for (int32 k = firstContact; k < lastContact; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_repulsiveParticle)
@@ -3564,11 +6075,68 @@ void b2ParticleSystem::SolveRepulsive(const b2StepContext& step)
 	}
 }
 
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::SolveRepulsive_Simd(float32 repulsiveStrength)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const b2FloatW strength = b2SplatW(repulsiveStrength);
+	int32 k = 0;
+	for (; k + B2_SIMD_WIDTH <= contactCount; k += B2_SIMD_WIDTH)
+	{
+		b2ParticleContactW c;
+		b2LoadParticleContactsW(&c, &m_contactBuffer[k], 1);
+		int32 active = b2GetContactLaneMask(c, b2_repulsiveParticle);
+		for (int32 i = 0; i < B2_SIMD_WIDTH; i++)
+		{
+			if (m_groupBuffer[c.indexA[i]] == m_groupBuffer[c.indexB[i]])
+			{
+				active &= ~(1 << i);
+			}
+		}
+		if (active == 0)
+		{
+			continue;
+		}
+		b2FloatW s = b2MulW(strength, c.weight);
+		b2ScatterContactLanes(m_velocityBuffer.data, c.indexA, c.indexB,
+							  active, b2MulW(s, c.normalX),
+							  b2MulW(s, c.normalY));
+	}
+	SolveRepulsive_Reference(repulsiveStrength, k, contactCount);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolvePowder(const b2StepContext& step)
 {
 	float32 powderStrength = m_def.powderStrength * GetCriticalVelocity(step);
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		b2ReferenceCheck<b2Vec2> check(&m_stackAllocator,
+									   m_velocityBuffer.data, m_count);
+	#endif
+
+	#if defined(B2_PARTICLE_SIMD)
+		SolvePowder_Simd(powderStrength);
+	#else
+		SolvePowder_Reference(powderStrength, 0, m_contactBuffer.GetCount());
+	#endif
+
+	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+		check.Restore();
+		SolvePowder_Reference(powderStrength, 0, m_contactBuffer.GetCount());
+		check.Check();
+	#endif
+}
+
+void b2ParticleSystem::SolvePowder_Reference(float32 powderStrength,
+											 int32 firstContact,
+											 int32 lastContact)
+{
 	float32 minWeight = 1.0f - b2_particleStride;
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	for (int32 k = firstContact; k < lastContact; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_powderParticle)
@@ -3587,6 +6155,34 @@ void b2ParticleSystem::SolvePowder(const b2StepContext& step)
 	}
 }
 
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::SolvePowder_Simd(float32 powderStrength)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const b2FloatW strength = b2SplatW(powderStrength);
+	const b2FloatW minWeight = b2SplatW(1.0f - b2_particleStride);
+	int32 k = 0;
+	for (; k + B2_SIMD_WIDTH <= contactCount; k += B2_SIMD_WIDTH)
+	{
+		b2ParticleContactW c;
+		b2LoadParticleContactsW(&c, &m_contactBuffer[k], 1);
+		const int32 active = b2GetContactLaneMask(c, b2_powderParticle) &
+			b2MaskBitsW(b2GreaterThanW(c.weight, minWeight));
+		if (active == 0)
+		{
+			continue;
+		}
+		b2FloatW s = b2MulW(strength, b2SubW(c.weight, minWeight));
+		b2ScatterContactLanes(m_velocityBuffer.data, c.indexA, c.indexB,
+							  active, b2MulW(s, c.normalX),
+							  b2MulW(s, c.normalY));
+	}
+	SolvePowder_Reference(powderStrength, k, contactCount);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
 void b2ParticleSystem::SolveSolid(const b2StepContext& step)
 {
 	// applies extra repulsive force from solid particle groups
@@ -3612,20 +6208,65 @@ void b2ParticleSystem::SolveSolid(const b2StepContext& step)
 void b2ParticleSystem::SolveForce(const b2StepContext& step)
 {
 	float32 velocityPerForce = step.dt * GetParticleInvMass();
-	for (int32 i = 0; i < m_count; i++)
+	if (m_hasForce)
+	{
+		for (int32 i = 0; i < m_count; i++)
+		{
+			m_velocityBuffer.data[i] += velocityPerForce * m_forceBuffer[i];
+		}
+		m_hasForce = false;
+	}
+	if (m_forceFieldList)
 	{
-		m_velocityBuffer.data[i] += velocityPerForce * m_forceBuffer[i];
+		SolveForceFields(velocityPerForce);
 	}
-	m_hasForce = false;
 }
 
+LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::SolveColorMixing()
 {
 	// mixes color between contacting particles
 	b2Assert(m_colorBuffer.data);
 	const int32 colorMixing128 = (int32) (128 * m_def.colorMixingStrength);
 	if (colorMixing128) {
-		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			b2ReferenceCheck<b2ParticleColor> check(&m_stackAllocator,
+				m_colorBuffer.data, m_count);
+		#endif
+
+		#if defined(B2_PARTICLE_SIMD)
+			// The packed mix only handles strengths up to 1.
+			if (0 < colorMixing128 && colorMixing128 <= 128)
+			{
+				SolveColorMixing_Simd(colorMixing128);
+			}
+			else
+		#endif
+			{
+				SolveColorMixing_Reference(colorMixing128, 0,
+					b2GetContactLaneStride(m_contactBuffer.GetCount()));
+			}
+
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			check.Restore();
+			SolveColorMixing_Reference(colorMixing128, 0,
+				b2GetContactLaneStride(m_contactBuffer.GetCount()));
+			check.Check();
+		#endif
+	}
+}
+
+// Mix the colors of the particle contacts of the batches
+// [firstBatch, lastBatch), see k_contactLaneCount.
+void b2ParticleSystem::SolveColorMixing_Reference(int32 strength,
+												  int32 firstBatch,
+												  int32 lastBatch)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	for (int32 i = firstBatch; i < lastBatch; i++)
+	{
+		for (int32 k = i; k < contactCount; k += stride)
 		{
 			const b2ParticleContact& contact = m_contactBuffer[k];
 			int32 a = contact.GetIndexA();
@@ -3637,12 +6278,93 @@ void b2ParticleSystem::SolveColorMixing()
 				b2ParticleColor& colorB = m_colorBuffer.data[b];
 				// Use the static method to ensure certain compilers inline
 				// this correctly.
-				b2ParticleColor::MixColors(&colorA, &colorB, colorMixing128);
+				b2ParticleColor::MixColors(&colorA, &colorB, strength);
+			}
+		}
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::SolveColorMixing_Simd(int32 strength)
+{
+	b2Assert(0 < strength && strength <= 128);
+	const int32 contactCount = m_contactBuffer.GetCount();
+	const int32 stride = b2GetContactLaneStride(contactCount);
+	const int32 fullBatchCount =
+		b2MaxInt(contactCount - (k_contactLaneCount - 1) * stride, 0);
+	const b2ParticleContact* contacts = m_contactBuffer.Data();
+	b2ParticleColor* colors = m_colorBuffer.data;
+	int32* marks = (int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	memset(marks, 0xff, sizeof(int32) * m_count);
+
+	// A color packs into 32 bits, so b2MixColors4 mixes 4 contacts at once.
+	b2Assert(sizeof(b2ParticleColor) == sizeof(uint32));
+	static const int32 k_colorLaneWidth = 4;
+	for (int32 i = 0; i < fullBatchCount; i++)
+	{
+		int32 indexA[k_contactLaneCount];
+		int32 indexB[k_contactLaneCount];
+		int32 active = 0;
+		for (int32 j = 0; j < k_contactLaneCount; j++)
+		{
+			const b2ParticleContact& contact = contacts[j * stride + i];
+			indexA[j] = contact.GetIndexA();
+			indexB[j] = contact.GetIndexB();
+			if (m_flagsBuffer.data[indexA[j]] & m_flagsBuffer.data[indexB[j]] &
+				b2_colorMixingParticle)
+			{
+				active |= 1 << j;
+			}
+		}
+		if (active == 0)
+		{
+			continue;
+		}
+		if (!b2AreContactLanesIndependent(indexA, indexB,
+				k_contactLaneCount, active, i, marks))
+		{
+			SolveColorMixing_Reference(strength, i, i + 1);
+			continue;
+		}
+		for (int32 h = 0; h < k_contactLaneCount; h += k_colorLaneWidth)
+		{
+			const int32 laneActive = (active >> h) & 0xf;
+			if (laneActive == 0)
+			{
+				continue;
+			}
+			uint32 packedA[k_colorLaneWidth];
+			uint32 packedB[k_colorLaneWidth];
+			for (int32 j = 0; j < k_colorLaneWidth; j++)
+			{
+				memcpy(&packedA[j], &colors[indexA[h + j]], sizeof(uint32));
+				memcpy(&packedB[j], &colors[indexB[h + j]], sizeof(uint32));
+			}
+			__m128i colorsA = _mm_loadu_si128((const __m128i*) packedA);
+			__m128i colorsB = _mm_loadu_si128((const __m128i*) packedB);
+			b2MixColors4(&colorsA, &colorsB, strength);
+			_mm_storeu_si128((__m128i*) packedA, colorsA);
+			_mm_storeu_si128((__m128i*) packedB, colorsB);
+			for (int32 j = 0; j < k_colorLaneWidth; j++)
+			{
+				if (laneActive & (1 << j))
+				{
+					memcpy((void*) &colors[indexA[h + j]], &packedA[j],
+						   sizeof(uint32));
+					memcpy((void*) &colors[indexB[h + j]], &packedB[j],
+						   sizeof(uint32));
+				}
 			}
 		}
 	}
+	SolveColorMixing_Reference(strength, fullBatchCount, stride);
+
+	m_stackAllocator.Free(marks);
 }
 
+#endif // defined(B2_PARTICLE_SIMD)
+
 void b2ParticleSystem::SolveZombie()
 {
 	// removes particles with zombie flag
@@ -3764,6 +6486,18 @@ void b2ParticleSystem::SolveZombie()
 		proxy.index = newIndices[proxy.index];
 	}
 	m_proxyBuffer.RemoveIf(Test::IsProxyInvalid);
+	const int32 staticCount = m_staticProxyBuffer.GetCount();
+	for (int32 k = 0; k < staticCount; k++)
+	{
+		Proxy& proxy = m_staticProxyBuffer.Begin()[k];
+		proxy.index = newIndices[proxy.index];
+	}
+	m_staticProxyBuffer.RemoveIf(Test::IsProxyInvalid);
+	if (m_staticProxyBuffer.GetCount() != staticCount)
+	{
+		// The static proxies are still sorted but their weights are stale.
+		m_staticProxiesNeedUpdate = true;
+	}
 
 	// update contacts
 	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
@@ -3774,6 +6508,20 @@ void b2ParticleSystem::SolveZombie()
 	}
 	m_contactBuffer.RemoveIf(Test::IsContactInvalid);
 
+	// update contact event keys, the surviving keys stay sorted
+	int32 keyCount = 0;
+	for (int32 k = 0; k < m_contactEventKeyBuffer.GetCount(); k++)
+	{
+		const uint64 key = m_contactEventKeyBuffer[k];
+		const int32 a = newIndices[b2ParticleContactKeyIndexA(key)];
+		const int32 b = newIndices[b2ParticleContactKeyIndexB(key)];
+		if (a >= 0 && b >= 0)
+		{
+			m_contactEventKeyBuffer[keyCount++] = b2MakeParticleContactKey(a, b);
+		}
+	}
+	m_contactEventKeyBuffer.SetCount(keyCount);
+
 	// update particle-body contacts
 	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
 	{
@@ -3782,6 +6530,21 @@ void b2ParticleSystem::SolveZombie()
 	}
 	m_bodyContactBuffer.RemoveIf(Test::IsBodyContactInvalid);
 
+	// update body contact event keys, the surviving keys stay sorted
+	keyCount = 0;
+	for (int32 k = 0; k < m_bodyContactEventKeyBuffer.GetCount(); k++)
+	{
+		BodyContactKey key = m_bodyContactEventKeyBuffer[k];
+		const int32 index = newIndices[b2BodyContactKeyIndex(key.key)];
+		if (index >= 0)
+		{
+			key.key = b2MakeBodyContactKey(
+				b2BodyContactKeyShapeIndex(key.key), index);
+			m_bodyContactEventKeyBuffer[keyCount++] = key;
+		}
+	}
+	m_bodyContactEventKeyBuffer.SetCount(keyCount);
+
 	// update pairs
 	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
 	{
@@ -3800,6 +6563,24 @@ void b2ParticleSystem::SolveZombie()
 		triad.indexC = newIndices[triad.indexC];
 	}
 	m_triadBuffer.RemoveIf(Test::IsTriadInvalid);
+	m_connectionsNeedColoring = true;
+
+	// update emitters, their particles may have been destroyed by others
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		bool modified = false;
+		for (int32 k = 0; k < emitter->m_count; k++)
+		{
+			int32& index = emitter->GetSlot(k);
+			index = newIndices[index];
+			modified |= index == b2_invalidParticleIndex;
+		}
+		if (modified)
+		{
+			emitter->RemoveInvalidSlots();
+		}
+	}
 
 	// Update lifetime indices.
 	if (m_indexByExpirationTimeBuffer.data)
@@ -3874,45 +6655,138 @@ void b2ParticleSystem::SolveZombie()
 		}
 		group = next;
 	}
-}
-
-/// Destroy all particles which have outlived their lifetimes set by
-/// SetParticleLifetime().
-void b2ParticleSystem::SolveLifetimes(const b2StepContext& step)
-{
-	b2Assert(m_expirationTimeBuffer.data);
-	b2Assert(m_indexByExpirationTimeBuffer.data);
-	// Update the time elapsed.
-	m_timeElapsed = LifetimeToExpirationTime(step.dt);
-	// Get the floor (non-fractional component) of the elapsed time.
-	const int32 quantizedTimeElapsed = GetQuantizedTimeElapsed();
+}
+
+/// Destroy all particles which have outlived their lifetimes set by
+/// SetParticleLifetime().
+void b2ParticleSystem::SolveLifetimes(const b2StepContext& step)
+{
+	b2Assert(m_expirationTimeBuffer.data);
+	b2Assert(m_indexByExpirationTimeBuffer.data);
+	// Update the time elapsed.
+	m_timeElapsed = LifetimeToExpirationTime(step.dt);
+	// Get the floor (non-fractional component) of the elapsed time.
+	const int32 quantizedTimeElapsed = GetQuantizedTimeElapsed();
+
+	const int32* const expirationTimes = m_expirationTimeBuffer.data;
+	int32* const expirationTimeIndices = m_indexByExpirationTimeBuffer.data;
+	const int32 particleCount = GetParticleCount();
+	// Sort the lifetime buffer if it's required.
+	if (m_expirationTimeBufferRequiresSorting)
+	{
+		const ExpirationTimeComparator expirationTimeComparator(
+			expirationTimes);
+		std::sort(expirationTimeIndices,
+				  expirationTimeIndices + particleCount,
+				  expirationTimeComparator);
+		m_expirationTimeBufferRequiresSorting = false;
+	}
+
+	// Destroy particles which have expired.
+	for (int32 i = particleCount - 1; i >= 0; --i)
+	{
+		const int32 particleIndex = expirationTimeIndices[i];
+		const int32 expirationTime = expirationTimes[particleIndex];
+		// If no particles need to be destroyed, skip this.
+		if (quantizedTimeElapsed < expirationTime || expirationTime <= 0)
+		{
+			break;
+		}
+		// Destroy this particle.
+		DestroyParticle(particleIndex);
+	}
+}
+
+// Update the particle indices held outside of the particle buffers after
+// the particles moved from index i to newIndices[i].
+template <typename T>
+void b2ParticleSystem::RemapParticleIndices(const T& newIndices)
+{
+	if (m_expirationTimeBuffer.data)
+	{
+		// Update expiration time buffer indices.
+		const int32 particleCount = GetParticleCount();
+		int32* const indexByExpirationTime =
+			m_indexByExpirationTimeBuffer.data;
+		for (int32 i = 0; i < particleCount; ++i)
+		{
+			indexByExpirationTime[i] = newIndices[indexByExpirationTime[i]];
+		}
+	}
+
+	// update proxies
+	for (int32 k = 0; k < m_proxyBuffer.GetCount(); k++)
+	{
+		Proxy& proxy = m_proxyBuffer.Begin()[k];
+		proxy.index = newIndices[proxy.index];
+	}
+	for (int32 k = 0; k < m_staticProxyBuffer.GetCount(); k++)
+	{
+		Proxy& proxy = m_staticProxyBuffer.Begin()[k];
+		proxy.index = newIndices[proxy.index];
+	}
+
+	// update contacts
+	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	{
+		b2ParticleContact& contact = m_contactBuffer[k];
+		contact.SetIndices(newIndices[contact.GetIndexA()],
+						   newIndices[contact.GetIndexB()]);
+	}
+
+	// update contact event keys
+	for (int32 k = 0; k < m_contactEventKeyBuffer.GetCount(); k++)
+	{
+		uint64& key = m_contactEventKeyBuffer[k];
+		key = b2MakeParticleContactKey(
+			newIndices[b2ParticleContactKeyIndexA(key)],
+			newIndices[b2ParticleContactKeyIndexB(key)]);
+		m_contactEventKeysRequireSorting = true;
+	}
+
+	// update particle-body contacts
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		contact.index = newIndices[contact.index];
+	}
+
+	// update body contact event keys
+	for (int32 k = 0; k < m_bodyContactEventKeyBuffer.GetCount(); k++)
+	{
+		uint64& key = m_bodyContactEventKeyBuffer[k].key;
+		key = b2MakeBodyContactKey(b2BodyContactKeyShapeIndex(key),
+								   newIndices[b2BodyContactKeyIndex(key)]);
+		m_bodyContactEventKeysRequireSorting = true;
+	}
+
+	// update pairs
+	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+	{
+		b2ParticlePair& pair = m_pairBuffer[k];
+		pair.indexA = newIndices[pair.indexA];
+		pair.indexB = newIndices[pair.indexB];
+	}
 
-	const int32* const expirationTimes = m_expirationTimeBuffer.data;
-	int32* const expirationTimeIndices = m_indexByExpirationTimeBuffer.data;
-	const int32 particleCount = GetParticleCount();
-	// Sort the lifetime buffer if it's required.
-	if (m_expirationTimeBufferRequiresSorting)
+	// update triads
+	for (int32 k = 0; k < m_triadBuffer.GetCount(); k++)
 	{
-		const ExpirationTimeComparator expirationTimeComparator(
-			expirationTimes);
-		std::sort(expirationTimeIndices,
-				  expirationTimeIndices + particleCount,
-				  expirationTimeComparator);
-		m_expirationTimeBufferRequiresSorting = false;
+		b2ParticleTriad& triad = m_triadBuffer[k];
+		triad.indexA = newIndices[triad.indexA];
+		triad.indexB = newIndices[triad.indexB];
+		triad.indexC = newIndices[triad.indexC];
 	}
+	m_connectionsNeedColoring = true;
 
-	// Destroy particles which have expired.
-	for (int32 i = particleCount - 1; i >= 0; --i)
+	// update emitters
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
 	{
-		const int32 particleIndex = expirationTimeIndices[i];
-		const int32 expirationTime = expirationTimes[particleIndex];
-		// If no particles need to be destroyed, skip this.
-		if (quantizedTimeElapsed < expirationTime || expirationTime <= 0)
+		for (int32 k = 0; k < emitter->m_count; k++)
 		{
-			break;
+			int32& index = emitter->GetSlot(k);
+			index = newIndices[index];
 		}
-		// Destroy this particle.
-		DestroyParticle(particleIndex);
 	}
 }
 
@@ -4022,61 +6896,162 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		std::rotate(m_expirationTimeBuffer.data + start,
 					m_expirationTimeBuffer.data + mid,
 					m_expirationTimeBuffer.data + end);
-		// Update expiration time buffer indices.
-		const int32 particleCount = GetParticleCount();
-		int32* const indexByExpirationTime =
-			m_indexByExpirationTimeBuffer.data;
-		for (int32 i = 0; i < particleCount; ++i)
-		{
-			indexByExpirationTime[i] = newIndices[indexByExpirationTime[i]];
-		}
 	}
+	RemapParticleIndices(newIndices);
 
-	// update proxies
-	for (int32 k = 0; k < m_proxyBuffer.GetCount(); k++)
+	// update groups
+	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
 	{
-		Proxy& proxy = m_proxyBuffer.Begin()[k];
-		proxy.index = newIndices[proxy.index];
+		group->m_firstIndex = newIndices[group->m_firstIndex];
+		group->m_lastIndex = newIndices[group->m_lastIndex - 1] + 1;
 	}
+}
 
-	// update contacts
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+// Move buffer[order[i]] to buffer[i] for the 'count' first elements.
+template <typename T>
+static void b2PermuteParticleBuffer(b2StackAllocator* allocator, T* buffer,
+									const int32* order, int32 count)
+{
+	T* permuted = (T*) allocator->Allocate(sizeof(T) * count);
+	for (int32 i = 0; i < count; i++)
 	{
-		b2ParticleContact& contact = m_contactBuffer[k];
-		contact.SetIndices(newIndices[contact.GetIndexA()],
-						   newIndices[contact.GetIndexB()]);
+		permuted[i] = buffer[order[i]];
+	}
+	for (int32 i = 0; i < count; i++)
+	{
+		buffer[i] = permuted[i];
 	}
+	allocator->Free(permuted);
+}
 
-	// update particle-body contacts
-	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+void b2ParticleSystem::ReorderParticles()
+{
+	// Sort each run of particles sharing a group by proxy tag, which orders
+	// them into rows like the proxies, so the contacts found from the sorted
+	// proxies mostly pair particles close in memory. The group ranges don't
+	// change.
+	uint32* tags = (uint32*) m_stackAllocator.Allocate(
+		sizeof(uint32) * m_count);
+	int32* order = (int32*) m_stackAllocator.Allocate(
+		sizeof(int32) * m_count);
+	for (int32 i = 0; i < m_count; i++)
 	{
-		b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
-		contact.index = newIndices[contact.index];
+		b2Vec2 p = m_positionBuffer.data[i];
+		tags[i] = computeTag(m_inverseDiameter * p.x,
+							 m_inverseDiameter * p.y);
+		order[i] = i;
+	}
+	struct TagComparator
+	{
+		bool operator()(int32 a, int32 b) const
+		{
+			return tags[a] < tags[b] || (tags[a] == tags[b] && a < b);
+		}
+		const uint32* tags;
+	} comparator;
+	comparator.tags = tags;
+	bool reordered = false;
+	for (int32 first = 0; first < m_count;)
+	{
+		int32 last = first + 1;
+		while (last < m_count && m_groupBuffer[last] == m_groupBuffer[first])
+		{
+			last++;
+		}
+		if (!std::is_sorted(order + first, order + last, comparator))
+		{
+			std::sort(order + first, order + last, comparator);
+			reordered = true;
+		}
+		first = last;
+	}
+	if (!reordered)
+	{
+		m_stackAllocator.Free(order);
+		m_stackAllocator.Free(tags);
+		return;
 	}
 
-	// update pairs
-	for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+	b2PermuteParticleBuffer(&m_stackAllocator, m_flagsBuffer.data, order,
+							m_count);
+	if (m_lastBodyContactStepBuffer.data)
 	{
-		b2ParticlePair& pair = m_pairBuffer[k];
-		pair.indexA = newIndices[pair.indexA];
-		pair.indexB = newIndices[pair.indexB];
+		b2PermuteParticleBuffer(&m_stackAllocator,
+								m_lastBodyContactStepBuffer.data, order,
+								m_count);
+	}
+	if (m_bodyContactCountBuffer.data)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator,
+								m_bodyContactCountBuffer.data, order, m_count);
+	}
+	if (m_consecutiveContactStepsBuffer.data)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator,
+								m_consecutiveContactStepsBuffer.data, order,
+								m_count);
+	}
+	b2PermuteParticleBuffer(&m_stackAllocator, m_positionBuffer.data, order,
+							m_count);
+	b2PermuteParticleBuffer(&m_stackAllocator, m_velocityBuffer.data, order,
+							m_count);
+	// The weights of the last step stay readable through GetWeightBuffer()
+	// until ComputeWeight runs again.
+	b2PermuteParticleBuffer(&m_stackAllocator, m_weightBuffer, order,
+							m_count);
+	if (m_hasForce)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_forceBuffer, order,
+								m_count);
+	}
+	if (m_staticPressureBuffer)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_staticPressureBuffer,
+								order, m_count);
+	}
+	if (m_depthBuffer)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_depthBuffer, order,
+								m_count);
+	}
+	if (m_colorBuffer.data)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_colorBuffer.data, order,
+								m_count);
+	}
+	if (m_userDataBuffer.data)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_userDataBuffer.data,
+								order, m_count);
+	}
+	if (m_expirationTimeBuffer.data)
+	{
+		b2PermuteParticleBuffer(&m_stackAllocator, m_expirationTimeBuffer.data,
+								order, m_count);
 	}
 
-	// update triads
-	for (int32 k = 0; k < m_triadBuffer.GetCount(); k++)
+	// Update handle indices.
+	if (m_handleIndexBuffer.data)
 	{
-		b2ParticleTriad& triad = m_triadBuffer[k];
-		triad.indexA = newIndices[triad.indexA];
-		triad.indexB = newIndices[triad.indexB];
-		triad.indexC = newIndices[triad.indexC];
+		b2PermuteParticleBuffer(&m_stackAllocator, m_handleIndexBuffer.data,
+								order, m_count);
+		for (int32 i = 0; i < m_count; ++i)
+		{
+			b2ParticleHandle * const handle = m_handleIndexBuffer.data[i];
+			if (handle) handle->SetIndex(i);
+		}
 	}
 
-	// update groups
-	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
+	// The tags are no longer needed, invert the order in place of them.
+	int32* newIndices = (int32*) tags;
+	for (int32 i = 0; i < m_count; i++)
 	{
-		group->m_firstIndex = newIndices[group->m_firstIndex];
-		group->m_lastIndex = newIndices[group->m_lastIndex - 1] + 1;
+		newIndices[order[i]] = i;
 	}
+	RemapParticleIndices(newIndices);
+
+	m_stackAllocator.Free(order);
+	m_stackAllocator.Free(tags);
 }
 
 /// Set the lifetime (in seconds) of a particle relative to the current
@@ -4190,8 +7165,7 @@ template <typename T> void b2ParticleSystem::SetUserOverridableBuffer(
 	b2Assert((newData && newCapacity) || (!newData && !newCapacity));
 	if (!buffer->userSuppliedCapacity && buffer->data)
 	{
-		m_blockAllocator.Free(
-			buffer->data, sizeof(T) * m_internalAllocatedCapacity);
+		m_blockAllocator.FreeAligned(buffer->data);
 	}
 	buffer->data = newData;
 	buffer->userSuppliedCapacity = newCapacity;
@@ -4206,6 +7180,8 @@ void b2ParticleSystem::SetPositionBuffer(b2Vec2* buffer,
 												 int32 capacity)
 {
 	SetUserOverridableBuffer(&m_positionBuffer, buffer, capacity);
+	m_staticProxiesNeedUpdate = true;
+	m_aabbNeedsUpdate = true;
 }
 
 void b2ParticleSystem::SetVelocityBuffer(b2Vec2* buffer,
@@ -4225,9 +7201,184 @@ void b2ParticleSystem::SetUserDataBuffer(void** buffer, int32 capacity)
 	SetUserOverridableBuffer(&m_userDataBuffer, buffer, capacity);
 }
 
+// Split a coordinate in compact position steps into the coordinate of its
+// tile and the 16-bit fixed point offset within the tile.
+static inline void b2EncodeCompactCoordinate(float32 steps, int32* tile,
+											 uint16* offset)
+{
+	int64 fixed = (int64) floorf(steps + 0.5f);
+	*tile = (int32) (fixed >> 16);
+	*offset = (uint16) (fixed & 0xFFFF);
+}
+
+static inline float32 b2DecodeCompactCoordinate(int32 tile, uint16 offset,
+												float32 stepSize)
+{
+	return (float32) (((int64) tile << 16) + offset) * stepSize;
+}
+
+static uint16 b2FloatToHalf(float32 value)
+{
+	uint32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32 sign = (bits >> 16) & 0x8000;
+	uint32 mantissa = bits & 0x7FFFFF;
+	int32 exponent = (int32) ((bits >> 23) & 0xFF) - 127 + 15;
+	if (exponent >= 31)
+	{
+		// Overflows to infinity, NaNs stay NaNs.
+		bool nan = ((bits >> 23) & 0xFF) == 0xFF && mantissa;
+		return (uint16) (sign | (nan ? 0x7E00 : 0x7C00));
+	}
+	uint32 shift = 13;
+	if (exponent <= 0)
+	{
+		// Subnormal half, or zero if too small.
+		if (exponent < -10)
+		{
+			return (uint16) sign;
+		}
+		mantissa |= 0x800000;
+		shift = 14 - exponent;
+		exponent = 0;
+	}
+	uint32 half = ((uint32) exponent << 10) | (mantissa >> shift);
+	uint32 rest = mantissa & ((1u << shift) - 1);
+	uint32 halfway = 1u << (shift - 1);
+	// Rounds to nearest even. A carry into the exponent is correct.
+	if (rest > halfway || (rest == halfway && (half & 1)))
+	{
+		half++;
+	}
+	return (uint16) (sign | half);
+}
+
+static float32 b2HalfToFloat(uint16 value)
+{
+	uint32 sign = (uint32) (value & 0x8000) << 16;
+	int32 exponent = (value >> 10) & 0x1F;
+	uint32 mantissa = value & 0x3FF;
+	uint32 bits;
+	if (exponent == 31)
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent == 0 && mantissa == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		if (exponent == 0)
+		{
+			// Normalizes a subnormal half.
+			exponent = 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3FF;
+		}
+		bits = sign | ((uint32) (exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float32 result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+int32 b2ParticleSystem::ExportCompactPositions(uint16* positions,
+											   b2ParticleCompactTile* tiles,
+											   int32 tileCapacity) const
+{
+	const float32 stepsPerUnit =
+		b2_particleCompactPositionSubdivisions * m_inverseDiameter;
+	int32 tileCount = 0;
+	b2ParticleCompactTile tile = {0, 0, 0};
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const b2Vec2& p = m_positionBuffer.data[i];
+		int32 x, y;
+		b2EncodeCompactCoordinate(p.x * stepsPerUnit, &x, &positions[2 * i]);
+		b2EncodeCompactCoordinate(p.y * stepsPerUnit, &y,
+								  &positions[2 * i + 1]);
+		if (tile.count > 0 && (x != tile.x || y != tile.y))
+		{
+			if (tileCount < tileCapacity)
+			{
+				tiles[tileCount] = tile;
+			}
+			tileCount++;
+			tile.count = 0;
+		}
+		tile.x = x;
+		tile.y = y;
+		tile.count++;
+	}
+	if (tile.count > 0)
+	{
+		if (tileCount < tileCapacity)
+		{
+			tiles[tileCount] = tile;
+		}
+		tileCount++;
+	}
+	return tileCount;
+}
+
+void b2ParticleSystem::ImportCompactPositions(
+	const uint16* positions, const b2ParticleCompactTile* tiles,
+	int32 tileCount)
+{
+	const float32 stepSize =
+		m_particleDiameter / b2_particleCompactPositionSubdivisions;
+	int32 i = 0;
+	for (int32 k = 0; k < tileCount; k++)
+	{
+		const b2ParticleCompactTile& tile = tiles[k];
+		b2Assert(i + tile.count <= m_count);
+		for (int32 end = i + tile.count; i < end; i++)
+		{
+			b2Vec2& p = m_positionBuffer.data[i];
+			p.x = b2DecodeCompactCoordinate(tile.x, positions[2 * i], stepSize);
+			p.y = b2DecodeCompactCoordinate(tile.y, positions[2 * i + 1],
+											stepSize);
+		}
+	}
+	b2Assert(i == m_count);
+	m_staticProxiesNeedUpdate = true;
+	m_aabbNeedsUpdate = true;
+}
+
+void b2ParticleSystem::ExportCompactVelocities(uint16* velocities) const
+{
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const b2Vec2& v = m_velocityBuffer.data[i];
+		velocities[2 * i] = b2FloatToHalf(v.x);
+		velocities[2 * i + 1] = b2FloatToHalf(v.y);
+	}
+}
+
+void b2ParticleSystem::ImportCompactVelocities(const uint16* velocities)
+{
+	for (int32 i = 0; i < m_count; i++)
+	{
+		b2Vec2& v = m_velocityBuffer.data[i];
+		v.x = b2HalfToFloat(velocities[2 * i]);
+		v.y = b2HalfToFloat(velocities[2 * i + 1]);
+	}
+}
+
 void b2ParticleSystem::SetParticleFlags(int32 index, uint32 newFlags)
 {
 	uint32* oldFlags = &m_flagsBuffer.data[index];
+	if (IsStaticProxyParticle(*oldFlags, m_groupBuffer[index]) !=
+		IsStaticProxyParticle(newFlags, m_groupBuffer[index]))
+	{
+		// The particle moves to the other proxy index.
+		m_staticProxiesNeedPartition = true;
+	}
 	if (*oldFlags & ~newFlags)
 	{
 		// If any flags might be removed
@@ -4333,6 +7484,84 @@ void b2ParticleSystem::ParticleApplyForce(int32 index, const b2Vec2& force)
 	}
 }
 
+int32 b2ParticleSystem::GetForceParticlesInAABB(const b2AABB& aabb,
+												int32* indices) const
+{
+	// The static proxies are wall particles, which forces don't apply to.
+	const uint32 lowerTag = computeTag(m_inverseDiameter * aabb.lowerBound.x,
+									   m_inverseDiameter * aabb.lowerBound.y);
+	const uint32 upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x,
+									   m_inverseDiameter * aabb.upperBound.y);
+	const Proxy* beginProxy = m_proxyBuffer.Begin();
+	const Proxy* endProxy = m_proxyBuffer.End();
+	const Proxy* firstProxy = std::lower_bound(beginProxy, endProxy, lowerTag);
+	const Proxy* lastProxy = std::upper_bound(firstProxy, endProxy, upperTag);
+	InsideBoundsEnumerator enumerator(lowerTag, upperTag, firstProxy,
+									  lastProxy);
+	int32 count = 0;
+	int32 i;
+	while ((i = enumerator.GetNext()) >= 0)
+	{
+		const b2Vec2& p = m_positionBuffer.data[i];
+		if (aabb.lowerBound.x < p.x && p.x < aabb.upperBound.x &&
+			aabb.lowerBound.y < p.y && p.y < aabb.upperBound.y &&
+			ForceCanBeApplied(m_flagsBuffer.data[i]))
+		{
+			indices[count++] = i;
+		}
+	}
+	return count;
+}
+
+void b2ParticleSystem::SolveForceFields(float32 velocityPerForce)
+{
+	// Each particle has a single proxy, so the particles of a field are
+	// distinct and their forces are computed independently.
+	int32* indices = (int32*) m_stackAllocator.Allocate(sizeof(int32) * m_count);
+	b2Vec2* forces = (b2Vec2*) m_stackAllocator.Allocate(sizeof(b2Vec2) * m_count);
+	for (const b2ParticleForceField* field = m_forceFieldList; field;
+		 field = field->GetNext())
+	{
+		const b2AABB aabb = field->GetAABB();
+		if (!b2AABB_Overlaps(aabb, GetAABB()))
+		{
+			continue;
+		}
+		const int32 count = GetForceParticlesInAABB(aabb, indices);
+
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			memset(forces, 0, sizeof(b2Vec2) * count);
+			b2ReferenceCheck<b2Vec2> check(&m_stackAllocator, forces, count);
+		#endif
+
+		#if defined(B2_PARTICLE_SIMD)
+			field->ComputeForces_Simd(m_positionBuffer.data, indices, count,
+									  forces);
+		#else
+			field->ComputeForces_Reference(m_positionBuffer.data, indices, 0,
+										   count, forces);
+		#endif
+
+		#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+			check.Restore();
+			field->ComputeForces_Reference(m_positionBuffer.data, indices, 0,
+										   count, forces);
+			check.Check();
+		#endif
+
+		for (int32 k = 0; k < count; k++)
+		{
+			if (IsSignificantForce(forces[k]))
+			{
+				const int32 i = indices[k];
+				m_velocityBuffer.data[i] += velocityPerForce * forces[k];
+			}
+		}
+	}
+	m_stackAllocator.Free(forces);
+	m_stackAllocator.Free(indices);
+}
+
 void b2ParticleSystem::ApplyLinearImpulse(int32 firstIndex, int32 lastIndex,
 										  const b2Vec2& impulse)
 {
@@ -4348,35 +7577,147 @@ void b2ParticleSystem::ApplyLinearImpulse(int32 firstIndex, int32 lastIndex,
 void b2ParticleSystem::QueryAABB(b2ParticleQueryCallback* callback,
 								 const b2AABB& aabb) const
 {
-	if (m_proxyBuffer.GetCount() == 0)
+	if (m_proxyBuffer.GetCount() == 0 && m_staticProxyBuffer.GetCount() == 0)
 	{
 		return;
 	}
-	const Proxy* beginProxy = m_proxyBuffer.Begin();
-	const Proxy* endProxy = m_proxyBuffer.End();
-	const Proxy* firstProxy = std::lower_bound(
-		beginProxy, endProxy,
-		computeTag(
-			m_inverseDiameter * aabb.lowerBound.x,
-			m_inverseDiameter * aabb.lowerBound.y));
-	const Proxy* lastProxy = std::upper_bound(
-		firstProxy, endProxy,
-		computeTag(
-			m_inverseDiameter * aabb.upperBound.x,
-			m_inverseDiameter * aabb.upperBound.y));
-	for (const Proxy* proxy = firstProxy; proxy < lastProxy; ++proxy)
+	const uint32 lowerTag = computeTag(m_inverseDiameter * aabb.lowerBound.x,
+									   m_inverseDiameter * aabb.lowerBound.y);
+	const uint32 upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x,
+									   m_inverseDiameter * aabb.upperBound.y);
+	InsideBoundsEnumerator enumerator =
+		GetInsideTagsEnumerator(lowerTag, upperTag);
+	int32 i;
+	while ((i = enumerator.GetNext()) >= 0)
 	{
-		int32 i = proxy->index;
 		const b2Vec2& p = m_positionBuffer.data[i];
 		if (aabb.lowerBound.x < p.x && p.x < aabb.upperBound.x &&
 			aabb.lowerBound.y < p.y && p.y < aabb.upperBound.y)
 		{
 			if (!callback->ReportParticle(this, i))
 			{
-				break;
+				break;
+			}
+		}
+	}
+}
+
+void b2ParticleSystem::QueryAABBs(b2ParticleBatchQueryCallback* callback,
+								  const b2AABB* aabbs, int32 count) const
+{
+	if ((m_proxyBuffer.GetCount() == 0 &&
+		 m_staticProxyBuffer.GetCount() == 0) || count == 0)
+	{
+		return;
+	}
+
+	struct BatchQuery
+	{
+		uint32 lowerTag;
+		uint32 upperTag;
+		int32 aabbIndex;
+		/// Whether the callback stopped reporting particles for this query.
+		bool stopped;
+
+		static bool CompareLowerTag(const BatchQuery& a, const BatchQuery& b)
+		{
+			return a.lowerTag < b.lowerTag;
+		}
+	};
+	BatchQuery* queries = (BatchQuery*) b2Alloc(sizeof(BatchQuery) * count);
+	int32* active = (int32*) b2Alloc(sizeof(int32) * count);
+	for (int32 k = 0; k < count; k++)
+	{
+		const b2AABB& aabb = aabbs[k];
+		BatchQuery& query = queries[k];
+		query.lowerTag = computeTag(m_inverseDiameter * aabb.lowerBound.x,
+									m_inverseDiameter * aabb.lowerBound.y);
+		query.upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x,
+									m_inverseDiameter * aabb.upperBound.y);
+		query.aabbIndex = k;
+		query.stopped = false;
+	}
+	// Sorting by the lower tag sorts the queries by their lowest row.
+	std::sort(queries, queries + count, BatchQuery::CompareLowerTag);
+
+	// Sweep the rows of each proxy buffer once. Each row is located a single
+	// time and shared by all the queries which overlap it.
+	const Proxy* beginProxies[2] = {
+		m_proxyBuffer.Begin(), m_staticProxyBuffer.Begin()
+	};
+	const Proxy* endProxies[2] = {
+		m_proxyBuffer.End(), m_staticProxyBuffer.End()
+	};
+	for (int32 pass = 0; pass < 2; pass++)
+	{
+		const Proxy* rowBegin = beginProxies[pass];
+		const Proxy* endProxy = endProxies[pass];
+		int32 nextQuery = 0;
+		int32 activeCount = 0;
+		while (rowBegin < endProxy && (nextQuery < count || activeCount > 0))
+		{
+			if (activeCount == 0)
+			{
+				// Skip the rows until the next query starts.
+				rowBegin = std::lower_bound(
+					rowBegin, endProxy, queries[nextQuery].lowerTag & yMask);
+				if (rowBegin == endProxy)
+				{
+					break;
+				}
+			}
+			const uint32 row = rowBegin->tag & yMask;
+			const Proxy* rowEnd = row == yMask ? endProxy :
+				std::lower_bound(rowBegin, endProxy, row + (1u << yShift));
+			while (nextQuery < count &&
+				   (queries[nextQuery].lowerTag & yMask) <= row)
+			{
+				if (!queries[nextQuery].stopped)
+				{
+					active[activeCount++] = nextQuery;
+				}
+				nextQuery++;
+			}
+
+			int32 stillActive = 0;
+			for (int32 k = 0; k < activeCount; k++)
+			{
+				const BatchQuery& query = queries[active[k]];
+				if ((query.upperTag & yMask) < row)
+				{
+					continue;
+				}
+				const b2AABB& aabb = aabbs[query.aabbIndex];
+				const Proxy* first = std::lower_bound(
+					rowBegin, rowEnd, row | (query.lowerTag & xMask));
+				const Proxy* last = std::upper_bound(
+					first, rowEnd, row | (query.upperTag & xMask));
+				bool proceed = true;
+				for (const Proxy* proxy = first; proxy < last; ++proxy)
+				{
+					const int32 i = proxy->index;
+					const b2Vec2& p = m_positionBuffer.data[i];
+					if (aabb.lowerBound.x < p.x && p.x < aabb.upperBound.x &&
+						aabb.lowerBound.y < p.y && p.y < aabb.upperBound.y &&
+						!callback->ReportParticle(this, query.aabbIndex, i))
+					{
+						proceed = false;
+						queries[active[k]].stopped = true;
+						break;
+					}
+				}
+				if (proceed && (query.upperTag & yMask) > row)
+				{
+					active[stillActive++] = active[k];
+				}
 			}
+			activeCount = stillActive;
+			rowBegin = rowEnd;
 		}
 	}
+
+	b2Free(active, sizeof(int32) * count);
+	b2Free(queries, sizeof(BatchQuery) * count);
 }
 
 void b2ParticleSystem::QueryShapeAABB(b2ParticleQueryCallback* callback,
@@ -4391,7 +7732,7 @@ void b2ParticleSystem::RayCast(b2ParticleRayCastCallback* callback,
 							   const b2Vec2& point1,
 							   const b2Vec2& point2) const
 {
-	if (m_proxyBuffer.GetCount() == 0)
+	if (m_proxyBuffer.GetCount() == 0 && m_staticProxyBuffer.GetCount() == 0)
 	{
 		return;
 	}
@@ -4440,6 +7781,356 @@ void b2ParticleSystem::RayCast(b2ParticleRayCastCallback* callback,
 	}
 }
 
+// Number of rays cast by one item of a batched ray cast task.
+static const int32 k_rayCastBlockSize = 32;
+// Number of particles intersected with a ray at once.
+static const int32 k_rayCastLaneCount = 8;
+
+static bool b2CompareRayCastHitFraction(const b2ParticleRayCastHit& a,
+										const b2ParticleRayCastHit& b)
+{
+	return a.fraction < b.fraction;
+}
+
+void b2ParticleSystem::RayCastBatchRay(const b2Vec2& origin,
+									   const b2Vec2& translation,
+									   int32 rayIndex,
+									   b2ParticleRayCastHit* closestHit,
+									   RayCastHitBlock* block) const
+{
+	const float32 v2 = b2Dot(translation, translation);
+	if (v2 == 0)
+	{
+		return;
+	}
+
+	// A particle can only be hit if the ray passes within one diameter of
+	// its center. Walk the rows of the grid in the direction of the ray and
+	// look up the span of tags near the ray in each row.
+	const float32 ox = m_inverseDiameter * origin.x;
+	const float32 oy = m_inverseDiameter * origin.y;
+	const float32 dx = m_inverseDiameter * translation.x;
+	const float32 dy = m_inverseDiameter * translation.y;
+	const float32 yLimit = (float32) (1 << yTruncBits) - 1;
+	const float32 xLimit = (float32) (1 << xTruncBits) - 1;
+	const int32 rowA = (int32) b2ClampFloat(
+		floorf(oy + yOffset + (dy < 0 ? 1 : -1)), 0, yLimit);
+	const int32 rowB = (int32) b2ClampFloat(
+		floorf(oy + dy + yOffset + (dy < 0 ? -1 : 1)), 0, yLimit);
+	const int32 rowStep = rowA <= rowB ? 1 : -1;
+	const Proxy* beginProxies[2] = {
+		m_proxyBuffer.Begin(), m_staticProxyBuffer.Begin()
+	};
+	const Proxy* endProxies[2] = {
+		m_proxyBuffer.End(), m_staticProxyBuffer.End()
+	};
+	float32 fraction = 1;
+	for (int32 row = rowA; row != rowB + rowStep; row += rowStep)
+	{
+		// The part of the ray within one diameter of the row.
+		float32 tMin = 0, tMax = 1;
+		if (dy != 0)
+		{
+			float32 ta = ((float32) row - 1 - yOffset - oy) / dy;
+			float32 tb = ((float32) row + 2 - yOffset - oy) / dy;
+			tMin = b2MaxFloat(tMin, b2MinFloat(ta, tb));
+			tMax = b2MinFloat(tMax, b2MaxFloat(ta, tb));
+		}
+		if (tMin > fraction)
+		{
+			// The rows are visited along the ray, no closer hit remains.
+			break;
+		}
+		if (tMin > tMax)
+		{
+			continue;
+		}
+		const float32 xa = ox + tMin * dx;
+		const float32 xb = ox + tMax * dx;
+		const float32 xLower = b2ClampFloat(
+			b2MinFloat(xa, xb) - 1, -(float32) xOffset / xScale,
+			xLimit - (float32) xOffset / xScale);
+		const float32 xUpper = b2ClampFloat(
+			b2MaxFloat(xa, xb) + 1, -(float32) xOffset / xScale,
+			xLimit - (float32) xOffset / xScale);
+		const uint32 rowTag = (uint32) row << yShift;
+		// The dynamic proxies, then the static ones.
+		for (int32 pass = 0; pass < 2; pass++)
+		{
+			const Proxy* first = std::lower_bound(
+				beginProxies[pass], endProxies[pass],
+				rowTag | (computeTag(xLower, 0) & xMask));
+			const Proxy* last = std::upper_bound(
+				first, endProxies[pass],
+				rowTag | (computeTag(xUpper, 0) & xMask));
+
+			// Solve ((1-t)*point1+t*point2-position)^2=diameter^2 as RayCast
+			// does, a fixed number of particles at a time.
+			for (const Proxy* proxy = first; proxy < last;
+				 proxy += k_rayCastLaneCount)
+			{
+				const int32 n =
+					b2MinInt(k_rayCastLaneCount, (int32) (last - proxy));
+				float32 pv[k_rayCastLaneCount];
+				float32 determinant[k_rayCastLaneCount];
+				#if defined(B2_PARTICLE_SIMD)
+					RayCastDiscriminants_Simd(origin, translation, proxy, n,
+											  pv, determinant);
+				#else
+					RayCastDiscriminants_Reference(origin, translation, proxy,
+												   0, n, pv, determinant);
+				#endif
+				#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+				{
+					// Ray casts run on the workers, so the check can't use
+					// the stack allocator.
+					float32 referencePv[k_rayCastLaneCount];
+					float32 referenceDeterminant[k_rayCastLaneCount];
+					RayCastDiscriminants_Reference(origin, translation, proxy,
+						0, n, referencePv, referenceDeterminant);
+					for (int32 k = 0; k < n; k++)
+					{
+						const float32 scale = referencePv[k] * referencePv[k] +
+							v2 * m_squaredDiameter;
+						b2Assert(b2ApproximatelyEqual(pv[k], referencePv[k],
+							sqrtf(scale)));
+						b2Assert(b2ApproximatelyEqual(determinant[k],
+							referenceDeterminant[k], scale));
+					}
+				}
+				#endif
+				for (int32 k = 0; k < n; k++)
+				{
+					if (determinant[k] < 0)
+					{
+						continue;
+					}
+					float32 sqrtDeterminant = sqrtf(determinant[k]);
+					// find a solution between 0 and fraction
+					float32 t = (-pv[k] - sqrtDeterminant) / v2;
+					if (t > fraction)
+					{
+						continue;
+					}
+					if (t < 0)
+					{
+						t = (-pv[k] + sqrtDeterminant) / v2;
+						if (t < 0 || t > fraction)
+						{
+							continue;
+						}
+					}
+					b2ParticleRayCastHit* hit;
+					if (closestHit)
+					{
+						hit = closestHit;
+						fraction = t;
+					}
+					else
+					{
+						if (block->count == block->capacity)
+						{
+							int32 capacity = b2MaxInt(2 * block->capacity, 64);
+							b2ParticleRayCastHit* hits = (b2ParticleRayCastHit*)
+								b2Alloc(sizeof(b2ParticleRayCastHit) * capacity);
+							if (block->hits)
+							{
+								memcpy(hits, block->hits,
+									sizeof(b2ParticleRayCastHit) * block->count);
+								b2Free(block->hits, sizeof(b2ParticleRayCastHit) *
+												   block->capacity);
+							}
+							block->hits = hits;
+							block->capacity = capacity;
+						}
+						hit = &block->hits[block->count++];
+					}
+					b2Vec2 p = origin - m_positionBuffer.data[proxy[k].index];
+					hit->rayIndex = rayIndex;
+					hit->index = proxy[k].index;
+					hit->point = origin + t * translation;
+					hit->normal = b2Normalize(p + t * translation);
+					hit->fraction = t;
+				}
+			}
+		}
+	}
+}
+
+void b2ParticleSystem::RayCastDiscriminants_Reference(
+	const b2Vec2& origin, const b2Vec2& translation, const Proxy* proxies,
+	int32 first, int32 last, float32* pv, float32* determinant) const
+{
+	const float32 v2 = b2Dot(translation, translation);
+	for (int32 k = first; k < last; k++)
+	{
+		const b2Vec2 p = origin - m_positionBuffer.data[proxies[k].index];
+		pv[k] = p.x * translation.x + p.y * translation.y;
+		const float32 p2 = p.x * p.x + p.y * p.y;
+		determinant[k] = pv[k] * pv[k] - v2 * (p2 - m_squaredDiameter);
+	}
+}
+
+#if defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::RayCastDiscriminants_Simd(
+	const b2Vec2& origin, const b2Vec2& translation, const Proxy* proxies,
+	int32 count, float32* pv, float32* determinant) const
+{
+	const b2FloatW ox = b2SplatW(origin.x);
+	const b2FloatW oy = b2SplatW(origin.y);
+	const b2FloatW vx = b2SplatW(translation.x);
+	const b2FloatW vy = b2SplatW(translation.y);
+	const b2FloatW v2 = b2SplatW(b2Dot(translation, translation));
+	const b2FloatW d2 = b2SplatW(m_squaredDiameter);
+	int32 k = 0;
+	for (; k + B2_SIMD_WIDTH <= count; k += B2_SIMD_WIDTH)
+	{
+		int32 indices[B2_SIMD_WIDTH];
+		for (int32 j = 0; j < B2_SIMD_WIDTH; j++)
+		{
+			indices[j] = proxies[k + j].index;
+		}
+		b2FloatW px, py;
+		b2GatherVec2W(m_positionBuffer.data, indices, &px, &py);
+		px = b2SubW(ox, px);
+		py = b2SubW(oy, py);
+		const b2FloatW p = b2AddW(b2MulW(px, vx), b2MulW(py, vy));
+		const b2FloatW p2 = b2AddW(b2MulW(px, px), b2MulW(py, py));
+		b2StoreW(pv + k, p);
+		b2StoreW(determinant + k,
+				 b2SubW(b2MulW(p, p), b2MulW(v2, b2SubW(p2, d2))));
+	}
+	RayCastDiscriminants_Reference(origin, translation, proxies, k, count,
+								   pv, determinant);
+}
+
+#endif // defined(B2_PARTICLE_SIMD)
+
+void b2ParticleSystem::RayCastBatchTask(int32 startIndex, int32 endIndex,
+										uint32 workerIndex, void* context)
+{
+	B2_NOT_USED(workerIndex);
+	RayCastBatchContext* batch = (RayCastBatchContext*) context;
+	for (int32 blockIndex = startIndex; blockIndex < endIndex; blockIndex++)
+	{
+		RayCastHitBlock* block =
+			batch->blocks ? &batch->blocks[blockIndex] : NULL;
+		const int32 rayBegin = blockIndex * k_rayCastBlockSize;
+		const int32 rayEnd = b2MinInt(rayBegin + k_rayCastBlockSize,
+									  batch->rayCount);
+		for (int32 i = rayBegin; i < rayEnd; i++)
+		{
+			b2ParticleRayCastHit* closestHit = NULL;
+			int32 hitBegin = block ? block->count : 0;
+			if (batch->closestHits)
+			{
+				closestHit = &batch->closestHits[i];
+				closestHit->rayIndex = i;
+				closestHit->index = b2_invalidParticleIndex;
+				closestHit->point = batch->origins[i] + batch->translations[i];
+				closestHit->normal = b2Vec2_zero;
+				closestHit->fraction = 1;
+			}
+			batch->system->RayCastBatchRay(
+				batch->origins[i], batch->translations[i], i, closestHit,
+				block);
+			if (!closestHit)
+			{
+				std::sort(block->hits + hitBegin, block->hits + block->count,
+						  b2CompareRayCastHitFraction);
+			}
+		}
+	}
+}
+
+void b2ParticleSystem::RayCastBatch(RayCastBatchContext* context,
+									int32 blockCount, bool useWorkers) const
+{
+	if (useWorkers)
+	{
+		b2Assert(m_world->locked == false);
+		void* task = m_world->enqueueTaskFcn(&RayCastBatchTask, blockCount, 1,
+											 context, m_world->userTaskContext);
+		m_world->taskCount += 1;
+		if (task != NULL)
+		{
+			m_world->finishTaskFcn(task, m_world->userTaskContext);
+		}
+	}
+	else
+	{
+		RayCastBatchTask(0, blockCount, 0, context);
+	}
+}
+
+void b2ParticleSystem::RayCastClosest(const b2Vec2* origins,
+									  const b2Vec2* translations,
+									  int32 rayCount,
+									  b2ParticleRayCastHit* hits,
+									  bool useWorkers) const
+{
+	if (rayCount == 0)
+	{
+		return;
+	}
+	RayCastBatchContext context;
+	context.system = this;
+	context.origins = origins;
+	context.translations = translations;
+	context.rayCount = rayCount;
+	context.closestHits = hits;
+	context.blocks = NULL;
+	const int32 blockCount =
+		(rayCount + k_rayCastBlockSize - 1) / k_rayCastBlockSize;
+	RayCastBatch(&context, blockCount, useWorkers);
+}
+
+int32 b2ParticleSystem::RayCastAll(const b2Vec2* origins,
+								   const b2Vec2* translations,
+								   int32 rayCount,
+								   b2ParticleRayCastHit* hits,
+								   int32 capacity, bool useWorkers) const
+{
+	if (rayCount == 0)
+	{
+		return 0;
+	}
+	const int32 blockCount =
+		(rayCount + k_rayCastBlockSize - 1) / k_rayCastBlockSize;
+	RayCastHitBlock* blocks = (RayCastHitBlock*)
+		b2Alloc(sizeof(RayCastHitBlock) * blockCount);
+	memset(blocks, 0, sizeof(RayCastHitBlock) * blockCount);
+	RayCastBatchContext context;
+	context.system = this;
+	context.origins = origins;
+	context.translations = translations;
+	context.rayCount = rayCount;
+	context.closestHits = NULL;
+	context.blocks = blocks;
+	RayCastBatch(&context, blockCount, useWorkers);
+
+	// Concatenate the hits of the blocks in ray order.
+	int32 hitCount = 0;
+	for (int32 k = 0; k < blockCount; k++)
+	{
+		RayCastHitBlock& block = blocks[k];
+		int32 n = b2MinInt(block.count, b2MaxInt(capacity - hitCount, 0));
+		if (n > 0)
+		{
+			memcpy(hits + hitCount, block.hits,
+				   sizeof(b2ParticleRayCastHit) * n);
+		}
+		hitCount += block.count;
+		if (block.hits)
+		{
+			b2Free(block.hits, sizeof(b2ParticleRayCastHit) * block.capacity);
+		}
+	}
+	b2Free(blocks, sizeof(RayCastHitBlock) * blockCount);
+	return hitCount;
+}
+
 float32 b2ParticleSystem::ComputeCollisionEnergy() const
 {
 	float32 sum_v2 = 0;
@@ -4513,6 +8204,8 @@ b2ParticleSystem* b2CreateParticleSystem( b2WorldId worldId, const b2ParticleSys
 	}
 	world->particleSystemList = p;
 
+	p->m_id = b2AllocParticleSystemId(world, p);
+
 	return p;
 }
 
@@ -4540,14 +8233,454 @@ void b2DestroyParticleSystem( b2ParticleSystem* p ) {
 		world->particleSystemList = p->m_next;
 	}
 
+	b2FreeParticleSystemId(world, p->m_id);
+
 	p->~b2ParticleSystem();
 	b2Free(p, sizeof(b2ParticleSystem));
 }
 
+b2ParticleSystemId b2World_CreateParticleSystem( b2WorldId worldId, const b2ParticleSystemDef* def ) {
+	b2ParticleSystemDef defaultDef;
+	b2ParticleSystem* p = b2CreateParticleSystem(worldId, def ? def : &defaultDef);
+	return p ? p->GetId() : b2_nullParticleSystemId;
+}
+
+void b2ParticleSystem_Destroy( b2ParticleSystemId systemId ) {
+	b2DestroyParticleSystem(b2GetParticleSystemFromId(systemId));
+}
+
+b2ParticleSystemId b2ParticleSystem_GetId( const b2ParticleSystem* system ) {
+	return system->GetId();
+}
+
+b2ParticleSystem* b2ParticleSystem_Get( b2ParticleSystemId systemId ) {
+	return b2GetParticleSystemFromId(systemId);
+}
+
+b2WorldId b2ParticleSystem_GetWorld( b2ParticleSystemId systemId ) {
+	const b2World* world = b2GetParticleSystemFromId(systemId)->m_world;
+	return b2WorldId{ (uint16_t)(world->worldId + 1), world->generation };
+}
+
+int b2ParticleSystem_GetParticleCount( b2ParticleSystemId systemId ) {
+	return b2GetParticleSystemFromId(systemId)->GetParticleCount();
+}
+
+int b2ParticleSystem_CreateParticles( b2ParticleSystemId systemId, const b2Vec2* positions, const b2Vec2* velocities,
+									  uint32_t flags, int count, int* indices ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	b2ParticleDef def;
+	def.flags = flags;
+	int created = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		def.position = positions[i];
+		def.velocity = velocities ? velocities[i] : b2Vec2_zero;
+		const int32 index = p->CreateParticle(def);
+		if (indices)
+		{
+			indices[i] = index;
+		}
+		if (index != b2_invalidParticleIndex)
+		{
+			created++;
+		}
+	}
+	return created;
+}
+
+// Clamp the range [startIndex, startIndex + count) to the particles of a
+// system and return the number of particles left in it. Every range of the
+// C API is clamped this way and every index list skips the indices outside
+// of the particles.
+static int32 b2ClampParticleRange( const b2ParticleSystem* p, int32 startIndex, int32 count ) {
+	b2Assert(startIndex >= 0 && count >= 0);
+	return b2ClampInt(p->GetParticleCount() - startIndex, 0, count);
+}
+
+static bool b2IsParticleIndexInRange( const b2ParticleSystem* p, int32 index ) {
+	return 0 <= index && index < p->GetParticleCount();
+}
+
+void b2ParticleSystem_DestroyParticles( b2ParticleSystemId systemId, const int* indices, int count ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	for (int32 i = 0; i < count; i++)
+	{
+		if (b2IsParticleIndexInRange(p, indices[i]))
+		{
+			p->DestroyParticle(indices[i]);
+		}
+	}
+}
+
+void b2ParticleSystem_DestroyParticleRange( b2ParticleSystemId systemId, int startIndex, int count ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	for (int32 i = startIndex; i < startIndex + count; i++)
+	{
+		p->DestroyParticle(i);
+	}
+}
+
+int b2ParticleSystem_GetPositions( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2* positions ) {
+	const b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	memcpy(positions, p->GetPositionBuffer() + startIndex, sizeof(b2Vec2) * count);
+	return count;
+}
+
+int b2ParticleSystem_SetPositions( b2ParticleSystemId systemId, int startIndex, int count, const b2Vec2* positions ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	memcpy(p->GetPositionBuffer() + startIndex, positions, sizeof(b2Vec2) * count);
+	p->InvalidateAABB();
+	return count;
+}
+
+int b2ParticleSystem_GetVelocities( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2* velocities ) {
+	const b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	memcpy(velocities, p->GetVelocityBuffer() + startIndex, sizeof(b2Vec2) * count);
+	return count;
+}
+
+int b2ParticleSystem_SetVelocities( b2ParticleSystemId systemId, int startIndex, int count, const b2Vec2* velocities ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	memcpy(p->GetVelocityBuffer() + startIndex, velocities, sizeof(b2Vec2) * count);
+	return count;
+}
+
+int b2ParticleSystem_GetColors( b2ParticleSystemId systemId, int startIndex, int count, b2ParticleColor* colors ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	const b2ParticleColor* colorBuffer = p->GetColorBuffer() + startIndex;
+	std::copy(colorBuffer, colorBuffer + count, colors);
+	return count;
+}
+
+int b2ParticleSystem_SetColors( b2ParticleSystemId systemId, int startIndex, int count, const b2ParticleColor* colors ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	std::copy(colors, colors + count, p->GetColorBuffer() + startIndex);
+	return count;
+}
+
+int b2ParticleSystem_GetFlags( b2ParticleSystemId systemId, int startIndex, int count, uint32_t* flags ) {
+	const b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	memcpy(flags, p->GetFlagsBuffer() + startIndex, sizeof(uint32) * count);
+	return count;
+}
+
+b2Vec2* b2ParticleSystem_MapPositions( b2ParticleSystemId systemId ) {
+	return b2GetParticleSystemFromId(systemId)->GetPositionBuffer();
+}
+
+void b2ParticleSystem_InvalidateAABB( b2ParticleSystemId systemId ) {
+	b2GetParticleSystemFromId(systemId)->InvalidateAABB();
+}
+
+b2Vec2* b2ParticleSystem_MapVelocities( b2ParticleSystemId systemId ) {
+	return b2GetParticleSystemFromId(systemId)->GetVelocityBuffer();
+}
+
+b2ParticleColor* b2ParticleSystem_MapColors( b2ParticleSystemId systemId ) {
+	return b2GetParticleSystemFromId(systemId)->GetColorBuffer();
+}
+
+void b2ParticleSystem_ApplyForceToRange( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2 force ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	if (count == 0 || !IsSignificantForce(force))
+	{
+		return;
+	}
+	p->PrepareForceBuffer();
+	for (int32 i = startIndex; i < startIndex + count; i++)
+	{
+		if (p->ForceCanBeApplied(p->m_flagsBuffer.data[i]))
+		{
+			p->m_forceBuffer[i] += force;
+		}
+	}
+}
+
+void b2ParticleSystem_ApplyForces( b2ParticleSystemId systemId, const int* indices, const b2Vec2* forces, int count ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	if (count == 0)
+	{
+		return;
+	}
+	p->PrepareForceBuffer();
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = indices ? indices[i] : i;
+		if (b2IsParticleIndexInRange(p, index) &&
+			p->ForceCanBeApplied(p->m_flagsBuffer.data[index]))
+		{
+			p->m_forceBuffer[index] += forces[i];
+		}
+	}
+}
+
+void b2ParticleSystem_ApplyLinearImpulseToRange( b2ParticleSystemId systemId, int startIndex, int count, b2Vec2 impulse ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	count = b2ClampParticleRange(p, startIndex, count);
+	if (count == 0)
+	{
+		return;
+	}
+	// ApplyLinearImpulse divides the impulse among the particles.
+	p->ApplyLinearImpulse(startIndex, startIndex + count, b2MulSV((float32)count, impulse));
+}
+
+void b2ParticleSystem_ApplyLinearImpulses( b2ParticleSystemId systemId, const int* indices, const b2Vec2* impulses,
+										   int count ) {
+	b2ParticleSystem* p = b2GetParticleSystemFromId(systemId);
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = indices ? indices[i] : i;
+		if (b2IsParticleIndexInRange(p, index))
+		{
+			p->ParticleApplyLinearImpulse(index, impulses[i]);
+		}
+	}
+}
+
+// The number of per-particle buffers reported by GetParticleBuffers().
+static const int32 k_particleBufferCount = 18;
+
+template <typename T>
+b2ParticleSystem::ParticleBufferInfo b2ParticleSystem::MakeParticleBufferInfo(
+	const char* name, const T* data, bool userSupplied)
+{
+	ParticleBufferInfo info;
+	info.name = name;
+	info.elementSize = sizeof(T);
+	info.allocated = data != NULL && !userSupplied;
+	return info;
+}
+
+int32 b2ParticleSystem::GetParticleBuffers(ParticleBufferInfo* buffers) const
+{
+	int32 n = 0;
+#define B2_PARTICLE_BUFFER(name, buffer) \
+	buffers[n++] = MakeParticleBufferInfo(name, buffer, false)
+#define B2_USER_PARTICLE_BUFFER(name, buffer) \
+	buffers[n++] = MakeParticleBufferInfo(name, buffer.data, \
+		buffer.userSuppliedCapacity != 0)
+	B2_USER_PARTICLE_BUFFER("handle index", m_handleIndexBuffer);
+	B2_USER_PARTICLE_BUFFER("flags", m_flagsBuffer);
+	B2_USER_PARTICLE_BUFFER("position", m_positionBuffer);
+	B2_USER_PARTICLE_BUFFER("velocity", m_velocityBuffer);
+	B2_PARTICLE_BUFFER("force", m_forceBuffer);
+	B2_PARTICLE_BUFFER("weight", m_weightBuffer);
+	B2_PARTICLE_BUFFER("static pressure", m_staticPressureBuffer);
+	B2_PARTICLE_BUFFER("accumulation", m_accumulationBuffer);
+	B2_PARTICLE_BUFFER("accumulation2", m_accumulation2Buffer);
+	B2_PARTICLE_BUFFER("depth", m_depthBuffer);
+	B2_USER_PARTICLE_BUFFER("color", m_colorBuffer);
+	B2_PARTICLE_BUFFER("group", m_groupBuffer);
+	B2_USER_PARTICLE_BUFFER("user data", m_userDataBuffer);
+	B2_USER_PARTICLE_BUFFER("last body contact step",
+							m_lastBodyContactStepBuffer);
+	B2_USER_PARTICLE_BUFFER("body contact count", m_bodyContactCountBuffer);
+	B2_USER_PARTICLE_BUFFER("consecutive contact steps",
+							m_consecutiveContactStepsBuffer);
+	B2_USER_PARTICLE_BUFFER("expiration time", m_expirationTimeBuffer);
+	B2_USER_PARTICLE_BUFFER("index by expiration time",
+							m_indexByExpirationTimeBuffer);
+#undef B2_USER_PARTICLE_BUFFER
+#undef B2_PARTICLE_BUFFER
+	b2Assert(n == k_particleBufferCount);
+	return n;
+}
+
+int32 b2ParticleSystem::GetAllocatedBytesPerParticle() const
+{
+	ParticleBufferInfo buffers[k_particleBufferCount];
+	const int32 bufferCount = GetParticleBuffers(buffers);
+	int32 bytes = 0;
+	for (int32 i = 0; i < bufferCount; i++)
+	{
+		if (buffers[i].allocated)
+		{
+			bytes += buffers[i].elementSize;
+		}
+	}
+	return bytes;
+}
+
+void b2ParticleSystem::GetMemoryStats(b2ParticleMemoryStats* stats) const
+{
+	b2Assert(stats);
+	ParticleBufferInfo buffers[k_particleBufferCount];
+	const int32 bufferCount = GetParticleBuffers(buffers);
+	stats->systemBytes = sizeof(b2ParticleSystem);
+	stats->particleBufferBytes = 0;
+	stats->particleBufferCount = 0;
+	for (int32 i = 0; i < bufferCount; i++)
+	{
+		if (buffers[i].allocated)
+		{
+			stats->particleBufferBytes +=
+				buffers[i].elementSize * m_internalAllocatedCapacity;
+			stats->particleBufferCount++;
+		}
+	}
+	stats->contactBufferBytes =
+		m_stuckParticleBuffer.GetCapacity() * sizeof(int32) +
+		m_proxyBuffer.GetCapacity() * sizeof(Proxy) +
+		m_staticProxyBuffer.GetCapacity() * sizeof(Proxy) +
+		m_staticProxyWeightBuffer.GetCapacity() * sizeof(float32) +
+		m_contactBuffer.GetCapacity() * sizeof(b2ParticleContact) +
+		m_bodyContactBuffer.GetCapacity() * sizeof(b2ParticleBodyContact) +
+		m_shapeCandidateBuffer.GetCapacity() * sizeof(ShapeParticle) +
+		m_pairBuffer.GetCapacity() * sizeof(b2ParticlePair) +
+		m_triadBuffer.GetCapacity() * sizeof(b2ParticleTriad) +
+		m_contactEventKeyBuffer.GetCapacity() * sizeof(uint64) +
+		m_contactBeginEventBuffer.GetCapacity() *
+			sizeof(b2ParticleContactBeginTouchEvent) +
+		m_contactEndEventBuffer.GetCapacity() *
+			sizeof(b2ParticleContactEndTouchEvent) +
+		m_bodyContactEventKeyBuffer.GetCapacity() * sizeof(BodyContactKey) +
+		m_bodyContactBeginEventBuffer.GetCapacity() *
+			sizeof(b2ParticleBodyContactBeginTouchEvent) +
+		m_bodyContactEndEventBuffer.GetCapacity() *
+			sizeof(b2ParticleBodyContactEndTouchEvent) +
+		m_shapeTouchBuffer.GetCapacity() * sizeof(b2ParticleShapeTouch) +
+		m_elasticTriads.GetCapacityBytes() +
+		m_springPairs.GetCapacityBytes() +
+		m_elasticColorBuffer.GetCapacity() * sizeof(int32) +
+		m_springColorBuffer.GetCapacity() * sizeof(int32) +
+		m_rigidGroupBuffer.GetCapacity() * sizeof(b2ParticleGroup*);
+	stats->groupBytes = m_groupCount * sizeof(b2ParticleGroup);
+	stats->emitterBytes = m_emitterCount * sizeof(b2ParticleEmitter);
+	for (const b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		stats->emitterBytes +=
+			emitter->m_capacity * (sizeof(int32) + sizeof(float32));
+	}
+	stats->forceFieldBytes = m_forceFieldCount * sizeof(b2ParticleForceField);
+	for (const b2ParticleForceField* field = m_forceFieldList; field;
+		 field = field->GetNext())
+	{
+		if (field->m_gridForces)
+		{
+			stats->forceFieldBytes += sizeof(b2Vec2) *
+				field->m_def.gridWidth * field->m_def.gridHeight;
+		}
+	}
+	stats->handleBytes = (int32) m_handleAllocator.GetByteCount();
+	stats->stackPeakBytes = m_stackAllocator.GetMaxAllocation();
+	stats->chunkBytes = m_blockAllocator.GetChunkBytes();
+	stats->freeChunkBytes = m_blockAllocator.GetFreeBytes();
+	stats->giantAllocationCount =
+		(int32) m_blockAllocator.GetNumGiantAllocations();
+	stats->giantBytes = (int32) m_blockAllocator.GetGiantBytes();
+}
+
+int32 b2ParticleSystem::GetParticleGroupMemory(
+	const b2ParticleGroup* group) const
+{
+	b2Assert(group && group->GetParticleSystem() == this);
+	return group->GetParticleCount() * GetAllocatedBytesPerParticle() +
+		sizeof(b2ParticleGroup);
+}
+
+void b2ParticleSystem::DumpMemoryStats(FILE* file) const
+{
+	b2ParticleMemoryStats stats;
+	GetMemoryStats(&stats);
+	fprintf(file, "particle system: %d particles, capacity %d\n", m_count,
+			m_internalAllocatedCapacity);
+	fprintf(file, "system: %d\n", stats.systemBytes);
+
+	ParticleBufferInfo buffers[k_particleBufferCount];
+	const int32 bufferCount = GetParticleBuffers(buffers);
+	for (int32 i = 0; i < bufferCount; i++)
+	{
+		if (buffers[i].allocated)
+		{
+			fprintf(file, "%s buffer: %d\n", buffers[i].name,
+					buffers[i].elementSize * m_internalAllocatedCapacity);
+		}
+	}
+	fprintf(file, "particle buffers: %d (%d)\n", stats.particleBufferBytes,
+			stats.particleBufferCount);
+	fprintf(file, "contact buffers: %d\n", stats.contactBufferBytes);
+	fprintf(file, "handles: %d\n", stats.handleBytes);
+	fprintf(file, "groups: %d (%d)\n", stats.groupBytes, m_groupCount);
+	for (const b2ParticleGroup* group = m_groupList; group;
+		 group = group->GetNext())
+	{
+		fprintf(file, "group %d: %d (%d particles)\n",
+				group->GetBufferIndex(), GetParticleGroupMemory(group),
+				group->GetParticleCount());
+	}
+	fprintf(file, "emitters: %d (%d)\n", stats.emitterBytes, m_emitterCount);
+	fprintf(file, "force fields: %d (%d)\n", stats.forceFieldBytes,
+			m_forceFieldCount);
+	fprintf(file, "stack allocator peak: %d\n", stats.stackPeakBytes);
+	fprintf(file, "block allocator chunks: %d (%d free)\n", stats.chunkBytes,
+			stats.freeChunkBytes);
+	fprintf(file, "block allocator giants: %d (%d)\n", stats.giantBytes,
+			stats.giantAllocationCount);
+	fprintf(file, "\n");
+}
+
+void b2DumpParticleSystemMemoryStats( b2ParticleSystem* list, FILE* file ) {
+	for (b2ParticleSystem* p = list; p; p = p->GetNext())
+	{
+		p->DumpMemoryStats(file);
+	}
+}
+
 void b2ParticleSystemSolve( b2ParticleSystem* list, b2StepContext* stepContext ) {
 	for (b2ParticleSystem* p = list; p; p = p->GetNext())
 	{
 		p->Solve(*stepContext); // Particle Simulation
+		b2Profile* profile = &stepContext->world->profile;
+		profile->particleIterations =
+			b2MaxInt(profile->particleIterations, p->m_iterationCount);
+	}
+}
+
+void b2World_QueryParticles(b2WorldId worldId,
+							b2ParticleQueryCallback* callback,
+							const b2AABB& aabb)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	for (const b2ParticleSystem* p = world->particleSystemList; p;
+		 p = p->GetNext())
+	{
+		if (b2AABB_Overlaps(p->GetAABB(), aabb))
+		{
+			p->QueryAABB(callback, aabb);
+		}
+	}
+}
+
+void b2World_RayCastParticles(b2WorldId worldId,
+							  b2ParticleRayCastCallback* callback,
+							  const b2Vec2& point1, const b2Vec2& point2)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	b2AABB rayAABB = {b2Min(point1, point2), b2Max(point1, point2)};
+	for (const b2ParticleSystem* p = world->particleSystemList; p;
+		 p = p->GetNext())
+	{
+		// Particles are hit within one diameter of their centers.
+		float32 diameter = 2 * p->GetRadius();
+		b2Vec2 padding = {diameter, diameter};
+		b2AABB aabb = {p->GetAABB().lowerBound - padding,
+					   p->GetAABB().upperBound + padding};
+		if (b2AABB_Overlaps(aabb, rayAABB))
+		{
+			p->RayCast(callback, point1, point2);
+		}
 	}
 }
 
@@ -4558,7 +8691,7 @@ void b2DrawParticleSystem( b2ParticleSystem* list, b2DebugDraw* draw) {
 		if (particleCount)
 		{
 			float32 radius = p->GetRadius();
-			const b2Vec2* positionBuffer = p->GetPositionBuffer();
+			const b2Vec2* positionBuffer = p->m_positionBuffer.data;
 			if (p->m_colorBuffer.data)
 			{
 				const b2ParticleColor* colorBuffer = p->GetColorBuffer();
@@ -0,0 +1,436 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "particle/b2StaticDistanceField.h"
+#include "body.h"
+#include "core.h"
+#include "shape.h"
+#include "world.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/// The number of cells along the side of a tile.
+static const int32 k_tileCells = 16;
+static const int32 k_tileNodes = k_tileCells + 1;
+static const int32 k_initialTileCapacity = 64;
+/// Keeps float to int conversions of the node coordinates in range.
+static const float32 k_maxCoordinate = 1.0e8f;
+
+static inline int32 FloorDivide(int32 a, int32 b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline uint32 HashTile(int32 x, int32 y)
+{
+	return (uint32)x * 73856093u ^ (uint32)y * 19349663u;
+}
+
+/// Whether a static shape takes part in the field.
+static inline bool IsFieldShape(const b2Shape* shape, const b2Filter& filter)
+{
+	return shape->sensorIndex == B2_NULL_INDEX &&
+		   b2ShouldShapesCollide(filter, shape->filter);
+}
+
+/// Computes the distance from a shape to a point, negative when the point is
+/// inside the shape. The normal points away from the shape.
+static float32 ComputeSignedDistance(
+	b2Shape* shape, b2Transform xf, b2Vec2 p, b2Vec2* normal)
+{
+	float32 distance = b2ShapeComputeDistance(shape, xf, p, normal);
+	if (distance > 0)
+	{
+		return distance;
+	}
+	switch (shape->type)
+	{
+		case b2_circleShape:
+		case b2_capsuleShape:
+		{
+			b2Vec2 c1, c2;
+			float32 radius;
+			if (shape->type == b2_circleShape)
+			{
+				c1 = c2 = b2TransformPoint(xf, shape->circle.center);
+				radius = shape->circle.radius;
+			}
+			else
+			{
+				c1 = b2TransformPoint(xf, shape->capsule.center1);
+				c2 = b2TransformPoint(xf, shape->capsule.center2);
+				radius = shape->capsule.radius;
+			}
+			b2Vec2 e = b2Sub(c2, c1);
+			float32 ee = b2Dot(e, e);
+			float32 t = ee > 0 ?
+				b2ClampFloat(b2Dot(b2Sub(p, c1), e) / ee, 0, 1) : 0;
+			b2Vec2 d = b2Sub(p, b2MulAdd(c1, t, e));
+			float32 length = b2Length(d);
+			*normal = length > 0 ? b2MulSV(1 / length, d) :
+				b2LeftPerp(b2Normalize(ee > 0 ? e : b2Vec2{1, 0}));
+			return length - radius;
+		}
+		case b2_polygonShape:
+		{
+			// The deepest point is measured against the least penetrated
+			// side.
+			const b2Polygon& polygon = shape->polygon;
+			b2Vec2 lp = b2InvTransformPoint(xf, p);
+			int32 best = 0;
+			float32 separation = -FLT_MAX;
+			for (int32 i = 0; i < polygon.count; i++)
+			{
+				float32 s = b2Dot(polygon.normals[i],
+								  b2Sub(lp, polygon.vertices[i]));
+				if (s > separation)
+				{
+					separation = s;
+					best = i;
+				}
+			}
+			*normal = b2RotateVector(xf.q, polygon.normals[best]);
+			return separation - polygon.radius;
+		}
+		default:
+			// Segments have no inside.
+			return distance;
+	}
+}
+
+b2StaticDistanceField::b2StaticDistanceField(
+	b2World* world, float32 spacing, float32 band)
+{
+	b2Assert(spacing > 0 && band > 0);
+	m_world = world;
+	m_filter = b2DefaultFilter();
+	m_spacing = spacing;
+	m_inverseSpacing = 1 / spacing;
+	m_band = band;
+	m_bounds.lowerBound = b2Vec2_zero;
+	m_bounds.upperBound = b2Vec2_zero;
+	m_staticRevision = -1;
+	m_tileCapacity = k_initialTileCapacity;
+	m_tileCount = 0;
+	m_tiles = (Tile*) b2Alloc(sizeof(Tile) * m_tileCapacity);
+	memset(m_tiles, 0, sizeof(Tile) * m_tileCapacity);
+}
+
+b2StaticDistanceField::~b2StaticDistanceField()
+{
+	Clear();
+	b2Free(m_tiles, sizeof(Tile) * m_tileCapacity);
+}
+
+void b2StaticDistanceField::SetFilter(const b2Filter& filter)
+{
+	m_filter = filter;
+	Clear();
+}
+
+void b2StaticDistanceField::Clear()
+{
+	for (int32 i = 0; i < m_tileCapacity; i++)
+	{
+		FreeTile(&m_tiles[i]);
+	}
+	memset(m_tiles, 0, sizeof(Tile) * m_tileCapacity);
+	m_tileCount = 0;
+}
+
+void b2StaticDistanceField::FreeTile(Tile* tile)
+{
+	if (tile->nodes)
+	{
+		b2Free(tile->nodes, sizeof(Node) * k_tileNodes * k_tileNodes);
+		tile->nodes = NULL;
+	}
+}
+
+void b2StaticDistanceField::Validate()
+{
+	// Every change of the static shapes which can change the field, including
+	// geometry and filter changes, goes through the static proxies.
+	const int32 revision = m_world->broadPhase.staticRevision;
+	if (revision == m_staticRevision)
+	{
+		return;
+	}
+	Clear();
+	m_staticRevision = revision;
+	const b2DynamicTree* tree = &m_world->broadPhase.trees[b2_staticBody];
+	m_bounds = b2DynamicTree_GetRootBounds(tree);
+	m_bounds.lowerBound.x -= m_band;
+	m_bounds.lowerBound.y -= m_band;
+	m_bounds.upperBound.x += m_band;
+	m_bounds.upperBound.y += m_band;
+}
+
+void b2StaticDistanceField::Grow()
+{
+	Tile* oldTiles = m_tiles;
+	int32 oldCapacity = m_tileCapacity;
+	m_tileCapacity *= 2;
+	m_tiles = (Tile*) b2Alloc(sizeof(Tile) * m_tileCapacity);
+	memset(m_tiles, 0, sizeof(Tile) * m_tileCapacity);
+	const uint32 mask = m_tileCapacity - 1;
+	for (int32 i = 0; i < oldCapacity; i++)
+	{
+		const Tile& tile = oldTiles[i];
+		if (tile.used)
+		{
+			uint32 slot = HashTile(tile.x, tile.y) & mask;
+			while (m_tiles[slot].used)
+			{
+				slot = (slot + 1) & mask;
+			}
+			m_tiles[slot] = tile;
+		}
+	}
+	b2Free(oldTiles, sizeof(Tile) * oldCapacity);
+}
+
+b2StaticDistanceField::Tile* b2StaticDistanceField::GetTile(int32 x, int32 y)
+{
+	uint32 mask = m_tileCapacity - 1;
+	uint32 slot = HashTile(x, y) & mask;
+	while (m_tiles[slot].used)
+	{
+		Tile* tile = &m_tiles[slot];
+		if (tile->x == x && tile->y == y)
+		{
+			return tile;
+		}
+		slot = (slot + 1) & mask;
+	}
+	// Keeps the load factor under one half.
+	if (2 * (m_tileCount + 1) > m_tileCapacity)
+	{
+		Grow();
+		return GetTile(x, y);
+	}
+	Tile* tile = &m_tiles[slot];
+	tile->x = x;
+	tile->y = y;
+	tile->used = true;
+	m_tileCount++;
+	BuildTile(tile);
+	return tile;
+}
+
+void b2StaticDistanceField::BuildTile(Tile* tile)
+{
+	tile->nodes = NULL;
+
+	// Collects the shapes within the band of the tile.
+	struct QueryContext
+	{
+		b2World* world;
+		b2Filter filter;
+		int32* shapeIds;
+		int32 count;
+		int32 capacity;
+
+		static bool Callback(int proxyId, uint64_t userData, void* context)
+		{
+			B2_UNUSED(proxyId);
+			QueryContext* query = (QueryContext*) context;
+			int32 shapeId = (int32) userData;
+			b2Shape* shape = b2ShapeArray_Get(&query->world->shapes, shapeId);
+			if (!IsFieldShape(shape, query->filter))
+			{
+				return true;
+			}
+			if (query->count == query->capacity)
+			{
+				int32 capacity = query->capacity ? 2 * query->capacity : 8;
+				int32* shapeIds = (int32*) b2Alloc(sizeof(int32) * capacity);
+				if (query->shapeIds)
+				{
+					memcpy(shapeIds, query->shapeIds,
+						   sizeof(int32) * query->count);
+					b2Free(query->shapeIds, sizeof(int32) * query->capacity);
+				}
+				query->shapeIds = shapeIds;
+				query->capacity = capacity;
+			}
+			query->shapeIds[query->count++] = shapeId;
+			return true;
+		}
+	} query = {m_world, m_filter, NULL, 0, 0};
+
+	const float32 tileSize = k_tileCells * m_spacing;
+	const b2Vec2 origin = {tile->x * tileSize, tile->y * tileSize};
+	b2AABB aabb;
+	aabb.lowerBound = {origin.x - m_band, origin.y - m_band};
+	aabb.upperBound = {origin.x + tileSize + m_band,
+					   origin.y + tileSize + m_band};
+	b2DynamicTree_Query(&m_world->broadPhase.trees[b2_staticBody], aabb,
+						GetQueryMaskBits(), &QueryContext::Callback, &query);
+	if (query.count == 0)
+	{
+		return;
+	}
+
+	Node* nodes = (Node*) b2Alloc(sizeof(Node) * k_tileNodes * k_tileNodes);
+	for (int32 y = 0; y < k_tileNodes; y++)
+	{
+		for (int32 x = 0; x < k_tileNodes; x++)
+		{
+			b2Vec2 p = {origin.x + x * m_spacing, origin.y + y * m_spacing};
+			Node& node = nodes[y * k_tileNodes + x];
+			node.distance = m_band;
+			node.normal = b2Vec2_zero;
+			node.shapeId = B2_NULL_INDEX;
+			node.shapeGeneration = 0;
+			node.multiple = false;
+			for (int32 k = 0; k < query.count; k++)
+			{
+				b2Shape* shape =
+					b2ShapeArray_Get(&m_world->shapes, query.shapeIds[k]);
+				// Skips shapes whose bounds are already too far. Until a
+				// second shape is found within the band, the shapes within
+				// the band are all measured. After that, once the node is
+				// inside a shape only the shapes containing it matter.
+				b2Vec2 nearest = b2Clamp(p, shape->aabb.lowerBound,
+										 shape->aabb.upperBound);
+				float32 gap = b2DistanceSquared(p, nearest);
+				float32 reach = node.multiple ? node.distance : m_band;
+				if (reach > 0 ? gap >= reach * reach : gap > 0)
+				{
+					continue;
+				}
+				b2Vec2 normal;
+				float32 distance = ComputeDistance(shape, p, &normal);
+				if (distance < m_band && node.shapeId != B2_NULL_INDEX)
+				{
+					node.multiple = true;
+				}
+				if (distance < node.distance)
+				{
+					node.distance = distance;
+					node.normal = normal;
+					node.shapeId = shape->id;
+					node.shapeGeneration = shape->generation;
+				}
+			}
+		}
+	}
+	b2Free(query.shapeIds, sizeof(int32) * query.capacity);
+	tile->nodes = nodes;
+}
+
+b2Shape* b2StaticDistanceField::Sample(
+	const b2Vec2& point, float32* distance, b2Vec2* normal, bool* multiple)
+{
+	float32 fx = b2ClampFloat(point.x * m_inverseSpacing,
+							  -k_maxCoordinate, k_maxCoordinate);
+	float32 fy = b2ClampFloat(point.y * m_inverseSpacing,
+							  -k_maxCoordinate, k_maxCoordinate);
+	float32 cx = floorf(fx);
+	float32 cy = floorf(fy);
+	int32 ix = (int32) cx;
+	int32 iy = (int32) cy;
+	int32 tx = FloorDivide(ix, k_tileCells);
+	int32 ty = FloorDivide(iy, k_tileCells);
+	const Tile* tile = GetTile(tx, ty);
+	*multiple = false;
+	if (!tile->nodes)
+	{
+		return NULL;
+	}
+	int32 lx = ix - tx * k_tileCells;
+	int32 ly = iy - ty * k_tileCells;
+	const Node* n00 = &tile->nodes[ly * k_tileNodes + lx];
+	const Node* n10 = n00 + 1;
+	const Node* n01 = n00 + k_tileNodes;
+	const Node* n11 = n01 + 1;
+
+	// The nearest shape of the cell is the one of its nearest node.
+	const Node* nearest = n00;
+	if (n10->distance < nearest->distance) nearest = n10;
+	if (n01->distance < nearest->distance) nearest = n01;
+	if (n11->distance < nearest->distance) nearest = n11;
+	if (nearest->shapeId == B2_NULL_INDEX)
+	{
+		return NULL;
+	}
+	*multiple = n00->multiple || n10->multiple || n01->multiple ||
+				n11->multiple;
+	// Validate() drops the tiles when shapes are destroyed, so this only
+	// catches a shape changed without it being called.
+	b2Shape* shape = NULL;
+	if (nearest->shapeId < m_world->shapes.count)
+	{
+		shape = b2ShapeArray_Get(&m_world->shapes, nearest->shapeId);
+	}
+	if (shape == NULL || shape->id != nearest->shapeId ||
+		shape->generation != nearest->shapeGeneration)
+	{
+		Clear();
+		return Sample(point, distance, normal, multiple);
+	}
+
+	float32 u = fx - cx;
+	float32 v = fy - cy;
+	float32 w00 = (1 - u) * (1 - v);
+	float32 w10 = u * (1 - v);
+	float32 w01 = (1 - u) * v;
+	float32 w11 = u * v;
+	*distance = w00 * n00->distance + w10 * n10->distance +
+				w01 * n01->distance + w11 * n11->distance;
+	b2Vec2 n = w00 * n00->normal + w10 * n10->normal +
+			   w01 * n01->normal + w11 * n11->normal;
+	*normal = b2Normalize(n);
+	return shape;
+}
+
+int32 b2StaticDistanceField::QueryShapes(
+	const b2Vec2& point, b2Shape** shapes, int32 capacity) const
+{
+	b2Assert(capacity > 0);
+	struct QueryContext
+	{
+		b2World* world;
+		b2Filter filter;
+		b2Shape** shapes;
+		int32 count;
+		int32 capacity;
+
+		static bool Callback(int proxyId, uint64_t userData, void* context)
+		{
+			B2_UNUSED(proxyId);
+			QueryContext* query = (QueryContext*) context;
+			b2Shape* shape =
+				b2ShapeArray_Get(&query->world->shapes, (int32) userData);
+			if (IsFieldShape(shape, query->filter))
+			{
+				query->shapes[query->count++] = shape;
+			}
+			return query->count < query->capacity;
+		}
+	} query = {m_world, m_filter, shapes, 0, capacity};
+
+	b2AABB aabb;
+	aabb.lowerBound = {point.x - m_band, point.y - m_band};
+	aabb.upperBound = {point.x + m_band, point.y + m_band};
+	b2DynamicTree_Query(&m_world->broadPhase.trees[b2_staticBody], aabb,
+						GetQueryMaskBits(), &QueryContext::Callback, &query);
+	return query.count;
+}
+
+float32 b2StaticDistanceField::ComputeDistance(
+	b2Shape* shape, const b2Vec2& point, b2Vec2* normal) const
+{
+	b2Body* body = b2BodyArray_Get(&m_world->bodies, shape->bodyId);
+	b2Transform transform = b2GetBodyTransformQuick(m_world, body);
+	return ComputeSignedDistance(shape, transform, point, normal);
+}
+
+uint64_t b2StaticDistanceField::GetQueryMaskBits() const
+{
+	// A shared group index can override the mask bits, so only a filter
+	// without a group can let the tree cull shapes by category.
+	return m_filter.groupIndex == 0 ? m_filter.maskBits : B2_DEFAULT_MASK_BITS;
+}
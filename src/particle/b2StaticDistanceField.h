@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef B2_STATIC_DISTANCE_FIELD
+#define B2_STATIC_DISTANCE_FIELD
+
+#include "particle/common/b2Settings.h"
+#include "box2d/types.h"
+
+typedef struct b2World b2World;
+typedef struct b2Shape b2Shape;
+
+/// A sampled distance field of the static shapes of a world. The field is
+/// made of square tiles of nodes, which are built the first time a point
+/// inside them is sampled and all dropped when the static shapes change.
+/// Each node stores the distance, the normal and the nearest shape, so a
+/// sample costs a bilinear interpolation instead of a tree query and a
+/// distance test per shape. Where more than one shape is within the band,
+/// such as at the seam of a floor and a wall, the nearest shape alone does
+/// not bound the point and the shapes must be tested one by one.
+class b2StaticDistanceField
+{
+public:
+
+	/// @param the world of the static shapes.
+	/// @param the distance between two nodes.
+	/// @param the largest distance stored. Nodes farther from all the shapes
+	///   only know they are beyond it.
+	b2StaticDistanceField(b2World* world, float32 spacing, float32 band);
+	~b2StaticDistanceField();
+
+	/// Set the filter that the shapes of the field must collide with.
+	void SetFilter(const b2Filter& filter);
+
+	/// Drop all the tiles if static shapes were created, destroyed, moved or
+	/// modified since the last call, see b2BroadPhase::staticRevision.
+	void Validate();
+
+	/// Get the bounds of the static shapes, extended by the band.
+	const b2AABB& GetBounds() const { return m_bounds; }
+
+	float32 GetSpacing() const { return m_spacing; }
+	const b2Filter& GetFilter() const { return m_filter; }
+
+	/// Sample the field.
+	/// @param the point to sample.
+	/// @param returns the distance from the point to the nearest shape,
+	///   negative inside solid shapes.
+	/// @param returns the unit vector pointing away from the nearest shape,
+	///   or zero if it cannot be told.
+	/// @param returns whether more than one shape is within the band of the
+	///   point. The nearest shape alone does not bound the point then, see
+	///   QueryShapes().
+	/// @return the nearest shape, or NULL if no shape is within the band.
+	b2Shape* Sample(const b2Vec2& point, float32* distance, b2Vec2* normal,
+					bool* multiple);
+
+	/// Get the shapes of the field whose bounds are within the band of a
+	/// point.
+	/// @return the number of shapes, at most capacity.
+	int32 QueryShapes(const b2Vec2& point, b2Shape** shapes,
+					  int32 capacity) const;
+
+	/// Compute the exact distance from a point to a shape of the field, as
+	/// stored in the nodes.
+	float32 ComputeDistance(b2Shape* shape, const b2Vec2& point,
+							b2Vec2* normal) const;
+
+private:
+
+	struct Node
+	{
+		float32 distance;
+		b2Vec2 normal;
+		int32 shapeId;
+		/// Generation of the shape, to detect a reused shape slot.
+		uint16 shapeGeneration;
+		/// Whether another shape is within the band of the node.
+		bool multiple;
+	};
+
+	struct Tile
+	{
+		int32 x, y;
+		/// NULL when no shape is within the band of the tile.
+		Node* nodes;
+		bool used;
+	};
+
+	Tile* GetTile(int32 x, int32 y);
+	void BuildTile(Tile* tile);
+	void FreeTile(Tile* tile);
+	void Clear();
+	void Grow();
+	/// The mask bits the static tree can cull the shapes of the field by.
+	uint64_t GetQueryMaskBits() const;
+
+	b2World* m_world;
+	b2Filter m_filter;
+	float32 m_spacing;
+	float32 m_inverseSpacing;
+	float32 m_band;
+	b2AABB m_bounds;
+	/// The static revision of the broad-phase the tiles were built from.
+	int32 m_staticRevision;
+	/// Open addressing hash table of the tiles.
+	Tile* m_tiles;
+	int32 m_tileCapacity;
+	int32 m_tileCount;
+};
+
+#endif
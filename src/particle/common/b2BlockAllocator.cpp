@@ -103,6 +103,46 @@ uint32 b2BlockAllocator::GetNumGiantAllocations() const
 	return m_giants.GetList().GetLength();
 }
 
+uint32 b2BlockAllocator::GetGiantBytes() const
+{
+	return (uint32)m_giants.GetByteCount();
+}
+
+int32 b2BlockAllocator::GetChunkBytes() const
+{
+	return m_chunkCount * b2_chunkSize;
+}
+
+int32 b2BlockAllocator::GetFreeBytes() const
+{
+	int32 bytes = 0;
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		for (const b2Block* block = m_freeLists[i]; block; block = block->next)
+		{
+			bytes += s_blockSizes[i];
+		}
+	}
+	return bytes;
+}
+
+void* b2BlockAllocator::AllocateAligned(int32 size)
+{
+	if (size == 0)
+		return NULL;
+
+	b2Assert(0 < size);
+	return m_giants.Allocate(size);
+}
+
+void b2BlockAllocator::FreeAligned(void* p)
+{
+	if (p)
+	{
+		m_giants.Free(p);
+	}
+}
+
 void* b2BlockAllocator::Allocate(int32 size)
 {
 	if (size == 0)
@@ -105,6 +105,18 @@ void b2TrackedBlockAllocator::Free(void *memory)
 	b2TrackedBlock::Free(memory);
 }
 
+/// Get the number of bytes allocated for all the blocks.
+std::size_t b2TrackedBlockAllocator::GetByteCount() const
+{
+	std::size_t size = 0;
+	for (const b2TrackedBlock* block = m_blocks.GetNext();
+		 block != m_blocks.GetTerminator(); block = block->GetNext())
+	{
+		size += block->GetSize();
+	}
+	return size;
+}
+
 /// Free all allocated blocks.
 void b2TrackedBlockAllocator::FreeAll()
 {
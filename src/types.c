@@ -149,3 +149,38 @@ b2DebugDraw b2DefaultDebugDraw( void )
 	draw.DrawStringFcn = b2EmptyDrawString;
 	return draw;
 }
+
+b2ParticleSystemDef b2DefaultParticleSystemDef( void )
+{
+	b2ParticleSystemDef def = { 0 };
+	def.density = 1.0f;
+	def.gravityScale = 1.0f;
+	def.radius = 1.0f;
+
+	// Initialize physical coefficients to the maximum values that
+	// maintain numerical stability.
+	def.pressureStrength = 0.05f;
+	def.pressureSolver = b2_linearPressureSolver;
+	def.pressureIterations = 3;
+	def.iterationDisplacement = 0.5f;
+	def.minIterations = 3;
+	def.maxIterations = 8;
+	def.dampingStrength = 1.0f;
+	def.elasticStrength = 0.25f;
+	def.springStrength = 0.25f;
+	def.viscousStrength = 0.25f;
+	def.surfaceTensionPressureStrength = 0.2f;
+	def.surfaceTensionNormalStrength = 0.2f;
+	def.repulsiveStrength = 1.0f;
+	def.powderStrength = 0.5f;
+	def.ejectionStrength = 0.5f;
+	def.staticPressureStrength = 0.2f;
+	def.staticPressureRelaxation = 0.2f;
+	def.staticPressureIterations = 8;
+	def.staticPressureSolver = b2_jacobiStaticPressureSolver;
+	def.colorMixingStrength = 0.5f;
+	def.destroyByAge = true;
+	def.lifetimeGranularity = 1.0f / 60.0f;
+	def.filter = b2DefaultFilter();
+	return def;
+}
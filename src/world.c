@@ -41,6 +41,7 @@ B2_ARRAY_SOURCE( b2ContactHitEvent, b2ContactHitEvent )
 B2_ARRAY_SOURCE( b2SensorBeginTouchEvent, b2SensorBeginTouchEvent )
 B2_ARRAY_SOURCE( b2SensorEndTouchEvent, b2SensorEndTouchEvent )
 B2_ARRAY_SOURCE( b2TaskContext, b2TaskContext )
+B2_ARRAY_SOURCE( b2ParticleSystemRef, b2ParticleSystemRef )
 
 b2World* b2GetWorldFromId( b2WorldId id )
 {
@@ -174,6 +175,8 @@ b2WorldId b2CreateWorld( const b2WorldDef* def )
 	world->sensors = b2SensorArray_Create( 4 );
 
 	world->particleSystemList = NULL;
+	world->particleSystemIdPool = b2CreateIdPool();
+	world->particleSystems = b2ParticleSystemRefArray_Create( 4 );
 
 	world->bodyMoveEvents = b2BodyMoveEventArray_Create( 4 );
 	world->sensorBeginEvents = b2SensorBeginTouchEventArray_Create( 4 );
@@ -323,6 +326,7 @@ void b2DestroyWorld( b2WorldId worldId )
 
 	b2SensorArray_Destroy( &world->sensors );
 
+	b2ParticleSystemRefArray_Destroy( &world->particleSystems );
 	b2BodyArray_Destroy( &world->bodies );
 	b2ShapeArray_Destroy( &world->shapes );
 	b2ChainShapeArray_Destroy( &world->chainShapes );
@@ -353,6 +357,7 @@ void b2DestroyWorld( b2WorldId worldId )
 	b2DestroyIdPool( &world->jointIdPool );
 	b2DestroyIdPool( &world->islandIdPool );
 	b2DestroyIdPool( &world->solverSetIdPool );
+	b2DestroyIdPool( &world->particleSystemIdPool );
 
 	b2DestroyArenaAllocator( &world->arena );
 
@@ -1724,6 +1729,74 @@ bool b2Joint_IsValid( b2JointId id )
 	return id.generation == joint->generation;
 }
 
+bool b2ParticleSystem_IsValid( b2ParticleSystemId id )
+{
+	if ( B2_MAX_WORLDS <= id.world0 )
+	{
+		return false;
+	}
+
+	b2World* world = b2_worlds + id.world0;
+	if ( world->worldId != id.world0 )
+	{
+		// world is free
+		return false;
+	}
+
+	int systemId = id.index1 - 1;
+	if ( systemId < 0 || world->particleSystems.count <= systemId )
+	{
+		return false;
+	}
+
+	b2ParticleSystemRef* ref = world->particleSystems.data + systemId;
+	if ( ref->system == NULL )
+	{
+		// particle system is free
+		return false;
+	}
+
+	return id.generation == ref->generation;
+}
+
+b2ParticleSystemId b2AllocParticleSystemId( b2World* world, b2ParticleSystem* system )
+{
+	int systemId = b2AllocId( &world->particleSystemIdPool );
+	if ( systemId == world->particleSystems.count )
+	{
+		b2ParticleSystemRefArray_Push( &world->particleSystems, ( b2ParticleSystemRef ){ 0 } );
+	}
+
+	b2ParticleSystemRef* ref = b2ParticleSystemRefArray_Get( &world->particleSystems, systemId );
+	B2_ASSERT( ref->system == NULL );
+	ref->system = system;
+
+	// id index starts at one so that zero can represent null
+	return ( b2ParticleSystemId ){ systemId + 1, world->worldId, ref->generation };
+}
+
+void b2FreeParticleSystemId( b2World* world, b2ParticleSystemId id )
+{
+	B2_ASSERT( b2ParticleSystem_IsValid( id ) );
+	int systemId = id.index1 - 1;
+	b2ParticleSystemRef* ref = b2ParticleSystemRefArray_Get( &world->particleSystems, systemId );
+	ref->system = NULL;
+	ref->generation += 1;
+	b2FreeId( &world->particleSystemIdPool, systemId );
+}
+
+b2ParticleSystem* b2GetParticleSystemFromId( b2ParticleSystemId id )
+{
+	B2_ASSERT( b2ParticleSystem_IsValid( id ) );
+	b2World* world = b2GetWorld( id.world0 );
+	return b2ParticleSystemRefArray_Get( &world->particleSystems, id.index1 - 1 )->system;
+}
+
+void b2SetDefaultParticleSystemDef( b2ParticleSystemDef* def )
+{
+	*def = b2DefaultParticleSystemDef();
+}
+
 void b2World_EnableSleeping( b2WorldId worldId, bool flag )
 {
 	b2World* world = b2GetWorldFromId( worldId );
@@ -1987,6 +2060,7 @@ void b2World_DumpMemoryStats( b2WorldId worldId )
 	fprintf( file, "island ids: %d\n", b2GetIdBytes( &world->islandIdPool ) );
 	fprintf( file, "shape ids: %d\n", b2GetIdBytes( &world->shapeIdPool ) );
 	fprintf( file, "chain ids: %d\n", b2GetIdBytes( &world->chainIdPool ) );
+	fprintf( file, "particle system ids: %d\n", b2GetIdBytes( &world->particleSystemIdPool ) );
 	fprintf( file, "\n" );
 
 	// world arrays
@@ -1998,6 +2072,7 @@ void b2World_DumpMemoryStats( b2WorldId worldId )
 	fprintf( file, "islands: %d\n", b2IslandArray_ByteCount( &world->islands ) );
 	fprintf( file, "shapes: %d\n", b2ShapeArray_ByteCount( &world->shapes ) );
 	fprintf( file, "chains: %d\n", b2ChainShapeArray_ByteCount( &world->chainShapes ) );
+	fprintf( file, "particle systems: %d\n", b2ParticleSystemRefArray_ByteCount( &world->particleSystems ) );
 	fprintf( file, "\n" );
 
 	// broad-phase
@@ -2063,6 +2138,9 @@ void b2World_DumpMemoryStats( b2WorldId worldId )
 	// stack allocator
 	fprintf( file, "stack allocator: %d\n\n", world->arena.capacity );
 
+	// particle systems
+	b2DumpParticleSystemMemoryStats( world->particleSystemList, file );
+
 	// chain shapes
 	// todo
 
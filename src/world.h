@@ -12,6 +12,8 @@
 
 #include "box2d/types.h"
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -43,6 +45,14 @@ typedef struct b2TaskContext
 
 } b2TaskContext;
 
+// Maps a particle system id to its particle system. The system is NULL
+// when the id is free.
+typedef struct b2ParticleSystemRef
+{
+	b2ParticleSystem* system;
+	uint16_t generation;
+} b2ParticleSystemRef;
+
 // The world struct manages all physics entities, dynamic simulation,  and asynchronous queries.
 // The world also contains efficient memory management facilities.
 typedef struct b2World
@@ -99,8 +109,15 @@ typedef struct b2World
 	// This is a dense array of sensor data.
 	b2SensorArray sensors;
 
+	// Particle systems are stepped through this doubly linked list.
 	b2ParticleSystem* particleSystemList;
 
+	// Used to create stable ids for particle systems
+	b2IdPool particleSystemIdPool;
+
+	// This is a sparse array that maps particle system ids to particle systems.
+	b2ParticleSystemRefArray particleSystems;
+
 	// Per thread storage
 	b2TaskContextArray taskContexts;
 	b2SensorTaskContextArray sensorTaskContexts;
@@ -196,8 +213,17 @@ B2_ARRAY_INLINE( b2ContactHitEvent, b2ContactHitEvent )
 B2_ARRAY_INLINE( b2SensorBeginTouchEvent, b2SensorBeginTouchEvent )
 B2_ARRAY_INLINE( b2SensorEndTouchEvent, b2SensorEndTouchEvent )
 B2_ARRAY_INLINE( b2TaskContext, b2TaskContext )
+B2_ARRAY_INLINE( b2ParticleSystemRef, b2ParticleSystemRef )
+
+b2ParticleSystemId b2AllocParticleSystemId( b2World* world, b2ParticleSystem* system );
+void b2FreeParticleSystemId( b2World* world, b2ParticleSystemId id );
+b2ParticleSystem* b2GetParticleSystemFromId( b2ParticleSystemId id );
+
+// Used by the C++ constructor of b2ParticleSystemDef. b2DefaultParticleSystemDef is only declared for C.
+void b2SetDefaultParticleSystemDef( b2ParticleSystemDef* def );
 
 void b2DrawParticleSystem( b2ParticleSystem* list, b2DebugDraw* draw);
+void b2DumpParticleSystemMemoryStats( b2ParticleSystem* list, FILE* file );
 
 #ifdef __cplusplus
 }
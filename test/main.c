@@ -24,6 +24,8 @@ extern int DeterminismTest( void );
 extern int DistanceTest( void );
 extern int IdTest( void );
 extern int MathTest( void );
+extern int ParticleTest( void );
+extern int ParticleSystemTest( void );
 extern int ShapeTest( void );
 extern int TableTest( void );
 extern int WorldTest( void );
@@ -56,6 +58,8 @@ int main( void )
 	RUN_TEST( DistanceTest );
 	RUN_TEST( IdTest );
 	RUN_TEST( MathTest );
+	RUN_TEST( ParticleTest );
+	RUN_TEST( ParticleSystemTest );
 	RUN_TEST( ShapeTest );
 	RUN_TEST( TableTest );
 	RUN_TEST( WorldTest );
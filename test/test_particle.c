@@ -0,0 +1,221 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "test_macros.h"
+
+#include "box2d/box2d.h"
+
+#include <float.h>
+#include <stdint.h>
+
+#define PARTICLE_COUNT 8
+
+static b2ParticleSystemId CreateTestSystem( b2WorldId worldId, int* indices )
+{
+	b2Vec2 positions[PARTICLE_COUNT];
+	for ( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		positions[i] = ( b2Vec2 ){ 0.1f * i, 1.0f };
+	}
+
+	b2ParticleSystemId systemId = b2World_CreateParticleSystem( worldId, NULL );
+	int created = b2ParticleSystem_CreateParticles( systemId, positions, NULL, 0, PARTICLE_COUNT, indices );
+	if ( created != PARTICLE_COUNT )
+	{
+		return b2_nullParticleSystemId;
+	}
+	return systemId;
+}
+
+static int ParticleSystemLifetime( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	int indices[PARTICLE_COUNT];
+	b2ParticleSystemId systemId = CreateTestSystem( worldId, indices );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) );
+	ENSURE( b2ParticleSystem_GetParticleCount( systemId ) == PARTICLE_COUNT );
+	ENSURE( b2ParticleSystem_GetWorld( systemId ).index1 == worldId.index1 );
+	ENSURE( b2ParticleSystem_GetId( b2ParticleSystem_Get( systemId ) ).index1 == systemId.index1 );
+
+	for ( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		ENSURE( indices[i] == i );
+	}
+
+	b2ParticleSystem_Destroy( systemId );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) == false );
+
+	// The slot is reused with a new generation.
+	b2ParticleSystemId otherId = CreateTestSystem( worldId, indices );
+	ENSURE( b2ParticleSystem_IsValid( otherId ) );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) == false );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+static int ParticleBulkAccess( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+	b2ParticleSystemId systemId = CreateTestSystem( worldId, NULL );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) );
+
+	b2Vec2 values[PARTICLE_COUNT];
+	for ( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		values[i] = ( b2Vec2 ){ (float)i, -(float)i };
+	}
+
+	// Ranges running past the last particle are clamped.
+	ENSURE( b2ParticleSystem_SetPositions( systemId, 2, PARTICLE_COUNT, values ) == PARTICLE_COUNT - 2 );
+	ENSURE( b2ParticleSystem_SetVelocities( systemId, 0, PARTICLE_COUNT, values ) == PARTICLE_COUNT );
+
+	b2Vec2 positions[PARTICLE_COUNT];
+	ENSURE( b2ParticleSystem_GetPositions( systemId, 0, PARTICLE_COUNT + 4, positions ) == PARTICLE_COUNT );
+	ENSURE( positions[0].x == 0.0f && positions[1].x == 0.1f );
+	ENSURE( positions[2].x == 0.0f && positions[PARTICLE_COUNT - 1].x == PARTICLE_COUNT - 3 );
+	ENSURE( b2ParticleSystem_GetPositions( systemId, PARTICLE_COUNT, 4, positions ) == 0 );
+
+	const b2Vec2* mapped = b2ParticleSystem_MapVelocities( systemId );
+	ENSURE( mapped[3].x == 3.0f && mapped[3].y == -3.0f );
+
+	b2ParticleColor colors[PARTICLE_COUNT];
+	for ( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		colors[i] = ( b2ParticleColor ){ (uint8_t)i, 0, 255, 128 };
+	}
+	ENSURE( b2ParticleSystem_SetColors( systemId, 4, PARTICLE_COUNT, colors ) == 4 );
+
+	b2ParticleColor readColors[PARTICLE_COUNT] = { 0 };
+	ENSURE( b2ParticleSystem_GetColors( systemId, 4, 4, readColors ) == 4 );
+	for ( int i = 0; i < 4; ++i )
+	{
+		ENSURE( readColors[i].r == i && readColors[i].g == 0 && readColors[i].b == 255 && readColors[i].a == 128 );
+	}
+
+	uint32_t flags[PARTICLE_COUNT];
+	ENSURE( b2ParticleSystem_GetFlags( systemId, 0, PARTICLE_COUNT, flags ) == PARTICLE_COUNT );
+	ENSURE( flags[0] == 0 );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+static int ParticleSystemDefinition( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef = b2DefaultParticleSystemDef();
+	ENSURE( systemDef.radius == 1.0f && systemDef.density == 1.0f );
+	ENSURE( systemDef.maxCount == 0 && systemDef.destroyByAge );
+	ENSURE( systemDef.pressureSolver == b2_linearPressureSolver );
+
+	systemDef.radius = 0.25f;
+	systemDef.maxCount = 4;
+	systemDef.destroyByAge = false;
+	b2ParticleSystemId systemId = b2World_CreateParticleSystem( worldId, &systemDef );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) );
+	ENSURE( b2ParticleSystem_GetWorld( systemId ).index1 == worldId.index1 );
+	ENSURE( b2ParticleSystem_GetWorld( systemId ).generation == worldId.generation );
+
+	// The system stops at the maximum count.
+	b2Vec2 positions[PARTICLE_COUNT] = { 0 };
+	ENSURE( b2ParticleSystem_CreateParticles( systemId, positions, NULL, 0, PARTICLE_COUNT, NULL ) == 4 );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+static int ParticleForces( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	// The particles are far apart so that only the forces move them.
+	b2ParticleSystemDef systemDef = b2DefaultParticleSystemDef();
+	systemDef.radius = 0.05f;
+	b2ParticleSystemId systemId = b2World_CreateParticleSystem( worldId, &systemDef );
+	b2Vec2 positions[PARTICLE_COUNT];
+	for ( int i = 0; i < PARTICLE_COUNT; ++i )
+	{
+		positions[i] = ( b2Vec2 ){ (float)i, 0.0f };
+	}
+	ENSURE( b2ParticleSystem_CreateParticles( systemId, positions, NULL, 0, PARTICLE_COUNT, NULL ) == PARTICLE_COUNT );
+
+	// The forces are small enough that the speeds stay below the particle speed limit.
+	int indices[3] = { 0, 2, PARTICLE_COUNT };
+	b2Vec2 forces[3] = { { 0.1f, 0.0f }, { 0.2f, 0.0f }, { 0.1f, 0.0f } };
+	b2ParticleSystem_ApplyForces( systemId, indices, forces, 3 );
+	b2ParticleSystem_ApplyForceToRange( systemId, 2, PARTICLE_COUNT, ( b2Vec2 ){ 0.0f, 0.1f } );
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 1 );
+
+	// Forces add up and reach only the particles they were applied to.
+	b2Vec2 velocities[PARTICLE_COUNT];
+	b2ParticleSystem_GetVelocities( systemId, 0, PARTICLE_COUNT, velocities );
+	ENSURE( velocities[0].x > 0.0f && velocities[0].y == 0.0f );
+	ENSURE( velocities[1].x == 0.0f && velocities[1].y == 0.0f );
+	ENSURE_SMALL( velocities[2].x - 2.0f * velocities[0].x, FLT_EPSILON );
+	ENSURE_SMALL( velocities[2].y - velocities[0].x, FLT_EPSILON );
+	ENSURE( velocities[PARTICLE_COUNT - 1].x == 0.0f && velocities[PARTICLE_COUNT - 1].y > 0.0f );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+static int ParticleImpulsesAndDestruction( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+	b2ParticleSystemId systemId = CreateTestSystem( worldId, NULL );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) );
+
+	// Indices outside of the particles are skipped.
+	int indices[3] = { 1, -1, PARTICLE_COUNT };
+	b2Vec2 impulses[3] = { { 1.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 0.0f } };
+	b2ParticleSystem_ApplyLinearImpulses( systemId, indices, impulses, 3 );
+
+	b2Vec2 velocities[PARTICLE_COUNT];
+	b2ParticleSystem_GetVelocities( systemId, 0, PARTICLE_COUNT, velocities );
+	ENSURE( velocities[0].x == 0.0f );
+	ENSURE( velocities[1].x > 0.0f );
+	ENSURE( velocities[2].x == 0.0f );
+
+	// Each particle of the range gets the whole impulse.
+	b2ParticleSystem_ApplyLinearImpulseToRange( systemId, 4, PARTICLE_COUNT, ( b2Vec2 ){ 0.0f, 1.0f } );
+	b2ParticleSystem_GetVelocities( systemId, 0, PARTICLE_COUNT, velocities );
+	ENSURE( velocities[3].y == 0.0f );
+	ENSURE( velocities[4].y > 0.0f );
+	ENSURE_SMALL( velocities[4].y - velocities[PARTICLE_COUNT - 1].y, FLT_EPSILON );
+	ENSURE_SMALL( velocities[1].x - velocities[4].y, FLT_EPSILON );
+
+	// Particles are destroyed during the next step.
+	int destroyed[2] = { 0, PARTICLE_COUNT + 1 };
+	b2ParticleSystem_DestroyParticles( systemId, destroyed, 2 );
+	b2ParticleSystem_DestroyParticleRange( systemId, PARTICLE_COUNT - 2, 4 );
+	ENSURE( b2ParticleSystem_GetParticleCount( systemId ) == PARTICLE_COUNT );
+
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 1 );
+	ENSURE( b2ParticleSystem_GetParticleCount( systemId ) == PARTICLE_COUNT - 3 );
+
+	b2DestroyWorld( worldId );
+	ENSURE( b2ParticleSystem_IsValid( systemId ) == false );
+	return 0;
+}
+
+int ParticleTest( void )
+{
+	RUN_SUBTEST( ParticleSystemLifetime );
+	RUN_SUBTEST( ParticleBulkAccess );
+	RUN_SUBTEST( ParticleSystemDefinition );
+	RUN_SUBTEST( ParticleForces );
+	RUN_SUBTEST( ParticleImpulsesAndDestruction );
+
+	return 0;
+}
@@ -0,0 +1,829 @@
+// SPDX-FileCopyrightText: 2026 Box2D contributors
+// SPDX-License-Identifier: MIT
+
+#include "test_macros.h"
+
+#include "box2d/box2d.h"
+#include "particle/b2ParticleEmitter.h"
+#include "particle/b2ParticleForceField.h"
+#include "particle/b2ParticleGroup.h"
+#include "particle/b2ParticleSurface.h"
+#include "particle/b2ParticleSystem.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+static const float PARTICLE_RADIUS = 0.05f;
+
+static b2BodyId CreateStaticBox( b2WorldId worldId, b2Vec2 center, float halfWidth, float halfHeight )
+{
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.position = center;
+	b2BodyId bodyId = b2CreateBody( worldId, &bodyDef );
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Polygon box = b2MakeBox( halfWidth, halfHeight );
+	b2CreatePolygonShape( bodyId, &shapeDef, &box );
+	return bodyId;
+}
+
+// Creates a square block of particles with the lower left corner at origin.
+static void CreateBlock( b2ParticleSystem* system, b2Vec2 origin, int side, b2Vec2 velocity, uint32 flags )
+{
+	const float spacing = 2.0f * PARTICLE_RADIUS;
+	for ( int i = 0; i < side; ++i )
+	{
+		for ( int j = 0; j < side; ++j )
+		{
+			b2ParticleDef def;
+			def.flags = flags;
+			def.position = { origin.x + spacing * i, origin.y + spacing * j };
+			def.velocity = velocity;
+			system->CreateParticle( def );
+		}
+	}
+}
+
+// A floor and two walls made of boxes meet at the bottom corners of a tank.
+// Particles thrown into the left corner must stay in front of the boxes
+// instead of slipping through the seams.
+static int StaticDistanceFieldCorner( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+	CreateStaticBox( worldId, { 4.0f, -0.5f }, 5.0f, 0.5f );
+	CreateStaticBox( worldId, { -0.5f, 2.0f }, 0.5f, 3.0f );
+	CreateStaticBox( worldId, { 8.5f, 2.0f }, 0.5f, 3.0f );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	systemDef.staticDistanceField = true;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+	CreateBlock( system, { PARTICLE_RADIUS, PARTICLE_RADIUS }, 20, { -10.0f, -10.0f }, b2_waterParticle );
+
+	for ( int i = 0; i < 120; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+
+		const b2Vec2* positions = system->GetPositionBuffer();
+		for ( int j = 0; j < system->GetParticleCount(); ++j )
+		{
+			ENSURE( positions[j].x > -PARTICLE_RADIUS );
+			ENSURE( positions[j].x < 8.0f + PARTICLE_RADIUS );
+			ENSURE( positions[j].y > -PARTICLE_RADIUS );
+		}
+	}
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+static const int REORDER_SIDE = 10;
+static const int REORDER_GROUP_SIDE = 4;
+
+// Creates loose particles far apart in the reverse order of their positions
+// and a spring group, and returns the handle of each loose particle.
+static b2ParticleSystem* CreateReorderSystem( b2WorldId worldId, int reorderInterval,
+											  std::vector<const b2ParticleHandle*>* handles )
+{
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	systemDef.reorderInterval = reorderInterval;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	for ( int id = 0; id < REORDER_SIDE * REORDER_SIDE; ++id )
+	{
+		b2ParticleDef def;
+		def.position = { (float)( REORDER_SIDE - 1 - id % REORDER_SIDE ), (float)( REORDER_SIDE - 1 - id / REORDER_SIDE ) };
+		def.velocity = { 0.5f * ( id % 3 - 1 ), 0.3f * ( id % 5 - 2 ) };
+		def.color = b2ParticleColor( (uint8)id, 0, 0, 255 );
+		def.lifetime = 100.0f + id;
+		def.userData = (void*)(intptr_t)( id + 1 );
+		int index = system->CreateParticle( def );
+		handles->push_back( system->GetParticleHandleFromIndex( index ) );
+	}
+
+	b2Vec2 groupPositions[REORDER_GROUP_SIDE * REORDER_GROUP_SIDE];
+	for ( int i = 0; i < REORDER_GROUP_SIDE * REORDER_GROUP_SIDE; ++i )
+	{
+		const float spacing = 1.5f * PARTICLE_RADIUS;
+		groupPositions[i] = { -5.0f - spacing * ( i % REORDER_GROUP_SIDE ), -5.0f - spacing * ( i / REORDER_GROUP_SIDE ) };
+	}
+	b2ParticleGroupDef groupDef;
+	groupDef.flags = b2_springParticle;
+	groupDef.positionData = groupPositions;
+	groupDef.particleCount = REORDER_GROUP_SIDE * REORDER_GROUP_SIDE;
+	groupDef.linearVelocity = { 1.0f, 0.5f };
+	system->CreateParticleGroup( groupDef );
+	return system;
+}
+
+// Collects the pairs as sorted pairs of particle handles.
+static std::vector<std::pair<const b2ParticleHandle*, const b2ParticleHandle*>> CollectPairs( b2ParticleSystem* system )
+{
+	std::vector<std::pair<const b2ParticleHandle*, const b2ParticleHandle*>> pairs;
+	for ( int i = 0; i < system->GetPairCount(); ++i )
+	{
+		const b2ParticlePair& pair = system->GetPairs()[i];
+		const b2ParticleHandle* a = system->GetParticleHandleFromIndex( pair.indexA );
+		const b2ParticleHandle* b = system->GetParticleHandleFromIndex( pair.indexB );
+		pairs.push_back( std::make_pair( std::min( a, b ), std::max( a, b ) ) );
+	}
+	std::sort( pairs.begin(), pairs.end() );
+	return pairs;
+}
+
+// Reordering moves the particles in memory but every particle keeps its
+// data, and particles that don't touch others move exactly like they do
+// without reordering.
+static int ParticleReorderInvariance( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+	b2WorldId referenceWorldId = b2CreateWorld( &worldDef );
+
+	std::vector<const b2ParticleHandle*> handles, referenceHandles;
+	b2ParticleSystem* system = CreateReorderSystem( worldId, 1, &handles );
+	b2ParticleSystem* reference = CreateReorderSystem( referenceWorldId, 0, &referenceHandles );
+	b2ParticleGroup* group = system->GetParticleGroupList();
+	std::vector<std::pair<const b2ParticleHandle*, const b2ParticleHandle*>> pairs = CollectPairs( system );
+	ENSURE( pairs.size() > 0 );
+
+	for ( int i = 0; i < 30; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+		b2World_Step( referenceWorldId, 1.0f / 60.0f, 4, 3 );
+	}
+
+	bool moved = false;
+	for ( int id = 0; id < (int)handles.size(); ++id )
+	{
+		const int index = handles[id]->GetIndex();
+		const int referenceIndex = referenceHandles[id]->GetIndex();
+		ENSURE( referenceIndex == id );
+		moved = moved || index != id;
+
+		ENSURE( system->GetUserDataBuffer()[index] == (void*)(intptr_t)( id + 1 ) );
+		ENSURE( system->GetColorBuffer()[index].r == id );
+		ENSURE( system->GetParticleLifetime( index ) == reference->GetParticleLifetime( referenceIndex ) );
+		ENSURE( system->GetPositionBuffer()[index].x == reference->GetPositionBuffer()[referenceIndex].x );
+		ENSURE( system->GetPositionBuffer()[index].y == reference->GetPositionBuffer()[referenceIndex].y );
+		ENSURE( system->GetVelocityBuffer()[index].x == reference->GetVelocityBuffer()[referenceIndex].x );
+		ENSURE( system->GetVelocityBuffer()[index].y == reference->GetVelocityBuffer()[referenceIndex].y );
+		ENSURE( system->GetGroupBuffer()[index] == NULL );
+	}
+	ENSURE( moved );
+
+	// The group keeps its particles and the pairs keep connecting them.
+	ENSURE( group->GetParticleCount() == REORDER_GROUP_SIDE * REORDER_GROUP_SIDE );
+	for ( int i = group->GetBufferIndex(); i < group->GetBufferIndex() + group->GetParticleCount(); ++i )
+	{
+		ENSURE( system->GetGroupBuffer()[i] == group );
+	}
+	ENSURE( CollectPairs( system ) == pairs );
+
+	b2DestroyWorld( referenceWorldId );
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// A steady emitter recycles its particles in place: the particle count and
+// the memory stay the same from step to step, and a recycled particle starts
+// over as a new one.
+static int ParticleEmitterSteadyState( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	// A particle with a lifetime makes the system track the lifetimes.
+	b2ParticleDef def;
+	def.position = { 0.0f, -10.0f };
+	def.lifetime = 100.0f;
+	system->CreateParticle( def );
+
+	b2ParticleEmitterDef emitterDef;
+	emitterDef.rate = 60.0f;
+	emitterDef.lifetime = 0.5f;
+	emitterDef.speed = 2.0f;
+	emitterDef.width = 1.0f;
+	b2ParticleEmitter* emitter = system->CreateParticleEmitter( emitterDef );
+	ENSURE( emitter->GetCapacity() == 30 );
+
+	for ( int i = 0; i < 10; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	}
+
+	// Outlive the emitter lifetime and hold a handle.
+	const int index = emitter->GetParticleIndex( emitter->GetParticleCount() - 1 );
+	system->SetParticleLifetime( index, 0.75f );
+	const b2ParticleHandle* handle = system->GetParticleHandleFromIndex( index );
+
+	bool recycled = false;
+	for ( int i = 0; i < 60; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+		if ( recycled == false && handle->GetIndex() == b2_invalidParticleIndex )
+		{
+			// The particle was replaced in place by the newest one.
+			recycled = true;
+			ENSURE( emitter->GetParticleIndex( emitter->GetParticleCount() - 1 ) == index );
+			ENSURE( system->GetParticleLifetime( index ) <= 0.0f );
+		}
+	}
+	ENSURE( recycled );
+
+	const int particleCount = system->GetParticleCount();
+	const int byteCount = b2GetByteCount();
+	ENSURE( emitter->GetParticleCount() == emitter->GetCapacity() );
+	for ( int i = 0; i < 120; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+		ENSURE( system->GetParticleCount() == particleCount );
+		ENSURE( b2GetByteCount() == byteCount );
+	}
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// An emitter filling a particle system with a maximum particle count
+// recycles its oldest particles instead of destroying others.
+static int ParticleEmitterFullSystem( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	systemDef.maxCount = 40;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	b2ParticleDef def;
+	def.position = { 0.0f, -10.0f };
+	const int other = system->CreateParticle( def );
+	const b2ParticleHandle* handle = system->GetParticleHandleFromIndex( other );
+
+	b2ParticleEmitterDef emitterDef;
+	emitterDef.rate = 60.0f;
+	emitterDef.lifetime = 10.0f;
+	emitterDef.capacity = 40;
+	emitterDef.speed = 2.0f;
+	emitterDef.width = 1.0f;
+	b2ParticleEmitter* emitter = system->CreateParticleEmitter( emitterDef );
+
+	for ( int i = 0; i < 120; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+		ENSURE( system->GetParticleCount() <= systemDef.maxCount );
+	}
+	ENSURE( system->GetParticleCount() == systemDef.maxCount );
+	ENSURE( emitter->GetParticleCount() == systemDef.maxCount - 1 );
+	ENSURE( handle->GetIndex() == other );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// Each field changes the velocity of the particles in its region like the
+// same force applied with ParticleApplyForce changes the velocity of a twin
+// particle far from the fields.
+static int ParticleForceFields( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	b2ParticleForceFieldDef fieldDef;
+	fieldDef.type = b2_radialForceField;
+	fieldDef.position = { 0.0f, 0.0f };
+	fieldDef.radius = 2.0f;
+	fieldDef.strength = 0.2f;
+	system->CreateParticleForceField( fieldDef );
+
+	fieldDef.type = b2_vortexForceField;
+	fieldDef.position = { 10.0f, 0.0f };
+	system->CreateParticleForceField( fieldDef );
+
+	fieldDef.type = b2_directionalForceField;
+	fieldDef.position = { 20.0f, 0.0f };
+	fieldDef.force = { 0.05f, -0.05f };
+	system->CreateParticleForceField( fieldDef );
+
+	const b2Vec2 gridForces[4] = { { 0.1f, 0.0f }, { 0.1f, 0.0f }, { 0.1f, 0.0f }, { 0.1f, 0.0f } };
+	fieldDef.type = b2_gridForceField;
+	fieldDef.position = { 30.0f, 0.0f };
+	fieldDef.gridForces = gridForces;
+	fieldDef.gridWidth = 2;
+	fieldDef.gridHeight = 2;
+	system->CreateParticleForceField( fieldDef );
+
+	struct Probe
+	{
+		b2Vec2 position;
+		b2Vec2 force;
+	} probes[] = {
+		// Half way to the radius, the radial force is half the strength.
+		{ { 1.0f, 0.0f }, { 0.1f, 0.0f } },
+		// The vortex turns counterclockwise.
+		{ { 11.0f, 0.0f }, { 0.0f, 0.1f } },
+		{ { 20.5f, 0.5f }, { 0.05f, -0.05f } },
+		// Outside of the polygon.
+		{ { 22.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 30.5f, 0.5f }, { 0.1f, 0.0f } },
+	};
+	const int probeCount = sizeof( probes ) / sizeof( probes[0] );
+	for ( int i = 0; i < probeCount; ++i )
+	{
+		b2ParticleDef def;
+		def.position = probes[i].position;
+		system->CreateParticle( def );
+		def.position = { probes[i].position.x, -10.0f };
+		system->CreateParticle( def );
+	}
+
+	// The fields skip wall particles.
+	b2ParticleDef wallDef;
+	wallDef.flags = b2_wallParticle;
+	wallDef.position = { -1.0f, 0.0f };
+	const int wall = system->CreateParticle( wallDef );
+
+	for ( int i = 0; i < probeCount; ++i )
+	{
+		system->ParticleApplyForce( 2 * i + 1, probes[i].force );
+	}
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 1 );
+
+	const b2Vec2* velocities = system->GetVelocityBuffer();
+	for ( int i = 0; i < probeCount; ++i )
+	{
+		ENSURE_SMALL( velocities[2 * i].x - velocities[2 * i + 1].x, 1e-6f );
+		ENSURE_SMALL( velocities[2 * i].y - velocities[2 * i + 1].y, 1e-6f );
+	}
+	ENSURE( velocities[0].x > 0.0f && velocities[2].y > 0.0f );
+	ENSURE( velocities[wall].x == 0.0f && velocities[wall].y == 0.0f );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// The signed area of the triangles or the closed contours of a surface.
+static float ComputeSurfaceArea( const b2ParticleSurface& surface )
+{
+	const b2Vec2* vertices = surface.GetVertices();
+	const int* indices = surface.GetIndices();
+	float area = 0.0f;
+	if ( surface.GetDef().type == b2_surfaceTriangles )
+	{
+		for ( int i = 0; i < surface.GetIndexCount(); i += 3 )
+		{
+			b2Vec2 a = vertices[indices[i]];
+			b2Vec2 b = vertices[indices[i + 1]];
+			b2Vec2 c = vertices[indices[i + 2]];
+			area += 0.5f * b2Cross( b2Sub( b, a ), b2Sub( c, a ) );
+		}
+	}
+	else
+	{
+		for ( int i = 0; i < surface.GetIndexCount(); i += 2 )
+		{
+			area += 0.5f * b2Cross( vertices[indices[i]], vertices[indices[i + 1]] );
+		}
+	}
+	return area;
+}
+
+// The surface of a block of fluid at rest covers the area of the block,
+// whether it is extracted as triangles or as contours.
+static int ParticleSurfaceArea( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+	const int side = 30;
+	CreateBlock( system, { 0.0f, 0.0f }, side, b2Vec2_zero, b2_waterParticle );
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 1 );
+
+	// Each particle covers a square of one diameter, centered on the particle.
+	// The surface is smoothed, so it only follows the outline of the block to
+	// within a diameter.
+	const float diameter = 2.0f * PARTICLE_RADIUS;
+	const float blockSize = diameter * side;
+	const float blockArea = blockSize * blockSize;
+	const float innerArea = ( blockSize - 2.0f * diameter ) * ( blockSize - 2.0f * diameter );
+	const b2AABB outerBounds = { { -1.5f * diameter, -1.5f * diameter },
+								 { blockSize + 0.5f * diameter, blockSize + 0.5f * diameter } };
+
+	b2ParticleSurfaceDef surfaceDef;
+	surfaceDef.incremental = true;
+	b2ParticleSurface triangles( surfaceDef );
+	triangles.Update( system );
+	ENSURE( triangles.GetIndexCount() > 0 );
+	const float triangleArea = ComputeSurfaceArea( triangles );
+	ENSURE( innerArea < triangleArea && triangleArea < blockArea );
+	for ( int i = 0; i < triangles.GetVertexCount(); ++i )
+	{
+		ENSURE( b2AABB_Contains( outerBounds, { triangles.GetVertices()[i], triangles.GetVertices()[i] } ) );
+	}
+
+	// Nothing moved, so every tile is kept.
+	triangles.Update( system );
+	ENSURE( triangles.GetUpdatedTileCount() == 0 );
+	ENSURE( ComputeSurfaceArea( triangles ) == triangleArea );
+
+	surfaceDef.type = b2_surfaceContours;
+	surfaceDef.incremental = false;
+	b2ParticleSurface contours( surfaceDef );
+	contours.Update( system, true );
+	ENSURE( contours.GetIndexCount() > 0 );
+	ENSURE( b2AbsFloat( ComputeSurfaceArea( contours ) - triangleArea ) < 0.01f * blockArea );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// Wall particles moved through the position buffer are still found by the
+// contacts of the other particles.
+static int StaticProxiesFollowMovedWalls( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+	b2ParticleDef def;
+	def.flags = b2_waterParticle;
+	def.velocity = { 1.0f, 0.0f };
+	system->CreateParticle( def );
+	def.flags = b2_wallParticle;
+	def.position = { 5.0f, 0.0f };
+	def.velocity = b2Vec2_zero;
+	system->CreateParticle( def );
+
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( system->GetContactCount() == 0 );
+
+	// Put the wall just in front of the moving particle.
+	const uint32* flags = system->GetFlagsBuffer();
+	int water = ( flags[0] & b2_wallParticle ) ? 1 : 0;
+	b2Vec2* positions = system->GetPositionBuffer();
+	positions[1 - water] = positions[water] + b2Vec2{ 1.6f * PARTICLE_RADIUS, 0.0f };
+	system->InvalidateAABB();
+
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( system->GetContactCount() == 1 );
+	ENSURE( system->GetVelocityBuffer()[water].x < 1.0f );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// Whether a particle belongs to the static proxy index, for the flags used
+// in StaticProxyPartition.
+static bool IsStaticProxy( const b2ParticleSystem* system, int index )
+{
+	uint32 flags = system->GetFlagsBuffer()[index];
+	return system->GetGroupBuffer()[index] == NULL &&
+		   ( flags & ( b2_wallParticle | b2_particleContactListenerParticle ) ) == b2_wallParticle;
+}
+
+// The contacts found in the last step must be all pairs of touching
+// particles except the ones between two static proxies.
+static int CheckStaticProxyContacts( const b2ParticleSystem* system )
+{
+	const int count = system->GetParticleCount();
+	const b2Vec2* positions = system->GetPositionBuffer();
+	const float diameter = 2.0f * PARTICLE_RADIUS;
+	int expectedCount = 0;
+	for ( int a = 0; a < count; ++a )
+	{
+		for ( int b = a + 1; b < count; ++b )
+		{
+			if ( b2DistanceSquared( positions[a], positions[b] ) < diameter * diameter &&
+				 !( IsStaticProxy( system, a ) && IsStaticProxy( system, b ) ) )
+			{
+				expectedCount += 1;
+			}
+		}
+	}
+	ENSURE( system->GetContactCount() == expectedCount );
+
+	std::vector<std::pair<int, int>> pairs;
+	for ( int k = 0; k < system->GetContactCount(); ++k )
+	{
+		const b2ParticleContact& contact = system->GetContacts()[k];
+		int a = contact.GetIndexA();
+		int b = contact.GetIndexB();
+		ENSURE( b2DistanceSquared( positions[a], positions[b] ) < diameter * diameter );
+		ENSURE( !( IsStaticProxy( system, a ) && IsStaticProxy( system, b ) ) );
+		pairs.push_back( std::make_pair( std::min( a, b ), std::max( a, b ) ) );
+	}
+	std::sort( pairs.begin(), pairs.end() );
+	ENSURE( std::adjacent_find( pairs.begin(), pairs.end() ) == pairs.end() );
+	return 0;
+}
+
+// Particles move between the proxy indices when their flags change and when
+// they join a group.
+static int StaticProxyPartition( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	// The particles touch their four nearest neighbors without any pressure,
+	// so they stay in place.
+	const int side = 8;
+	const float spacing = 1.8f * PARTICLE_RADIUS;
+	for ( int i = 0; i < side * side; ++i )
+	{
+		b2ParticleDef def;
+		def.position = { spacing * ( i % side ), spacing * ( i / side ) };
+		system->CreateParticle( def );
+	}
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( CheckStaticProxyContacts( system ) == 0 );
+
+	for ( int i = 0; i < system->GetParticleCount(); i += 2 )
+	{
+		system->SetParticleFlags( i, b2_wallParticle );
+	}
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( CheckStaticProxyContacts( system ) == 0 );
+
+	for ( int i = 0; i < system->GetParticleCount(); ++i )
+	{
+		switch ( i % 3 )
+		{
+			case 0:
+				system->SetParticleFlags( i, b2_wallParticle );
+				break;
+			case 1:
+				system->SetParticleFlags( i, b2_waterParticle );
+				break;
+			default:
+				system->SetParticleFlags( i, system->GetFlagsBuffer()[i] | b2_particleContactListenerParticle );
+				break;
+		}
+	}
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( CheckStaticProxyContacts( system ) == 0 );
+
+	// A group of wall particles next to the loose ones keeps its contacts.
+	b2Vec2 groupPositions[side];
+	for ( int i = 0; i < side; ++i )
+	{
+		groupPositions[i] = { -spacing, spacing * i };
+	}
+	b2ParticleGroupDef groupDef;
+	groupDef.flags = b2_wallParticle;
+	groupDef.positionData = groupPositions;
+	groupDef.particleCount = side;
+	b2ParticleGroup* group = system->CreateParticleGroup( groupDef );
+	b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+	ENSURE( CheckStaticProxyContacts( system ) == 0 );
+	int groupContactCount = 0;
+	for ( int k = 0; k < system->GetContactCount(); ++k )
+	{
+		const b2ParticleContact& contact = system->GetContacts()[k];
+		if ( system->GetGroupBuffer()[contact.GetIndexA()] == group &&
+			 system->GetGroupBuffer()[contact.GetIndexB()] == group )
+		{
+			groupContactCount += 1;
+		}
+	}
+	ENSURE( groupContactCount == side - 1 );
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// A fast stream of particles thrown at a chain of barrier particles never
+// passes between them. The chain is denser than the diameter, so each
+// particle near it is tested against several segments.
+static int BarrierChainStopsStream( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	const int chainCount = 40;
+	const float barrierX = 1.0f;
+	b2Vec2 chainPositions[chainCount];
+	for ( int i = 0; i < chainCount; ++i )
+	{
+		chainPositions[i] = { barrierX, 1.5f * PARTICLE_RADIUS * ( i - chainCount / 2 ) };
+	}
+	b2ParticleGroupDef chainDef;
+	chainDef.flags = b2_barrierParticle | b2_wallParticle;
+	chainDef.positionData = chainPositions;
+	chainDef.particleCount = chainCount;
+	system->CreateParticleGroup( chainDef );
+
+	// Each step adds a column of particles moving several diameters per step.
+	const float chainHalfHeight = 1.5f * PARTICLE_RADIUS * ( chainCount / 2 - 2 );
+	for ( int i = 0; i < 60; ++i )
+	{
+		for ( float y = -chainHalfHeight; y < chainHalfHeight; y += 2.0f * PARTICLE_RADIUS )
+		{
+			b2ParticleDef def;
+			def.flags = b2_waterParticle;
+			def.position = { 0.0f, y };
+			def.velocity = { 30.0f, 0.0f };
+			system->CreateParticle( def );
+		}
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+
+		const uint32* flags = system->GetFlagsBuffer();
+		const b2Vec2* positions = system->GetPositionBuffer();
+		for ( int j = 0; j < system->GetParticleCount(); ++j )
+		{
+			if ( !( flags[j] & b2_barrierParticle ) && b2AbsFloat( positions[j].y ) < chainHalfHeight )
+			{
+				ENSURE( positions[j].x < barrierX );
+			}
+		}
+	}
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// The total velocity of the particles, which the pairwise solvers keep.
+static b2Vec2 SumVelocities( const b2ParticleSystem* system )
+{
+	b2Vec2 sum = b2Vec2_zero;
+	for ( int i = 0; i < system->GetParticleCount(); ++i )
+	{
+		sum = b2Add( sum, system->GetVelocityBuffer()[i] );
+	}
+	return sum;
+}
+
+// The elastic triads and spring pairs are solved by color, several
+// connections at a time. A particle shared by two connections of a color
+// would lose one of their impulses, which would show as a change of
+// momentum. Debug builds also validate the colors each time they are built.
+static int ConnectionColoring( void )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+
+	// Without pressure the dense clump below stays together, so no speed is
+	// limited, which would change the momentum.
+	b2ParticleSystemDef systemDef;
+	systemDef.pressureStrength = 0.0f;
+	systemDef.radius = PARTICLE_RADIUS;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+
+	const int side = 12;
+	b2Vec2 blockPositions[side * side];
+	for ( int i = 0; i < side * side; ++i )
+	{
+		const float spacing = 1.5f * PARTICLE_RADIUS;
+		blockPositions[i] = { spacing * ( i % side - 0.5f * side ), spacing * ( i / side - 0.5f * side ) };
+	}
+	b2ParticleGroupDef blockDef;
+	blockDef.flags = b2_springParticle | b2_elasticParticle;
+	blockDef.positionData = blockPositions;
+	blockDef.particleCount = side * side;
+	b2ParticleGroup* block = system->CreateParticleGroup( blockDef );
+
+	// A clump whose particles all touch each other has more connections
+	// per particle than there are colors, so some go to the overflow color.
+	const int clumpCount = 32;
+	b2Vec2 clumpPositions[clumpCount];
+	for ( int i = 0; i < clumpCount; ++i )
+	{
+		const float angle = 2.0f * B2_PI * i / clumpCount;
+		const float radius = 0.4f * PARTICLE_RADIUS * ( 1 + i % 2 );
+		clumpPositions[i] = { -0.75f * side * PARTICLE_RADIUS - 2.0f * PARTICLE_RADIUS + radius * cosf( angle ), radius * sinf( angle ) };
+	}
+	b2ParticleGroupDef clumpDef;
+	clumpDef.flags = b2_springParticle | b2_elasticParticle;
+	clumpDef.positionData = clumpPositions;
+	clumpDef.particleCount = clumpCount;
+	b2ParticleGroup* clump = system->CreateParticleGroup( clumpDef );
+
+	b2Vec2* velocities = system->GetVelocityBuffer();
+	for ( int i = 0; i < system->GetParticleCount(); ++i )
+	{
+		velocities[i] = { 0.2f * sinf( 1.7f * i ), 0.2f * cosf( 2.3f * i ) };
+	}
+	const b2Vec2 momentum = SumVelocities( system );
+	float speedSum = 0.0f;
+	for ( int i = 0; i < system->GetParticleCount(); ++i )
+	{
+		speedSum += b2Length( velocities[i] );
+	}
+
+	for ( int i = 0; i < 60; ++i )
+	{
+		if ( i == 30 )
+		{
+			// Joining adds pairs and triads, which are colored again.
+			system->JoinParticleGroups( block, clump );
+		}
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+
+		// The rounding of the elastic solver lets the momentum drift by a
+		// fraction of a percent over the test. A lost impulse changes it by
+		// about as much as the speeds of the particles.
+		const b2Vec2 drift = b2Sub( SumVelocities( system ), momentum );
+		ENSURE( b2Length( drift ) < 0.01f * speedSum );
+	}
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// Settles a block of static pressure particles in a tank. Once it is calm,
+// every particle iteration must reach the tolerance before running out of
+// static pressure iterations. Sums the iterations they needed.
+static int SettleStaticPressure( b2StaticPressureSolver solver, float tolerance, int maxIterations, int* iterationCount )
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld( &worldDef );
+	CreateStaticBox( worldId, { 1.0f, -0.5f }, 1.5f, 0.5f );
+	CreateStaticBox( worldId, { -0.5f, 2.0f }, 0.5f, 3.0f );
+	CreateStaticBox( worldId, { 2.5f, 2.0f }, 0.5f, 3.0f );
+
+	b2ParticleSystemDef systemDef;
+	systemDef.radius = PARTICLE_RADIUS;
+	systemDef.staticPressureSolver = solver;
+	systemDef.staticPressureTolerance = tolerance;
+	systemDef.staticPressureIterations = maxIterations;
+	b2ParticleSystem* system = b2CreateParticleSystem( worldId, &systemDef );
+	CreateBlock( system, { PARTICLE_RADIUS, PARTICLE_RADIUS }, 20, b2Vec2_zero, b2_waterParticle | b2_staticPressureParticle );
+
+	*iterationCount = 0;
+	for ( int i = 0; i < 120; ++i )
+	{
+		b2World_Step( worldId, 1.0f / 60.0f, 4, 3 );
+		if ( i >= 60 )
+		{
+			ENSURE( system->GetStaticPressureIterationCount() < maxIterations );
+			*iterationCount += system->GetStaticPressureIterationCount();
+		}
+	}
+
+	b2DestroyWorld( worldId );
+	return 0;
+}
+
+// Both static pressure solvers stop once no pressure changes by more than
+// the tolerance. Gauss-Seidel gets there in fewer iterations.
+static int StaticPressureConvergence( void )
+{
+	const float tolerance = 1.0e-5f;
+	const int maxIterations = 100;
+	int jacobiCount, gaussSeidelCount;
+	ENSURE( SettleStaticPressure( b2_jacobiStaticPressureSolver, tolerance, maxIterations, &jacobiCount ) == 0 );
+	ENSURE( SettleStaticPressure( b2_gaussSeidelStaticPressureSolver, tolerance, maxIterations, &gaussSeidelCount ) == 0 );
+	ENSURE( gaussSeidelCount < 0.8f * jacobiCount );
+	return 0;
+}
+
+extern "C" int ParticleSystemTest( void )
+{
+	RUN_SUBTEST( StaticDistanceFieldCorner );
+	RUN_SUBTEST( ParticleReorderInvariance );
+	RUN_SUBTEST( ParticleEmitterSteadyState );
+	RUN_SUBTEST( ParticleEmitterFullSystem );
+	RUN_SUBTEST( ParticleForceFields );
+	RUN_SUBTEST( ParticleSurfaceArea );
+	RUN_SUBTEST( StaticProxiesFollowMovedWalls );
+	RUN_SUBTEST( StaticProxyPartition );
+	RUN_SUBTEST( BarrierChainStopsStream );
+	RUN_SUBTEST( ConnectionColoring );
+	RUN_SUBTEST( StaticPressureConvergence );
+
+	return 0;
+}